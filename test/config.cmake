@@ -63,11 +63,9 @@ function(buildClModule module_name file_name)
   add_custom_target(${module_name} DEPENDS ${spv_file_path})
 endfunction(buildClModule)
 
-function(buildVulkanClspvTest1)
+function(buildVulkanExecutable test_name file_name)
   initTestOption()
 
-  buildClModule(ClVulkanClspvTest1 vulkan_clspv_test1)
-
   set(test_definitions VULKAN_HPP_TYPESAFE_CONVERSION
                        VULKAN_HPP_NO_SMART_HANDLE
                        VULKAN_HPP_ENABLE_DYNAMIC_LOADER_TOOL=0)
@@ -77,9 +75,8 @@ function(buildVulkanClspvTest1)
                                  VMA_DEBUG_DETECT_CORRUPTION=1)
   endif()
 
-  set(test_name VulkanClspvTest1)
   # Build unit tests
-  add_executable(${test_name} ${PROJECT_SOURCE_DIR}/test/vulkan_clspv_test1.cpp)
+  add_executable(${test_name} ${PROJECT_SOURCE_DIR}/test/${file_name}.cpp)
   set_target_properties(${test_name} PROPERTIES
       RUNTIME_OUTPUT_DIRECTORY ${PROJECT_BINARY_DIR}
       RUNTIME_OUTPUT_DIRECTORY_DEBUG ${PROJECT_BINARY_DIR}
@@ -104,49 +101,109 @@ function(buildVulkanClspvTest1)
   target_compile_definitions(${test_name} PRIVATE ${test_definitions}
                                                   ${cxx_definitions}
                                                   ${platform_definitions})
-  add_dependencies(${test_name} ClVulkanClspvTest1)
+endfunction(buildVulkanExecutable)
+
+function(buildVulkanClspvExecutable test_name file_name)
+  set(module_name Cl${test_name})
+  buildClModule(${module_name} ${file_name})
+  buildVulkanExecutable(${test_name} ${file_name})
+  add_dependencies(${test_name} ${module_name})
+endfunction(buildVulkanClspvExecutable)
+
+function(buildVulkanClspvTest1)
+  buildVulkanClspvExecutable(VulkanClspvTest1 vulkan_clspv_test1)
 endfunction(buildVulkanClspvTest1)
 
 function(buildVulkanClspvTest2)
-  initTestOption()
+  buildVulkanClspvExecutable(VulkanClspvTest2 vulkan_clspv_test2)
+endfunction(buildVulkanClspvTest2)
 
-  buildClModule(ClVulkanClspvTest2 vulkan_clspv_test2)
+function(buildVulkanSubmissionBenchmark)
+  buildVulkanClspvExecutable(VulkanSubmissionBenchmark vulkan_submission_benchmark)
+endfunction(buildVulkanSubmissionBenchmark)
 
-  set(test_definitions VULKAN_HPP_TYPESAFE_CONVERSION
-                       VULKAN_HPP_NO_SMART_HANDLE
-                       VULKAN_HPP_ENABLE_DYNAMIC_LOADER_TOOL=0)
-  if(Z_DEBUG_MODE)
-    list(APPEND test_definitions VMA_DEBUG_INITIALIZE_ALLOCATIONS=1
-                                 VMA_DEBUG_MARGIN=32
-                                 VMA_DEBUG_DETECT_CORRUPTION=1)
+function(buildVulkanDeviceGroupTest)
+  buildVulkanClspvExecutable(VulkanDeviceGroupTest vulkan_device_group_test)
+endfunction(buildVulkanDeviceGroupTest)
+
+function(buildVulkanServiceTest)
+  # The service uses unix domain sockets
+  if(Z_LINUX OR Z_MAC)
+    buildVulkanClspvExecutable(VulkanServiceTest vulkan_service_test)
   endif()
+endfunction(buildVulkanServiceTest)
 
-  set(test_name VulkanClspvTest2)
-  # Build unit tests
-  add_executable(${test_name} ${PROJECT_SOURCE_DIR}/test/vulkan_clspv_test2.cpp)
-  set_target_properties(${test_name} PROPERTIES
-      RUNTIME_OUTPUT_DIRECTORY ${PROJECT_BINARY_DIR}
-      RUNTIME_OUTPUT_DIRECTORY_DEBUG ${PROJECT_BINARY_DIR}
-      RUNTIME_OUTPUT_DIRECTORY_RELWITHDEBINFO ${PROJECT_BINARY_DIR}
-      RUNTIME_OUTPUT_DIRECTORY_RELEASE ${PROJECT_BINARY_DIR})
-  # Set unittest properties
-  set_target_properties(${test_name} PROPERTIES CXX_STANDARD 17
-                                                CXX_EXTENSIONS ON
-                                                CXX_STANDARD_REQUIRED ON)
-  getCxxWarningFlags(cxx_warning_flags)
-  getTestWarningFlags(test_warning_flags)
-  target_compile_options(${test_name} PRIVATE ${cxx_compiler_flags}
-                                              ${cxx_warning_flags}
-                                              ${test_warning_flags})
-  target_include_directories(${test_name} PRIVATE ${PROJECT_SOURCE_DIR}/test)
-  target_include_directories(${test_name} SYSTEM PRIVATE ${vma_include_dir}
-                                                         ${lodepng_include_dir})
-  target_link_libraries(${test_name} PRIVATE Vulkan::Vulkan
-                                             ${lodepng_library}
-                                             ${cxx_linker_flags}
-                                             ${CMAKE_THREAD_LIBS_INIT})
-  target_compile_definitions(${test_name} PRIVATE ${test_definitions}
-                                                  ${cxx_definitions}
-                                                  ${platform_definitions})
-  add_dependencies(${test_name} ClVulkanClspvTest2)
-endfunction(buildVulkanClspvTest2)
+function(buildVulkanExternalMemoryTest)
+  # The test uses the opaque fd handles and fork
+  if(Z_LINUX)
+    buildVulkanClspvExecutable(VulkanExternalMemoryTest vulkan_external_memory_test)
+  endif()
+endfunction(buildVulkanExternalMemoryTest)
+
+function(buildVulkanKernelBenchmark)
+  buildVulkanClspvExecutable(VulkanKernelBenchmark vulkan_kernel_benchmark)
+endfunction(buildVulkanKernelBenchmark)
+
+function(buildVulkanMemoryBenchmark)
+  buildVulkanClspvExecutable(VulkanMemoryBenchmark vulkan_memory_benchmark)
+endfunction(buildVulkanMemoryBenchmark)
+
+function(buildVulkanCoroutineTest)
+  # The coroutine interfaces are enabled with C++20 only
+  buildVulkanClspvExecutable(VulkanCoroutineTest vulkan_coroutine_test)
+  set_target_properties(VulkanCoroutineTest PROPERTIES CXX_STANDARD 20)
+  if(Z_GCC)
+    target_compile_options(VulkanCoroutineTest PRIVATE -fcoroutines)
+  endif()
+endfunction(buildVulkanCoroutineTest)
+
+function(buildVulkanPagedBufferTest)
+  buildVulkanClspvExecutable(VulkanPagedBufferTest vulkan_paged_buffer_test)
+endfunction(buildVulkanPagedBufferTest)
+
+function(buildVulkanStreamExecutorTest)
+  buildVulkanClspvExecutable(VulkanStreamExecutorTest vulkan_stream_executor_test)
+endfunction(buildVulkanStreamExecutorTest)
+
+function(buildVulkanFrameExecutorTest)
+  buildVulkanClspvExecutable(VulkanFrameExecutorTest vulkan_frame_executor_test)
+endfunction(buildVulkanFrameExecutorTest)
+
+function(buildVulkanSpecializationTest)
+  # clspv doesn't emit user SpecIds, so the test assembles its own module
+  buildVulkanExecutable(VulkanSpecializationTest vulkan_specialization_test)
+endfunction(buildVulkanSpecializationTest)
+
+function(buildVulkanReplay)
+  # The replay loads the shader modules from a capture file
+  buildVulkanExecutable(VulkanReplay vulkan_replay)
+endfunction(buildVulkanReplay)
+
+function(buildVulkanBenchmarkGate)
+  # The gate runs the empty kernel of the kernel benchmark
+  buildVulkanExecutable(VulkanBenchmarkGate vulkan_benchmark_gate)
+  add_dependencies(VulkanBenchmarkGate ClVulkanKernelBenchmark)
+  set(baseline_path ${PROJECT_SOURCE_DIR}/test/vulkan_benchmark_baseline.json)
+  target_compile_definitions(VulkanBenchmarkGate PRIVATE
+      CLSPV_TEST_BENCHMARK_BASELINE="${baseline_path}")
+  # Fail the target if a benchmark regresses from the baseline. The gate is
+  # enabled once the medians are recorded on the reference device
+  set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${baseline_path})
+  file(READ ${baseline_path} baseline_json)
+  string(REGEX MATCH "\"median\"[ \t]*:[ \t]*null" unrecorded_median "${baseline_json}")
+  if(unrecorded_median)
+    message(STATUS "The benchmark baseline has no medians, 'RunBenchmarkGate' is disabled. Run 'UpdateBenchmarkBaseline' on the reference device.")
+  else()
+    add_custom_target(RunBenchmarkGate
+        COMMAND VulkanBenchmarkGate
+        WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
+        COMMENT "Comparing the benchmarks with ${baseline_path}"
+        USES_TERMINAL)
+  endif()
+  # Record the medians of the reference configuration into the baseline
+  add_custom_target(UpdateBenchmarkBaseline
+      COMMAND VulkanBenchmarkGate --update-baseline
+      WORKING_DIRECTORY ${PROJECT_BINARY_DIR}
+      COMMENT "Recording the benchmarks into ${baseline_path}"
+      USES_TERMINAL)
+endfunction(buildVulkanBenchmarkGate)
@@ -0,0 +1,570 @@
+/*!
+  \file vulkan_benchmark_gate.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/benchmark_utility.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+
+#if !defined(CLSPV_TEST_BENCHMARK_BASELINE)
+#define CLSPV_TEST_BENCHMARK_BASELINE "vulkan_benchmark_baseline.json"
+#endif // CLSPV_TEST_BENCHMARK_BASELINE
+
+namespace {
+
+//! The tolerance of a benchmark which isn't in the baseline
+constexpr double kDefaultTolerance = 0.25;
+
+//! The settings of the runner
+struct GateOptions
+{
+  std::size_t num_of_repetitions_ = 15; //!< The samples of a benchmark
+  std::size_t num_of_warmups_ = 3; //!< The samples which are discarded
+  std::size_t num_of_kernel_iterations_ = 200; //!< The runs in a kernel sample
+  std::size_t num_of_transfer_iterations_ = 20; //!< The transfers in a transfer sample
+};
+
+//! The samples of a benchmark and their robust statistics
+struct BenchmarkResult
+{
+  std::string name_;
+  std::string unit_;
+  std::vector<double> sample_list_;
+  double median_ = 0.0;
+  double mad_ = 0.0; //!< The median absolute deviation from the median
+};
+
+//! A benchmark in the baseline file
+struct BaselineEntry
+{
+  std::string name_;
+  std::string unit_;
+  double median_ = 0.0;
+  double mad_ = 0.0;
+  double tolerance_ = kDefaultTolerance; //!< The allowed relative slowdown
+  bool has_median_ = false; //!< The median is recorded
+};
+
+} // namespace
+
+// Forward declaration
+const BaselineEntry* findBaseline(const std::vector<BaselineEntry>& baseline_list,
+                                  const std::string_view name);
+
+bool loadBaseline(const std::string_view file_path,
+                  std::string* device_name,
+                  std::vector<BaselineEntry>* baseline_list);
+
+std::size_t printComparison(const std::vector<BenchmarkResult>& result_list,
+                            const std::vector<BaselineEntry>& baseline_list);
+
+BenchmarkResult runBenchmark(const std::string_view name,
+                             const std::string_view unit,
+                             const GateOptions& options,
+                             const std::function<double ()>& sample);
+
+std::vector<BenchmarkResult> runKernelBenchmarks(clspvtest::VulkanDevice* device,
+                                                 const GateOptions& options);
+
+std::vector<BenchmarkResult> runTransferBenchmarks(clspvtest::VulkanDevice* device,
+                                                   const GateOptions& options);
+
+bool writeBaseline(const std::string_view file_path,
+                   const std::string_view device_name,
+                   const std::vector<BenchmarkResult>& result_list,
+                   const std::vector<BaselineEntry>& baseline_list);
+
+
+/*!
+  \details
+  Usage:
+    VulkanBenchmarkGate [repetitions] [device number] [baseline json] [--update-baseline]
+
+  Run the host overhead benchmarks of VulkanKernel and VulkanBuffer with
+  warm-up samples, and compare the median of each benchmark with the
+  baseline. A benchmark regresses if its median exceeds the baseline median
+  by more than the tolerance of the benchmark. The process exits with
+  EXIT_FAILURE on a regression or on a benchmark which has no recorded
+  median, so the gate can run in CI. A software
+  driver such as lavapipe gives stable numbers without a GPU, since the
+  benchmarks measure the host side.
+
+  '--update-baseline' writes the measured medians into the baseline file
+  and keeps the tolerances. The results are also written into
+  'vulkan_benchmark_gate.json'.
+  */
+int main(int argc, char** argv)
+{
+  std::cout << "Compare the host overhead of kernels and transfers with the baseline." << std::endl;
+
+  GateOptions options;
+  clspvtest::uint32b device_number = 0;
+  std::string baseline_path = CLSPV_TEST_BENCHMARK_BASELINE;
+  bool update_baseline = false;
+  {
+    std::vector<std::string_view> arg_list;
+    for (int i = 1; i < argc; ++i) {
+      const std::string_view arg{argv[i]};
+      if (arg == "--update-baseline")
+        update_baseline = true;
+      else
+        arg_list.emplace_back(arg);
+    }
+    if (0 < arg_list.size())
+      options.num_of_repetitions_ = static_cast<std::size_t>(std::atoll(arg_list[0].data()));
+    if (1 < arg_list.size())
+      device_number = static_cast<clspvtest::uint32b>(std::atoll(arg_list[1].data()));
+    if (2 < arg_list.size())
+      baseline_path = arg_list[2];
+    options.num_of_repetitions_ = (std::max)(options.num_of_repetitions_,
+                                             std::size_t{1});
+  }
+
+  std::string baseline_device;
+  std::vector<BaselineEntry> baseline_list;
+  if (!loadBaseline(baseline_path, &baseline_device, &baseline_list) &&
+      !update_baseline) {
+    std::cerr << "Error: The baseline '" << baseline_path << "' can't be read."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanBenchmarkGate";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+  device_options.vulkan_device_number_ = device_number;
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  std::size_t num_of_regressions = 0;
+  try {
+    device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+    std::cout << clspvtest::getDeviceInfo(*device) << std::endl;
+    const std::vector<clspvtest::uint32b> spirv_code =
+        clspvtest::loadModuleSpirvCode("vulkan_kernel_benchmark.spv");
+    device->setShaderModule(spirv_code, 0);
+
+    std::cout << "- Run " << options.num_of_repetitions_ << " samples after "
+              << options.num_of_warmups_ << " warm-ups." << std::endl;
+    std::vector<BenchmarkResult> result_list =
+        runKernelBenchmarks(device.get(), options);
+    for (auto& result : runTransferBenchmarks(device.get(), options))
+      result_list.emplace_back(std::move(result));
+
+    const std::string device_name{device->name()};
+    if (!baseline_device.empty() && (baseline_device != device_name)) {
+      std::cout << "- Warning: The baseline is recorded on '" << baseline_device
+                << "'." << std::endl;
+    }
+    num_of_regressions = printComparison(result_list, baseline_list);
+
+    const char* result_path = "vulkan_benchmark_gate.json";
+    if (writeBaseline(result_path, device_name, result_list, baseline_list))
+      std::cout << "- Write '" << result_path << "'." << std::endl;
+    if (update_baseline) {
+      if (writeBaseline(baseline_path, device_name, result_list, baseline_list)) {
+        std::cout << "- Update the baseline '" << baseline_path << "'." << std::endl;
+        num_of_regressions = 0;
+      }
+      else {
+        std::cerr << "Error: The baseline '" << baseline_path
+                  << "' can't be written." << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (num_of_regressions != 0) {
+    std::cout << "- " << num_of_regressions
+              << " benchmarks regressed or have no baseline." << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/*!
+  \brief Return the baseline of the benchmark. Returns null if it isn't found
+  */
+const BaselineEntry* findBaseline(const std::vector<BaselineEntry>& baseline_list,
+                                  const std::string_view name)
+{
+  for (const auto& entry : baseline_list) {
+    if (entry.name_ == name)
+      return &entry;
+  }
+  return nullptr;
+}
+
+/*!
+  \details
+  The baseline is an object which has a "device" string and a "benchmarks"
+  array. Each benchmark is an object of "name", "unit", "median", "mad" and
+  "tolerance". The median is null if it isn't recorded yet. Only this subset
+  of json is accepted.
+  */
+bool loadBaseline(const std::string_view file_path,
+                  std::string* device_name,
+                  std::vector<BaselineEntry>* baseline_list)
+{
+  std::ifstream file{std::string{file_path}};
+  if (!file)
+    return false;
+  const std::string text{std::istreambuf_iterator<char>{file},
+                         std::istreambuf_iterator<char>{}};
+  std::size_t p = 0;
+
+  const auto skip_spaces = [&text, &p]()
+  {
+    while ((p < text.size()) && std::isspace(static_cast<unsigned char>(text[p])))
+      ++p;
+  };
+  const auto consume = [&text, &p, &skip_spaces](const char c)
+  {
+    skip_spaces();
+    const bool result = (p < text.size()) && (text[p] == c);
+    if (result)
+      ++p;
+    return result;
+  };
+  const auto parse_string = [&text, &p, &consume](std::string* value)
+  {
+    if (!consume('"'))
+      return false;
+    value->clear();
+    while ((p < text.size()) && (text[p] != '"')) {
+      if ((text[p] == '\\') && (p + 1 < text.size()))
+        ++p;
+      value->push_back(text[p++]);
+    }
+    return consume('"');
+  };
+  // A number or null. A null leaves the value unchanged
+  const auto parse_number = [&text, &p, &skip_spaces](double* value, bool* is_null)
+  {
+    skip_spaces();
+    *is_null = text.compare(p, 4, "null") == 0;
+    if (*is_null) {
+      p += 4;
+      return true;
+    }
+    const char* begin = text.c_str() + p;
+    char* end = nullptr;
+    const double v = std::strtod(begin, &end);
+    if (end == begin)
+      return false;
+    p += static_cast<std::size_t>(end - begin);
+    *value = v;
+    return true;
+  };
+  const auto parse_scalar = [&text, &p, &skip_spaces, &parse_string, &parse_number]()
+  {
+    skip_spaces();
+    double number = 0.0;
+    bool is_null = false;
+    std::string s;
+    return ((p < text.size()) && (text[p] == '"')) ? parse_string(&s)
+                                                   : parse_number(&number, &is_null);
+  };
+  // Parse the members of an object. The key is passed to the callback
+  const auto parse_object = [&consume, &parse_string](auto&& parse_member)
+  {
+    if (!consume('{'))
+      return false;
+    if (consume('}'))
+      return true;
+    do {
+      std::string key;
+      if (!parse_string(&key) || !consume(':') || !parse_member(key))
+        return false;
+    } while (consume(','));
+    return consume('}');
+  };
+
+  const auto parse_entry = [&](const std::string& key, BaselineEntry* entry)
+  {
+    bool is_null = false;
+    if (key == "name")
+      return parse_string(&entry->name_);
+    if (key == "unit")
+      return parse_string(&entry->unit_);
+    if (key == "median") {
+      const bool result = parse_number(&entry->median_, &is_null);
+      entry->has_median_ = !is_null;
+      return result;
+    }
+    if (key == "mad")
+      return parse_number(&entry->mad_, &is_null);
+    if (key == "tolerance")
+      return parse_number(&entry->tolerance_, &is_null);
+    return parse_scalar();
+  };
+  const auto parse_benchmarks = [&]()
+  {
+    if (!consume('['))
+      return false;
+    if (consume(']'))
+      return true;
+    do {
+      BaselineEntry entry;
+      const bool result = parse_object([&parse_entry, &entry](const std::string& key)
+      {
+        return parse_entry(key, &entry);
+      });
+      if (!result)
+        return false;
+      baseline_list->emplace_back(std::move(entry));
+    } while (consume(','));
+    return consume(']');
+  };
+
+  return parse_object([&](const std::string& key)
+  {
+    if (key == "device")
+      return parse_string(device_name);
+    if (key == "benchmarks")
+      return parse_benchmarks();
+    return parse_scalar();
+  });
+}
+
+/*!
+  \brief Print the difference from the baseline and return the number of failures
+
+  A benchmark which has no recorded median fails, since it can't be compared.
+  The medians are recorded with '--update-baseline'.
+  */
+std::size_t printComparison(const std::vector<BenchmarkResult>& result_list,
+                            const std::vector<BaselineEntry>& baseline_list)
+{
+  std::size_t num_of_regressions = 0;
+  std::cout << "- Comparison with the baseline." << std::endl;
+  for (const auto& result : result_list) {
+    const BaselineEntry* baseline = findBaseline(baseline_list, result.name_);
+    std::array<char, 256> line;
+    if ((baseline == nullptr) || !baseline->has_median_) {
+      std::snprintf(line.data(), line.size(),
+                    "    %-28s %12.3f %-2s (mad %.3f)  NO BASELINE",
+                    result.name_.c_str(), result.median_, result.unit_.c_str(),
+                    result.mad_);
+      std::cout << line.data() << std::endl;
+      ++num_of_regressions;
+      continue;
+    }
+    const double change = (0.0 < baseline->median_)
+        ? (result.median_ - baseline->median_) / baseline->median_
+        : 0.0;
+    const char* status = "ok";
+    if (baseline->tolerance_ < change) {
+      status = "REGRESSION";
+      ++num_of_regressions;
+    }
+    else if (change < -baseline->tolerance_) {
+      status = "faster";
+    }
+    std::snprintf(line.data(), line.size(),
+                  "    %-28s %12.3f -> %12.3f %-2s (%+7.1f%%, tolerance %.0f%%, mad %.3f)  %s",
+                  result.name_.c_str(), baseline->median_, result.median_,
+                  result.unit_.c_str(), 100.0 * change,
+                  100.0 * baseline->tolerance_, result.mad_, status);
+    std::cout << line.data() << std::endl;
+  }
+  return num_of_regressions;
+}
+
+/*!
+  \brief Take the samples of a benchmark after the warm-ups
+  */
+BenchmarkResult runBenchmark(const std::string_view name,
+                             const std::string_view unit,
+                             const GateOptions& options,
+                             const std::function<double ()>& sample)
+{
+  for (std::size_t i = 0; i < options.num_of_warmups_; ++i)
+    sample();
+
+  BenchmarkResult result;
+  result.name_ = name;
+  result.unit_ = unit;
+  result.sample_list_.reserve(options.num_of_repetitions_);
+  for (std::size_t i = 0; i < options.num_of_repetitions_; ++i)
+    result.sample_list_.emplace_back(sample());
+
+  result.median_ = clspvtest::median(result.sample_list_);
+  std::vector<double> deviation_list;
+  deviation_list.reserve(result.sample_list_.size());
+  for (const double s : result.sample_list_)
+    deviation_list.emplace_back(std::abs(s - result.median_));
+  result.mad_ = clspvtest::median(std::move(deviation_list));
+  return result;
+}
+
+/*!
+  \brief Measure the host time of run() and the round trip of the empty kernel
+
+  The samples are taken by the same functions as VulkanKernelBenchmark. The
+  run time is the sum of the phases of VulkanKernel::run() in microseconds,
+  which excludes the wait for the kernel. The round trip is the median
+  latency of the iterations.
+  */
+std::vector<BenchmarkResult> runKernelBenchmarks(clspvtest::VulkanDevice* device,
+                                                 const GateOptions& options)
+{
+  const std::size_t n = (std::max)(options.num_of_kernel_iterations_, std::size_t{1});
+  std::vector<BenchmarkResult> result_list;
+  result_list.emplace_back(runBenchmark("kernel_run_same_args", "us", options,
+                                        [device, n]()
+  {
+    return 1.0e-3 * clspvtest::measureRunPhases(device, 0, "empty", n, false).total_;
+  }));
+  result_list.emplace_back(runBenchmark("kernel_run_rebind", "us", options,
+                                        [device, n]()
+  {
+    return 1.0e-3 * clspvtest::measureRunPhases(device, 0, "empty", n, true).total_;
+  }));
+  result_list.emplace_back(runBenchmark("kernel_round_trip", "us", options,
+                                        [device, n]()
+  {
+    return clspvtest::measureKernelLatency(device, 0, "empty", n).p50_;
+  }));
+  return result_list;
+}
+
+/*!
+  \brief Measure the time of the buffer reads, writes and copies
+
+  A sample is the median time of the iterations in microseconds, which is
+  measured as VulkanMemoryBenchmark does. The small transfers to the host
+  visible memory measure the overhead of VulkanBuffer, and the large
+  transfers measure the staging path.
+  */
+std::vector<BenchmarkResult> runTransferBenchmarks(clspvtest::VulkanDevice* device,
+                                                   const GateOptions& options)
+{
+  using clspvtest::uint8b;
+  using clspvtest::BufferUsage;
+  constexpr std::size_t small_size = 4 * 1024;
+  constexpr std::size_t large_size = 1024 * 1024;
+
+  std::vector<uint8b> host_data(large_size, 1);
+  clspvtest::VulkanBuffer<uint8b> host_buffer{device, BufferUsage::kHostOnly, small_size};
+  clspvtest::VulkanBuffer<uint8b> device_buffer1{device, BufferUsage::kDeviceOnly, large_size};
+  clspvtest::VulkanBuffer<uint8b> device_buffer2{device, BufferUsage::kDeviceOnly, large_size};
+
+  const std::size_t n = (std::max)(options.num_of_transfer_iterations_, std::size_t{1});
+  const auto sample = [n](const std::function<void ()>& transfer)
+  {
+    return 1.0e6 * clspvtest::measureMedianTime(n, transfer);
+  };
+
+  std::vector<BenchmarkResult> result_list;
+  result_list.emplace_back(runBenchmark("buffer_write_host_4k", "us", options,
+                                        [&]()
+  {
+    return sample([&]() {host_buffer.write(host_data.data(), small_size, 0, 0);});
+  }));
+  result_list.emplace_back(runBenchmark("buffer_read_host_4k", "us", options,
+                                        [&]()
+  {
+    return sample([&]() {host_buffer.read(host_data.data(), small_size, 0, 0);});
+  }));
+  result_list.emplace_back(runBenchmark("buffer_write_staged_1m", "us", options,
+                                        [&]()
+  {
+    return sample([&]() {device_buffer1.write(host_data.data(), large_size, 0, 0);});
+  }));
+  result_list.emplace_back(runBenchmark("buffer_read_staged_1m", "us", options,
+                                        [&]()
+  {
+    return sample([&]() {device_buffer1.read(host_data.data(), large_size, 0, 0);});
+  }));
+  result_list.emplace_back(runBenchmark("buffer_copy_1m", "us", options,
+                                        [&]()
+  {
+    return sample([&]()
+    {
+      device_buffer1.copyTo(&device_buffer2, large_size, 0, 0, 0);
+      device->waitForCompletion(clspvtest::QueueType::kTransfer, 0);
+    });
+  }));
+  return result_list;
+}
+
+/*!
+  \details
+  The tolerances of the benchmarks which are in the baseline are kept.
+  */
+bool writeBaseline(const std::string_view file_path,
+                   const std::string_view device_name,
+                   const std::vector<BenchmarkResult>& result_list,
+                   const std::vector<BaselineEntry>& baseline_list)
+{
+  const auto number = [](const double value)
+  {
+    std::array<char, 32> s;
+    std::snprintf(s.data(), s.size(), "%.6g", value);
+    return std::string{s.data()};
+  };
+
+  std::ostringstream json;
+  json << "{\n";
+  json << "  \"device\": \"" << device_name << "\",\n";
+  json << "  \"benchmarks\": [";
+  for (std::size_t i = 0; i < result_list.size(); ++i) {
+    const auto& result = result_list[i];
+    const BaselineEntry* baseline = findBaseline(baseline_list, result.name_);
+    const double tolerance = (baseline != nullptr) ? baseline->tolerance_
+                                                   : kDefaultTolerance;
+    json << ((i == 0) ? "\n" : ",\n")
+         << "    {\"name\": \"" << result.name_
+         << "\", \"unit\": \"" << result.unit_
+         << "\", \"median\": " << number(result.median_)
+         << ", \"mad\": " << number(result.mad_)
+         << ", \"tolerance\": " << number(tolerance) << "}";
+  }
+  json << "\n  ]\n";
+  json << "}\n";
+
+  std::ofstream file{std::string{file_path}};
+  if (!file)
+    return false;
+  file << json.str();
+  return static_cast<bool>(file);
+}
@@ -19,15 +19,14 @@
 #include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
 #include "vulkan_device/config.hpp"
 #include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
 #include "vulkan_device/vulkan_buffer.hpp"
 #include "vulkan_device/vulkan_kernel.hpp"
 #include "vulkan_device/vulkan_device.hpp"
 
 // Forward declaration
-std::string getDeviceInfo(const clspvtest::VulkanDevice& device);
+std::string getDeviceDetails(const clspvtest::VulkanDevice& device);
 
-std::vector<clspvtest::uint32b> loadModuleSpirvCode(
-    const std::string_view module_file_name);
 template <typename Type>
 
 clspvtest::UniqueBuffer<Type> makeBuffer(
@@ -53,7 +52,8 @@ int main(int /* argc */, char** /* argv */)
   device_options.app_version_major_ = 1;
   device_options.app_version_minor_ = 0;
   device_options.app_version_patch_ = 0;
-  device_options.vulkan_device_number_ = 0; //!< Use 0th GPU
+  device_options.device_selection_ = clspvtest::DeviceSelection::kCapability; //!< Use the most capable GPU
+  device_options.device_info_cache_path_ = "vulkan_device_info.cache";
 #if defined(Z_DEBUG_MODE)
   device_options.enable_debug_ = true;
 #else
@@ -71,7 +71,7 @@ int main(int /* argc */, char** /* argv */)
       // Create a vulkan device
       device = std::make_unique<clspvtest::VulkanDevice>(device_options);
       {
-        const std::string info = getDeviceInfo(*device);
+        const std::string info = getDeviceDetails(*device);
         std::cout << info << std::endl;
       }
       // Create vulkan buffers
@@ -107,41 +107,31 @@ int main(int /* argc */, char** /* argv */)
   return 0;
 }
 
-std::string getDeviceInfo(const clspvtest::VulkanDevice& device)
+/*!
+  \brief Return the device info with the subgroup and initialization details
+  */
+std::string getDeviceDetails(const clspvtest::VulkanDevice& device)
 {
   using namespace std::string_literals;
-  std::string info;
-  info = "    Vulkan Device:\n"s;
-  info += "      Vendor: "s + device.vendorName().data() + "\n"s;
-  info += "      Name: "s + device.name().data() + "\n"s;
-  info += "      Subgroup: "s + std::to_string(device.subgroupSize());
+  std::string info = clspvtest::getDeviceInfo(device) + "\n"s;
+  const auto& subgroup = device.subgroupCapabilities();
+  info += "      Subgroup sizes: "s + std::to_string(subgroup.size_) + " (min "s +
+      std::to_string(subgroup.min_size_) + ", max "s +
+      std::to_string(subgroup.max_size_) + ", size control "s +
+      (device.isSubgroupSizeControlSupported() ? "yes"s : "no"s) + ")\n"s;
+  info += "      Subgroup operations: "s +
+      vk::to_string(subgroup.supported_operations_) + "\n"s;
+  const auto& t = device.initializationTime();
+  info += "      Initialization: "s + std::to_string(t.total_) + " ms (instance "s +
+      std::to_string(t.instance_) + ", physical device "s +
+      std::to_string(t.physical_device_) + ", device "s +
+      std::to_string(t.device_) + ", queue "s +
+      std::to_string(t.queue_) + ", command pool "s +
+      std::to_string(t.command_pool_) + ", allocator "s +
+      std::to_string(t.memory_allocator_) + ")"s;
   return info;
 }
 
-std::vector<clspvtest::uint32b> loadModuleSpirvCode(
-    const std::string_view module_file_name)
-{
-  static_assert(sizeof(clspvtest::uint32b) == 4,
-                "The size of uint32b isn't 4 bytes.");
-  std::vector<clspvtest::uint32b> spirv_code{};
-  std::ifstream spirv_file{module_file_name.data(), std::ios_base::binary};
-  std::streamsize spirv_size = 0;
-  {
-    const auto begin = spirv_file.tellg();
-    spirv_file.seekg(0, std::ios_base::end);
-    const auto end = spirv_file.tellg();
-    spirv_size = end - begin;
-    if ((spirv_size % 4) != 0) {
-      //! \todo Handle error
-    }
-    spirv_file.clear();
-    spirv_file.seekg(0, std::ios_base::beg);
-  }
-  spirv_code.resize(static_cast<std::size_t>(spirv_size / 4));
-  spirv_file.read(reinterpret_cast<char*>(spirv_code.data()), spirv_size);
-  return spirv_code;
-}
-
 /*!
   \brief Make a buffer
   */
@@ -166,7 +156,7 @@ clspvtest::UniqueKernel<kDimension, ArgumentTypes...> makeKernel(
 {
   if (!device->hasShaderModule(module_index)) {
     const std::vector<clspvtest::uint32b> spirv_code =
-        loadModuleSpirvCode(module_file_name);
+        clspvtest::loadModuleSpirvCode(module_file_name);
     device->setShaderModule(spirv_code, module_index);
   }
   using Kernel = clspvtest::VulkanKernel<kDimension, ArgumentTypes...>;
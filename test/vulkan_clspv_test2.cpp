@@ -9,7 +9,9 @@
 
 // Standard C++ library
 #include <array>
+#include <cstddef>
 #include <fstream>
+#include <memory>
 #include <iostream>
 #include <stdexcept>
 #include <string>
@@ -21,15 +23,31 @@
 #include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
 #include "vulkan_device/config.hpp"
 #include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/transient_buffer_planner.hpp"
 #include "vulkan_device/vulkan_buffer.hpp"
 #include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_local_work_size_tuner.hpp"
 #include "vulkan_device/vulkan_device.hpp"
+#include "vulkan_device/vulkan_metrics.hpp"
+#include "vulkan_device/vulkan_profiler.hpp"
+#include "vulkan_device/vulkan_recorder.hpp"
+#include "vulkan_device/vulkan_tracer.hpp"
 
-// Forward declaration
-std::string getDeviceInfo(const clspvtest::VulkanDevice& device);
+namespace {
+
+//! The instrumentation which is enabled by the command line
+struct DemoOptions
+{
+  bool capture_ = false; //!< Capture the workload for VulkanReplay
+  bool trace_ = false; //!< Export the timeline as a chrome trace
+  bool metrics_ = false; //!< Export the counters as a prometheus text
+  bool tune_ = false; //!< Tune the local-work size and save it into the cache
+};
 
-std::vector<clspvtest::uint32b> loadModuleSpirvCode(
-    const std::string_view module_file_name);
+} // namespace
+
+// Forward declaration
 template <typename Type>
 
 clspvtest::UniqueBuffer<Type> makeBuffer(
@@ -44,20 +62,50 @@ clspvtest::UniqueKernel<kDimension, ArgumentTypes...> makeKernel(
     const std::string_view kernel_name);
 
 
-int main(int /* argc */, char** /* argv */)
+/*!
+  \details
+  Usage: VulkanClspvTest2 [--capture] [--trace] [--metrics] [--tune]
+
+  Blur 'table.png' and save the result as 'result_gpu.png'. The
+  instrumentation and the tuning are disabled by default.
+  '--capture' captures the workload into 'vulkan_clspv_test2.capture'.
+  '--trace' exports the timeline into 'vulkan_clspv_test2_trace.json'.
+  '--metrics' exports the counters into 'vulkan_clspv_test2_metrics.prom'.
+  '--tune' tunes the local-work size of the blur after the result is read,
+  and saves it into 'vulkan_clspv_test2_local_work_size.cache', which is
+  loaded by the later runs.
+  */
+int main(int argc, char** argv)
 {
   using clspvtest::uint8b;
   using clspvtest::uint32b;
 
   std::cout << "Blur an image with gaussian kernel." << std::endl;
 
+  DemoOptions options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    if (arg == "--capture")
+      options.capture_ = true;
+    else if (arg == "--trace")
+      options.trace_ = true;
+    else if (arg == "--metrics")
+      options.metrics_ = true;
+    else if (arg == "--tune")
+      options.tune_ = true;
+    else
+      std::cerr << "Warning: Unknown option '" << arg << "'." << std::endl;
+  }
+
   clspvtest::UniqueDevice device;
   clspvtest::DeviceOptions device_options;
   device_options.app_name_ = "VulkanClspvTest2";
   device_options.app_version_major_ = 1;
   device_options.app_version_minor_ = 0;
   device_options.app_version_patch_ = 0;
-  device_options.vulkan_device_number_ = 0; //!< Use 0th GPU
+  device_options.device_selection_ = clspvtest::DeviceSelection::kCapability; //!< Use the most capable GPU
+  device_options.deferred_allocation_ = true; //!< Allocate buffers in a batch
+  device_options.local_work_size_cache_path_ = "vulkan_clspv_test2_local_work_size.cache";
 #if defined(Z_DEBUG_MODE)
   device_options.enable_debug_ = true;
 #else
@@ -83,23 +131,47 @@ int main(int /* argc */, char** /* argv */)
     std::cout << "- Run a gaussian kernel." << std::endl;
     using clspvtest::BufferUsage;
     bool success = true;
+    // Declared before the buffers so that the recorder outlives them
+    std::unique_ptr<clspvtest::VulkanRecorder> recorder;
     clspvtest::UniqueKernel<1, uint8b, uint8b, uint32b, uint32b> kernel;
     clspvtest::UniqueBuffer<uint8b> buffer1;
     clspvtest::UniqueBuffer<uint8b> buffer2;
     clspvtest::UniqueBuffer<uint32b> block_size;
     clspvtest::UniqueBuffer<uint32b> resolution;
+    std::unique_ptr<clspvtest::VulkanMetrics> metrics;
+    std::unique_ptr<clspvtest::VulkanProfiler> profiler;
+    std::unique_ptr<clspvtest::VulkanTracer> tracer;
     try {
       // Create a vulkan device
       device = std::make_unique<clspvtest::VulkanDevice>(device_options);
       {
-        const std::string info = getDeviceInfo(*device);
+        const std::string info = clspvtest::getDeviceInfo(*device);
         std::cout << info << std::endl;
       }
-      // Create vulkan buffers
+      // Count the events of the hot paths
+      if (options.metrics_) {
+        metrics = std::make_unique<clspvtest::VulkanMetrics>();
+        device->setMetrics(metrics.get());
+      }
+      // Measure the device time of the kernels and the copies
+      profiler = std::make_unique<clspvtest::VulkanProfiler>(device.get());
+      device->setProfiler(profiler.get());
+      // Record the host activity on a timeline
+      if (options.trace_) {
+        tracer = std::make_unique<clspvtest::VulkanTracer>();
+        device->setTracer(tracer.get());
+      }
+      // Capture the workload so that VulkanReplay can reproduce it
+      if (options.capture_) {
+        recorder = std::make_unique<clspvtest::VulkanRecorder>(
+            "vulkan_clspv_test2.capture", true);
+        device->setRecorder(recorder.get());
+      }
+      // Create vulkan buffers. All buffers are declared before the first use
+      // so that the device allocates them in one batch
       buffer1 = makeBuffer<clspvtest::uint8b>(device.get(),
                                               BufferUsage::kDeviceOnly);
       buffer1->setSize(3 * w * h);
-      buffer1->write(image.data(), image.size(), 0, 0);
       buffer2 = makeBuffer<clspvtest::uint8b>(device.get(),
                                               BufferUsage::kDeviceOnly);
       buffer2->setSize(3 * w * h);
@@ -107,10 +179,28 @@ int main(int /* argc */, char** /* argv */)
       block_size = makeBuffer<clspvtest::uint32b>(device.get(),
                                                   BufferUsage::kDeviceOnly);
       block_size->setSize(1);
-      block_size->write(&bsize, 1, 0, 0);
       resolution = makeBuffer<clspvtest::uint32b>(device.get(),
                                                   BufferUsage::kDeviceOnly);
       resolution->setSize(2);
+      // The blur ping-pongs between the two image buffers, so both are alive
+      // in every pass. The planner packs the pair into one memory block
+      {
+        clspvtest::TransientBufferPlanner planner{device.get()};
+        const std::size_t id1 = planner.addBuffer(buffer1.get());
+        const std::size_t id2 = planner.addBuffer(buffer2.get());
+        planner.addStage({id1}, {id2});
+        planner.addStage({id2}, {id1});
+        planner.addStage({id1}, {id2});
+        planner.plan();
+        const bool is_shared = planner.isAliased(id1) && planner.isAliased(id2) &&
+                               (planner.memory(id1) == planner.memory(id2));
+        std::cout << "- Plan the image buffers: " << planner.memoryUsage()
+                  << " bytes (unaliased " << planner.unaliasedMemoryUsage()
+                  << " bytes), shared block " << (is_shared ? "yes" : "no")
+                  << "." << std::endl;
+      }
+      buffer1->write(image.data(), image.size(), 0, 0);
+      block_size->write(&bsize, 1, 0, 0);
       resolution->write(res.data(), res.size(), 0, 0);
       // Create a kernel
       kernel = makeKernel<1, uint8b, uint8b, uint32b, uint32b>(
@@ -129,6 +219,69 @@ int main(int /* argc */, char** /* argv */)
 
       // Read the result
       buffer2->read(image.data(), image.size(), 0, 0);
+
+      std::cout << "- Device time." << std::endl;
+      for (const auto& statistics : profiler->statistics()) {
+        std::cout << "    " << statistics.name_ << ": count " << statistics.count_
+                  << ", min " << statistics.min_ << " ms"
+                  << ", mean " << statistics.mean_ << " ms"
+                  << ", p99 " << statistics.p99_ << " ms";
+        if (statistics.invocations_ != 0)
+          std::cout << ", invocations " << statistics.invocations_;
+        std::cout << std::endl;
+      }
+      for (const auto& executable : kernel->executableProperties()) {
+        std::cout << "- Executable: " << executable.name_
+                  << " (subgroup " << executable.subgroup_size_ << ")." << std::endl;
+        for (const auto& statistic : executable.statistic_list_) {
+          std::cout << "    " << statistic.name_ << ": " << statistic.value_
+                    << std::endl;
+        }
+      }
+
+      // Export the timeline of the host and the device
+      if (tracer) {
+        tracer->setEnabled(false);
+        const char* trace_name = "vulkan_clspv_test2_trace.json";
+        if (tracer->writeChromeTrace(trace_name, profiler.get()))
+          std::cout << "- Save the timeline as `" << trace_name << "'." << std::endl;
+        device->setTracer(nullptr);
+      }
+      device->setProfiler(nullptr);
+
+      // Export the counters
+      if (metrics) {
+        const char* metrics_name = "vulkan_clspv_test2_metrics.prom";
+        if (metrics->writePrometheusText(metrics_name))
+          std::cout << "- Save the metrics as `" << metrics_name << "'." << std::endl;
+        device->setMetrics(nullptr);
+      }
+
+      // Finish the capture
+      if (recorder) {
+        device->setRecorder(nullptr);
+        if (recorder->isOpen()) {
+          std::cout << "- Save " << recorder->numOfRecords()
+                    << " operations as `vulkan_clspv_test2.capture'." << std::endl;
+        }
+      }
+
+      // Tune the local-work size on request. Later runs load it
+      if (options.tune_) {
+        std::cout << "- Tune the local-work size of the kernel." << std::endl;
+        clspvtest::VulkanLocalWorkSizeTuner tuner{device.get()};
+        const auto local_work_size = tuner.tune(0,
+                                                "applyGaussianFilter",
+                                                std::array<uint32b, 1>{{num_threads}},
+                                                0,
+                                                *buffer1,
+                                                *buffer2,
+                                                *block_size,
+                                                *resolution);
+        device->saveLocalWorkSizeCache(device_options.local_work_size_cache_path_);
+        std::cout << "    " << tuner.results().size() << " candidates, select "
+                  << local_work_size[0] << "." << std::endl;
+      }
     }
     catch (const std::exception& error) {
       std::cerr << "Error: " << error.what() << std::endl;
@@ -149,41 +302,6 @@ int main(int /* argc */, char** /* argv */)
   return 0;
 }
 
-std::string getDeviceInfo(const clspvtest::VulkanDevice& device)
-{
-  using namespace std::string_literals;
-  std::string info;
-  info = "    Vulkan Device:\n"s;
-  info += "      Vendor: "s + device.vendorName().data() + "\n"s;
-  info += "      Name: "s + device.name().data() + "\n"s;
-  info += "      Subgroup: "s + std::to_string(device.subgroupSize());
-  return info;
-}
-
-std::vector<clspvtest::uint32b> loadModuleSpirvCode(
-    const std::string_view module_file_name)
-{
-  static_assert(sizeof(clspvtest::uint32b) == 4,
-                "The size of uint32b isn't 4 bytes.");
-  std::vector<clspvtest::uint32b> spirv_code{};
-  std::ifstream spirv_file{module_file_name.data(), std::ios_base::binary};
-  std::streamsize spirv_size = 0;
-  {
-    const auto begin = spirv_file.tellg();
-    spirv_file.seekg(0, std::ios_base::end);
-    const auto end = spirv_file.tellg();
-    spirv_size = end - begin;
-    if ((spirv_size % 4) != 0) {
-      //! \todo Handle error
-    }
-    spirv_file.clear();
-    spirv_file.seekg(0, std::ios_base::beg);
-  }
-  spirv_code.resize(static_cast<std::size_t>(spirv_size / 4));
-  spirv_file.read(reinterpret_cast<char*>(spirv_code.data()), spirv_size);
-  return spirv_code;
-}
-
 /*!
   \brief Make a buffer
   */
@@ -208,7 +326,7 @@ clspvtest::UniqueKernel<kDimension, ArgumentTypes...> makeKernel(
 {
   if (!device->hasShaderModule(module_index)) {
     const std::vector<clspvtest::uint32b> spirv_code =
-        loadModuleSpirvCode(module_file_name);
+        clspvtest::loadModuleSpirvCode(module_file_name);
     device->setShaderModule(spirv_code, module_index);
   }
   using Kernel = clspvtest::VulkanKernel<kDimension, ArgumentTypes...>;
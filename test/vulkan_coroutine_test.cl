@@ -0,0 +1,29 @@
+/*!
+  \file vulkan_coroutine_test.cl
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-compat"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-c++11-compat-pedantic"
+
+// Type aliases
+typedef unsigned int uint32b;
+
+
+/*!
+  \brief Add the step to the values
+  */
+__kernel void addStep(__global uint32b* values, __global const uint32b* step)
+{
+  const size_t index = get_global_id(0);
+  values[index] = values[index] + step[0];
+}
+
+#pragma clang diagnostic pop
+#pragma clang diagnostic pop
@@ -0,0 +1,201 @@
+/*!
+  \file vulkan_coroutine_test.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_coroutine.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+
+#if defined(CLSPV_TEST_COROUTINE_SUPPORTED)
+
+// Standard C++ library
+#include <coroutine>
+
+using Kernel = clspvtest::VulkanKernel<1, clspvtest::uint32b, clspvtest::uint32b>;
+
+/*!
+  \brief A coroutine which starts immediately and destroys itself at the end
+  */
+struct Job
+{
+  struct promise_type
+  {
+    Job get_return_object() noexcept {return Job{};}
+    std::suspend_never initial_suspend() noexcept {return {};}
+    std::suspend_never final_suspend() noexcept {return {};}
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept {std::terminate();}
+  };
+};
+
+// Forward declaration
+Job runJob(clspvtest::VulkanReactor* reactor,
+           Kernel* kernel,
+           clspvtest::VulkanBuffer<clspvtest::uint32b>* values,
+           clspvtest::VulkanBuffer<clspvtest::uint32b>* step,
+           const clspvtest::uint32b step_value,
+           std::promise<std::size_t> num_of_errors);
+
+#endif // CLSPV_TEST_COROUTINE_SUPPORTED
+
+
+/*!
+  \details
+  Usage: VulkanCoroutineTest
+
+  Runs jobs as coroutines which co_await the uploads, the kernels and the
+  readbacks. The reactor resumes the jobs, so the main thread only waits for
+  the results. Returns non-zero if any result is wrong or any coroutine is
+  left suspended.
+  */
+int main(int /* argc */, char** /* argv */)
+{
+#if defined(CLSPV_TEST_COROUTINE_SUPPORTED)
+  using clspvtest::uint32b;
+  using clspvtest::BufferUsage;
+  constexpr std::size_t num_of_jobs = 4;
+  constexpr std::size_t num_of_values = 1 << 16;
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanCoroutineTest";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  bool success = true;
+  {
+    std::vector<std::unique_ptr<Kernel>> kernel_list;
+    std::vector<clspvtest::UniqueBuffer<uint32b>> values_list;
+    std::vector<clspvtest::UniqueBuffer<uint32b>> step_list;
+    clspvtest::UniqueReactor reactor;
+    try {
+      device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+      {
+        const std::string info = clspvtest::getDeviceInfo(*device);
+        std::cout << info << std::endl;
+      }
+      {
+        const std::vector<uint32b> spirv_code =
+            clspvtest::loadModuleSpirvCode("vulkan_coroutine_test.spv");
+        device->setShaderModule(spirv_code, 0);
+      }
+      // A kernel can't be run by multiple jobs at once, so each job has its own
+      for (std::size_t i = 0; i < num_of_jobs; ++i) {
+        kernel_list.emplace_back(std::make_unique<Kernel>(device.get(), 0, "addStep"));
+        values_list.emplace_back(std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+            device.get(), BufferUsage::kDeviceOnly, num_of_values));
+        step_list.emplace_back(std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+            device.get(), BufferUsage::kHostOnly, 1));
+      }
+      reactor = std::make_unique<clspvtest::VulkanReactor>(device.get());
+
+      std::vector<std::future<std::size_t>> result_list;
+      for (std::size_t i = 0; i < num_of_jobs; ++i) {
+        std::promise<std::size_t> num_of_errors;
+        result_list.emplace_back(num_of_errors.get_future());
+        runJob(reactor.get(),
+               kernel_list[i].get(),
+               values_list[i].get(),
+               step_list[i].get(),
+               static_cast<uint32b>(i + 1),
+               std::move(num_of_errors));
+      }
+      for (std::size_t i = 0; i < num_of_jobs; ++i) {
+        const std::size_t num_of_errors = result_list[i].get();
+        std::cout << "  job" << i << ": errors = " << num_of_errors << std::endl;
+        success = success && (num_of_errors == 0);
+      }
+      // The reactor resumes a coroutine after removing it from the waiters
+      const std::size_t num_of_waiters = reactor->numOfWaiters();
+      std::cout << "  waiters = " << num_of_waiters << std::endl;
+      success = success && (num_of_waiters == 0);
+      // An awaitable which isn't awaited can outlive the reactor
+      {
+        const auto awaitable = kernel_list[0]->runAsync(
+            reactor.get(),
+            *values_list[0],
+            *step_list[0],
+            {static_cast<uint32b>(num_of_values)},
+            clspvtest::kAnyQueue);
+        reactor.reset();
+      }
+    }
+    catch (const std::exception& error) {
+      std::cerr << "Error: " << error.what() << std::endl;
+      success = false;
+    }
+    // The reactor waits for the suspended coroutines before the buffers die
+    reactor.reset();
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+#else // CLSPV_TEST_COROUTINE_SUPPORTED
+  std::cout << "The compiler doesn't support coroutines." << std::endl;
+  return EXIT_SUCCESS;
+#endif // CLSPV_TEST_COROUTINE_SUPPORTED
+}
+
+#if defined(CLSPV_TEST_COROUTINE_SUPPORTED)
+
+/*!
+  \brief Upload the values, add the step to them a few times and read them back
+  */
+Job runJob(clspvtest::VulkanReactor* reactor,
+           Kernel* kernel,
+           clspvtest::VulkanBuffer<clspvtest::uint32b>* values,
+           clspvtest::VulkanBuffer<clspvtest::uint32b>* step,
+           const clspvtest::uint32b step_value,
+           std::promise<std::size_t> num_of_errors)
+{
+  using clspvtest::uint32b;
+  using clspvtest::kAnyQueue;
+  constexpr uint32b num_of_runs = 8;
+
+  const std::size_t n = values->size();
+  std::vector<uint32b> data(n);
+  for (std::size_t i = 0; i < n; ++i)
+    data[i] = static_cast<uint32b>(i);
+  step->write(&step_value, 1, 0, 0);
+  co_await values->writeAsync(reactor, data.data(), n, 0, kAnyQueue);
+  for (uint32b run = 0; run < num_of_runs; ++run)
+    co_await kernel->runAsync(reactor, *values, *step, {static_cast<uint32b>(n)}, kAnyQueue);
+  std::vector<uint32b> results(n);
+  co_await values->readAsync(reactor, results.data(), n, 0, kAnyQueue);
+
+  std::size_t errors = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (results[i] != data[i] + num_of_runs * step_value)
+      ++errors;
+  }
+  num_of_errors.set_value(errors);
+}
+
+#endif // CLSPV_TEST_COROUTINE_SUPPORTED
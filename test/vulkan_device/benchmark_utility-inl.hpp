@@ -0,0 +1,195 @@
+/*!
+  \file benchmark_utility-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_BENCHMARK_UTILITY_INL_HPP
+#define CLSPV_TEST_BENCHMARK_UTILITY_INL_HPP
+
+#include "benchmark_utility.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_device.hpp"
+#include "vulkan_kernel.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+inline
+double measureBandwidth(const std::size_t size,
+                        const std::size_t num_of_repetitions,
+                        const std::function<void ()>& transfer)
+{
+  const double time = measureMedianTime(num_of_repetitions, transfer);
+  return (0.0 < time) ? static_cast<double>(size) / time * 1.0e-9 : 0.0;
+}
+
+/*!
+  \details
+  The kernel must take a uint32b buffer. The first run isn't measured since
+  it includes the lazy setup of the queue and the buffer.
+  */
+inline
+KernelLatency measureKernelLatency(VulkanDevice* device,
+                                   const uint32b module_index,
+                                   const std::string_view kernel_name,
+                                   const std::size_t num_of_iterations)
+{
+  constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+
+  VulkanKernel<1, uint32b> kernel{device, module_index, kernel_name};
+  VulkanBuffer<uint32b> buffer{device, BufferUsage::kDeviceOnly, 1};
+  const auto& d = device->device();
+  vk::Fence fence;
+  {
+    const vk::FenceCreateInfo fence_info{};
+    d.createFence(&fence_info, nullptr, &fence);
+  }
+
+  kernel.run(buffer, {1}, 0, fence);
+  d.waitForFences(1, &fence, VK_TRUE, timeout);
+  d.resetFences(1, &fence);
+
+  std::vector<double> time_list;
+  time_list.reserve(num_of_iterations);
+  for (std::size_t i = 0; i < num_of_iterations; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    kernel.run(buffer, {1}, 0, fence);
+    d.waitForFences(1, &fence, VK_TRUE, timeout);
+    const auto end = std::chrono::steady_clock::now();
+    d.resetFences(1, &fence);
+    const std::chrono::duration<double, std::micro> elapsed_time = end - start;
+    time_list.emplace_back(elapsed_time.count());
+  }
+  d.destroyFence(fence);
+
+  KernelLatency result;
+  if (time_list.empty())
+    return result;
+  std::sort(time_list.begin(), time_list.end());
+  const auto percentile = [&time_list](const double p)
+  {
+    const auto i = static_cast<std::size_t>(p * static_cast<double>(time_list.size() - 1));
+    return time_list[i];
+  };
+  result.min_ = time_list.front();
+  result.mean_ = std::accumulate(time_list.begin(), time_list.end(), 0.0) /
+                 static_cast<double>(time_list.size());
+  result.p50_ = percentile(0.5);
+  result.p99_ = percentile(0.99);
+  result.max_ = time_list.back();
+  return result;
+}
+
+/*!
+  \details
+  The first operation isn't measured since it includes the lazy setup of the
+  buffers and the command buffers.
+  */
+inline
+double measureMedianTime(const std::size_t num_of_repetitions,
+                         const std::function<void ()>& operation)
+{
+  operation();
+  std::vector<double> time_list;
+  time_list.reserve(num_of_repetitions);
+  for (std::size_t i = 0; i < num_of_repetitions; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    operation();
+    const auto end = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> elapsed_time = end - start;
+    time_list.emplace_back(elapsed_time.count());
+  }
+  return median(std::move(time_list));
+}
+
+/*!
+  \details
+  The kernel must take a uint32b buffer. If the buffers are rebound, two
+  buffers are used alternately, so every run updates the descriptor set.
+  */
+inline
+RunPhaseTime measureRunPhases(VulkanDevice* device,
+                              const uint32b module_index,
+                              const std::string_view kernel_name,
+                              const std::size_t num_of_iterations,
+                              const bool rebind_buffers)
+{
+  constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+
+  VulkanKernel<1, uint32b> kernel{device, module_index, kernel_name};
+  VulkanBuffer<uint32b> buffer1{device, BufferUsage::kDeviceOnly, 1};
+  VulkanBuffer<uint32b> buffer2{device, BufferUsage::kDeviceOnly, 1};
+  const std::array<VulkanBuffer<uint32b>*, 2> buffer_list{{&buffer1, &buffer2}};
+  const auto& d = device->device();
+  vk::Fence fence;
+  {
+    const vk::FenceCreateInfo fence_info{};
+    d.createFence(&fence_info, nullptr, &fence);
+  }
+
+  for (auto* buffer : buffer_list) {
+    kernel.run(*buffer, {1}, 0, fence);
+    d.waitForFences(1, &fence, VK_TRUE, timeout);
+    d.resetFences(1, &fence);
+  }
+
+  kernel.setRunStatisticsEnabled(true);
+  kernel.resetRunStatistics();
+  for (std::size_t i = 0; i < num_of_iterations; ++i) {
+    auto* buffer = buffer_list[rebind_buffers ? (i % 2) : 0];
+    kernel.run(*buffer, {1}, 0, fence);
+    // The command buffer of the kernel must not be pending on the next run
+    d.waitForFences(1, &fence, VK_TRUE, timeout);
+    d.resetFences(1, &fence);
+  }
+  d.destroyFence(fence);
+
+  const auto& statistics = kernel.runStatistics();
+  RunPhaseTime result;
+  if (statistics.num_of_runs_ == 0)
+    return result;
+  const double n = static_cast<double>(statistics.num_of_runs_);
+  result.same_args_ = static_cast<double>(statistics.same_args_time_) / n;
+  result.bind_buffers_ = static_cast<double>(statistics.bind_buffers_time_) / n;
+  result.dispatch_ = static_cast<double>(statistics.dispatch_time_) / n;
+  result.submit_ = static_cast<double>(statistics.submit_time_) / n;
+  result.total_ = result.same_args_ + result.bind_buffers_ +
+                  result.dispatch_ + result.submit_;
+  return result;
+}
+
+/*!
+  */
+inline
+double median(std::vector<double> value_list) noexcept
+{
+  if (value_list.empty())
+    return 0.0;
+  const std::size_t n = value_list.size();
+  std::sort(value_list.begin(), value_list.end());
+  return ((n % 2) == 1) ? value_list[n / 2]
+                        : 0.5 * (value_list[n / 2 - 1] + value_list[n / 2]);
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_BENCHMARK_UTILITY_INL_HPP
@@ -0,0 +1,75 @@
+/*!
+  \file benchmark_utility.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_BENCHMARK_UTILITY_HPP
+#define CLSPV_TEST_BENCHMARK_UTILITY_HPP
+
+// Standard C++ library
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <vector>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+class VulkanDevice;
+
+//! The average host time of the phases of a kernel run in nanoseconds
+struct RunPhaseTime
+{
+  double same_args_ = 0.0;
+  double bind_buffers_ = 0.0;
+  double dispatch_ = 0.0;
+  double submit_ = 0.0;
+  double total_ = 0.0;
+};
+
+//! The round-trip latency of a kernel in microseconds
+struct KernelLatency
+{
+  double min_ = 0.0;
+  double mean_ = 0.0;
+  double p50_ = 0.0;
+  double p99_ = 0.0;
+  double max_ = 0.0;
+};
+
+//! Return the bandwidth of the median time of the transfers in GB/s
+double measureBandwidth(const std::size_t size,
+                        const std::size_t num_of_repetitions,
+                        const std::function<void ()>& transfer);
+
+//! Measure the time from run() to the completion of a kernel
+KernelLatency measureKernelLatency(VulkanDevice* device,
+                                   const uint32b module_index,
+                                   const std::string_view kernel_name,
+                                   const std::size_t num_of_iterations);
+
+//! Return the median time of the operations in seconds
+double measureMedianTime(const std::size_t num_of_repetitions,
+                         const std::function<void ()>& operation);
+
+//! Measure the host time of the phases of run()
+RunPhaseTime measureRunPhases(VulkanDevice* device,
+                              const uint32b module_index,
+                              const std::string_view kernel_name,
+                              const std::size_t num_of_iterations,
+                              const bool rebind_buffers);
+
+//! Return the median of the values
+double median(std::vector<double> value_list) noexcept;
+
+} // namespace clspvtest
+
+#include "benchmark_utility-inl.hpp"
+
+#endif // CLSPV_TEST_BENCHMARK_UTILITY_HPP
@@ -12,8 +12,16 @@
 
 // Standard C++ library
 #include <cstdint>
+#include <limits>
 #include <type_traits>
 
+// C++20 coroutines
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define CLSPV_TEST_COROUTINE_SUPPORTED 1
+#endif
+#endif
+
 namespace clspvtest {
 
 // General
@@ -31,6 +39,16 @@ using uint64b = std::uint64_t;
 
 // Device
 
+/*!
+  \brief How a physical device is selected
+  */
+enum class DeviceSelection : uint32b
+{
+  kNumber = 0, //!< Use the device of the given number
+  kCapability, //!< Use the device which has the highest capability score
+  kBenchmark //!< Use the device which has the highest measured bandwidth
+};
+
 /*!
   */
 enum class QueueType : uint32b
@@ -39,6 +57,9 @@ enum class QueueType : uint32b
   kTransfer
 };
 
+//! The queue index which lets the device select the least loaded queue
+constexpr uint32b kAnyQueue = (std::numeric_limits<uint32b>::max)();
+
 // Buffer
 
 /*!
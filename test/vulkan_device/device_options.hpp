@@ -28,7 +28,12 @@ struct DeviceOptions
   uint32b app_version_minor_ = 0;
   uint32b app_version_patch_ = 0;
   bool enable_debug_ = true;
-  uint32b vulkan_device_number_ = 0;
+  uint32b vulkan_device_number_ = 0; //!< Used if the selection is 'kNumber'
+  DeviceSelection device_selection_ = DeviceSelection::kNumber;
+  const char* device_cache_path_ = nullptr; //!< The file which caches the benchmark results. Not cached if null
+  const char* device_info_cache_path_ = nullptr; //!< The file which caches the physical device info. Not cached if null
+  bool deferred_allocation_ = false; //!< Allocate buffer memories in a batch on first use
+  const char* local_work_size_cache_path_ = nullptr; //!< The file which caches the tuned local-work sizes. Not loaded if null
 };
 
 } // namespace clspvtest
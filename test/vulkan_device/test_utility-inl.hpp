@@ -0,0 +1,78 @@
+/*!
+  \file test_utility-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_TEST_UTILITY_INL_HPP
+#define CLSPV_TEST_TEST_UTILITY_INL_HPP
+
+#include "test_utility.hpp"
+// Standard C++ library
+#include <cstddef>
+#include <fstream>
+#include <ios>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_device.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+inline
+std::string getDeviceInfo(const VulkanDevice& device)
+{
+  using namespace std::string_literals;
+  std::string info;
+  info = "    Vulkan Device:\n"s;
+  info += "      Vendor: "s + device.vendorName().data() + "\n"s;
+  info += "      Name: "s + device.name().data() + "\n"s;
+  info += "      Subgroup: "s + std::to_string(device.subgroupSize()) + "\n"s;
+  info += "      Compute queues: "s +
+      std::to_string(device.numOfQueues(QueueType::kCompute));
+  return info;
+}
+
+/*!
+  \details
+  A module is a sequence of 32-bit words, so a file which can't be read or
+  of which the size isn't a multiple of 4 bytes is rejected.
+  */
+inline
+std::vector<uint32b> loadModuleSpirvCode(const std::string_view module_file_name)
+{
+  static_assert(sizeof(uint32b) == 4, "The size of uint32b isn't 4 bytes.");
+  const std::string file_name{module_file_name};
+  std::ifstream spirv_file{file_name, std::ios_base::binary};
+  if (!spirv_file)
+    throw std::runtime_error{"The module '" + file_name + "' can't be opened."};
+  std::streamsize spirv_size = 0;
+  {
+    const auto begin = spirv_file.tellg();
+    spirv_file.seekg(0, std::ios_base::end);
+    const auto end = spirv_file.tellg();
+    spirv_size = end - begin;
+    if ((spirv_size <= 0) || ((spirv_size % 4) != 0))
+      throw std::runtime_error{"The module '" + file_name + "' is broken."};
+    spirv_file.clear();
+    spirv_file.seekg(0, std::ios_base::beg);
+  }
+  std::vector<uint32b> spirv_code;
+  spirv_code.resize(static_cast<std::size_t>(spirv_size / 4));
+  spirv_file.read(reinterpret_cast<char*>(spirv_code.data()), spirv_size);
+  if (!spirv_file)
+    throw std::runtime_error{"The module '" + file_name + "' can't be read."};
+  return spirv_code;
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_TEST_UTILITY_INL_HPP
@@ -0,0 +1,35 @@
+/*!
+  \file test_utility.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_TEST_UTILITY_HPP
+#define CLSPV_TEST_TEST_UTILITY_HPP
+
+// Standard C++ library
+#include <string>
+#include <string_view>
+#include <vector>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+class VulkanDevice;
+
+//! Return the description of the device which the test programs print
+std::string getDeviceInfo(const VulkanDevice& device);
+
+//! Load a SPIR-V module. Throws std::runtime_error if the module is invalid
+std::vector<uint32b> loadModuleSpirvCode(const std::string_view module_file_name);
+
+} // namespace clspvtest
+
+#include "test_utility-inl.hpp"
+
+#endif // CLSPV_TEST_TEST_UTILITY_HPP
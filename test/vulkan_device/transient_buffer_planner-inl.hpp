@@ -0,0 +1,308 @@
+/*!
+  \file transient_buffer_planner-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_TRANSIENT_BUFFER_PLANNER_INL_HPP
+#define CLSPV_TEST_TRANSIENT_BUFFER_PLANNER_INL_HPP
+
+#include "transient_buffer_planner.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+#include "vk_mem_alloc.h"
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_device.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+inline
+TransientBufferPlanner::TransientBufferPlanner(VulkanDevice* device) noexcept :
+    device_{device}
+{
+}
+
+/*!
+  \details
+  The buffer must be declared (its size must be set) on a device which
+  defers the memory allocation. If the memory of the buffer is already
+  allocated, the buffer keeps its own memory and isn't aliased.
+  */
+template <typename Type> inline
+std::size_t TransientBufferPlanner::addBuffer(VulkanBuffer<Type>* buffer) noexcept
+{
+  const std::size_t buffer_id = buffer_list_.size();
+  buffer_list_.emplace_back();
+  auto& transient = buffer_list_.back();
+  transient.buffer_ = &buffer->buffer();
+  transient.memory_ = VK_NULL_HANDLE;
+  transient.usage_ = buffer->usage();
+  transient.first_stage_ = std::numeric_limits<std::size_t>::max();
+  transient.last_stage_ = 0;
+  transient.offset_ = 0;
+  if (device_->isDeferredBuffer(transient.buffer_, buffer->buffer())) {
+    const auto& device = device_->device();
+    transient.handle_ = buffer->buffer();
+    transient.requirements_ = device.getBufferMemoryRequirements(transient.handle_);
+  }
+  else {
+    transient.requirements_ = vk::MemoryRequirements{0, 1, 0};
+  }
+  return buffer_id;
+}
+
+/*!
+  */
+inline
+std::size_t TransientBufferPlanner::addStage(
+    const std::vector<std::size_t>& inputs,
+    const std::vector<std::size_t>& outputs)
+{
+  const std::size_t stage = num_of_stages_++;
+  for (const std::size_t buffer_id : inputs)
+    updateLifetime(buffer_id, stage);
+  for (const std::size_t buffer_id : outputs)
+    updateLifetime(buffer_id, stage);
+  return stage;
+}
+
+/*!
+  */
+inline
+void TransientBufferPlanner::clear() noexcept
+{
+  buffer_list_.clear();
+  num_of_stages_ = 0;
+  memory_usage_ = 0;
+}
+
+/*!
+  */
+inline
+bool TransientBufferPlanner::isAliased(const std::size_t buffer_id) const noexcept
+{
+  return buffer_list_[buffer_id].memory_ != VK_NULL_HANDLE;
+}
+
+/*!
+  */
+inline
+std::size_t TransientBufferPlanner::memoryUsage() const noexcept
+{
+  return memory_usage_;
+}
+
+/*!
+  */
+inline
+std::size_t TransientBufferPlanner::numOfBuffers() const noexcept
+{
+  return buffer_list_.size();
+}
+
+/*!
+  */
+inline
+std::size_t TransientBufferPlanner::numOfStages() const noexcept
+{
+  return num_of_stages_;
+}
+
+/*!
+  */
+inline
+std::size_t TransientBufferPlanner::offset(const std::size_t buffer_id) const noexcept
+{
+  return buffer_list_[buffer_id].offset_;
+}
+
+/*!
+  */
+inline
+VmaAllocation TransientBufferPlanner::memory(const std::size_t buffer_id) const noexcept
+{
+  return buffer_list_[buffer_id].memory_;
+}
+
+/*!
+  \details
+  A memory block is allocated for each buffer usage, and the buffers are
+  bound to the block with 'vmaBindBufferMemory2' at the planned offsets.
+  The stages must be executed in order, and a stage must be completed before
+  a following stage which reuses the memory starts.
+  */
+inline
+void TransientBufferPlanner::plan() noexcept
+{
+  constexpr std::array<BufferUsage, 4> usage_list{{BufferUsage::kDeviceOnly,
+                                                   BufferUsage::kHostOnly,
+                                                   BufferUsage::kHostToDevice,
+                                                   BufferUsage::kDeviceToHost}};
+  memory_usage_ = 0;
+  std::vector<TransientBuffer*> target_list;
+  target_list.reserve(buffer_list_.size());
+  for (const BufferUsage usage : usage_list) {
+    // The destroyed buffers and the allocated buffers are dropped here
+    target_list.clear();
+    for (auto& transient : buffer_list_) {
+      if ((transient.usage_ == usage) && isPending(transient))
+        target_list.emplace_back(&transient);
+      else if ((transient.usage_ == usage) && (transient.memory_ == VK_NULL_HANDLE))
+        transient.handle_ = nullptr;
+    }
+    const std::size_t block_size = placeBuffers(target_list);
+    if (block_size == 0)
+      continue;
+
+    vk::MemoryRequirements block_requirements{block_size,
+                                              1,
+                                              ~0u};
+    for (const auto transient : target_list) {
+      const auto& requirements = transient->requirements_;
+      block_requirements.alignment = (std::max)(block_requirements.alignment,
+                                                requirements.alignment);
+      block_requirements.memoryTypeBits &= requirements.memoryTypeBits;
+    }
+
+    VmaAllocationInfo block_info;
+    const VmaAllocation memory = device_->allocateSharedMemory(block_requirements,
+                                                               usage,
+                                                               target_list.size(),
+                                                               &block_info);
+    //! \todo Handle error
+    if (memory == VK_NULL_HANDLE) {
+      continue;
+    }
+    // Each failed bind releases its reference, so the block is freed if no buffer is bound
+    std::size_t num_of_bound_buffers = 0;
+    for (const auto transient : target_list) {
+      const bool is_bound = device_->bindDeferredBuffer(transient->buffer_,
+                                                        transient->handle_,
+                                                        memory,
+                                                        transient->offset_);
+      if (is_bound) {
+        transient->memory_ = memory;
+        ++num_of_bound_buffers;
+      }
+      else {
+        transient->handle_ = nullptr;
+      }
+    }
+    if (0 < num_of_bound_buffers)
+      memory_usage_ += block_size;
+  }
+}
+
+/*!
+  */
+inline
+std::size_t TransientBufferPlanner::unaliasedMemoryUsage() const noexcept
+{
+  std::size_t memory_usage = 0;
+  for (const auto& transient : buffer_list_)
+    memory_usage += static_cast<std::size_t>(transient.requirements_.size);
+  return memory_usage;
+}
+
+/*!
+  */
+inline
+bool TransientBufferPlanner::isPending(const TransientBuffer& transient) const noexcept
+{
+  const bool result = transient.handle_ &&
+                      (transient.memory_ == VK_NULL_HANDLE) &&
+                      device_->isDeferredBuffer(transient.buffer_,
+                                                transient.handle_);
+  return result;
+}
+
+/*!
+  \details
+  The buffers are placed in descending order of size. Each buffer is placed
+  at the lowest offset which doesn't overlap with the already placed
+  buffers whose lifetimes overlap with the buffer.
+  */
+inline
+std::size_t TransientBufferPlanner::placeBuffers(
+    std::vector<TransientBuffer*> target_list) noexcept
+{
+  const std::size_t last_stage = (0 < num_of_stages_) ? num_of_stages_ - 1 : 0;
+  for (auto transient : target_list) {
+    // A buffer which isn't used by any stage lives through the pipeline
+    if (transient->first_stage_ == std::numeric_limits<std::size_t>::max()) {
+      transient->first_stage_ = 0;
+      transient->last_stage_ = last_stage;
+    }
+  }
+  std::stable_sort(target_list.begin(), target_list.end(),
+  [](const TransientBuffer* lhs, const TransientBuffer* rhs)
+  {
+    return rhs->requirements_.size < lhs->requirements_.size;
+  });
+
+  const auto align = [](const std::size_t offset, const std::size_t alignment)
+  {
+    return ((offset + alignment - 1) / alignment) * alignment;
+  };
+
+  std::size_t block_size = 0;
+  std::vector<const TransientBuffer*> live_list;
+  live_list.reserve(target_list.size());
+  for (std::size_t i = 0; i < target_list.size(); ++i) {
+    auto transient = target_list[i];
+    // Collect the placed buffers which are alive at the same time
+    live_list.clear();
+    for (std::size_t j = 0; j < i; ++j) {
+      const auto placed = target_list[j];
+      if ((placed->first_stage_ <= transient->last_stage_) &&
+          (transient->first_stage_ <= placed->last_stage_))
+        live_list.emplace_back(placed);
+    }
+    std::sort(live_list.begin(), live_list.end(),
+    [](const TransientBuffer* lhs, const TransientBuffer* rhs)
+    {
+      return lhs->offset_ < rhs->offset_;
+    });
+    // Find the first gap which the buffer fits in
+    const auto size = static_cast<std::size_t>(transient->requirements_.size);
+    const auto alignment = static_cast<std::size_t>(transient->requirements_.alignment);
+    std::size_t offset = 0;
+    for (const auto placed : live_list) {
+      const std::size_t placed_size = static_cast<std::size_t>(placed->requirements_.size);
+      if (align(offset, alignment) + size <= placed->offset_)
+        break;
+      offset = (std::max)(offset, placed->offset_ + placed_size);
+    }
+    transient->offset_ = align(offset, alignment);
+    block_size = (std::max)(block_size, transient->offset_ + size);
+  }
+  return block_size;
+}
+
+/*!
+  */
+inline
+void TransientBufferPlanner::updateLifetime(const std::size_t buffer_id,
+                                            const std::size_t stage) noexcept
+{
+  auto& transient = buffer_list_[buffer_id];
+  transient.first_stage_ = (std::min)(transient.first_stage_, stage);
+  transient.last_stage_ = (std::max)(transient.last_stage_, stage);
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_TRANSIENT_BUFFER_PLANNER_INL_HPP
@@ -0,0 +1,118 @@
+/*!
+  \file transient_buffer_planner.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_TRANSIENT_BUFFER_PLANNER_HPP
+#define CLSPV_TEST_TRANSIENT_BUFFER_PLANNER_HPP
+
+// Standard C++ library
+#include <cstddef>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+#include "vk_mem_alloc.h"
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+template <typename> class VulkanBuffer;
+class VulkanDevice;
+
+/*!
+  \brief Alias the memories of intermediate buffers of a multi-stage pipeline
+
+  The buffers must be declared on a device which defers the memory allocation.
+  The lifetime of a buffer is the range from the first stage to the last stage
+  which use it. Buffers whose lifetimes don't overlap are placed at
+  overlapping offsets of a shared memory block, so the memory usage of the
+  pipeline becomes the maximum live set instead of the sum of the buffers.
+
+  The buffers stay deferred until plan() binds them. A buffer which is
+  destroyed or used before plan() is dropped from the plan.
+  */
+class TransientBufferPlanner
+{
+ public:
+  //! Create a planner
+  TransientBufferPlanner(VulkanDevice* device) noexcept;
+
+
+  //! Add a transient buffer and return the ID of the buffer
+  template <typename Type>
+  std::size_t addBuffer(VulkanBuffer<Type>* buffer) noexcept;
+
+  //! Add a stage which reads the inputs and writes the outputs
+  std::size_t addStage(const std::vector<std::size_t>& inputs,
+                       const std::vector<std::size_t>& outputs);
+
+  //! Clear the buffers and the stages
+  void clear() noexcept;
+
+  //! Check if the buffer is bound to a shared memory by plan()
+  bool isAliased(const std::size_t buffer_id) const noexcept;
+
+  //! Return the memory usage of the planned buffers
+  std::size_t memoryUsage() const noexcept;
+
+  //! Return the number of buffers
+  std::size_t numOfBuffers() const noexcept;
+
+  //! Return the number of stages
+  std::size_t numOfStages() const noexcept;
+
+  //! Return the offset of the buffer in the shared memory
+  std::size_t offset(const std::size_t buffer_id) const noexcept;
+
+  //! Return the memory block which the buffer is bound to
+  VmaAllocation memory(const std::size_t buffer_id) const noexcept;
+
+  //! Compute the buffer placement and bind the buffers to shared memories
+  void plan() noexcept;
+
+  //! Return the memory usage if the buffers are not aliased
+  std::size_t unaliasedMemoryUsage() const noexcept;
+
+ private:
+  //! A transient buffer
+  struct TransientBuffer
+  {
+    const vk::Buffer* buffer_; //!< Identifies the buffer, never dereferenced
+    vk::Buffer handle_; //!< Null if the buffer isn't aliased
+    VmaAllocation memory_;
+    vk::MemoryRequirements requirements_;
+    BufferUsage usage_;
+    std::size_t first_stage_;
+    std::size_t last_stage_;
+    std::size_t offset_;
+  };
+
+
+  //! Check if the buffer is waiting for the placement
+  bool isPending(const TransientBuffer& transient) const noexcept;
+
+  //! Place the buffers and return the size of the memory block
+  std::size_t placeBuffers(std::vector<TransientBuffer*> target_list) noexcept;
+
+  //! Update the lifetime of the buffer
+  void updateLifetime(const std::size_t buffer_id,
+                      const std::size_t stage) noexcept;
+
+
+  VulkanDevice* device_;
+  std::vector<TransientBuffer> buffer_list_;
+  std::size_t num_of_stages_ = 0;
+  std::size_t memory_usage_ = 0;
+};
+
+} // namespace clspvtest
+
+#include "transient_buffer_planner-inl.hpp"
+
+#endif // CLSPV_TEST_TRANSIENT_BUFFER_PLANNER_HPP
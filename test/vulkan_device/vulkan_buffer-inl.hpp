@@ -12,13 +12,20 @@
 
 #include "vulkan_buffer.hpp"
 // Standard C++ library
+#include <array>
 #include <cstddef>
+#include <cstring>
+#include <limits>
 // Vulkan
 #include <vulkan/vulkan.hpp>
 #include "vk_mem_alloc.h"
 // ClspvTest
 #include "config.hpp"
 #include "vulkan_device.hpp"
+#include "vulkan_metrics.hpp"
+#include "vulkan_profiler.hpp"
+#include "vulkan_recorder.hpp"
+#include "vulkan_tracer.hpp"
 
 namespace clspvtest {
 
@@ -44,12 +51,35 @@ VulkanBuffer<T>::VulkanBuffer(const VulkanDevice* device,
   setSize(size);
 }
 
+/*!
+  \details
+  The buffer must be created with the same usage and size as the exported
+  buffer on the same physical device. The descriptor is consumed only if the
+  import succeeds, which can be checked with isExternal().
+  */
+template <typename T> inline
+VulkanBuffer<T>::VulkanBuffer(const VulkanDevice* device,
+                              const BufferUsage usage_flag,
+                              const std::size_t size,
+                              const int fd) :
+    VulkanBuffer(device, usage_flag)
+{
+  size_ = size;
+  auto d = const_cast<VulkanDevice*>(device_);
+  d->allocateExternal(size, fd, this);
+}
+
 /*!
   */
 template <typename T> inline
 VulkanBuffer<T>::~VulkanBuffer() noexcept
 {
   destroy();
+  if (command_pool_) {
+    device_->device().destroyCommandPool(command_pool_);
+    command_pool_ = nullptr;
+    copy_command_ = nullptr;
+  }
 }
 
 /*!
@@ -93,19 +123,26 @@ void VulkanBuffer<T>::copyTo(VulkanBuffer* dst,
                              const std::size_t dst_offset,
                              const uint32b queue_index) const noexcept
 {
-  const std::size_t s = sizeof(Type) * count;
-  const std::size_t src_offset_size = sizeof(Type) * src_offset;
-  const std::size_t dst_offset_size = sizeof(Type) * dst_offset;
-  const vk::BufferCopy copy_info{src_offset_size, dst_offset_size, s};
-
-  vk::CommandBufferBeginInfo begin_info{};
-  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-  copy_command_.begin(begin_info);
-
-  copy_command_.copyBuffer(buffer(), dst->buffer(), 1, &copy_info);
+  copyTo(dst, count, src_offset, dst_offset, queue_index, vk::Fence{});
+}
 
-  copy_command_.end();
-  device_->submit(QueueType::kTransfer, queue_index, copy_command_);
+/*!
+  \details
+  The fence is signaled when the copy is completed, so the completion can be
+  observed without waiting for the all submissions of the queue.
+  If a profiler is attached to the device, the copy is measured as "copyTo".
+  */
+template <typename T> inline
+void VulkanBuffer<T>::copyTo(VulkanBuffer* dst,
+                             const std::size_t count,
+                             const std::size_t src_offset,
+                             const std::size_t dst_offset,
+                             const uint32b queue_index,
+                             const vk::Fence& fence) const noexcept
+{
+  if (auto recorder = device_->recorder())
+    recorder->copyBuffer(*this, *dst, count, src_offset, dst_offset, queue_index);
+  submitCopy(dst, count, src_offset, dst_offset, queue_index, fence);
 }
 
 /*!
@@ -114,16 +151,65 @@ template <typename T> inline
 void VulkanBuffer<T>::destroy() noexcept
 {
   if (buffer_) {
+    if (auto recorder = device_->recorder())
+      recorder->destroyBuffer(*this);
+    destroyOwnershipObjects();
     auto d = const_cast<VulkanDevice*>(device_);
     d->deallocate(this);
   }
 }
 
+/*!
+  \details
+  The caller owns the returned descriptor, -1 is returned if the buffer isn't
+  exportable. The memory isn't synchronized between the processes, so the
+  commands which write the buffer must be completed before the handoff.
+  */
+template <typename T> inline
+int VulkanBuffer<T>::exportMemory() const noexcept
+{
+  const int fd = device_->exportMemory(*this);
+  return fd;
+}
+
+/*!
+  */
+template <typename T> inline
+vk::DeviceMemory& VulkanBuffer<T>::externalMemory() noexcept
+{
+  return external_memory_;
+}
+
+/*!
+  */
+template <typename T> inline
+const vk::DeviceMemory& VulkanBuffer<T>::externalMemory() const noexcept
+{
+  return external_memory_;
+}
+
+/*!
+  */
+template <typename T> inline
+bool VulkanBuffer<T>::hasOwner() const noexcept
+{
+  return has_owner_;
+}
+
+/*!
+  */
+template <typename T> inline
+bool VulkanBuffer<T>::isConcurrent() const noexcept
+{
+  return is_concurrent_;
+}
+
 /*!
   */
 template <typename T> inline
 bool VulkanBuffer<T>::isDeviceMemory() const noexcept
 {
+  prepareMemory();
   const auto& info = device_->physicalDeviceInfo();
   const auto& memory_property = info.memoryProperties().properties1_;
   const uint32b index = allocationInfo().memoryType;
@@ -133,6 +219,23 @@ bool VulkanBuffer<T>::isDeviceMemory() const noexcept
   return result;
 }
 
+/*!
+  */
+template <typename T> inline
+bool VulkanBuffer<T>::isExportable() const noexcept
+{
+  return is_exportable_;
+}
+
+/*!
+  */
+template <typename T> inline
+bool VulkanBuffer<T>::isExternal() const noexcept
+{
+  const bool result = static_cast<bool>(external_memory_);
+  return result;
+}
+
 /*!
   */
 template <typename T> inline
@@ -147,6 +250,7 @@ bool VulkanBuffer<T>::isHostMemory() const noexcept
 template <typename T> inline
 bool VulkanBuffer<T>::isHostVisible() const noexcept
 {
+  prepareMemory();
   const auto& info = device_->physicalDeviceInfo();
   const auto& memory_property = info.memoryProperties().properties1_;
   const uint32b index = allocationInfo().memoryType;
@@ -194,6 +298,33 @@ const VmaAllocation& VulkanBuffer<T>::memory() const noexcept
   return memory_;
 }
 
+/*!
+  */
+template <typename T> inline
+std::size_t& VulkanBuffer<T>::memoryOffset() noexcept
+{
+  return memory_offset_;
+}
+
+/*!
+  */
+template <typename T> inline
+const std::size_t& VulkanBuffer<T>::memoryOffset() const noexcept
+{
+  return memory_offset_;
+}
+
+/*!
+  \details
+  0 means that the buffer isn't restricted, the memory type is selected by
+  the usage.
+  */
+template <typename T> inline
+uint32b VulkanBuffer<T>::memoryTypeBits() const noexcept
+{
+  return memory_type_bits_;
+}
+
 /*!
   */
 template <typename T> inline
@@ -203,6 +334,22 @@ std::size_t VulkanBuffer<T>::memoryUsage() const noexcept
   return memory_usage;
 }
 
+/*!
+  */
+template <typename T> inline
+QueueType VulkanBuffer<T>::owner() const noexcept
+{
+  return owner_;
+}
+
+/*!
+  */
+template <typename T> inline
+uint32b VulkanBuffer<T>::ownerQueueIndex() const noexcept
+{
+  return owner_queue_index_;
+}
+
 /*!
   */
 template <typename T> inline
@@ -211,29 +358,98 @@ void VulkanBuffer<T>::read(Pointer data,
                            const std::size_t offset,
                            const uint32b queue_index) const noexcept
 {
+  const TraceSpan span{device_->tracer(), TraceCategory::kTransfer, "read"};
+  const std::size_t s = sizeof(Type) * count;
+  auto metrics = device_->metrics();
+  if (metrics != nullptr) {
+    metrics->add(MetricCounter::kDownloadedBytes, s);
+    metrics->observe(MetricHistogram::kTransferSize, s);
+  }
   if (isHostVisible()) {
     auto src = this->mapMemory();
-    const std::size_t s = sizeof(Type) * count;
     std::memcpy(data, src.data() + offset, s);
   }
   else {
     VulkanBuffer dst{device_, BufferUsage::kHostOnly};
     dst.setSize(count);
-    copyTo(&dst, count, offset, 0, queue_index);
-    device_->waitForCompletion(QueueType::kTransfer, queue_index);
-    dst.read(data, count, 0, queue_index);
+    if (metrics != nullptr)
+      metrics->add(MetricCounter::kStagingAllocations);
+    const uint32b index = selectTransferQueueIndex(&dst, queue_index);
+    submitCopy(&dst, count, offset, 0, index, vk::Fence{});
+    device_->waitForCompletion(QueueType::kTransfer, index);
+    auto src = dst.mapMemory();
+    std::memcpy(data, src.data(), s);
   }
+  if (auto recorder = device_->recorder())
+    recorder->readBuffer(*this, data, count, offset);
+}
+
+/*!
+  \details
+  A concurrent buffer can be accessed from both the compute queues and the
+  transfer queues without ownership transfers, but the access can be slower.
+  It takes effect from the next allocation.
+  */
+template <typename T> inline
+void VulkanBuffer<T>::setConcurrent(const bool is_concurrent) noexcept
+{
+  is_concurrent_ = is_concurrent;
+}
+
+/*!
+  \details
+  An exportable buffer has its own dedicated memory, it isn't packed with
+  other buffers even if the allocation is deferred. It takes effect from the
+  next allocation.
+  */
+template <typename T> inline
+void VulkanBuffer<T>::setExportable(const bool is_exportable) noexcept
+{
+  is_exportable_ = is_exportable;
+}
+
+/*!
+  \details
+  Each bit corresponds to an index of the memory types of the physical
+  device. A restricted buffer is allocated immediately in one of the given
+  types regardless of the usage, so it can be used to compare the memory
+  types. It takes effect from the next allocation.
+  */
+template <typename T> inline
+void VulkanBuffer<T>::setMemoryTypeBits(const uint32b memory_type_bits) noexcept
+{
+  memory_type_bits_ = memory_type_bits;
 }
 
 /*!
+  \details
+  This is used when the ownership is transferred by commands which are
+  recorded outside of the buffer.
   */
 template <typename T> inline
-void VulkanBuffer<T>::setSize(const std::size_t size) noexcept
+void VulkanBuffer<T>::setOwner(const QueueType queue_type,
+                               const uint32b queue_index) noexcept
+{
+  owner_ = queue_type;
+  owner_queue_index_ = queue_index;
+  has_owner_ = true;
+}
+
+/*!
+  \details
+  Returns false if the buffer can't be allocated.
+  */
+template <typename T> inline
+bool VulkanBuffer<T>::setSize(const std::size_t size) noexcept
 {
   destroy();
   size_ = size;
   auto d = const_cast<VulkanDevice*>(device_);
-  d->allocate(size, this);
+  if (isExportable()) {
+    d->allocateExternal(size, -1, this);
+    return isExternal();
+  }
+  return d->allocate(size, this);
 }
 
 /*!
@@ -244,6 +460,69 @@ std::size_t VulkanBuffer<T>::size() const noexcept
   return size_;
 }
 
+/*!
+  \details
+  If the buffer is owned by the other queue family, a release command is
+  submitted to the owner queue and an acquire barrier is recorded into the
+  given command. The returned semaphore is signaled by the release command,
+  the given command must be submitted with waiting it.
+  Returns a null semaphore if no ownership transfer is required.
+  */
+template <typename T> inline
+vk::Semaphore VulkanBuffer<T>::transferOwnership(
+    const QueueType queue_type,
+    const uint32b queue_index,
+    const vk::CommandBuffer& command) const noexcept
+{
+  vk::Semaphore semaphore;
+  const bool is_transfer_required = !isConcurrent() &&
+                                    !device_->isQueueFamilyShared() &&
+                                    has_owner_ &&
+                                    (owner_ != queue_type);
+  if (is_transfer_required) {
+    const auto& device = device_->device();
+    const std::size_t index = static_cast<std::size_t>(owner_);
+    auto& release_command = release_command_list_[index];
+    auto& release_fence = release_fence_list_[index];
+    auto& release_semaphore = release_semaphore_list_[index];
+    if (!release_command) {
+      release_command_pool_list_[index] = device_->createCommandPool(owner_);
+      const vk::CommandBufferAllocateInfo alloc_info{
+          release_command_pool_list_[index],
+          vk::CommandBufferLevel::ePrimary,
+          1};
+      device.allocateCommandBuffers(&alloc_info, &release_command);
+      const vk::FenceCreateInfo fence_info{vk::FenceCreateFlagBits::eSignaled};
+      device.createFence(&fence_info, nullptr, &release_fence);
+      const vk::SemaphoreCreateInfo semaphore_info{};
+      device.createSemaphore(&semaphore_info, nullptr, &release_semaphore);
+    }
+    // The previous release must be completed before re-recording
+    constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+    device.waitForFences(1, &release_fence, VK_TRUE, timeout);
+    device.resetFences(1, &release_fence);
+
+    vk::CommandBufferBeginInfo begin_info{};
+    begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+    release_command.begin(begin_info);
+    device_->releaseOwnership(buffer_, owner_, queue_type, release_command);
+    release_command.end();
+    device_->submit(owner_,
+                    owner_queue_index_,
+                    release_command,
+                    nullptr,
+                    release_semaphore,
+                    release_fence);
+
+    device_->acquireOwnership(buffer_, owner_, queue_type, command);
+    semaphore = release_semaphore;
+  }
+  owner_ = queue_type;
+  owner_queue_index_ = queue_index;
+  has_owner_ = true;
+  return semaphore;
+}
+
 /*!
   */
 template <typename T> inline
@@ -260,29 +539,98 @@ void VulkanBuffer<T>::write(ConstPointer data,
                             const std::size_t offset,
                             const uint32b queue_index) noexcept
 {
+  const TraceSpan span{device_->tracer(), TraceCategory::kTransfer, "write"};
+  if (auto recorder = device_->recorder())
+    recorder->writeBuffer(*this, data, count, offset);
+  const std::size_t s = sizeof(Type) * count;
+  auto metrics = device_->metrics();
+  if (metrics != nullptr) {
+    metrics->add(MetricCounter::kUploadedBytes, s);
+    metrics->observe(MetricHistogram::kTransferSize, s);
+  }
   if (isHostVisible()) {
     auto dst = this->mapMemory();
-    const std::size_t s = sizeof(Type) * count;
     std::memcpy(dst.data() + offset, data, s);
   }
   else {
     VulkanBuffer src{device_, BufferUsage::kHostOnly};
     src.setSize(count);
-    src.write(data, count, 0, queue_index);
-    src.copyTo(this, count, 0, offset, queue_index);
-    device_->waitForCompletion(QueueType::kTransfer, queue_index);
+    if (metrics != nullptr)
+      metrics->add(MetricCounter::kStagingAllocations);
+    const uint32b index = selectTransferQueueIndex(&src, queue_index);
+    {
+      auto dst = src.mapMemory();
+      std::memcpy(dst.data(), data, s);
+    }
+    src.submitCopy(this, count, 0, offset, index, vk::Fence{});
+    device_->waitForCompletion(QueueType::kTransfer, index);
+  }
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanBuffer<T>::destroyOwnershipObjects() noexcept
+{
+  const auto& device = device_->device();
+  for (std::size_t i = 0; i < release_command_list_.size(); ++i) {
+    if (release_fence_list_[i]) {
+      constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+      device.waitForFences(1, &release_fence_list_[i], VK_TRUE, timeout);
+      device.destroyFence(release_fence_list_[i]);
+      release_fence_list_[i] = nullptr;
+    }
+    if (release_semaphore_list_[i]) {
+      device.destroySemaphore(release_semaphore_list_[i]);
+      release_semaphore_list_[i] = nullptr;
+    }
+    if (release_command_pool_list_[i]) {
+      device.destroyCommandPool(release_command_pool_list_[i]);
+      release_command_pool_list_[i] = nullptr;
+      release_command_list_[i] = nullptr;
+    }
   }
+  has_owner_ = false;
 }
 
 /*!
+  \details
+  For 'kAnyQueue', the transfer queue which used this or the other buffer
+  last is preferred, so the transfer is ordered after the previous one.
+  Otherwise the least loaded transfer queue is selected.
+  */
+template <typename T> inline
+uint32b VulkanBuffer<T>::selectTransferQueueIndex(
+    const VulkanBuffer* other,
+    const uint32b queue_index) const noexcept
+{
+  uint32b index = queue_index;
+  if (index == kAnyQueue) {
+    const std::array<const VulkanBuffer*, 2> buffer_list{{this, other}};
+    for (const VulkanBuffer* buffer : buffer_list) {
+      if (buffer->hasOwner() && (buffer->owner() == QueueType::kTransfer)) {
+        index = buffer->ownerQueueIndex();
+        break;
+      }
+    }
+  }
+  index = device_->selectQueueIndex(QueueType::kTransfer, index);
+  return index;
+}
+
+/*!
+  \details
+  The buffer owns the pools of its command buffers, so the buffer can be used
+  from any thread as long as it isn't used by multiple threads at once.
   */
 template <typename T> inline
 void VulkanBuffer<T>::initialize()
 {
   alloc_info_.size = 0;
   // Initialize a copy command
+  command_pool_ = device_->createCommandPool(QueueType::kTransfer);
   const vk::CommandBufferAllocateInfo alloc_info{
-      device_->commandPool(QueueType::kTransfer),
+      command_pool_,
       vk::CommandBufferLevel::ePrimary,
       1};
   auto copy_commands = device_->device().allocateCommandBuffers(alloc_info);
@@ -290,22 +638,103 @@ void VulkanBuffer<T>::initialize()
 }
 
 /*!
+  \details
+  Returns null if the buffer has no memory, e.g. the allocation failed.
   */
 template <typename T> inline
 auto VulkanBuffer<T>::mappedMemory() const noexcept -> Pointer
 {
+  prepareMemory();
   void* d = nullptr;
-  const auto result = vmaMapMemory(device_->memoryAllocator(), memory_, &d);
-  (void)result;
+  if (isExternal()) {
+    const auto& device = device_->device();
+    const auto result = device.mapMemory(external_memory_, 0, VK_WHOLE_SIZE,
+                                         vk::MemoryMapFlags{}, &d);
+    (void)result;
+  }
+  else if (memory_ != VK_NULL_HANDLE) {
+    const auto result = vmaMapMemory(device_->memoryAllocator(), memory_, &d);
+    (void)result;
+  }
+  // The memory block can be shared with other buffers
+  if (d != nullptr)
+    d = static_cast<uint8b*>(d) + memory_offset_;
   return static_cast<Pointer>(d);
 }
 
+/*!
+  */
+template <typename T> inline
+void VulkanBuffer<T>::prepareMemory() const noexcept
+{
+  if (buffer_ && !isExternal() && (memory_ == VK_NULL_HANDLE)) {
+    auto d = const_cast<VulkanDevice*>(device_);
+    d->allocateDeferredBuffers();
+  }
+}
+
+/*!
+  \details
+  The staging copies of read() and write() call this directly, so they
+  aren't captured by a recorder.
+  */
+template <typename T> inline
+void VulkanBuffer<T>::submitCopy(VulkanBuffer* dst,
+                                 const std::size_t count,
+                                 const std::size_t src_offset,
+                                 const std::size_t dst_offset,
+                                 const uint32b queue_index,
+                                 const vk::Fence& fence) const noexcept
+{
+  const TraceSpan span{device_->tracer(), TraceCategory::kTransfer, "copyTo"};
+  const std::size_t s = sizeof(Type) * count;
+  const std::size_t src_offset_size = sizeof(Type) * src_offset;
+  const std::size_t dst_offset_size = sizeof(Type) * dst_offset;
+  const vk::BufferCopy copy_info{src_offset_size, dst_offset_size, s};
+
+  prepareMemory();
+  dst->prepareMemory();
+  const uint32b index = selectTransferQueueIndex(dst, queue_index);
+
+  vk::CommandBufferBeginInfo begin_info{};
+  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  copy_command_.begin(begin_info);
+
+  const std::array<vk::Semaphore, 2> semaphore_list{{
+      transferOwnership(QueueType::kTransfer, index, copy_command_),
+      dst->transferOwnership(QueueType::kTransfer, index, copy_command_)}};
+  auto profiler = device_->profiler();
+  const uint32b range_id = (profiler != nullptr)
+      ? profiler->begin(copy_command_, QueueType::kTransfer, "copyTo")
+      : VulkanProfiler::kInvalidRange;
+  copy_command_.copyBuffer(buffer(), dst->buffer(), 1, &copy_info);
+  if (profiler != nullptr)
+    profiler->end(copy_command_, range_id);
+
+  copy_command_.end();
+  std::array<vk::Semaphore, 2> wait_list;
+  uint32b num_of_waits = 0;
+  for (const auto& semaphore : semaphore_list) {
+    if (semaphore)
+      wait_list[num_of_waits++] = semaphore;
+  }
+  device_->submit(QueueType::kTransfer,
+                  index,
+                  copy_command_,
+                  vk::ArrayProxy<const vk::Semaphore>{num_of_waits, wait_list.data()},
+                  nullptr,
+                  fence);
+}
+
 /*!
   */
 template <typename T> inline
 void VulkanBuffer<T>::unmapMemory() const noexcept
 {
-  vmaUnmapMemory(device_->memoryAllocator(), memory_);
+  if (isExternal())
+    device_->device().unmapMemory(external_memory_);
+  else if (memory_ != VK_NULL_HANDLE)
+    vmaUnmapMemory(device_->memoryAllocator(), memory_);
 }
 
 } // namespace clspvtest
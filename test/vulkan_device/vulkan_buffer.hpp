@@ -11,6 +11,7 @@
 #define CLSPV_TEST_VULKAN_BUFFER_HPP
 
 // Standard C++ library
+#include <array>
 #include <cstddef>
 #include <memory>
 #include <type_traits>
@@ -25,6 +26,10 @@ namespace clspvtest {
 
 // Forward declaration
 class VulkanDevice;
+#if defined(CLSPV_TEST_COROUTINE_SUPPORTED)
+template <typename> class BufferAwaitable;
+class VulkanReactor;
+#endif // CLSPV_TEST_COROUTINE_SUPPORTED
 
 /*!
   */
@@ -48,6 +53,12 @@ class VulkanBuffer
                const BufferUsage usage_flag,
                const std::size_t size);
 
+  //! Create a buffer which wraps the memory exported by another process
+  VulkanBuffer(const VulkanDevice* device,
+               const BufferUsage usage_flag,
+               const std::size_t size,
+               const int fd);
+
   //! Destroy a buffer
   ~VulkanBuffer() noexcept;
 
@@ -71,12 +82,41 @@ class VulkanBuffer
               const std::size_t dst_offset,
               const uint32b queue_index) const noexcept;
 
+  //! Copy this buffer to a dst buffer and signal the fence on completion
+  void copyTo(VulkanBuffer* dst,
+              const std::size_t count,
+              const std::size_t src_offset,
+              const std::size_t dst_offset,
+              const uint32b queue_index,
+              const vk::Fence& fence) const noexcept;
+
   //! Destroy a buffer
   void destroy() noexcept;
 
+  //! Export the memory as a file descriptor which can be imported by another process
+  int exportMemory() const noexcept;
+
+  //! Return the memory which is exported or imported
+  vk::DeviceMemory& externalMemory() noexcept;
+
+  //! Return the memory which is exported or imported
+  const vk::DeviceMemory& externalMemory() const noexcept;
+
+  //! Check if the buffer has been used by a queue
+  bool hasOwner() const noexcept;
+
+  //! Check if the buffer is shared by the queue families concurrently
+  bool isConcurrent() const noexcept;
+
   //! Check if a buffer memory is on device
   bool isDeviceMemory() const noexcept;
 
+  //! Check if the memory of the buffer can be exported
+  bool isExportable() const noexcept;
+
+  //! Check if the buffer has an exported or imported memory
+  bool isExternal() const noexcept;
+
   //! Check if a buffer memory is on host
   bool isHostMemory() const noexcept;
 
@@ -95,21 +135,62 @@ class VulkanBuffer
   //! Return the memory allocation
   const VmaAllocation& memory() const noexcept;
 
+  //! Return the offset of the buffer in the memory allocation
+  std::size_t& memoryOffset() noexcept;
+
+  //! Return the offset of the buffer in the memory allocation
+  const std::size_t& memoryOffset() const noexcept;
+
+  //! Return the memory types which the buffer can be allocated in
+  uint32b memoryTypeBits() const noexcept;
+
   //! Return the memory usage
   std::size_t memoryUsage() const noexcept;
 
+  //! Return the queue type which owns the buffer
+  QueueType owner() const noexcept;
+
+  //! Return the index of the queue which owns the buffer
+  uint32b ownerQueueIndex() const noexcept;
+
   //! Read a data from a buffer
   void read(Pointer data,
             const std::size_t count,
             const std::size_t offset,
             const uint32b queue_index) const noexcept;
 
+#if defined(CLSPV_TEST_COROUTINE_SUPPORTED)
+  //! Read a data from a buffer asynchronously. Defined in vulkan_coroutine.hpp
+  BufferAwaitable<T> readAsync(VulkanReactor* reactor,
+                               Pointer data,
+                               const std::size_t count,
+                               const std::size_t offset,
+                               const uint32b queue_index) const;
+#endif // CLSPV_TEST_COROUTINE_SUPPORTED
+
+  //! Enable the concurrent access from the queue families
+  void setConcurrent(const bool is_concurrent) noexcept;
+
+  //! Allocate the memory which can be exported to another process
+  void setExportable(const bool is_exportable) noexcept;
+
+  //! Restrict the memory types which the buffer can be allocated in
+  void setMemoryTypeBits(const uint32b memory_type_bits) noexcept;
+
+  //! Set the queue which owns the buffer
+  void setOwner(const QueueType queue_type, const uint32b queue_index) noexcept;
+
   //! Set a size of a buffer
-  void setSize(const std::size_t size) noexcept;
+  bool setSize(const std::size_t size) noexcept;
 
   //! Return a size of a buffer
   std::size_t size() const noexcept;
 
+  //! Transfer the ownership of the buffer to the queue
+  vk::Semaphore transferOwnership(const QueueType queue_type,
+                                  const uint32b queue_index,
+                                  const vk::CommandBuffer& command) const noexcept;
+
   //! Return the usage flag
   BufferUsage usage() const noexcept;
 
@@ -119,28 +200,68 @@ class VulkanBuffer
              const std::size_t offset,
              const uint32b queue_index) noexcept;
 
+#if defined(CLSPV_TEST_COROUTINE_SUPPORTED)
+  //! Write a data to a buffer asynchronously. Defined in vulkan_coroutine.hpp
+  BufferAwaitable<T> writeAsync(VulkanReactor* reactor,
+                                ConstPointer data,
+                                const std::size_t count,
+                                const std::size_t offset,
+                                const uint32b queue_index);
+#endif // CLSPV_TEST_COROUTINE_SUPPORTED
+
  private:
   friend MappedMemory<Type>;
   friend MappedMemory<ConstType>;
 
 
+  //! Destroy the objects for ownership transfers
+  void destroyOwnershipObjects() noexcept;
+
   //! Initialize a buffer
   void initialize();
 
   //! Map a buffer memory to a host
   Pointer mappedMemory() const noexcept;
 
+  //! Allocate the memory if the allocation of the buffer is deferred
+  void prepareMemory() const noexcept;
+
+  //! Return the queue index for a transfer between this and the other buffer
+  uint32b selectTransferQueueIndex(const VulkanBuffer* other,
+                                   const uint32b queue_index) const noexcept;
+
+  //! Record a copy command and submit it
+  void submitCopy(VulkanBuffer* dst,
+                  const std::size_t count,
+                  const std::size_t src_offset,
+                  const std::size_t dst_offset,
+                  const uint32b queue_index,
+                  const vk::Fence& fence) const noexcept;
+
   //! Unmap a buffer memory
   void unmapMemory() const noexcept;
 
 
   const VulkanDevice* device_;
   vk::Buffer buffer_;
+  vk::CommandPool command_pool_;
   vk::CommandBuffer copy_command_;
+  mutable std::array<vk::CommandPool, 2> release_command_pool_list_;
+  mutable std::array<vk::CommandBuffer, 2> release_command_list_;
+  mutable std::array<vk::Semaphore, 2> release_semaphore_list_;
+  mutable std::array<vk::Fence, 2> release_fence_list_;
   VmaAllocation memory_ = VK_NULL_HANDLE;
+  vk::DeviceMemory external_memory_;
   VmaAllocationInfo alloc_info_;
   BufferUsage usage_flag_;
   std::size_t size_ = 0;
+  std::size_t memory_offset_ = 0;
+  uint32b memory_type_bits_ = 0;
+  mutable QueueType owner_ = QueueType::kCompute;
+  mutable uint32b owner_queue_index_ = 0;
+  mutable bool has_owner_ = false;
+  bool is_concurrent_ = false;
+  bool is_exportable_ = false;
 };
 
 // Type aliases
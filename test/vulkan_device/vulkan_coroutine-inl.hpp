@@ -0,0 +1,467 @@
+/*!
+  \file vulkan_coroutine-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_COROUTINE_INL_HPP
+#define CLSPV_TEST_VULKAN_COROUTINE_INL_HPP
+
+#include "vulkan_coroutine.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_device.hpp"
+#include "vulkan_kernel.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+inline
+bool VulkanReactor::FencePool::releaseFence(const vk::Fence& fence) noexcept
+{
+  std::unique_lock<std::mutex> lock{mutex_};
+  const bool is_alive = static_cast<bool>(device_);
+  if (is_alive)
+    free_fence_list_.push_back(fence);
+  return is_alive;
+}
+
+/*!
+  */
+inline
+VulkanReactor::VulkanReactor(const VulkanDevice* device) :
+    VulkanReactor(device, Executor{})
+{
+}
+
+/*!
+  \details
+  The executor is called on the reactor thread, so it should only schedule
+  the coroutine, e.g. push it to the queue of a thread pool.
+  */
+inline
+VulkanReactor::VulkanReactor(const VulkanDevice* device, Executor executor) :
+    device_{device},
+    executor_{std::move(executor)}
+{
+  initialize();
+}
+
+/*!
+  */
+inline
+VulkanReactor::~VulkanReactor() noexcept
+{
+  destroy();
+}
+
+/*!
+  */
+inline
+void VulkanReactor::destroy() noexcept
+{
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    is_running_ = false;
+  }
+  condition_.notify_one();
+  if (thread_.joinable())
+    thread_.join();
+
+  // The awaitables which are still alive destroy their fences by themselves
+  if (fence_pool_) {
+    std::unique_lock<std::mutex> lock{fence_pool_->mutex_};
+    for (const auto& fence : fence_pool_->free_fence_list_)
+      fence_pool_->device_.destroyFence(fence);
+    fence_pool_->free_fence_list_.clear();
+    fence_pool_->device_ = nullptr;
+  }
+  fence_pool_.reset();
+}
+
+/*!
+  */
+inline
+const VulkanDevice* VulkanReactor::device() const noexcept
+{
+  return device_;
+}
+
+/*!
+  \details
+  The fences are reused, call releaseFence() when the fence isn't needed.
+  */
+inline
+vk::Fence VulkanReactor::makeFence() noexcept
+{
+  const auto& device = device_->device();
+  vk::Fence fence;
+  {
+    std::unique_lock<std::mutex> lock{fence_pool_->mutex_};
+    auto& free_fence_list = fence_pool_->free_fence_list_;
+    if (!free_fence_list.empty()) {
+      fence = free_fence_list.back();
+      free_fence_list.pop_back();
+    }
+  }
+  if (fence) {
+    device.resetFences(1, &fence);
+  }
+  else {
+    const vk::FenceCreateInfo fence_info{};
+    const auto result = device.createFence(&fence_info, nullptr, &fence);
+    if (result != vk::Result::eSuccess) {
+      //! \todo Handle error
+    }
+  }
+  return fence;
+}
+
+/*!
+  */
+inline
+std::size_t VulkanReactor::numOfWaiters() const noexcept
+{
+  return num_of_waiters_.load();
+}
+
+/*!
+  */
+inline
+void VulkanReactor::releaseFence(const vk::Fence& fence) noexcept
+{
+  fence_pool_->releaseFence(fence);
+}
+
+/*!
+  \details
+  The coroutine can be resumed before this function returns, so the caller
+  must not touch the coroutine frame after calling this.
+  */
+inline
+void VulkanReactor::watch(const vk::Fence& fence,
+                          std::coroutine_handle<> handle)
+{
+  ++num_of_waiters_;
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    waiter_list_.push_back(Waiter{fence, handle});
+  }
+  condition_.notify_one();
+}
+
+/*!
+  */
+inline
+void VulkanReactor::initialize()
+{
+  fence_pool_ = std::make_shared<FencePool>();
+  fence_pool_->device_ = device_->device();
+  is_running_ = true;
+  thread_ = std::thread{&VulkanReactor::poll, this};
+}
+
+/*!
+  \details
+  The thread sleeps while no coroutine is suspended. Otherwise it blocks
+  until any of the fences is signaled, with a short timeout so that the
+  waiters which are added meanwhile are picked up.
+  */
+inline
+void VulkanReactor::poll() noexcept
+{
+  constexpr uint64b timeout = 1'000'000; // 1 ms in nanoseconds
+  const auto& device = device_->device();
+  std::vector<Waiter> polled_list;
+  std::vector<vk::Fence> fence_list;
+  std::vector<std::coroutine_handle<>> resumed_list;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      condition_.wait(lock, [this, &polled_list]()
+      {
+        return !is_running_ || !waiter_list_.empty() || !polled_list.empty();
+      });
+      polled_list.insert(polled_list.end(),
+                         waiter_list_.begin(),
+                         waiter_list_.end());
+      waiter_list_.clear();
+      // Finish after the all suspended coroutines are resumed
+      if (!is_running_ && polled_list.empty())
+        break;
+    }
+
+    fence_list.clear();
+    for (const auto& waiter : polled_list)
+      fence_list.push_back(waiter.fence_);
+    device.waitForFences(static_cast<uint32b>(fence_list.size()),
+                         fence_list.data(),
+                         VK_FALSE,
+                         timeout);
+
+    // Remove the completed waiters before resuming them
+    const auto completed = std::partition(
+        polled_list.begin(),
+        polled_list.end(),
+        [&device](const Waiter& waiter)
+        {
+          return device.getFenceStatus(waiter.fence_) != vk::Result::eSuccess;
+        });
+    resumed_list.clear();
+    for (auto waiter = completed; waiter != polled_list.end(); ++waiter)
+      resumed_list.push_back(waiter->handle_);
+    polled_list.erase(completed, polled_list.end());
+    num_of_waiters_ -= resumed_list.size();
+
+    for (auto handle : resumed_list)
+      resume(handle);
+  }
+}
+
+/*!
+  */
+inline
+void VulkanReactor::resume(std::coroutine_handle<> handle) noexcept
+{
+  if (executor_)
+    executor_(handle);
+  else
+    handle.resume();
+}
+
+/*!
+  */
+inline
+FenceAwaitable::FenceAwaitable(VulkanReactor* reactor,
+                               const vk::Fence& fence) noexcept :
+    reactor_{reactor},
+    fence_pool_{reactor->fence_pool_},
+    device_{reactor->device()->device()},
+    fence_{fence}
+{
+}
+
+/*!
+  */
+inline
+FenceAwaitable::FenceAwaitable(FenceAwaitable&& other) noexcept :
+    reactor_{other.reactor_},
+    fence_pool_{std::move(other.fence_pool_)},
+    device_{other.device_},
+    fence_{other.fence_}
+{
+  other.reactor_ = nullptr;
+  other.fence_pool_.reset();
+  other.device_ = nullptr;
+  other.fence_ = nullptr;
+}
+
+/*!
+  */
+inline
+FenceAwaitable::~FenceAwaitable() noexcept
+{
+  destroy();
+}
+
+/*!
+  */
+inline
+FenceAwaitable& FenceAwaitable::operator=(FenceAwaitable&& other) noexcept
+{
+  if (this != &other) {
+    destroy();
+    reactor_ = other.reactor_;
+    fence_pool_ = std::move(other.fence_pool_);
+    device_ = other.device_;
+    fence_ = other.fence_;
+    other.reactor_ = nullptr;
+    other.fence_pool_.reset();
+    other.device_ = nullptr;
+    other.fence_ = nullptr;
+  }
+  return *this;
+}
+
+/*!
+  */
+inline
+bool FenceAwaitable::await_ready() const noexcept
+{
+  if (!fence_)
+    return true;
+  return device_.getFenceStatus(fence_) == vk::Result::eSuccess;
+}
+
+/*!
+  */
+inline
+void FenceAwaitable::await_resume() const noexcept
+{
+}
+
+/*!
+  */
+inline
+void FenceAwaitable::await_suspend(std::coroutine_handle<> handle)
+{
+  reactor_->watch(fence_, handle);
+}
+
+/*!
+  \details
+  If the reactor is already destroyed, the fence is destroyed instead of
+  being returned to the reactor. The device must still be alive.
+  */
+inline
+void FenceAwaitable::destroy() noexcept
+{
+  if (fence_) {
+    constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+    device_.waitForFences(1, &fence_, VK_TRUE, timeout);
+    const auto fence_pool = fence_pool_.lock();
+    const bool is_released = fence_pool && fence_pool->releaseFence(fence_);
+    if (!is_released)
+      device_.destroyFence(fence_);
+    fence_ = nullptr;
+  }
+  fence_pool_.reset();
+  device_ = nullptr;
+  reactor_ = nullptr;
+}
+
+/*!
+  */
+inline
+const vk::Fence& FenceAwaitable::fence() const noexcept
+{
+  return fence_;
+}
+
+/*!
+  */
+template <typename T> inline
+BufferAwaitable<T>::BufferAwaitable(VulkanReactor* reactor,
+                                    const vk::Fence& fence,
+                                    UniqueBuffer<T>&& staging,
+                                    Pointer data,
+                                    const std::size_t count) noexcept :
+    FenceAwaitable(reactor, fence),
+    staging_{std::move(staging)},
+    data_{data},
+    count_{count}
+{
+}
+
+/*!
+  \details
+  The fence is waited before the staging buffer is destroyed.
+  */
+template <typename T> inline
+BufferAwaitable<T>::~BufferAwaitable() noexcept
+{
+  FenceAwaitable::destroy();
+}
+
+/*!
+  */
+template <typename T> inline
+void BufferAwaitable<T>::await_resume() const noexcept
+{
+  if (staging_ && (data_ != nullptr))
+    staging_->read(data_, count_, 0, 0);
+}
+
+/*!
+  \details
+  If the buffer is host visible, the data is read immediately and the
+  returned awaitable is ready. The buffer must not be accessed until the
+  awaitable is resumed.
+  */
+template <typename T> inline
+BufferAwaitable<T> VulkanBuffer<T>::readAsync(
+    VulkanReactor* reactor,
+    Pointer data,
+    const std::size_t count,
+    const std::size_t offset,
+    const uint32b queue_index) const
+{
+  if (isHostVisible()) {
+    read(data, count, offset, queue_index);
+    return BufferAwaitable<T>{};
+  }
+  auto staging = std::make_unique<VulkanBuffer>(device_,
+                                                BufferUsage::kHostOnly,
+                                                count);
+  const uint32b index = selectTransferQueueIndex(staging.get(), queue_index);
+  const vk::Fence fence = reactor->makeFence();
+  copyTo(staging.get(), count, offset, 0, index, fence);
+  return BufferAwaitable<T>{reactor, fence, std::move(staging), data, count};
+}
+
+/*!
+  \details
+  The data is copied to a staging buffer before this function returns, so
+  the data can be released immediately.
+  */
+template <typename T> inline
+BufferAwaitable<T> VulkanBuffer<T>::writeAsync(
+    VulkanReactor* reactor,
+    ConstPointer data,
+    const std::size_t count,
+    const std::size_t offset,
+    const uint32b queue_index)
+{
+  if (isHostVisible()) {
+    write(data, count, offset, queue_index);
+    return BufferAwaitable<T>{};
+  }
+  auto staging = std::make_unique<VulkanBuffer>(device_,
+                                                BufferUsage::kHostOnly,
+                                                count);
+  const uint32b index = selectTransferQueueIndex(staging.get(), queue_index);
+  staging->write(data, count, 0, index);
+  const vk::Fence fence = reactor->makeFence();
+  staging->copyTo(this, count, 0, offset, index, fence);
+  return BufferAwaitable<T>{reactor, fence, std::move(staging), nullptr, 0};
+}
+
+/*!
+  \details
+  The kernel and the buffers must not be used until the awaitable is
+  resumed, since the command buffer of the kernel is in use.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+FenceAwaitable VulkanKernel<kDimension, ArgumentTypes...>::runAsync(
+    VulkanReactor* reactor,
+    BufferRef<ArgumentTypes>... args,
+    const std::array<uint32b, kDimension> works,
+    const uint32b queue_index)
+{
+  const vk::Fence fence = reactor->makeFence();
+  run(args..., works, queue_index, fence);
+  return FenceAwaitable{reactor, fence};
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_COROUTINE_INL_HPP
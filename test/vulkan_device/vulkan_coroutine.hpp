@@ -0,0 +1,235 @@
+/*!
+  \file vulkan_coroutine.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_COROUTINE_HPP
+#define CLSPV_TEST_VULKAN_COROUTINE_HPP
+
+// ClspvTest
+#include "config.hpp"
+
+#if defined(CLSPV_TEST_COROUTINE_SUPPORTED)
+
+// Standard C++ library
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "vulkan_buffer.hpp"
+#include "vulkan_kernel.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+class FenceAwaitable;
+class VulkanDevice;
+
+/*!
+  \brief Resume coroutines when the fences which they wait for are signaled
+
+  A reactor has a thread which polls the fences of the suspended coroutines,
+  so a coroutine which waits for a GPU job doesn't occupy a thread. The
+  resumed coroutines are passed to the executor, or resumed on the reactor
+  thread if no executor is given.
+
+  The reactor must outlive the coroutines which are suspended with it. When
+  a reactor is destroyed, it waits until the all suspended coroutines are
+  resumed. An awaitable which isn't awaited can outlive the reactor, then
+  its fence is destroyed instead of being returned.
+  */
+class VulkanReactor
+{
+ public:
+  //! Resume a coroutine on a host executor
+  using Executor = std::function<void (std::coroutine_handle<>)>;
+
+
+  //! Create a reactor which resumes coroutines on the reactor thread
+  VulkanReactor(const VulkanDevice* device);
+
+  //! Create a reactor which resumes coroutines with the executor
+  VulkanReactor(const VulkanDevice* device, Executor executor);
+
+  //! Destroy a reactor
+  ~VulkanReactor() noexcept;
+
+
+  //! Destroy a reactor
+  void destroy() noexcept;
+
+  //! Return an assigned device
+  const VulkanDevice* device() const noexcept;
+
+  //! Return an unsignaled fence
+  vk::Fence makeFence() noexcept;
+
+  //! Return the number of the suspended coroutines
+  std::size_t numOfWaiters() const noexcept;
+
+  //! Return a fence which is made by makeFence()
+  void releaseFence(const vk::Fence& fence) noexcept;
+
+  //! Resume the coroutine when the fence is signaled
+  void watch(const vk::Fence& fence, std::coroutine_handle<> handle);
+
+ private:
+  friend FenceAwaitable;
+
+
+  //! The free fences which are shared with the awaitables
+  struct FencePool
+  {
+    //! Return a fence to the pool. Returns false if the reactor is destroyed
+    bool releaseFence(const vk::Fence& fence) noexcept;
+
+    std::mutex mutex_;
+    std::vector<vk::Fence> free_fence_list_;
+    vk::Device device_; //!< Null after the reactor is destroyed
+  };
+
+  //! A suspended coroutine
+  struct Waiter
+  {
+    vk::Fence fence_;
+    std::coroutine_handle<> handle_;
+  };
+
+
+  //! Initialize a reactor
+  void initialize();
+
+  //! Poll the fences until the reactor is destroyed
+  void poll() noexcept;
+
+  //! Resume the coroutine
+  void resume(std::coroutine_handle<> handle) noexcept;
+
+
+  const VulkanDevice* device_;
+  Executor executor_;
+  std::vector<Waiter> waiter_list_; //!< The waiters which aren't polled yet
+  std::shared_ptr<FencePool> fence_pool_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::atomic<std::size_t> num_of_waiters_{0};
+  bool is_running_ = false;
+};
+
+/*!
+  \brief Suspend a coroutine until a fence is signaled
+
+  If an awaitable is destroyed without being awaited, the destructor waits
+  for the fence, so the resources of the job are never released while the
+  device uses them. The awaitable only holds a weak reference to the fences
+  of the reactor, so it can be destroyed after the reactor.
+  */
+class FenceAwaitable
+{
+ public:
+  //! Create an awaitable which is ready
+  FenceAwaitable() noexcept = default;
+
+  //! Create an awaitable which waits for the fence made by the reactor
+  FenceAwaitable(VulkanReactor* reactor, const vk::Fence& fence) noexcept;
+
+  //! Move an awaitable
+  FenceAwaitable(FenceAwaitable&& other) noexcept;
+
+  //! Destroy an awaitable
+  ~FenceAwaitable() noexcept;
+
+
+  //! Move an awaitable
+  FenceAwaitable& operator=(FenceAwaitable&& other) noexcept;
+
+
+  //! Check if the fence is already signaled
+  bool await_ready() const noexcept;
+
+  //! Do nothing
+  void await_resume() const noexcept;
+
+  //! Resume the coroutine by the reactor when the fence is signaled
+  void await_suspend(std::coroutine_handle<> handle);
+
+  //! Wait for the fence and return it to the reactor
+  void destroy() noexcept;
+
+  //! Return the fence
+  const vk::Fence& fence() const noexcept;
+
+ private:
+  VulkanReactor* reactor_ = nullptr;
+  std::weak_ptr<VulkanReactor::FencePool> fence_pool_;
+  vk::Device device_;
+  vk::Fence fence_;
+};
+
+/*!
+  \brief Suspend a coroutine until a buffer transfer is completed
+
+  A transfer between a device local buffer and the host goes through a
+  staging buffer, which is kept alive until the transfer is completed. For
+  a read, the data is copied from the staging buffer on resumption.
+  */
+template <typename T>
+class BufferAwaitable : public FenceAwaitable
+{
+ public:
+  using Pointer = typename VulkanBuffer<T>::Pointer;
+
+
+  //! Create an awaitable which is ready
+  BufferAwaitable() noexcept = default;
+
+  //! Create an awaitable which waits for the transfer with the staging buffer
+  BufferAwaitable(VulkanReactor* reactor,
+                  const vk::Fence& fence,
+                  UniqueBuffer<T>&& staging,
+                  Pointer data,
+                  const std::size_t count) noexcept;
+
+  //! Move an awaitable
+  BufferAwaitable(BufferAwaitable&& other) noexcept = default;
+
+  //! Destroy an awaitable
+  ~BufferAwaitable() noexcept;
+
+
+  //! Move an awaitable
+  BufferAwaitable& operator=(BufferAwaitable&& other) noexcept = default;
+
+
+  //! Copy the read data from the staging buffer
+  void await_resume() const noexcept;
+
+ private:
+  UniqueBuffer<T> staging_;
+  Pointer data_ = nullptr; //!< Null for a write
+  std::size_t count_ = 0;
+};
+
+// Type aliases
+using UniqueReactor = std::unique_ptr<VulkanReactor>;
+
+} // namespace clspvtest
+
+#include "vulkan_coroutine-inl.hpp"
+
+#endif // CLSPV_TEST_COROUTINE_SUPPORTED
+
+#endif // CLSPV_TEST_VULKAN_COROUTINE_HPP
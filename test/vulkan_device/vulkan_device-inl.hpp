@@ -13,16 +13,22 @@
 #include "vulkan_device.hpp"
 // Standard C++ library
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstring>
 #include <cstdio>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 // Vulkan
@@ -32,9 +38,45 @@
 #include "config.hpp"
 #include "device_options.hpp"
 #include "vulkan_buffer.hpp"
+#include "vulkan_device_selector.hpp"
+#include "vulkan_metrics.hpp"
+#include "vulkan_recorder.hpp"
+#include "vulkan_tracer.hpp"
 
 namespace clspvtest {
 
+/*!
+  \details
+  The command buffers which are allocated from the pools must be completed
+  before the thread exits.
+  */
+inline
+void VulkanDevice::CommandPoolRegistry::releaseThread(
+    const std::thread::id id) noexcept
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto ite = pool_list_.find(id);
+  if (ite == pool_list_.end())
+    return;
+  if (device_) {
+    for (auto& command_pool : ite->second)
+      device_.destroyCommandPool(command_pool);
+  }
+  pool_list_.erase(ite);
+}
+
+/*!
+  */
+inline
+VulkanDevice::CommandPoolReclaimer::~CommandPoolReclaimer() noexcept
+{
+  const auto id = std::this_thread::get_id();
+  for (auto& registry : registry_list_) {
+    if (auto r = registry.lock())
+      r->releaseThread(id);
+  }
+}
+
 /*!
   */
 inline
@@ -45,6 +87,22 @@ VulkanDevice::VulkanDevice(DeviceOptions& options) :
   initialize(options);
 }
 
+/*!
+  \details
+  The instance isn't destroyed with the device, it must outlive the device.
+  The same physical device can be used by multiple devices.
+  */
+inline
+VulkanDevice::VulkanDevice(const vk::Instance& instance,
+                           DeviceOptions& options) :
+    instance_{instance},
+    queue_family_index_ref_list_{{std::numeric_limits<uint32b>::max(),
+                                  std::numeric_limits<uint32b>::max()}},
+    owns_instance_{false}
+{
+  initialize(options);
+}
+
 /*!
   */
 inline
@@ -54,52 +112,71 @@ VulkanDevice::~VulkanDevice() noexcept
 }
 
 /*!
+  \details
+  The barrier must be recorded in a command which is submitted to a queue of
+  the dst family after the release command is submitted.
+  */
+inline
+void VulkanDevice::acquireOwnership(const vk::Buffer& buffer,
+                                    const QueueType src_queue_type,
+                                    const QueueType dst_queue_type,
+                                    const vk::CommandBuffer& command) const noexcept
+{
+  auto barrier = makeOwnershipBarrier(buffer, src_queue_type, dst_queue_type);
+  barrier.srcAccessMask = vk::AccessFlags{};
+  barrier.dstAccessMask = getQueueAccessFlags(dst_queue_type);
+  command.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                          getQueueStageFlags(dst_queue_type),
+                          vk::DependencyFlags{},
+                          0, nullptr,
+                          1, &barrier,
+                          0, nullptr);
+}
+
+/*!
+  \details
+  Returns false if the buffer can't be created, then the buffer is null.
   */
 template <typename Type> inline
-void VulkanDevice::allocate(const std::size_t size,
+bool VulkanDevice::allocate(const std::size_t size,
                             VulkanBuffer<Type>* buffer) noexcept
 {
+  const TraceSpan span{tracer(), TraceCategory::kMemory, "allocate"};
   auto& b = buffer->buffer();
   auto& memory = buffer->memory();
   auto& alloc_info = buffer->allocationInfo();
-
-  vk::BufferCreateInfo buffer_create_info;
-  buffer_create_info.size = sizeof(Type) * size;
-  buffer_create_info.usage = vk::BufferUsageFlagBits::eTransferSrc |
-                             vk::BufferUsageFlagBits::eTransferDst;
-  buffer_create_info.usage = buffer_create_info.usage | 
-                             vk::BufferUsageFlagBits::eStorageBuffer;
-  buffer_create_info.queueFamilyIndexCount =
-      static_cast<uint32b>(queue_family_index_list_.size());
-  buffer_create_info.pQueueFamilyIndices = queue_family_index_list_.data();
-
-  VmaAllocationCreateInfo alloc_create_info;
-  switch (buffer->usage()) {
-   case BufferUsage::kHostOnly: {
-    alloc_create_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
-    break;
-   }
-   case BufferUsage::kHostToDevice: {
-    alloc_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
-    break;
-   }
-   case BufferUsage::kDeviceToHost: {
-    alloc_create_info.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
-    break;
-   }
-   case BufferUsage::kDeviceOnly:
-   default: {
-    alloc_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-    break;
-   }
+  auto& memory_offset = buffer->memoryOffset();
+
+  const vk::BufferCreateInfo buffer_create_info =
+      makeBufferCreateInfo(sizeof(Type) * size, buffer->isConcurrent());
+
+  const uint32b memory_type_bits = buffer->memoryTypeBits();
+  if (deferredAllocation() && (memory_type_bits == 0)) {
+    // Create only a buffer object. The memory is bound on first use
+    const auto result = device_.createBuffer(&buffer_create_info, nullptr, &b);
+    if (result != vk::Result::eSuccess) {
+      b = nullptr;
+      return false;
+    }
+    memory = VK_NULL_HANDLE;
+    alloc_info.size = 0;
+    memory_offset = 0;
+    std::lock_guard<std::mutex> lock{memory_mutex_};
+    deferred_buffer_list_.emplace_back(DeferredBuffer{&b,
+                                                      &memory,
+                                                      &alloc_info,
+                                                      &memory_offset,
+                                                      buffer->usage()});
+    return true;
   }
-  alloc_create_info.flags = 0;
-  alloc_create_info.requiredFlags = 0;
-  alloc_create_info.preferredFlags = 0;
-  alloc_create_info.memoryTypeBits = 0;
-  alloc_create_info.pool = VK_NULL_HANDLE;
-  alloc_create_info.pUserData = nullptr;
 
+  VmaAllocationCreateInfo alloc_create_info =
+      makeAllocationCreateInfo(buffer->usage());
+  if (memory_type_bits != 0) {
+    // The usage mustn't add the required flags to the restricted types
+    alloc_create_info.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    alloc_create_info.memoryTypeBits = memory_type_bits;
+  }
   const auto result = vmaCreateBuffer(
       allocator_,
       &static_cast<const VkBufferCreateInfo&>(buffer_create_info),
@@ -107,9 +184,291 @@ void VulkanDevice::allocate(const std::size_t size,
       reinterpret_cast<VkBuffer*>(&b),
       &memory,
       &alloc_info);
-  //! \todo Handle error
+  memory_offset = 0;
   if (result != VK_SUCCESS) {
+    b = nullptr;
+    memory = VK_NULL_HANDLE;
+    alloc_info.size = 0;
+    return false;
+  }
+  if (metrics_ != nullptr)
+    metrics_->add(MetricCounter::kBufferCreations);
+  return true;
+}
+
+/*!
+  \details
+  The deferred buffers which have the same usage are packed into a shared
+  memory block, and then all buffers are bound to the blocks at once. The
+  memory mutex is held until the buffers are bound, so a deallocation of a
+  buffer waits for the binding.
+
+  If a block can't be allocated, each buffer of the block gets its own
+  memory. A buffer which still can't get a memory stays deferred and is
+  retried on the next use. Returns false if any buffer isn't bound.
+  */
+inline
+bool VulkanDevice::allocateDeferredBuffers() noexcept
+{
+  const TraceSpan span{tracer(), TraceCategory::kMemory, "allocateDeferredBuffers"};
+  std::lock_guard<std::mutex> lock{memory_mutex_};
+  if (deferred_buffer_list_.empty())
+    return true;
+  std::vector<DeferredBuffer> buffer_list = std::move(deferred_buffer_list_);
+  deferred_buffer_list_.clear();
+
+  const std::size_t n = buffer_list.size();
+  std::vector<vk::MemoryRequirements> requirements_list;
+  requirements_list.reserve(n);
+  for (const auto& deferred : buffer_list)
+    requirements_list.emplace_back(
+        device_.getBufferMemoryRequirements(*deferred.buffer_));
+
+  bool result = true;
+  std::vector<vk::BindBufferMemoryInfo> bind_info_list;
+  bind_info_list.reserve(n);
+  std::vector<std::size_t> bound_list;
+  bound_list.reserve(n);
+  std::vector<vk::DeviceSize> offset_list(n, 0);
+  std::vector<bool> is_packed(n, false);
+  std::vector<std::size_t> group;
+  group.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (is_packed[i])
+      continue;
+    // Pack the buffers into a memory block
+    const BufferUsage usage = buffer_list[i].usage_;
+    vk::MemoryRequirements block_requirements{0,
+                                              1,
+                                              requirements_list[i].memoryTypeBits};
+    group.clear();
+    for (std::size_t j = i; j < n; ++j) {
+      const auto& requirements = requirements_list[j];
+      const uint32b type_bits = block_requirements.memoryTypeBits &
+                                requirements.memoryTypeBits;
+      if (is_packed[j] || (buffer_list[j].usage_ != usage) || (type_bits == 0))
+        continue;
+      const vk::DeviceSize alignment = requirements.alignment;
+      const vk::DeviceSize offset =
+          ((block_requirements.size + alignment - 1) / alignment) * alignment;
+      offset_list[j] = offset;
+      block_requirements.size = offset + requirements.size;
+      block_requirements.alignment = (std::max)(block_requirements.alignment,
+                                                alignment);
+      block_requirements.memoryTypeBits = type_bits;
+      is_packed[j] = true;
+      group.emplace_back(j);
+    }
+    // Allocate a memory block
+    VmaAllocationInfo block_info{};
+    const VmaAllocation memory = createSharedMemory(block_requirements,
+                                                    usage,
+                                                    group.size(),
+                                                    &block_info);
+    if (memory != VK_NULL_HANDLE) {
+      for (const std::size_t j : group) {
+        const auto& deferred = buffer_list[j];
+        *deferred.memory_ = memory;
+        *deferred.alloc_info_ = block_info;
+        deferred.alloc_info_->offset = block_info.offset + offset_list[j];
+        deferred.alloc_info_->size = requirements_list[j].size;
+        *deferred.memory_offset_ = static_cast<std::size_t>(offset_list[j]);
+        bind_info_list.emplace_back(*deferred.buffer_,
+                                    vk::DeviceMemory{block_info.deviceMemory},
+                                    deferred.alloc_info_->offset);
+        bound_list.emplace_back(j);
+      }
+      continue;
+    }
+    // Allocate a memory per buffer instead
+    const VmaAllocationCreateInfo alloc_create_info =
+        makeAllocationCreateInfo(usage);
+    for (const std::size_t j : group) {
+      const auto& deferred = buffer_list[j];
+      VmaAllocation buffer_memory = VK_NULL_HANDLE;
+      VmaAllocationInfo buffer_info{};
+      const auto r = vmaAllocateMemoryForBuffer(
+          allocator_,
+          static_cast<VkBuffer>(*deferred.buffer_),
+          &alloc_create_info,
+          &buffer_memory,
+          &buffer_info);
+      if (r != VK_SUCCESS) {
+        deferred_buffer_list_.emplace_back(deferred);
+        result = false;
+        continue;
+      }
+      *deferred.memory_ = buffer_memory;
+      *deferred.alloc_info_ = buffer_info;
+      *deferred.memory_offset_ = 0;
+      bind_info_list.emplace_back(*deferred.buffer_,
+                                  vk::DeviceMemory{buffer_info.deviceMemory},
+                                  buffer_info.offset);
+      bound_list.emplace_back(j);
+    }
+  }
+  if (bind_info_list.empty())
+    return result;
+
+  // Bind all buffers in a single pass
+  const auto r = device_.bindBufferMemory2(
+      static_cast<uint32b>(bind_info_list.size()),
+      bind_info_list.data());
+  if (r != vk::Result::eSuccess) {
+    // The buffers of a failed batch can't be bound again, so they are left
+    // without memory
+    for (const std::size_t j : bound_list) {
+      const auto& deferred = buffer_list[j];
+      if (isSharedMemory(*deferred.memory_))
+        releaseSharedMemory(*deferred.memory_);
+      else
+        vmaFreeMemory(allocator_, *deferred.memory_);
+      *deferred.memory_ = VK_NULL_HANDLE;
+      deferred.alloc_info_->size = 0;
+      *deferred.memory_offset_ = 0;
+    }
+    result = false;
+  }
+  return result;
+}
+
+/*!
+  \details
+  The buffer gets a dedicated memory of the opaque fd handle type. The memory
+  type of an opaque fd can't be queried, so the importer selects the type in
+  the same way as the exporter, which requires the same usage and size on the
+  same physical device.
+  */
+template <typename Type> inline
+void VulkanDevice::allocateExternal(const std::size_t size,
+                                    const int fd,
+                                    VulkanBuffer<Type>* buffer) noexcept
+{
+  const TraceSpan span{tracer(), TraceCategory::kMemory, "allocateExternal"};
+  //! \todo Handle error
+  if (!isExternalMemorySupported()) {
+    return;
+  }
+  auto& b = buffer->buffer();
+  auto& memory = buffer->externalMemory();
+  auto& alloc_info = buffer->allocationInfo();
+
+  constexpr auto handle_type = vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd;
+  vk::BufferCreateInfo buffer_create_info =
+      makeBufferCreateInfo(sizeof(Type) * size, buffer->isConcurrent());
+  vk::ExternalMemoryBufferCreateInfo external_create_info;
+  external_create_info.handleTypes = handle_type;
+  buffer_create_info.pNext = &external_create_info;
+  auto result = device_.createBuffer(&buffer_create_info, nullptr, &b);
+  //! \todo Handle error
+  if (result != vk::Result::eSuccess) {
+    return;
+  }
+
+  const auto requirements = device_.getBufferMemoryRequirements(b);
+  const VmaAllocationCreateInfo alloc_create_info =
+      makeAllocationCreateInfo(buffer->usage());
+  uint32b type_index = 0;
+  if (vmaFindMemoryTypeIndex(allocator_,
+                             requirements.memoryTypeBits,
+                             &alloc_create_info,
+                             &type_index) != VK_SUCCESS) {
+    device_.destroyBuffer(b);
+    b = nullptr;
+    return;
+  }
+
+  vk::MemoryDedicatedAllocateInfo dedicated_info;
+  dedicated_info.buffer = b;
+  vk::ExportMemoryAllocateInfo export_info;
+  export_info.handleTypes = handle_type;
+  vk::ImportMemoryFdInfoKHR import_info;
+  import_info.handleType = handle_type;
+  import_info.fd = fd;
+  if (fd == -1)
+    dedicated_info.pNext = &export_info;
+  else
+    dedicated_info.pNext = &import_info;
+  vk::MemoryAllocateInfo memory_alloc_info;
+  memory_alloc_info.pNext = &dedicated_info;
+  memory_alloc_info.allocationSize = requirements.size;
+  memory_alloc_info.memoryTypeIndex = type_index;
+  result = device_.allocateMemory(&memory_alloc_info, nullptr, &memory);
+  //! \todo Handle error
+  if (result != vk::Result::eSuccess) {
+    device_.destroyBuffer(b);
+    b = nullptr;
+    memory = nullptr;
+    return;
   }
+  device_.bindBufferMemory(b, memory, 0);
+
+  alloc_info = VmaAllocationInfo{};
+  alloc_info.memoryType = type_index;
+  alloc_info.deviceMemory = memory;
+  alloc_info.offset = 0;
+  alloc_info.size = requirements.size;
+  buffer->memoryOffset() = 0;
+}
+
+/*!
+  \details
+  The block is freed when all the buffers bound to it are deallocated.
+  */
+inline
+VmaAllocation VulkanDevice::allocateSharedMemory(
+    const vk::MemoryRequirements& requirements,
+    const BufferUsage usage,
+    const std::size_t num_of_buffers,
+    VmaAllocationInfo* block_info) noexcept
+{
+  std::lock_guard<std::mutex> lock{memory_mutex_};
+  return createSharedMemory(requirements, usage, num_of_buffers, block_info);
+}
+
+/*!
+  \details
+  A buffer is identified by the address of its handle and the handle, so a
+  buffer which is destroyed or already allocated is never touched. The block
+  must be allocated by 'allocateSharedMemory', and the reference of the buffer
+  to the block is released if the buffer isn't bound.
+  */
+inline
+bool VulkanDevice::bindDeferredBuffer(const vk::Buffer* buffer,
+                                      const vk::Buffer& handle,
+                                      const VmaAllocation memory,
+                                      const std::size_t offset) noexcept
+{
+  std::lock_guard<std::mutex> lock{memory_mutex_};
+  auto deferred = std::find_if(deferred_buffer_list_.begin(),
+                               deferred_buffer_list_.end(),
+                               [buffer, &handle](const DeferredBuffer& d)
+                               {
+                                 return (d.buffer_ == buffer) &&
+                                        (*d.buffer_ == handle);
+                               });
+  bool result = deferred != deferred_buffer_list_.end();
+  if (result) {
+    const auto r = vmaBindBufferMemory2(allocator_,
+                                        memory,
+                                        offset,
+                                        static_cast<VkBuffer>(handle),
+                                        nullptr);
+    // The buffer stays deferred and gets its own memory on first use
+    result = r == VK_SUCCESS;
+  }
+  if (!result) {
+    releaseSharedMemory(memory);
+    return result;
+  }
+  auto& alloc_info = *deferred->alloc_info_;
+  vmaGetAllocationInfo(allocator_, memory, &alloc_info);
+  alloc_info.offset = alloc_info.offset + offset;
+  alloc_info.size = device_.getBufferMemoryRequirements(handle).size;
+  *deferred->memory_ = memory;
+  *deferred->memory_offset_ = offset;
+  deferred_buffer_list_.erase(deferred);
+  return result;
 }
 
 /*!
@@ -117,9 +476,18 @@ void VulkanDevice::allocate(const std::size_t size,
 template <std::size_t kDimension> inline
 std::array<uint32b, 3> VulkanDevice::calcWorkGroupSize(
     const std::array<uint32b, kDimension>& works) const noexcept
+{
+  return calcWorkGroupSize(works, localWorkSize<kDimension>());
+}
+
+/*!
+  */
+template <std::size_t kDimension> inline
+std::array<uint32b, 3> VulkanDevice::calcWorkGroupSize(
+    const std::array<uint32b, kDimension>& works,
+    const std::array<uint32b, 3>& local_work_size) const noexcept
 {
   std::array<uint32b, 3> work_group_size{{1, 1, 1}};
-  const auto& local_work_size = localWorkSize<kDimension>();
   for (std::size_t i = 0; i < kDimension; ++i) {
     work_group_size[i] = ((works[i] % local_work_size[i]) == 0)
         ? works[i] / local_work_size[i]
@@ -136,7 +504,8 @@ auto VulkanDevice::commandPool(const QueueType queue_type) noexcept
 {
   const std::size_t list_index = static_cast<std::size_t>(queue_type);
   const std::size_t ref_index = queue_family_index_ref_list_[list_index];
-  return command_pool_list_[ref_index];
+  auto& command_pool_list = threadCommandPoolList();
+  return command_pool_list[ref_index];
 }
 
 /*!
@@ -147,7 +516,24 @@ auto VulkanDevice::commandPool(const QueueType queue_type) const noexcept
 {
   const std::size_t list_index = static_cast<std::size_t>(queue_type);
   const std::size_t ref_index = queue_family_index_ref_list_[list_index];
-  return command_pool_list_[ref_index];
+  const auto& command_pool_list = threadCommandPoolList();
+  return command_pool_list[ref_index];
+}
+
+/*!
+  \details
+  The pool can be reset and recorded by the owner only. The owner must destroy
+  the pool before the device is destroyed.
+  */
+inline
+vk::CommandPool VulkanDevice::createCommandPool(const QueueType queue_type) const
+{
+  const std::size_t list_index = static_cast<std::size_t>(queue_type);
+  const std::size_t ref_index = queue_family_index_ref_list_[list_index];
+  const vk::CommandPoolCreateInfo pool_info{
+      vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+      queue_family_index_list_[ref_index]};
+  return device_.createCommandPool(pool_info);
 }
 
 /*!
@@ -158,20 +544,66 @@ void VulkanDevice::deallocate(VulkanBuffer<Type>* buffer) noexcept
   auto& b = buffer->buffer();
   auto& memory = buffer->memory();
   auto& alloc_info = buffer->allocationInfo();
+  auto& memory_offset = buffer->memoryOffset();
   if (b) {
-    vmaDestroyBuffer(allocator_, *reinterpret_cast<VkBuffer*>(&b), memory);
+    std::lock_guard<std::mutex> lock{memory_mutex_};
+    auto deferred = std::find_if(deferred_buffer_list_.begin(),
+                                 deferred_buffer_list_.end(),
+                                 [&b](const DeferredBuffer& d)
+                                 {
+                                   return d.buffer_ == &b;
+                                 });
+    if (deferred != deferred_buffer_list_.end()) {
+      deferred_buffer_list_.erase(deferred);
+      device_.destroyBuffer(b);
+    }
+    else if (buffer->isExternal()) {
+      device_.destroyBuffer(b);
+      device_.freeMemory(buffer->externalMemory());
+      buffer->externalMemory() = nullptr;
+    }
+    else if (isSharedMemory(memory)) {
+      device_.destroyBuffer(b);
+      releaseSharedMemory(memory);
+    }
+    else {
+      vmaDestroyBuffer(allocator_, *reinterpret_cast<VkBuffer*>(&b), memory);
+    }
     b = nullptr;
     memory = VK_NULL_HANDLE;
     alloc_info.size = 0;
+    memory_offset = 0;
   }
 }
 
+/*!
+  */
+inline
+vk::Instance VulkanDevice::createInstance(const DeviceOptions& options)
+{
+  const vk::ApplicationInfo app_info = makeApplicationInfo(
+      options.app_name_,
+      options.app_version_major_,
+      options.app_version_minor_,
+      options.app_version_patch_);
+  return makeInstance(app_info, options.enable_debug_);
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::deferredAllocation() const noexcept
+{
+  return deferred_allocation_;
+}
+
 /*!
   */
 inline
 void VulkanDevice::destroy() noexcept
 {
   if (device_) {
+    device_.waitIdle();
     for (auto& module : shader_module_list_) {
       if (module) {
         device_.destroyShaderModule(module);
@@ -182,13 +614,32 @@ void VulkanDevice::destroy() noexcept
       vmaDestroyAllocator(allocator_);
       allocator_ = VK_NULL_HANDLE;
     }
-    for (std::size_t i = 0; i < command_pool_list_.size(); ++i) {
-      auto command_pool = command_pool_list_[i];
-      if (command_pool) {
-        device_.destroyCommandPool(command_pool);
-        command_pool_list_[i] = nullptr;
+    if (command_pool_registry_) {
+      // The threads which exit later don't touch the destroyed device
+      std::lock_guard<std::mutex> lock{command_pool_registry_->mutex_};
+      for (auto& thread_command_pool : command_pool_registry_->pool_list_) {
+        for (auto& command_pool : thread_command_pool.second) {
+          if (command_pool) {
+            device_.destroyCommandPool(command_pool);
+            command_pool = nullptr;
+          }
+        }
       }
+      command_pool_registry_->pool_list_.clear();
+      command_pool_registry_->device_ = nullptr;
     }
+    command_pool_registry_.reset();
+    for (auto& family_state : queue_state_list_) {
+      for (auto& state : family_state) {
+        for (auto& fence : state.pending_fence_list_)
+          device_.destroyFence(fence);
+        for (auto& fence : state.free_fence_list_)
+          device_.destroyFence(fence);
+        if (state.timeline_semaphore_)
+          device_.destroySemaphore(state.timeline_semaphore_);
+      }
+    }
+    queue_state_list_.clear();
     device_.destroy();
     device_ = nullptr;
   }
@@ -205,7 +656,8 @@ void VulkanDevice::destroy() noexcept
   }
 
   if (instance_) {
-    instance_.destroy();
+    if (owns_instance_)
+      instance_.destroy();
     instance_ = nullptr;
   }
 }
@@ -251,6 +703,116 @@ const vk::Device& VulkanDevice::device() const noexcept
 //  return device_info_list;
 //}
 
+/*!
+  \details
+  The number is selected by the selection mode of the device options.
+  */
+inline
+uint32b VulkanDevice::deviceNumber() const noexcept
+{
+  return device_number_;
+}
+
+/*!
+  \details
+  The caller owns the returned descriptor. -1 is returned if the buffer
+  isn't exportable.
+  */
+template <typename Type> inline
+int VulkanDevice::exportMemory(const VulkanBuffer<Type>& buffer) const noexcept
+{
+  int fd = -1;
+  if (buffer.isExportable() && buffer.isExternal() && (get_memory_fd_ != nullptr)) {
+    VkMemoryGetFdInfoKHR get_fd_info{};
+    get_fd_info.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+    get_fd_info.memory = buffer.externalMemory();
+    get_fd_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+    if (get_memory_fd_(device_, &get_fd_info, &fd) != VK_SUCCESS)
+      fd = -1;
+  }
+  return fd;
+}
+
+/*!
+  \details
+  The pipeline must be created with eCaptureStatisticsKHR. Returns an empty
+  list if the extension isn't supported.
+  */
+inline
+auto VulkanDevice::getPipelineExecutableProperties(
+    const vk::Pipeline& pipeline) const noexcept
+    -> std::vector<vk::PipelineExecutablePropertiesKHR>
+{
+  std::vector<vk::PipelineExecutablePropertiesKHR> properties_list;
+  if (!isPipelineExecutableInfoSupported())
+    return properties_list;
+
+  VkPipelineInfoKHR pipeline_info{VK_STRUCTURE_TYPE_PIPELINE_INFO_KHR,
+                                  nullptr,
+                                  static_cast<VkPipeline>(pipeline)};
+  uint32b n = 0;
+  auto result = get_pipeline_executable_properties_(
+      static_cast<VkDevice>(device_),
+      &pipeline_info,
+      &n,
+      nullptr);
+  if ((result == VK_SUCCESS) && (0 < n)) {
+    properties_list.resize(n);
+    result = get_pipeline_executable_properties_(
+        static_cast<VkDevice>(device_),
+        &pipeline_info,
+        &n,
+        reinterpret_cast<VkPipelineExecutablePropertiesKHR*>(properties_list.data()));
+  }
+  //! \todo Handle error
+  if (result != VK_SUCCESS) {
+    properties_list.clear();
+  }
+  return properties_list;
+}
+
+/*!
+  \details
+  The statistics are the driver specific values, e.g. the number of
+  registers or the size of the scratch memory. Returns an empty list if the
+  extension isn't supported.
+  */
+inline
+auto VulkanDevice::getPipelineExecutableStatistics(
+    const vk::Pipeline& pipeline,
+    const uint32b executable_index) const noexcept
+    -> std::vector<vk::PipelineExecutableStatisticKHR>
+{
+  std::vector<vk::PipelineExecutableStatisticKHR> statistic_list;
+  if (!isPipelineExecutableInfoSupported())
+    return statistic_list;
+
+  VkPipelineExecutableInfoKHR executable_info{
+      VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_INFO_KHR,
+      nullptr,
+      static_cast<VkPipeline>(pipeline),
+      executable_index};
+  uint32b n = 0;
+  auto result = get_pipeline_executable_statistics_(
+      static_cast<VkDevice>(device_),
+      &executable_info,
+      &n,
+      nullptr);
+  if ((result == VK_SUCCESS) && (0 < n)) {
+    statistic_list.resize(n);
+    result = get_pipeline_executable_statistics_(
+        static_cast<VkDevice>(device_),
+        &executable_info,
+        &n,
+        reinterpret_cast<VkPipelineExecutableStatisticKHR*>(statistic_list.data()));
+  }
+  //! \todo Handle error
+  if (result != VK_SUCCESS) {
+    statistic_list.clear();
+  }
+  return statistic_list;
+}
+
 /*!
   */
 inline
@@ -329,103 +891,700 @@ void VulkanDevice::initLocalWorkSize(const uint32b subgroup_size) noexcept
 
 /*!
   */
-template <std::size_t kDimension> inline
-const std::array<uint32b, 3>& VulkanDevice::localWorkSize() const noexcept
+inline
+auto VulkanDevice::initializationTime() const noexcept
+    -> const InitializationTime&
+{
+  return initialization_time_;
+}
+
+/*!
+  */
+inline
+const vk::Instance& VulkanDevice::instance() const noexcept
+{
+  return instance_;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isDeferredBuffer(const vk::Buffer* buffer,
+                                    const vk::Buffer& handle) const noexcept
+{
+  std::lock_guard<std::mutex> lock{memory_mutex_};
+  const bool result = std::any_of(deferred_buffer_list_.begin(),
+                                  deferred_buffer_list_.end(),
+                                  [buffer, &handle](const DeferredBuffer& d)
+                                  {
+                                    return (d.buffer_ == buffer) &&
+                                           (*d.buffer_ == handle);
+                                  });
+  return result;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isExternalMemorySupported() const noexcept
+{
+  return is_external_memory_supported_;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isHostQueryResetSupported() const noexcept
+{
+  return is_host_query_reset_supported_;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isLocalWorkSizeTuned(const uint32b module_index,
+                                        const std::string_view kernel_name) const noexcept
+{
+  const auto key = std::make_pair(module_index, std::string{kernel_name});
+  std::lock_guard<std::mutex> lock{local_work_size_mutex_};
+  return tuned_local_work_size_list_.find(key) !=
+         tuned_local_work_size_list_.end();
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isPipelineExecutableInfoSupported() const noexcept
+{
+  return is_pipeline_executable_info_supported_;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isPipelineStatisticsQuerySupported() const noexcept
+{
+  return is_pipeline_statistics_query_supported_;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isQueueFamilyShared() const noexcept
+{
+  const bool result = queueFamilyIndex(QueueType::kCompute) ==
+                      queueFamilyIndex(QueueType::kTransfer);
+  return result;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isSubgroupOperationSupported(
+    const vk::SubgroupFeatureFlags operations) const noexcept
+{
+  const auto& capabilities = subgroup_capabilities_;
+  const bool result =
+      (capabilities.supported_stages_ & vk::ShaderStageFlagBits::eCompute) &&
+      ((capabilities.supported_operations_ & operations) == operations);
+  return result;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isSubgroupSizeControlSupported() const noexcept
+{
+  return subgroup_capabilities_.size_control_ ||
+         subgroup_capabilities_.compute_full_subgroups_;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isTimelineSemaphoreSupported() const noexcept
+{
+  return is_timeline_semaphore_supported_;
+}
+
+/*!
+  \details
+  A submission which waits for the timeline semaphore of the queue to reach
+  the value is ordered after all work submitted to the queue so far. Returns
+  0 if nothing has been submitted or timeline semaphores aren't supported.
+  */
+inline
+uint64b VulkanDevice::lastTimelineValue(const QueueType queue_type,
+                                        const uint32b queue_index) const noexcept
+{
+  auto& state = queueState(queue_type, queue_index);
+  std::lock_guard<std::mutex> lock{state.mutex_};
+  return state.timeline_value_;
+}
+
+/*!
+  \details
+  A cache file has a line of "key module kernel x y z" per kernel, where the
+  key identifies the device and the driver, and the module is the index of
+  the shader module, since different modules can have kernels of the same
+  name. The sizes of the other devices are ignored. Returns false if the
+  file can't be read.
+  */
+inline
+bool VulkanDevice::loadLocalWorkSizeCache(const std::string_view cache_path)
+{
+  std::ifstream cache_file{std::string{cache_path}};
+  if (!cache_file)
+    return false;
+  const std::string device_key = VulkanDeviceSelector::getCacheKey(device_info_);
+  std::string key;
+  uint32b module_index = 0;
+  std::string kernel_name;
+  std::array<uint32b, 3> local_work_size;
+  while (cache_file >> key >> module_index >> kernel_name >> local_work_size[0]
+                    >> local_work_size[1] >> local_work_size[2]) {
+    if (key == device_key)
+      setLocalWorkSize(module_index, kernel_name, local_work_size);
+  }
+  return true;
+}
+
+/*!
+  */
+template <std::size_t kDimension> inline
+const std::array<uint32b, 3>& VulkanDevice::localWorkSize() const noexcept
+{
+  static_assert((0 < kDimension) && (kDimension <= 3),
+                "The dimension is out of range.");
+  return local_work_size_list_[kDimension - 1];
+}
+
+/*!
+  \details
+  The components of a tuned size beyond the dimension are ignored.
+  */
+template <std::size_t kDimension> inline
+std::array<uint32b, 3> VulkanDevice::localWorkSize(
+    const uint32b module_index,
+    const std::string_view kernel_name) const noexcept
+{
+  std::array<uint32b, 3> local_work_size = localWorkSize<kDimension>();
+  const auto key = std::make_pair(module_index, std::string{kernel_name});
+  std::lock_guard<std::mutex> lock{local_work_size_mutex_};
+  const auto tuned = tuned_local_work_size_list_.find(key);
+  if (tuned != tuned_local_work_size_list_.end()) {
+    for (std::size_t i = 0; i < kDimension; ++i)
+      local_work_size[i] = tuned->second[i];
+  }
+  return local_work_size;
+}
+
+///*!
+//  */
+//template <std::size_t kDimension, typename Function, typename ...ArgumentTypes>
+//inline
+//UniqueKernel<kDimension, ArgumentTypes...> VulkanDevice::makeKernel(
+//    const uint32b module_index,
+//    const std::string_view kernel_name) noexcept
+//{
+//  using UniqueVulkanKernel = zisc::UniqueMemoryPointer<VulkanKernel<
+//      kDimension,
+//      Function,
+//      ArgumentTypes...>>;
+//  UniqueKernel<kDimension, ArgumentTypes...> kernel =
+//      UniqueVulkanKernel::make(memoryResource(), this, module_index, kernel_name);
+//  return kernel;
+//}
+
+/*!
+  */
+inline
+VmaAllocator& VulkanDevice::memoryAllocator() noexcept
+{
+  return allocator_;
+}
+
+/*!
+  */
+inline
+const VmaAllocator& VulkanDevice::memoryAllocator() const noexcept
+{
+  return allocator_;
+}
+
+/*!
+  */
+inline
+VulkanMetrics* VulkanDevice::metrics() const noexcept
+{
+  return metrics_;
+}
+
+/*!
+  */
+inline
+std::string_view VulkanDevice::name() const noexcept
+{
+  const auto& device_info = physicalDeviceInfo();
+  std::string_view device_name{device_info.properties().properties1_.deviceName};
+  return device_name;
+}
+
+/*!
+  \details
+  If timeline semaphores are supported, the number is the difference between
+  the timeline values which the queue has been submitted and has completed,
+  so no fence is polled. Otherwise the submissions without a fence are
+  counted.
+  */
+inline
+std::size_t VulkanDevice::numOfPendingSubmissions(
+    const QueueType queue_type,
+    const uint32b queue_index) const noexcept
+{
+  auto& state = queueState(queue_type, queue_index);
+  if (isTimelineSemaphoreSupported()) {
+    const uint64b completed = timelineValue(queue_type, queue_index);
+    std::lock_guard<std::mutex> lock{state.mutex_};
+    const uint64b submitted = state.timeline_value_;
+    return static_cast<std::size_t>(submitted - (std::min)(completed, submitted));
+  }
+  std::lock_guard<std::mutex> lock{state.mutex_};
+  retireSubmissions(state);
+  return state.pending_fence_list_.size();
+}
+
+/*!
+  */
+inline
+uint32b VulkanDevice::numOfQueues(const QueueType queue_type) const noexcept
+{
+  const uint32b family_index = queueFamilyIndex(queue_type);
+  const auto& info = physicalDeviceInfo();
+  const auto& family_info_list = info.queueFamilyPropertiesList();
+  const auto& family_info = family_info_list[family_index].properties1_;
+  return family_info.queueCount;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::ownsInstance() const noexcept
+{
+  return owns_instance_;
+}
+
+/*!
+  */
+inline
+auto VulkanDevice::physicalDeviceInfo() const noexcept
+    -> const VulkanPhysicalDeviceInfo&
+{
+  return device_info_;
+}
+
+/*!
+  */
+inline
+VulkanProfiler* VulkanDevice::profiler() const noexcept
+{
+  return profiler_;
+}
+
+/*!
+  */
+inline
+uint32b VulkanDevice::queueFamilyIndex(const QueueType queue_type) const noexcept
+{
+  const std::size_t list_index = static_cast<std::size_t>(queue_type);
+  const std::size_t ref_index = queue_family_index_ref_list_[list_index];
+  const uint32b family_index = queue_family_index_list_[ref_index];
+  return family_index;
+}
+
+/*!
+  */
+inline
+VulkanRecorder* VulkanDevice::recorder() const noexcept
+{
+  return recorder_;
+}
+
+/*!
+  \details
+  The barrier must be recorded at the end of the last command which accesses
+  the buffer on the src family, and the command must signal a semaphore
+  which the acquire command waits.
+  */
+inline
+void VulkanDevice::releaseOwnership(const vk::Buffer& buffer,
+                                    const QueueType src_queue_type,
+                                    const QueueType dst_queue_type,
+                                    const vk::CommandBuffer& command) const noexcept
+{
+  auto barrier = makeOwnershipBarrier(buffer, src_queue_type, dst_queue_type);
+  barrier.srcAccessMask = getQueueAccessFlags(src_queue_type);
+  barrier.dstAccessMask = vk::AccessFlags{};
+  command.pipelineBarrier(getQueueStageFlags(src_queue_type),
+                          vk::PipelineStageFlagBits::eBottomOfPipe,
+                          vk::DependencyFlags{},
+                          0, nullptr,
+                          1, &barrier,
+                          0, nullptr);
+}
+
+/*!
+  \details
+  The queries must not be used by pending commands.
+  */
+inline
+void VulkanDevice::resetQueries(const vk::QueryPool& query_pool,
+                                const uint32b first_query,
+                                const uint32b num_of_queries) const noexcept
+{
+  if (reset_query_pool_ != nullptr)
+    reset_query_pool_(device_, query_pool, first_query, num_of_queries);
+}
+
+/*!
+  \details
+  The sizes of the other devices which are in the file are kept.
+  */
+inline
+void VulkanDevice::saveLocalWorkSizeCache(const std::string_view cache_path) const
+{
+  const std::string device_key = VulkanDeviceSelector::getCacheKey(device_info_);
+  std::vector<std::string> line_list;
+  {
+    std::ifstream cache_file{std::string{cache_path}};
+    std::string line;
+    while (std::getline(cache_file, line)) {
+      if (!line.empty() && (line.compare(0, device_key.size(), device_key) != 0))
+        line_list.emplace_back(std::move(line));
+    }
+  }
+
+  std::ofstream cache_file{std::string{cache_path}};
+  if (!cache_file) {
+    //! \todo Handle error
+    return;
+  }
+  for (const auto& line : line_list)
+    cache_file << line << "\n";
+  std::lock_guard<std::mutex> lock{local_work_size_mutex_};
+  for (const auto& entry : tuned_local_work_size_list_) {
+    const auto& s = entry.second;
+    cache_file << device_key << " " << entry.first.first << " "
+               << entry.first.second << " "
+               << s[0] << " " << s[1] << " " << s[2] << "\n";
+  }
+}
+
+/*!
+  \details
+  The load of a queue is the number of its pending submissions. The search
+  starts from a rotating queue, so idle queues are used evenly.
+  */
+inline
+uint32b VulkanDevice::selectQueueIndex(const QueueType queue_type,
+                                       const uint32b queue_index) const noexcept
+{
+  if (queue_index != kAnyQueue)
+    return queue_index;
+
+  const uint32b num_of_queues = numOfQueues(queue_type);
+  const uint32b first = queue_selection_count_++ % num_of_queues;
+  uint32b index = first;
+  std::size_t min_load = (std::numeric_limits<std::size_t>::max)();
+  for (uint32b i = 0; (i < num_of_queues) && (0 < min_load); ++i) {
+    const uint32b q = (first + i) % num_of_queues;
+    const std::size_t load = numOfPendingSubmissions(queue_type, q);
+    if (load < min_load) {
+      index = q;
+      min_load = load;
+    }
+  }
+  return index;
+}
+
+/*!
+  \details
+  The size is used by the kernels which are created after this call.
+  */
+inline
+void VulkanDevice::setLocalWorkSize(const uint32b module_index,
+                                    const std::string_view kernel_name,
+                                    const std::array<uint32b, 3>& local_work_size)
+{
+  auto key = std::make_pair(module_index, std::string{kernel_name});
+  std::lock_guard<std::mutex> lock{local_work_size_mutex_};
+  tuned_local_work_size_list_.insert_or_assign(std::move(key), local_work_size);
+}
+
+/*!
+  \details
+  The registry must outlive the device operations which are called while
+  it's attached. Null detaches the registry.
+  */
+inline
+void VulkanDevice::setMetrics(VulkanMetrics* metrics) noexcept
+{
+  metrics_ = metrics;
+}
+
+/*!
+  \details
+  The profiler must outlive the commands which are recorded while it's
+  attached. Null detaches the profiler.
+  */
+inline
+void VulkanDevice::setProfiler(VulkanProfiler* profiler) noexcept
+{
+  profiler_ = profiler;
+}
+
+/*!
+  \details
+  The recorder must outlive the buffers which are referenced while it's
+  attached. Null detaches the recorder.
+  */
+inline
+void VulkanDevice::setRecorder(VulkanRecorder* recorder) noexcept
+{
+  recorder_ = recorder;
+}
+
+/*!
+  */
+inline
+void VulkanDevice::setShaderModule(const std::vector<uint32b>& spirv_code,
+                                   const std::size_t index)
+{
+  if (shader_module_list_.size() <= index)
+    shader_module_list_.resize(index + 1);
+  else if (hasShaderModule(index))
+    device_.destroyShaderModule(getShaderModule(index));
+
+  static_assert(sizeof(uint32b) == 4, "The size of uint32b isn't 4 bytes.");
+  const vk::ShaderModuleCreateInfo create_info{vk::ShaderModuleCreateFlags{},
+                                               4 * spirv_code.size(),
+                                               spirv_code.data()};
+  vk::ShaderModule shader_module = device_.createShaderModule(create_info);
+  shader_module_list_[index] = shader_module;
+  if (recorder_ != nullptr)
+    recorder_->setShaderModule(spirv_code, index);
+}
+
+/*!
+  \details
+  The requirements are used by the kernels which are created after this
+  call.
+  */
+inline
+void VulkanDevice::setSubgroupSizeControl(const std::string_view kernel_name,
+                                          const SubgroupSizeControl& control)
+{
+  std::lock_guard<std::mutex> lock{subgroup_mutex_};
+  const auto c = subgroup_size_control_list_.find(kernel_name);
+  if (c != subgroup_size_control_list_.end())
+    c->second = control;
+  else
+    subgroup_size_control_list_.emplace(std::string{kernel_name}, control);
+}
+
+/*!
+  \details
+  The tracer must outlive the device operations which are called while it's
+  attached. Null detaches the tracer.
+  */
+inline
+void VulkanDevice::setTracer(VulkanTracer* tracer) noexcept
+{
+  tracer_ = tracer;
+}
+
+/*!
+  */
+inline
+auto VulkanDevice::subgroupCapabilities() const noexcept
+    -> const SubgroupCapabilities&
+{
+  return subgroup_capabilities_;
+}
+
+/*!
+  */
+inline
+uint32b VulkanDevice::subgroupSize() const noexcept
+{
+  return subgroup_capabilities_.size_;
+}
+
+/*!
+  \details
+  The requirements which the device doesn't support are dropped, so the
+  pipeline falls back to the default subgroup size. A required size must be
+  a power of two in the range of the min and max sizes, and it can't be
+  combined with a varying size.
+  */
+inline
+auto VulkanDevice::subgroupSizeControl(const std::string_view kernel_name) const
+    -> SubgroupSizeControl
+{
+  SubgroupSizeControl control;
+  {
+    std::lock_guard<std::mutex> lock{subgroup_mutex_};
+    const auto c = subgroup_size_control_list_.find(kernel_name);
+    if (c != subgroup_size_control_list_.end())
+      control = c->second;
+  }
+
+  const auto& capabilities = subgroup_capabilities_;
+  const uint32b size = control.required_size_;
+  const bool is_size_supported =
+      capabilities.size_control_ &&
+      (capabilities.required_size_stages_ & vk::ShaderStageFlagBits::eCompute) &&
+      (capabilities.min_size_ <= size) && (size <= capabilities.max_size_) &&
+      ((size & (size - 1)) == 0);
+  if (!is_size_supported)
+    control.required_size_ = 0;
+  control.allow_varying_size_ = control.allow_varying_size_ &&
+                                capabilities.size_control_ &&
+                                (control.required_size_ == 0);
+  control.require_full_subgroups_ = control.require_full_subgroups_ &&
+                                    capabilities.compute_full_subgroups_;
+  return control;
+}
+
+/*!
+  */
+inline
+void VulkanDevice::submit(const QueueType queue_type,
+                          const uint32b queue_index,
+                          const vk::CommandBuffer& command) const noexcept
 {
-  static_assert((0 < kDimension) && (kDimension <= 3),
-                "The dimension is out of range.");
-  return local_work_size_list_[kDimension - 1];
+  submit(queue_type, queue_index, command, vk::Fence{});
 }
 
-///*!
-//  */
-//template <std::size_t kDimension, typename Function, typename ...ArgumentTypes>
-//inline
-//UniqueKernel<kDimension, ArgumentTypes...> VulkanDevice::makeKernel(
-//    const uint32b module_index,
-//    const std::string_view kernel_name) noexcept
-//{
-//  using UniqueVulkanKernel = zisc::UniqueMemoryPointer<VulkanKernel<
-//      kDimension,
-//      Function,
-//      ArgumentTypes...>>;
-//  UniqueKernel<kDimension, ArgumentTypes...> kernel =
-//      UniqueVulkanKernel::make(memoryResource(), this, module_index, kernel_name);
-//  return kernel;
-//}
-
 /*!
   */
 inline
-VmaAllocator& VulkanDevice::memoryAllocator() noexcept
+void VulkanDevice::submit(const QueueType queue_type,
+                          const uint32b queue_index,
+                          const vk::CommandBuffer& command,
+                          const vk::Fence& fence) const noexcept
 {
-  return allocator_;
+  submit(queue_type, queue_index, command, nullptr, nullptr, fence);
 }
 
 /*!
+  \details
+  Any number of semaphores can be waited for and signaled.
   */
 inline
-const VmaAllocator& VulkanDevice::memoryAllocator() const noexcept
+void VulkanDevice::submit(
+    const QueueType queue_type,
+    const uint32b queue_index,
+    const vk::CommandBuffer& command,
+    const vk::ArrayProxy<const vk::Semaphore>& wait_semaphores,
+    const vk::ArrayProxy<const vk::Semaphore>& signal_semaphores,
+    const vk::Fence& fence) const noexcept
 {
-  return allocator_;
+  submit(queue_type, queue_index, command,
+         wait_semaphores, nullptr, signal_semaphores, fence);
 }
 
 /*!
+  \details
+  The wait values are either empty or have a value per wait semaphore. The
+  values of the binary semaphores are ignored. The values are ignored if
+  timeline semaphores aren't supported.
   */
 inline
-std::string_view VulkanDevice::name() const noexcept
+void VulkanDevice::submit(
+    const QueueType queue_type,
+    const uint32b queue_index,
+    const vk::CommandBuffer& command,
+    const vk::ArrayProxy<const vk::Semaphore>& wait_semaphores,
+    const vk::ArrayProxy<const uint64b>& wait_values,
+    const vk::ArrayProxy<const vk::Semaphore>& signal_semaphores,
+    const vk::Fence& fence) const noexcept
 {
-  const auto& device_info = physicalDeviceInfo();
-  std::string_view device_name{device_info.properties().properties1_.deviceName};
-  return device_name;
+  const uint32b num_of_waits = wait_semaphores.size();
+  const std::vector<vk::PipelineStageFlags> wait_stage_list(
+      num_of_waits,
+      vk::PipelineStageFlagBits::eAllCommands);
+
+  const uint32b index = selectQueueIndex(queue_type, queue_index);
+  vk::Queue q = getQueue(queue_type, index);
+  auto& state = queueState(queue_type, index);
+  const vk::SubmitInfo info{num_of_waits,
+                            wait_semaphores.data(),
+                            wait_stage_list.data(),
+                            1,
+                            &command,
+                            signal_semaphores.size(),
+                            signal_semaphores.data()};
+  std::lock_guard<std::mutex> lock{state.mutex_};
+  submitInfo(q, state, info, wait_values, fence);
 }
 
 /*!
+  \details
+  The value signaled by the submission is returned. The timeline value of a
+  queue reaches it when the command and all preceding commands in the queue
+  are completed. Timeline semaphores must be supported.
   */
 inline
-auto VulkanDevice::physicalDeviceInfo() const noexcept
-    -> const VulkanPhysicalDeviceInfo&
+uint64b VulkanDevice::submitTimeline(const QueueType queue_type,
+                                     const uint32b queue_index,
+                                     const vk::CommandBuffer& command) const noexcept
 {
-  return device_info_;
+  const uint32b index = selectQueueIndex(queue_type, queue_index);
+  vk::Queue q = getQueue(queue_type, index);
+  auto& state = queueState(queue_type, index);
+
+  const vk::SubmitInfo info{0, nullptr, nullptr, 1, &command, 0, nullptr};
+  std::lock_guard<std::mutex> lock{state.mutex_};
+  const uint64b value = submitInfo(q, state, info, nullptr, vk::Fence{});
+  return value;
 }
 
 /*!
   */
 inline
-void VulkanDevice::setShaderModule(const std::vector<uint32b>& spirv_code,
-                                   const std::size_t index)
+const vk::Semaphore& VulkanDevice::timelineSemaphore(
+    const QueueType queue_type,
+    const uint32b queue_index) const noexcept
 {
-  if (shader_module_list_.size() <= index)
-    shader_module_list_.resize(index + 1);
-  else if (hasShaderModule(index))
-    device_.destroyShaderModule(getShaderModule(index));
-
-  static_assert(sizeof(uint32b) == 4, "The size of uint32b isn't 4 bytes.");
-  const vk::ShaderModuleCreateInfo create_info{vk::ShaderModuleCreateFlags{},
-                                               4 * spirv_code.size(),
-                                               spirv_code.data()};
-  vk::ShaderModule shader_module = device_.createShaderModule(create_info);
-  shader_module_list_[index] = shader_module;
+  const auto& state = queueState(queue_type, queue_index);
+  return state.timeline_semaphore_;
 }
 
 /*!
   */
 inline
-uint32b VulkanDevice::subgroupSize() const noexcept
+uint64b VulkanDevice::timelineValue(const QueueType queue_type,
+                                    const uint32b queue_index) const noexcept
 {
-  return local_work_size_list_[0][0];
+  const auto& state = queueState(queue_type, queue_index);
+  uint64b value = 0;
+  const auto result = get_semaphore_counter_value_(
+      static_cast<VkDevice>(device_),
+      static_cast<VkSemaphore>(state.timeline_semaphore_),
+      &value);
+  //! \todo Handle error
+  if (result != VK_SUCCESS) {
+  }
+  return value;
 }
 
 /*!
   */
 inline
-void VulkanDevice::submit(const QueueType queue_type,
-                          const uint32b queue_index,
-                          const vk::CommandBuffer& command) const noexcept
+VulkanTracer* VulkanDevice::tracer() const noexcept
 {
-  vk::Queue q = getQueue(queue_type, queue_index);
-  const vk::SubmitInfo info{0, nullptr, nullptr, 1, &command};
-  q.submit(1, &info, nullptr);
+  return tracer_;
 }
 
 /*!
@@ -442,6 +1601,17 @@ std::string_view VulkanDevice::vendorName() const noexcept
 inline
 void VulkanDevice::waitForCompletion() const noexcept
 {
+  const TraceSpan span{tracer(), TraceCategory::kWait, "waitForCompletion"};
+  if (recorder_ != nullptr)
+    recorder_->wait();
+  // vkDeviceWaitIdle requires the all queues to be externally synchronized.
+  // The locks are acquired in a fixed order, and never nested with others
+  const WaitMeasurement measurement{metrics_};
+  std::vector<std::unique_lock<std::mutex>> lock_list;
+  for (auto& family_state : queue_state_list_) {
+    for (auto& state : family_state)
+      lock_list.emplace_back(state.mutex_);
+  }
   device_.waitIdle();
 }
 
@@ -450,6 +1620,8 @@ void VulkanDevice::waitForCompletion() const noexcept
 inline
 void VulkanDevice::waitForCompletion(const QueueType queue_type) const noexcept
 {
+  if (recorder_ != nullptr)
+    recorder_->wait();
   const uint32b family_index = queueFamilyIndex(queue_type);
   const auto& info = physicalDeviceInfo();
   const auto& family_info_list = info.queueFamilyPropertiesList();
@@ -464,10 +1636,70 @@ inline
 void VulkanDevice::waitForCompletion(const QueueType queue_type,
                                      const uint32b queue_index) const noexcept
 {
+  if (queue_index == kAnyQueue) {
+    waitForCompletion(queue_type);
+    return;
+  }
+  const TraceSpan span{tracer(), TraceCategory::kWait, "waitForCompletion"};
+  const WaitMeasurement measurement{metrics_};
   vk::Queue q = getQueue(queue_type, queue_index);
+  auto& state = queueState(queue_type, queue_index);
+  std::lock_guard<std::mutex> lock{state.mutex_};
   q.waitIdle();
 }
 
+/*!
+  */
+inline
+void VulkanDevice::waitForTimeline(const QueueType queue_type,
+                                   const uint32b queue_index,
+                                   const uint64b value) const noexcept
+{
+  const TraceSpan span{tracer(), TraceCategory::kWait, "waitForTimeline"};
+  const auto& state = queueState(queue_type, queue_index);
+  const auto semaphore = static_cast<VkSemaphore>(state.timeline_semaphore_);
+  const VkSemaphoreWaitInfoKHR wait_info{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+                                         nullptr,
+                                         0,
+                                         1,
+                                         &semaphore,
+                                         &value};
+  constexpr uint64b timeout = (std::numeric_limits<uint64b>::max)();
+  const auto result = wait_semaphores_(static_cast<VkDevice>(device_),
+                                       &wait_info,
+                                       timeout);
+  //! \todo Handle error
+  if (result != VK_SUCCESS) {
+  }
+}
+
+/*!
+  \details
+  Returns null if the block can't be allocated.
+  */
+inline
+VmaAllocation VulkanDevice::createSharedMemory(
+    const vk::MemoryRequirements& requirements,
+    const BufferUsage usage,
+    const std::size_t num_of_buffers,
+    VmaAllocationInfo* block_info) noexcept
+{
+  const VmaAllocationCreateInfo alloc_create_info =
+      makeAllocationCreateInfo(usage);
+  VmaAllocation memory = VK_NULL_HANDLE;
+  const auto result = vmaAllocateMemory(
+      allocator_,
+      &static_cast<const VkMemoryRequirements&>(requirements),
+      &alloc_create_info,
+      &memory,
+      block_info);
+  if (result != VK_SUCCESS)
+    return VK_NULL_HANDLE;
+  if (0 < num_of_buffers)
+    shared_memory_list_.emplace_back(SharedMemory{memory, num_of_buffers});
+  return memory;
+}
+
 /*!
   */
 inline
@@ -631,16 +1863,49 @@ vk::Queue VulkanDevice::getQueue(const QueueType queue_type,
 /*!
   */
 inline
-void VulkanDevice::initCommandPool()
+vk::AccessFlags VulkanDevice::getQueueAccessFlags(
+    const QueueType queue_type) noexcept
 {
-  command_pool_list_.reserve(queue_family_index_list_.size());
-  for (std::size_t i = 0; i < queue_family_index_list_.size(); ++i) {
-    const vk::CommandPoolCreateInfo pool_info{
-        vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
-        queue_family_index_list_[i]};
-    vk::CommandPool command_pool = device_.createCommandPool(pool_info);
-    command_pool_list_.emplace_back(command_pool);
+  const vk::AccessFlags flags = (queue_type == QueueType::kCompute)
+      ? vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite
+      : vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+  return flags;
+}
+
+/*!
+  */
+inline
+vk::PipelineStageFlags VulkanDevice::getQueueStageFlags(
+    const QueueType queue_type) noexcept
+{
+  const vk::PipelineStageFlags flags = (queue_type == QueueType::kCompute)
+      ? vk::PipelineStageFlagBits::eComputeShader
+      : vk::PipelineStageFlagBits::eTransfer;
+  return flags;
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::hasTimelineSubmitInfo(const void* chain) noexcept
+{
+  const auto* s = static_cast<const VkBaseInStructure*>(chain);
+  for (; s != nullptr; s = s->pNext) {
+    if (s->sType == VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR)
+      return true;
   }
+  return false;
+}
+
+/*!
+  */
+inline
+void VulkanDevice::initCommandPool()
+{
+  command_pool_registry_ = std::make_shared<CommandPoolRegistry>();
+  command_pool_registry_->device_ = device_;
+  // The pools of the other threads are made on their first access
+  threadCommandPoolList();
 }
 
 /*!
@@ -683,7 +1948,7 @@ inline
 void VulkanDevice::initDevice(const DeviceOptions& options)
 {
   std::vector<const char*> layers{};
-  const std::vector<const char*> extensions{{
+  std::vector<const char*> extensions{{
       VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
       VK_KHR_8BIT_STORAGE_EXTENSION_NAME,
       VK_KHR_16BIT_STORAGE_EXTENSION_NAME,
@@ -696,12 +1961,49 @@ void VulkanDevice::initDevice(const DeviceOptions& options)
   }
 
   const auto& info = physicalDeviceInfo();
+  is_timeline_semaphore_supported_ =
+      info.isExtensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) &&
+      info.features().timeline_semaphore_.timelineSemaphore;
+  if (is_timeline_semaphore_supported_)
+    extensions.emplace_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+  if (info.isExtensionSupported(VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME)) {
+    // The storage buffers must be exportable and importable as opaque fds
+    vk::PhysicalDeviceExternalBufferInfo external_info;
+    external_info.usage = vk::BufferUsageFlagBits::eTransferSrc |
+                          vk::BufferUsageFlagBits::eTransferDst |
+                          vk::BufferUsageFlagBits::eStorageBuffer;
+    external_info.handleType = vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd;
+    const auto properties =
+        physical_device_.getExternalBufferProperties(external_info);
+    const auto features = properties.externalMemoryProperties.externalMemoryFeatures;
+    const auto required = vk::ExternalMemoryFeatureFlagBits::eExportable |
+                          vk::ExternalMemoryFeatureFlagBits::eImportable;
+    is_external_memory_supported_ = (features & required) == required;
+  }
+  if (is_external_memory_supported_)
+    extensions.emplace_back(VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME);
+  is_host_query_reset_supported_ =
+      info.isExtensionSupported(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME) &&
+      info.features().host_query_reset_.hostQueryReset;
+  if (is_host_query_reset_supported_)
+    extensions.emplace_back(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME);
+  is_pipeline_executable_info_supported_ =
+      info.isExtensionSupported(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME) &&
+      info.features().pipeline_executable_properties_.pipelineExecutableInfo;
+  if (is_pipeline_executable_info_supported_)
+    extensions.emplace_back(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME);
+  if (isSubgroupSizeControlSupported())
+    extensions.emplace_back(VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME);
+  is_pipeline_statistics_query_supported_ =
+      info.features().features1_.pipelineStatisticsQuery;
+
   vk::PhysicalDeviceFeatures device_features;
   {
     const auto& features = info.features().features1_;
     device_features.shaderFloat64 = features.shaderFloat64;
     device_features.shaderInt64 = features.shaderInt64;
     device_features.shaderInt16 = features.shaderInt16;
+    device_features.pipelineStatisticsQuery = features.pipelineStatisticsQuery;
   }
 
   std::vector<std::vector<float>> priority_list;
@@ -739,9 +2041,61 @@ void VulkanDevice::initDevice(const DeviceOptions& options)
                                  b8bit_storage_feature,
                                  float16_int8_feature,
                                  variable_pointers_feature);
+  void** next = &variable_pointers_feature.pNext;
+  vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_feature;
+  if (is_timeline_semaphore_supported_) {
+    timeline_semaphore_feature.timelineSemaphore = VK_TRUE;
+    *next = &timeline_semaphore_feature;
+    next = &timeline_semaphore_feature.pNext;
+  }
+  vk::PhysicalDeviceHostQueryResetFeaturesEXT host_query_reset_feature;
+  if (is_host_query_reset_supported_) {
+    host_query_reset_feature.hostQueryReset = VK_TRUE;
+    *next = &host_query_reset_feature;
+    next = &host_query_reset_feature.pNext;
+  }
+  vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR pipeline_executable_feature;
+  if (is_pipeline_executable_info_supported_) {
+    pipeline_executable_feature.pipelineExecutableInfo = VK_TRUE;
+    *next = &pipeline_executable_feature;
+    next = &pipeline_executable_feature.pNext;
+  }
+  vk::PhysicalDeviceSubgroupSizeControlFeaturesEXT subgroup_size_control_feature;
+  if (isSubgroupSizeControlSupported()) {
+    const auto& capabilities = subgroup_capabilities_;
+    subgroup_size_control_feature.subgroupSizeControl =
+        capabilities.size_control_ ? VK_TRUE : VK_FALSE;
+    subgroup_size_control_feature.computeFullSubgroups =
+        capabilities.compute_full_subgroups_ ? VK_TRUE : VK_FALSE;
+    *next = &subgroup_size_control_feature;
+  }
 
   vk::Device device = physical_device_.createDevice(device_create_info);
   device_ = device;
+
+  if (is_timeline_semaphore_supported_) {
+    get_semaphore_counter_value_ =
+        reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+            device_.getProcAddr("vkGetSemaphoreCounterValueKHR"));
+    wait_semaphores_ = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+        device_.getProcAddr("vkWaitSemaphoresKHR"));
+  }
+  if (is_external_memory_supported_) {
+    get_memory_fd_ = reinterpret_cast<PFN_vkGetMemoryFdKHR>(
+        device_.getProcAddr("vkGetMemoryFdKHR"));
+  }
+  if (is_host_query_reset_supported_) {
+    reset_query_pool_ = reinterpret_cast<PFN_vkResetQueryPoolEXT>(
+        device_.getProcAddr("vkResetQueryPoolEXT"));
+  }
+  if (is_pipeline_executable_info_supported_) {
+    get_pipeline_executable_properties_ =
+        reinterpret_cast<PFN_vkGetPipelineExecutablePropertiesKHR>(
+            device_.getProcAddr("vkGetPipelineExecutablePropertiesKHR"));
+    get_pipeline_executable_statistics_ =
+        reinterpret_cast<PFN_vkGetPipelineExecutableStatisticsKHR>(
+            device_.getProcAddr("vkGetPipelineExecutableStatisticsKHR"));
+  }
 }
 
 /*!
@@ -772,29 +2126,60 @@ void VulkanDevice::initMemoryAllocator()
 inline
 void VulkanDevice::initialize(const DeviceOptions& options)
 {
+  deferred_allocation_ = options.deferred_allocation_;
   app_info_ = makeApplicationInfo(options.app_name_,
                                   options.app_version_major_,
                                   options.app_version_minor_,
                                   options.app_version_patch_);
-  instance_ = makeInstance(app_info_, options.enable_debug_);
+  // Measure the elapsed time of each phase
+  using Clock = std::chrono::steady_clock;
+  const auto start_time = Clock::now();
+  auto phase_time = start_time;
+  const auto elapsed_time = [&phase_time]()
+  {
+    const auto now = Clock::now();
+    const std::chrono::duration<double, std::milli> t = now - phase_time;
+    phase_time = now;
+    return t.count();
+  };
+
+  if (owns_instance_)
+    instance_ = makeInstance(app_info_, options.enable_debug_);
   if (options.enable_debug_)
     initDebugMessenger();
+  initialization_time_.instance_ = elapsed_time();
+
   initPhysicalDevice(options);
+  const bool is_cached = (options.device_info_cache_path_ != nullptr) &&
+                         device_info_.loadCache(options.device_info_cache_path_);
   initQueueFamilyIndexList();
 
   {
     const auto& info = physicalDeviceInfo();
-    uint32b subgroup_size = info.properties().subgroup_.subgroupSize;
-    subgroup_size = ((1 <= subgroup_size) && (subgroup_size <= 128))
-        ? subgroup_size
-        : 32;
     vendor_name_ = getVendorName(info.properties().properties1_.vendorID);
-    initLocalWorkSize(subgroup_size);
+    initSubgroupCapabilities();
+    initLocalWorkSize(subgroupSize());
+    if (options.local_work_size_cache_path_ != nullptr)
+      loadLocalWorkSizeCache(options.local_work_size_cache_path_);
   }
+  initialization_time_.physical_device_ = elapsed_time();
 
   initDevice(options);
+  initialization_time_.device_ = elapsed_time();
+  initQueueStateList();
+  initialization_time_.queue_ = elapsed_time();
   initCommandPool();
+  initialization_time_.command_pool_ = elapsed_time();
   initMemoryAllocator();
+  initialization_time_.memory_allocator_ = elapsed_time();
+
+  // The info is saved after the initialization, so the cache misses only once
+  if ((options.device_info_cache_path_ != nullptr) && !is_cached)
+    device_info_.saveCache(options.device_info_cache_path_);
+
+  const std::chrono::duration<double, std::milli> total_time =
+      Clock::now() - start_time;
+  initialization_time_.total_ = total_time.count();
 }
 
 /*!
@@ -803,7 +2188,8 @@ inline
 void VulkanDevice::initPhysicalDevice(const DeviceOptions& options)
 {
   const auto physical_device_list = instance_.enumeratePhysicalDevices();
-  physical_device_ = physical_device_list[options.vulkan_device_number_];
+  device_number_ = VulkanDeviceSelector::select(instance_, options);
+  physical_device_ = physical_device_list[device_number_];
   device_info_.fetch(physical_device_);
 }
 
@@ -831,6 +2217,187 @@ void VulkanDevice::initQueueFamilyIndexList() noexcept
   }
 }
 
+/*!
+  */
+inline
+void VulkanDevice::initQueueStateList()
+{
+  const auto& info = physicalDeviceInfo();
+  const auto& family_info_list = info.queueFamilyPropertiesList();
+  queue_state_list_.reserve(queue_family_index_list_.size());
+  for (const uint32b family_index : queue_family_index_list_) {
+    const auto& family_info = family_info_list[family_index].properties1_;
+    queue_state_list_.emplace_back(family_info.queueCount);
+  }
+  // One timeline semaphore per queue tracks the progress of the queue
+  if (isTimelineSemaphoreSupported()) {
+    const vk::SemaphoreTypeCreateInfoKHR type_info{vk::SemaphoreTypeKHR::eTimeline, 0};
+    vk::SemaphoreCreateInfo semaphore_info{};
+    semaphore_info.pNext = &type_info;
+    for (auto& family_state : queue_state_list_) {
+      for (auto& state : family_state)
+        state.timeline_semaphore_ = device_.createSemaphore(semaphore_info);
+    }
+  }
+}
+
+/*!
+  \details
+  The default size is replaced with 32 if the device reports an invalid
+  size. The min and max sizes are the default size unless
+  VK_EXT_subgroup_size_control is supported.
+  */
+inline
+void VulkanDevice::initSubgroupCapabilities() noexcept
+{
+  const auto& info = physicalDeviceInfo();
+  const auto& subgroup = info.properties().subgroup_;
+  const auto& limits = info.properties().properties1_.limits;
+  auto& capabilities = subgroup_capabilities_;
+  capabilities = SubgroupCapabilities{};
+  capabilities.size_ = ((1 <= subgroup.subgroupSize) && (subgroup.subgroupSize <= 128))
+      ? subgroup.subgroupSize
+      : 32;
+  capabilities.min_size_ = capabilities.size_;
+  capabilities.max_size_ = capabilities.size_;
+  capabilities.max_compute_workgroup_subgroups_ =
+      (limits.maxComputeWorkGroupInvocations + capabilities.size_ - 1) /
+      capabilities.size_;
+  capabilities.supported_stages_ = subgroup.supportedStages;
+  capabilities.supported_operations_ = subgroup.supportedOperations;
+  capabilities.quad_operations_in_all_stages_ =
+      subgroup.quadOperationsInAllStages == VK_TRUE;
+
+  if (info.isExtensionSupported(VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME)) {
+    const auto& properties = info.properties().subgroup_size_control_;
+    const auto& features = info.features().subgroup_size_control_;
+    capabilities.size_control_ = (features.subgroupSizeControl == VK_TRUE) &&
+                                 (0 < properties.minSubgroupSize) &&
+                                 (properties.minSubgroupSize <= properties.maxSubgroupSize);
+    capabilities.compute_full_subgroups_ = features.computeFullSubgroups == VK_TRUE;
+    if (capabilities.size_control_) {
+      capabilities.min_size_ = properties.minSubgroupSize;
+      capabilities.max_size_ = properties.maxSubgroupSize;
+      capabilities.max_compute_workgroup_subgroups_ =
+          properties.maxComputeWorkgroupSubgroups;
+      capabilities.required_size_stages_ = properties.requiredSubgroupSizeStages;
+    }
+  }
+}
+
+/*!
+  */
+inline
+bool VulkanDevice::isSharedMemory(const VmaAllocation memory) const noexcept
+{
+  auto ite = std::find_if(shared_memory_list_.begin(),
+                          shared_memory_list_.end(),
+                          [memory](const SharedMemory& shared)
+                          {
+                            return shared.memory_ == memory;
+                          });
+  const bool result = (memory != VK_NULL_HANDLE) &&
+                      (ite != shared_memory_list_.end());
+  return result;
+}
+
+/*!
+  */
+inline
+VmaAllocationCreateInfo VulkanDevice::makeAllocationCreateInfo(
+    const BufferUsage usage) noexcept
+{
+  VmaAllocationCreateInfo alloc_create_info;
+  switch (usage) {
+   case BufferUsage::kHostOnly: {
+    alloc_create_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+    break;
+   }
+   case BufferUsage::kHostToDevice: {
+    alloc_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    break;
+   }
+   case BufferUsage::kDeviceToHost: {
+    alloc_create_info.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+    break;
+   }
+   case BufferUsage::kDeviceOnly:
+   default: {
+    alloc_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    break;
+   }
+  }
+  alloc_create_info.flags = 0;
+  alloc_create_info.requiredFlags = 0;
+  alloc_create_info.preferredFlags = 0;
+  alloc_create_info.memoryTypeBits = 0;
+  alloc_create_info.pool = VK_NULL_HANDLE;
+  alloc_create_info.pUserData = nullptr;
+  return alloc_create_info;
+}
+
+/*!
+  */
+inline
+vk::BufferCreateInfo VulkanDevice::makeBufferCreateInfo(
+    const std::size_t size,
+    const bool is_concurrent) const noexcept
+{
+  vk::BufferCreateInfo buffer_create_info;
+  buffer_create_info.size = size;
+  buffer_create_info.usage = vk::BufferUsageFlagBits::eTransferSrc |
+                             vk::BufferUsageFlagBits::eTransferDst;
+  buffer_create_info.usage = buffer_create_info.usage | 
+                             vk::BufferUsageFlagBits::eStorageBuffer;
+  // An exclusive buffer requires the ownership transfers between the families
+  if (is_concurrent && (1 < queue_family_index_list_.size())) {
+    buffer_create_info.sharingMode = vk::SharingMode::eConcurrent;
+    buffer_create_info.queueFamilyIndexCount =
+        static_cast<uint32b>(queue_family_index_list_.size());
+    buffer_create_info.pQueueFamilyIndices = queue_family_index_list_.data();
+  }
+  else {
+    buffer_create_info.sharingMode = vk::SharingMode::eExclusive;
+    buffer_create_info.queueFamilyIndexCount = 0;
+    buffer_create_info.pQueueFamilyIndices = nullptr;
+  }
+  return buffer_create_info;
+}
+
+/*!
+  */
+inline
+std::vector<vk::CommandPool> VulkanDevice::makeCommandPoolList() const
+{
+  std::vector<vk::CommandPool> command_pool_list;
+  command_pool_list.reserve(queue_family_index_list_.size());
+  for (std::size_t i = 0; i < queue_family_index_list_.size(); ++i) {
+    const vk::CommandPoolCreateInfo pool_info{
+        vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+        queue_family_index_list_[i]};
+    vk::CommandPool command_pool = device_.createCommandPool(pool_info);
+    command_pool_list.emplace_back(command_pool);
+  }
+  return command_pool_list;
+}
+
+/*!
+  */
+inline
+vk::BufferMemoryBarrier VulkanDevice::makeOwnershipBarrier(
+    const vk::Buffer& buffer,
+    const QueueType src_queue_type,
+    const QueueType dst_queue_type) const noexcept
+{
+  vk::BufferMemoryBarrier barrier;
+  barrier.srcQueueFamilyIndex = queueFamilyIndex(src_queue_type);
+  barrier.dstQueueFamilyIndex = queueFamilyIndex(dst_queue_type);
+  barrier.buffer = buffer;
+  barrier.offset = 0;
+  barrier.size = VK_WHOLE_SIZE;
+  return barrier;
+}
+
 /*!
   */
 inline
@@ -884,12 +2451,161 @@ vk::ApplicationInfo VulkanDevice::makeApplicationInfo(
 /*!
   */
 inline
-uint32b VulkanDevice::queueFamilyIndex(const QueueType queue_type) const noexcept
+auto VulkanDevice::queueState(const QueueType queue_type,
+                              const uint32b queue_index) const noexcept
+    -> QueueState&
 {
   const std::size_t list_index = static_cast<std::size_t>(queue_type);
   const std::size_t ref_index = queue_family_index_ref_list_[list_index];
-  const uint32b family_index = queue_family_index_list_[ref_index];
-  return family_index;
+  auto& family_state = queue_state_list_[ref_index];
+  return family_state[queue_index % family_state.size()];
+}
+
+/*!
+  */
+inline
+void VulkanDevice::releaseSharedMemory(const VmaAllocation memory) noexcept
+{
+  auto ite = std::find_if(shared_memory_list_.begin(),
+                          shared_memory_list_.end(),
+                          [memory](const SharedMemory& shared)
+                          {
+                            return shared.memory_ == memory;
+                          });
+  if (ite != shared_memory_list_.end()) {
+    --(ite->ref_count_);
+    if (ite->ref_count_ == 0) {
+      vmaFreeMemory(allocator_, ite->memory_);
+      shared_memory_list_.erase(ite);
+    }
+  }
+}
+
+/*!
+  */
+inline
+void VulkanDevice::retireSubmissions(QueueState& state) const noexcept
+{
+  auto& pending_list = state.pending_fence_list_;
+  auto ite = std::remove_if(pending_list.begin(), pending_list.end(),
+  [this, &state](const vk::Fence& fence)
+  {
+    const bool is_completed = device_.getFenceStatus(fence) == vk::Result::eSuccess;
+    if (is_completed) {
+      device_.resetFences(1, &fence);
+      state.free_fence_list_.emplace_back(fence);
+    }
+    return is_completed;
+  });
+  pending_list.erase(ite, pending_list.end());
+}
+
+/*!
+  \details
+  If timeline semaphores are supported, the batch also signals the next
+  timeline value of the queue, and the value is returned. The timeline info
+  is linked in front of the pNext chain of the batch. If the chain already
+  has a timeline info, the value is signaled by a following empty batch,
+  which is ordered after the batch in the queue, and the wait values must be
+  in that timeline info too. Without timeline semaphores, a batch without a
+  fence is tracked with a recycled fence, and 0 is returned. A batch with a
+  fence isn't tracked, so it never needs an extra submission.
+  */
+inline
+uint64b VulkanDevice::submitInfo(const vk::Queue& queue,
+                                 QueueState& state,
+                                 const vk::SubmitInfo& info,
+                                 const vk::ArrayProxy<const uint64b>& wait_values,
+                                 const vk::Fence& fence) const noexcept
+{
+  const TraceSpan span{tracer(), TraceCategory::kSubmit, "submit"};
+  if (isTimelineSemaphoreSupported()) {
+    const uint64b value = ++state.timeline_value_;
+    if (hasTimelineSubmitInfo(info.pNext)) {
+      queue.submit(1, &info, fence);
+      const vk::TimelineSemaphoreSubmitInfoKHR timeline_info{0, nullptr, 1, &value};
+      vk::SubmitInfo signal_info{0, nullptr, nullptr, 0, nullptr,
+                                 1, &state.timeline_semaphore_};
+      signal_info.pNext = &timeline_info;
+      queue.submit(1, &signal_info, vk::Fence{});
+      return value;
+    }
+    std::vector<vk::Semaphore> semaphore_list{
+        info.pSignalSemaphores,
+        info.pSignalSemaphores + info.signalSemaphoreCount};
+    semaphore_list.emplace_back(state.timeline_semaphore_);
+    // The values are ignored for the binary semaphores
+    std::vector<uint64b> value_list(semaphore_list.size(), 0);
+    value_list.back() = value;
+    vk::TimelineSemaphoreSubmitInfoKHR timeline_info{
+        0,
+        nullptr,
+        static_cast<uint32b>(value_list.size()),
+        value_list.data()};
+    if (!wait_values.empty()) {
+      timeline_info.waitSemaphoreValueCount = info.waitSemaphoreCount;
+      timeline_info.pWaitSemaphoreValues = wait_values.data();
+    }
+    timeline_info.pNext = info.pNext;
+    vk::SubmitInfo timeline_submit_info = info;
+    timeline_submit_info.signalSemaphoreCount =
+        static_cast<uint32b>(semaphore_list.size());
+    timeline_submit_info.pSignalSemaphores = semaphore_list.data();
+    timeline_submit_info.pNext = &timeline_info;
+    queue.submit(1, &timeline_submit_info, fence);
+    return value;
+  }
+
+  if (fence) {
+    queue.submit(1, &info, fence);
+    return 0;
+  }
+  // The completed fences are recycled only when no fence is free
+  if (state.free_fence_list_.empty())
+    retireSubmissions(state);
+  vk::Fence tracking_fence;
+  if (state.free_fence_list_.empty()) {
+    const vk::FenceCreateInfo fence_info{};
+    device_.createFence(&fence_info, nullptr, &tracking_fence);
+  }
+  else {
+    tracking_fence = state.free_fence_list_.back();
+    state.free_fence_list_.pop_back();
+  }
+  queue.submit(1, &info, tracking_fence);
+  state.pending_fence_list_.emplace_back(tracking_fence);
+  return 0;
+}
+
+/*!
+  \details
+  A command pool must be externally synchronized, so each thread has its own
+  pools. The command buffers allocated by a thread must be recorded by the
+  thread, and must be completed before the thread exits since the pools are
+  destroyed at the thread exit. Objects which keep command buffers across
+  calls, like kernels and buffers, own their pools instead.
+  */
+inline
+std::vector<vk::CommandPool>& VulkanDevice::threadCommandPoolList() const noexcept
+{
+  // Reclaims the pools of all devices which the thread used
+  thread_local CommandPoolReclaimer reclaimer;
+
+  const auto id = std::this_thread::get_id();
+  auto& registry = *command_pool_registry_;
+  std::lock_guard<std::mutex> lock{registry.mutex_};
+  auto ite = registry.pool_list_.find(id);
+  if (ite == registry.pool_list_.end()) {
+    ite = registry.pool_list_.emplace(id, makeCommandPoolList()).first;
+    auto& registry_list = reclaimer.registry_list_;
+    registry_list.erase(std::remove_if(registry_list.begin(),
+                                       registry_list.end(),
+                                       [](const auto& r){return r.expired();}),
+                        registry_list.end());
+    registry_list.emplace_back(command_pool_registry_);
+  }
+  // The references to the elements of the map are never invalidated
+  return ite->second;
 }
 
 } // namespace clspvtest
@@ -12,11 +12,17 @@
 
 // Standard C++ library
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 // Vulkan
 #include <vulkan/vulkan.hpp>
@@ -30,6 +36,10 @@ namespace clspvtest {
 
 // Forward declaration
 template <typename> class VulkanBuffer;
+class VulkanMetrics;
+class VulkanProfiler;
+class VulkanRecorder;
+class VulkanTracer;
 
 /*!
   */
@@ -46,33 +56,113 @@ class VulkanDevice
     kIntel = 0x8086 // INTEL
   };
 
+  //! The elapsed time of the initialization phases in milliseconds
+  struct InitializationTime
+  {
+    double instance_ = 0.0; //!< Instance and debug messenger
+    double physical_device_ = 0.0; //!< Device selection and device info
+    double device_ = 0.0; //!< Logical device
+    double queue_ = 0.0; //!< Queue states and timeline semaphores
+    double command_pool_ = 0.0;
+    double memory_allocator_ = 0.0;
+    double total_ = 0.0; //!< Including the device info cache
+  };
+
+  //! The subgroup capabilities of the device
+  struct SubgroupCapabilities
+  {
+    uint32b size_ = 0; //!< The default subgroup size
+    uint32b min_size_ = 0; //!< Same as the default size without the size control
+    uint32b max_size_ = 0; //!< Same as the default size without the size control
+    uint32b max_compute_workgroup_subgroups_ = 0;
+    vk::ShaderStageFlags supported_stages_;
+    vk::SubgroupFeatureFlags supported_operations_;
+    vk::ShaderStageFlags required_size_stages_; //!< The stages which can require a size
+    bool quad_operations_in_all_stages_ = false;
+    bool size_control_ = false; //!< A pipeline can require a subgroup size
+    bool compute_full_subgroups_ = false; //!< A compute pipeline can require full subgroups
+  };
+
+  //! The subgroup requirements of the pipeline of a kernel
+  struct SubgroupSizeControl
+  {
+    uint32b required_size_ = 0; //!< The subgroup size of the pipeline. Not required if 0
+    bool require_full_subgroups_ = false; //!< Every subgroup of a workgroup is full
+    bool allow_varying_size_ = false; //!< The size may be any size from min to max
+  };
+
 
   //! Initialize a vulkan device
   VulkanDevice(DeviceOptions& options);
 
+  //! Initialize a vulkan device on the instance which is shared with other devices
+  VulkanDevice(const vk::Instance& instance, DeviceOptions& options);
+
   //! Destroy a vulkan instance
   ~VulkanDevice() noexcept;
 
 
+  //! Record a barrier which acquires the ownership of a buffer
+  void acquireOwnership(const vk::Buffer& buffer,
+                        const QueueType src_queue_type,
+                        const QueueType dst_queue_type,
+                        const vk::CommandBuffer& command) const noexcept;
+
   //! Allocate a memory of a buffer
   template <typename Type>
-  void allocate(const std::size_t size, VulkanBuffer<Type>* buffer) noexcept;
+  bool allocate(const std::size_t size, VulkanBuffer<Type>* buffer) noexcept;
+
+  //! Allocate memories of the deferred buffers in one batch
+  bool allocateDeferredBuffers() noexcept;
+
+  //! Allocate an exportable memory of a buffer, or import it if the fd isn't -1
+  template <typename Type>
+  void allocateExternal(const std::size_t size,
+                        const int fd,
+                        VulkanBuffer<Type>* buffer) noexcept;
+
+  //! Allocate a memory block which is shared by the given number of buffers
+  VmaAllocation allocateSharedMemory(const vk::MemoryRequirements& requirements,
+                                     const BufferUsage usage,
+                                     const std::size_t num_of_buffers,
+                                     VmaAllocationInfo* block_info) noexcept;
+
+  //! Bind a deferred buffer to a shared memory block at the offset
+  bool bindDeferredBuffer(const vk::Buffer* buffer,
+                          const vk::Buffer& handle,
+                          const VmaAllocation memory,
+                          const std::size_t offset) noexcept;
 
   //! Return the workgroup size for the work dimension
   template <std::size_t kDimension>
   std::array<uint32b, 3> calcWorkGroupSize(
       const std::array<uint32b, kDimension>& works) const noexcept;
 
-  //! Return the command pool
+  //! Return the workgroup size for the work dimension and the local-work size
+  template <std::size_t kDimension>
+  std::array<uint32b, 3> calcWorkGroupSize(
+      const std::array<uint32b, kDimension>& works,
+      const std::array<uint32b, 3>& local_work_size) const noexcept;
+
+  //! Return the command pool of the calling thread
   vk::CommandPool& commandPool(const QueueType queue_type) noexcept;
 
-  //! Return the command pool
+  //! Return the command pool of the calling thread
   const vk::CommandPool& commandPool(const QueueType queue_type) const noexcept;
 
+  //! Create a command pool which is owned by the caller
+  vk::CommandPool createCommandPool(const QueueType queue_type) const;
+
+  //! Create a vulkan instance which can be shared by devices
+  static vk::Instance createInstance(const DeviceOptions& options);
+
   //! Deallocate a memory of a buffer
   template <typename Type>
   void deallocate(VulkanBuffer<Type>* buffer) noexcept;
 
+  //! Check if the memory allocation of buffers is deferred until first use
+  bool deferredAllocation() const noexcept;
+
   //! Destroy a vulkan instance
   void destroy() noexcept;
 
@@ -82,11 +172,27 @@ class VulkanDevice
   //! Return the device body
   const vk::Device& device() const noexcept;
 
+  //! Return the number of the physical device
+  uint32b deviceNumber() const noexcept;
+
+  //! Export the memory of a buffer as a file descriptor
+  template <typename Type>
+  int exportMemory(const VulkanBuffer<Type>& buffer) const noexcept;
+
   //! Return the list of device info
 //  static std::vector<VulkanPhysicalDeviceInfo> getPhysicalDeviceInfoList(
 //      zisc::pmr::memory_resource* mem_resource =
 //          zisc::SimpleMemoryResource::sharedResource()) noexcept;
 
+  //! Return the executables of a pipeline which is created with the statistics capture
+  std::vector<vk::PipelineExecutablePropertiesKHR> getPipelineExecutableProperties(
+      const vk::Pipeline& pipeline) const noexcept;
+
+  //! Return the driver statistics of an executable of a pipeline
+  std::vector<vk::PipelineExecutableStatisticKHR> getPipelineExecutableStatistics(
+      const vk::Pipeline& pipeline,
+      const uint32b executable_index) const noexcept;
+
   //! Return the shader module by the index
   const vk::ShaderModule& getShaderModule(const std::size_t index) const noexcept;
 
@@ -99,10 +205,61 @@ class VulkanDevice
   //! Initialize local-work size
   void initLocalWorkSize(const uint32b subgroup_size) noexcept;
 
+  //! Return the elapsed time of the initialization phases
+  const InitializationTime& initializationTime() const noexcept;
+
+  //! Return the vulkan instance
+  const vk::Instance& instance() const noexcept;
+
+  //! Check if the memory allocation of the buffer is still deferred
+  bool isDeferredBuffer(const vk::Buffer* buffer,
+                        const vk::Buffer& handle) const noexcept;
+
+  //! Check if buffer memories can be exported and imported as file descriptors
+  bool isExternalMemorySupported() const noexcept;
+
+  //! Check if the queries can be reset on the host
+  bool isHostQueryResetSupported() const noexcept;
+
+  //! Check if the kernel of the module has a tuned local-work size
+  bool isLocalWorkSizeTuned(const uint32b module_index,
+                            const std::string_view kernel_name) const noexcept;
+
+  //! Check if the driver statistics of pipeline executables can be captured
+  bool isPipelineExecutableInfoSupported() const noexcept;
+
+  //! Check if the pipeline statistics queries are supported
+  bool isPipelineStatisticsQuerySupported() const noexcept;
+
+  //! Check if the compute queues and the transfer queues are in the same family
+  bool isQueueFamilyShared() const noexcept;
+
+  //! Check if the compute stage supports the subgroup operations
+  bool isSubgroupOperationSupported(
+      const vk::SubgroupFeatureFlags operations) const noexcept;
+
+  //! Check if a pipeline can require a subgroup size or full subgroups
+  bool isSubgroupSizeControlSupported() const noexcept;
+
+  //! Check if the timeline semaphores are supported
+  bool isTimelineSemaphoreSupported() const noexcept;
+
+  //! Return the timeline value which is signaled by the last submission to the queue
+  uint64b lastTimelineValue(const QueueType queue_type,
+                            const uint32b queue_index) const noexcept;
+
+  //! Load the tuned local-work sizes of the device from the cache file
+  bool loadLocalWorkSizeCache(const std::string_view cache_path);
+
   //! Return the local-work size for the work dimension
   template <std::size_t kDimension>
   const std::array<uint32b, 3>& localWorkSize() const noexcept;
 
+  //! Return the local-work size of the kernel of the module. The tuned size is preferred
+  template <std::size_t kDimension>
+  std::array<uint32b, 3> localWorkSize(const uint32b module_index,
+                                       const std::string_view kernel_name) const noexcept;
+
 //  //! Make a kernel
 //  template <std::size_t kDimension, typename Function, typename ...ArgumentTypes>
 //  UniqueKernel<kDimension, ArgumentTypes...> makeKernel(
@@ -115,24 +272,130 @@ class VulkanDevice
   //! Return the memory allocator of the device
   const VmaAllocator& memoryAllocator() const noexcept;
 
+  //! Return the attached metrics registry. Returns null if the metrics are disabled
+  VulkanMetrics* metrics() const noexcept;
+
   //! Return the device name
   std::string_view name() const noexcept;
 
+  //! Return the number of the submissions which are not completed in the queue
+  std::size_t numOfPendingSubmissions(const QueueType queue_type,
+                                      const uint32b queue_index) const noexcept;
+
+  //! Return the number of queues of the queue type
+  uint32b numOfQueues(const QueueType queue_type) const noexcept;
+
+  //! Check if the device owns the vulkan instance
+  bool ownsInstance() const noexcept;
+
   //! Return the physical device info
   const VulkanPhysicalDeviceInfo& physicalDeviceInfo() const noexcept;
 
+  //! Return the attached profiler. Returns null if profiling is disabled
+  VulkanProfiler* profiler() const noexcept;
+
+  //! Return an index of a queue family
+  uint32b queueFamilyIndex(const QueueType queue_type) const noexcept;
+
+  //! Return the attached recorder. Returns null if capturing is disabled
+  VulkanRecorder* recorder() const noexcept;
+
+  //! Record a barrier which releases the ownership of a buffer
+  void releaseOwnership(const vk::Buffer& buffer,
+                        const QueueType src_queue_type,
+                        const QueueType dst_queue_type,
+                        const vk::CommandBuffer& command) const noexcept;
+
+  //! Reset the queries on the host
+  void resetQueries(const vk::QueryPool& query_pool,
+                    const uint32b first_query,
+                    const uint32b num_of_queries) const noexcept;
+
+  //! Save the tuned local-work sizes of the device into the cache file
+  void saveLocalWorkSizeCache(const std::string_view cache_path) const;
+
+  //! Return the queue index. The least loaded queue is selected for 'kAnyQueue'
+  uint32b selectQueueIndex(const QueueType queue_type,
+                           const uint32b queue_index) const noexcept;
+
+  //! Set the tuned local-work size of the kernel of the module
+  void setLocalWorkSize(const uint32b module_index,
+                        const std::string_view kernel_name,
+                        const std::array<uint32b, 3>& local_work_size);
+
+  //! Attach a metrics registry which counts the events of the hot paths
+  void setMetrics(VulkanMetrics* metrics) noexcept;
+
+  //! Attach a profiler which measures the dispatches and the copies
+  void setProfiler(VulkanProfiler* profiler) noexcept;
+
+  //! Attach a recorder which captures the buffer and kernel operations
+  void setRecorder(VulkanRecorder* recorder) noexcept;
+
   //! Set a shader module
   void setShaderModule(const std::vector<uint32b>& spirv_code,
                        const std::size_t index);
 
-  //! Return the subgroup size
+  //! Set the subgroup requirements of the kernel
+  void setSubgroupSizeControl(const std::string_view kernel_name,
+                              const SubgroupSizeControl& control);
+
+  //! Attach a tracer which records the host activity
+  void setTracer(VulkanTracer* tracer) noexcept;
+
+  //! Return the subgroup capabilities
+  const SubgroupCapabilities& subgroupCapabilities() const noexcept;
+
+  //! Return the default subgroup size
   uint32b subgroupSize() const noexcept;
 
+  //! Return the subgroup requirements of the kernel which the device supports
+  SubgroupSizeControl subgroupSizeControl(const std::string_view kernel_name) const;
+
   //! Submit a command
   void submit(const QueueType queue_type,
               const uint32b queue_index,
               const vk::CommandBuffer& command) const noexcept;
 
+  //! Submit a command and signal the fence when the command is completed
+  void submit(const QueueType queue_type,
+              const uint32b queue_index,
+              const vk::CommandBuffer& command,
+              const vk::Fence& fence) const noexcept;
+
+  //! Submit a command which waits and signals the semaphores
+  void submit(const QueueType queue_type,
+              const uint32b queue_index,
+              const vk::CommandBuffer& command,
+              const vk::ArrayProxy<const vk::Semaphore>& wait_semaphores,
+              const vk::ArrayProxy<const vk::Semaphore>& signal_semaphores,
+              const vk::Fence& fence) const noexcept;
+
+  //! Submit a command which waits for the semaphores to reach the values
+  void submit(const QueueType queue_type,
+              const uint32b queue_index,
+              const vk::CommandBuffer& command,
+              const vk::ArrayProxy<const vk::Semaphore>& wait_semaphores,
+              const vk::ArrayProxy<const uint64b>& wait_values,
+              const vk::ArrayProxy<const vk::Semaphore>& signal_semaphores,
+              const vk::Fence& fence) const noexcept;
+
+  //! Submit a command which signals the timeline semaphore of the queue
+  uint64b submitTimeline(const QueueType queue_type,
+                         const uint32b queue_index,
+                         const vk::CommandBuffer& command) const noexcept;
+
+  //! Return the timeline semaphore of the queue
+  const vk::Semaphore& timelineSemaphore(const QueueType queue_type,
+                                         const uint32b queue_index) const noexcept;
+
+  //! Return the timeline value which the queue has completed
+  uint64b timelineValue(const QueueType queue_type,
+                        const uint32b queue_index) const noexcept;
+
+  //! Return the attached tracer. Returns null if tracing is disabled
+  VulkanTracer* tracer() const noexcept;
+
   //! Return the vendor name
   std::string_view vendorName() const noexcept;
 
@@ -146,7 +409,66 @@ class VulkanDevice
   void waitForCompletion(const QueueType queue_type,
                          const uint32b queue_index) const noexcept;
 
+  //! Wait this thread until the queue reaches the timeline value
+  void waitForTimeline(const QueueType queue_type,
+                       const uint32b queue_index,
+                       const uint64b value) const noexcept;
+
  private:
+  //! A buffer of which the memory allocation is deferred
+  struct DeferredBuffer
+  {
+    vk::Buffer* buffer_;
+    VmaAllocation* memory_;
+    VmaAllocationInfo* alloc_info_;
+    std::size_t* memory_offset_;
+    BufferUsage usage_;
+  };
+
+  //! A memory block which is shared by multiple buffers
+  struct SharedMemory
+  {
+    VmaAllocation memory_;
+    std::size_t ref_count_;
+  };
+
+  //! The command pools of the threads which use the device
+  struct CommandPoolRegistry
+  {
+    //! Destroy the command pools of a thread
+    void releaseThread(const std::thread::id id) noexcept;
+
+    std::mutex mutex_;
+    std::unordered_map<std::thread::id, std::vector<vk::CommandPool>> pool_list_;
+    vk::Device device_; //!< Null after the device is destroyed
+  };
+
+  //! Destroy the command pools of the calling thread when the thread exits
+  struct CommandPoolReclaimer
+  {
+    //! Release the command pools from the registries
+    ~CommandPoolReclaimer() noexcept;
+
+    std::vector<std::weak_ptr<CommandPoolRegistry>> registry_list_;
+  };
+
+  //! The state of a queue
+  struct QueueState
+  {
+    std::mutex mutex_;
+    std::vector<vk::Fence> pending_fence_list_; //!< Used if timeline semaphores aren't supported
+    std::vector<vk::Fence> free_fence_list_;
+    vk::Semaphore timeline_semaphore_;
+    uint64b timeline_value_ = 0; //!< The last value which is signaled by a submission
+  };
+
+
+  //! Allocate a memory block which is shared by the buffers. The memory mutex must be locked
+  VmaAllocation createSharedMemory(const vk::MemoryRequirements& requirements,
+                                   const BufferUsage usage,
+                                   const std::size_t num_of_buffers,
+                                   VmaAllocationInfo* block_info) noexcept;
+
   //! Output a debug message
   static VKAPI_ATTR VkBool32 VKAPI_CALL debugMessengerCallback(
       VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -161,6 +483,15 @@ class VulkanDevice
   vk::Queue getQueue(const QueueType queue_type,
                      const uint32b queue_index) const noexcept;
 
+  //! Return the access flags of the queue type
+  static vk::AccessFlags getQueueAccessFlags(const QueueType queue_type) noexcept;
+
+  //! Return the pipeline stage of the queue type
+  static vk::PipelineStageFlags getQueueStageFlags(const QueueType queue_type) noexcept;
+
+  //! Check if the pNext chain has a timeline semaphore submit info
+  static bool hasTimelineSubmitInfo(const void* chain) noexcept;
+
   //! Initialize a command pool
   void initCommandPool();
 
@@ -182,6 +513,32 @@ class VulkanDevice
   //! Initialize a queue family index list
   void initQueueFamilyIndexList() noexcept;
 
+  //! Initialize the states of the queues
+  void initQueueStateList();
+
+  //! Initialize the subgroup capabilities
+  void initSubgroupCapabilities() noexcept;
+
+  //! Check if the memory is a block shared by multiple buffers. The memory mutex must be locked
+  bool isSharedMemory(const VmaAllocation memory) const noexcept;
+
+  //! Make an allocation create info
+  static VmaAllocationCreateInfo makeAllocationCreateInfo(
+      const BufferUsage usage) noexcept;
+
+  //! Make a buffer create info
+  vk::BufferCreateInfo makeBufferCreateInfo(const std::size_t size,
+                                            const bool is_concurrent) const noexcept;
+
+  //! Make the command pools of the calling thread
+  std::vector<vk::CommandPool> makeCommandPoolList() const;
+
+  //! Make a barrier which transfers the ownership of a buffer
+  vk::BufferMemoryBarrier makeOwnershipBarrier(
+      const vk::Buffer& buffer,
+      const QueueType src_queue_type,
+      const QueueType dst_queue_type) const noexcept;
+
   //! Make a vulkan instance
   static vk::Instance makeInstance(const vk::ApplicationInfo& app_info,
                                    const bool enable_validation_layers);
@@ -193,13 +550,36 @@ class VulkanDevice
       const uint32b app_version_minor,
       const uint32b app_version_patch) noexcept;
 
-  //! Return an index of a queue family
-  uint32b queueFamilyIndex(const QueueType queue_type) const noexcept;
+  //! Return the state of a queue
+  QueueState& queueState(const QueueType queue_type,
+                         const uint32b queue_index) const noexcept;
+
+  //! Release a reference to a shared memory block. The memory mutex must be locked
+  void releaseSharedMemory(const VmaAllocation memory) noexcept;
+
+  //! Recycle the fences of the completed submissions. The queue mutex must be locked
+  void retireSubmissions(QueueState& state) const noexcept;
+
+  //! Submit a batch and track the load of the queue. The queue mutex must be locked
+  uint64b submitInfo(const vk::Queue& queue,
+                     QueueState& state,
+                     const vk::SubmitInfo& info,
+                     const vk::ArrayProxy<const uint64b>& wait_values,
+                     const vk::Fence& fence) const noexcept;
+
+  //! Return the command pools of the calling thread
+  std::vector<vk::CommandPool>& threadCommandPoolList() const noexcept;
 
 
   VulkanPhysicalDeviceInfo device_info_;
+  InitializationTime initialization_time_;
   std::vector<vk::ShaderModule> shader_module_list_;
-  std::vector<vk::CommandPool> command_pool_list_;
+  std::shared_ptr<CommandPoolRegistry> command_pool_registry_;
+  mutable std::vector<std::vector<QueueState>> queue_state_list_;
+  mutable std::mutex memory_mutex_;
+  mutable std::mutex local_work_size_mutex_;
+  mutable std::mutex subgroup_mutex_;
+  mutable std::atomic<uint32b> queue_selection_count_{0};
   vk::ApplicationInfo app_info_;
   vk::Instance instance_;
   vk::DebugUtilsMessengerEXT debug_messenger_;
@@ -210,6 +590,29 @@ class VulkanDevice
   std::vector<uint32b> queue_family_index_list_;
   std::array<std::size_t, 2> queue_family_index_ref_list_;
   std::array<std::array<uint32b, 3>, 3> local_work_size_list_;
+  std::map<std::pair<uint32b, std::string>, std::array<uint32b, 3>> tuned_local_work_size_list_; //!< Keyed by the module index and the kernel name
+  SubgroupCapabilities subgroup_capabilities_;
+  std::map<std::string, SubgroupSizeControl, std::less<>> subgroup_size_control_list_;
+  uint32b device_number_ = 0;
+  std::vector<DeferredBuffer> deferred_buffer_list_;
+  std::vector<SharedMemory> shared_memory_list_;
+  PFN_vkGetSemaphoreCounterValueKHR get_semaphore_counter_value_ = nullptr;
+  PFN_vkWaitSemaphoresKHR wait_semaphores_ = nullptr;
+  PFN_vkGetMemoryFdKHR get_memory_fd_ = nullptr;
+  PFN_vkResetQueryPoolEXT reset_query_pool_ = nullptr;
+  PFN_vkGetPipelineExecutablePropertiesKHR get_pipeline_executable_properties_ = nullptr;
+  PFN_vkGetPipelineExecutableStatisticsKHR get_pipeline_executable_statistics_ = nullptr;
+  VulkanMetrics* metrics_ = nullptr;
+  VulkanProfiler* profiler_ = nullptr;
+  VulkanRecorder* recorder_ = nullptr;
+  VulkanTracer* tracer_ = nullptr;
+  bool deferred_allocation_ = false;
+  bool is_timeline_semaphore_supported_ = false;
+  bool is_external_memory_supported_ = false;
+  bool is_host_query_reset_supported_ = false;
+  bool is_pipeline_executable_info_supported_ = false;
+  bool is_pipeline_statistics_query_supported_ = false;
+  bool owns_instance_ = true;
 };
 
 // type aliases
@@ -0,0 +1,339 @@
+/*!
+  \file vulkan_device_group-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_DEVICE_GROUP_INL_HPP
+#define CLSPV_TEST_VULKAN_DEVICE_GROUP_INL_HPP
+
+#include "vulkan_device_group.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <utility>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "device_options.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_device.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+inline
+VulkanDeviceGroup::VulkanDeviceGroup(DeviceOptions& options) :
+    VulkanDeviceGroup(options, std::vector<uint32b>{})
+{
+}
+
+/*!
+  \details
+  If the number list is empty, the all physical devices are used.
+  */
+inline
+VulkanDeviceGroup::VulkanDeviceGroup(
+    DeviceOptions& options,
+    const std::vector<uint32b>& device_number_list)
+{
+  initialize(options, device_number_list);
+}
+
+/*!
+  */
+inline
+VulkanDeviceGroup::~VulkanDeviceGroup() noexcept
+{
+  destroy();
+}
+
+/*!
+  */
+inline
+void VulkanDeviceGroup::destroy() noexcept
+{
+  // The devices must be destroyed before the instance
+  device_list_.clear();
+  score_list_.clear();
+  if (instance_) {
+    instance_.destroy();
+    instance_ = nullptr;
+  }
+}
+
+/*!
+  */
+inline
+VulkanDevice* VulkanDeviceGroup::device(const std::size_t index) noexcept
+{
+  return device_list_[index].get();
+}
+
+/*!
+  */
+inline
+const VulkanDevice* VulkanDeviceGroup::device(const std::size_t index) const
+    noexcept
+{
+  return device_list_[index].get();
+}
+
+/*!
+  \details
+  Each device has a buffer of the whole dispatch size and writes its results
+  at the part assigned to it. The parts are read concurrently.
+  */
+template <std::size_t kDimension, typename Type> inline
+void VulkanDeviceGroup::gather(
+    const std::vector<WorkRange<kDimension>>& range_list,
+    const std::vector<const VulkanBuffer<Type>*>& buffer_list,
+    Type* data) const noexcept
+{
+  std::vector<std::thread> thread_list;
+  thread_list.reserve(range_list.size());
+  for (std::size_t i = 0; i < range_list.size(); ++i) {
+    const auto& range = range_list[i];
+    if (range.linear_size_ == 0)
+      continue;
+    const VulkanBuffer<Type>* buffer = buffer_list[i];
+    thread_list.emplace_back([buffer, &range, data]()
+    {
+      buffer->read(data + range.linear_offset_,
+                   range.linear_size_,
+                   range.linear_offset_,
+                   kAnyQueue);
+    });
+  }
+  for (auto& t : thread_list)
+    t.join();
+}
+
+/*!
+  */
+inline
+const vk::Instance& VulkanDeviceGroup::instance() const noexcept
+{
+  return instance_;
+}
+
+/*!
+  */
+inline
+std::size_t VulkanDeviceGroup::numOfDevices() const noexcept
+{
+  return device_list_.size();
+}
+
+/*!
+  */
+inline
+std::size_t VulkanDeviceGroup::numOfPhysicalDevices() const noexcept
+{
+  const auto physical_device_list = instance_.enumeratePhysicalDevices();
+  return physical_device_list.size();
+}
+
+/*!
+  \details
+  The function is called as function(device, index, range) on a thread per
+  device, and must record and submit the part of the dispatch to the device.
+  The function returns when the all parts are completed. The kernels and the
+  buffers which the function uses must be made for each device beforehand.
+  */
+template <std::size_t kDimension, typename Function> inline
+std::vector<WorkRange<kDimension>> VulkanDeviceGroup::run(
+    const std::array<uint32b, kDimension>& works,
+    Function&& function)
+{
+  const auto range_list = split(works);
+  std::vector<double> time_list(numOfDevices(), 0.0);
+  std::vector<std::thread> thread_list;
+  thread_list.reserve(numOfDevices());
+  for (std::size_t i = 0; i < numOfDevices(); ++i) {
+    if (range_list[i].linear_size_ == 0)
+      continue;
+    thread_list.emplace_back([this, &function, &range_list, &time_list, i]()
+    {
+      auto d = device(i);
+      const auto start = std::chrono::steady_clock::now();
+      function(d, i, range_list[i]);
+      d->waitForCompletion();
+      const auto end = std::chrono::steady_clock::now();
+      const std::chrono::duration<double> elapsed_time = end - start;
+      time_list[i] = elapsed_time.count();
+    });
+  }
+  for (auto& t : thread_list)
+    t.join();
+
+  updateScores(range_list, time_list);
+  return range_list;
+}
+
+/*!
+  */
+inline
+double VulkanDeviceGroup::score(const std::size_t index) const noexcept
+{
+  return score_list_[index];
+}
+
+/*!
+  \details
+  The scores are relative, only the ratio between the devices matters.
+  */
+inline
+void VulkanDeviceGroup::setScore(const std::size_t index,
+                                 const double score) noexcept
+{
+  score_list_[index] = (std::max)(score, 0.0);
+}
+
+/*!
+  \details
+  0 keeps the scores fixed and 1 replaces them with the last measurement.
+  */
+inline
+void VulkanDeviceGroup::setScoreSmoothing(const double smoothing) noexcept
+{
+  score_smoothing_ = std::clamp(smoothing, 0.0, 1.0);
+}
+
+/*!
+  */
+inline
+void VulkanDeviceGroup::setShaderModule(const std::vector<uint32b>& spirv_code,
+                                        const std::size_t index)
+{
+  for (auto& d : device_list_)
+    d->setShaderModule(spirv_code, index);
+}
+
+/*!
+  \details
+  The parts are contiguous and cover the whole dispatch. A device gets an
+  empty part if its share is less than a row.
+  */
+template <std::size_t kDimension> inline
+std::vector<WorkRange<kDimension>> VulkanDeviceGroup::split(
+    const std::array<uint32b, kDimension>& works) const noexcept
+{
+  constexpr std::size_t axis = kDimension - 1;
+  const std::size_t n = numOfDevices();
+  const double total_score = std::accumulate(score_list_.begin(),
+                                             score_list_.end(),
+                                             0.0);
+  const std::size_t row_size = (kDimension == 2) ? works[0] : 1;
+  const uint32b total = works[axis];
+
+  std::vector<WorkRange<kDimension>> range_list(n);
+  double cumulative_score = 0.0;
+  uint32b begin = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    cumulative_score += (0.0 < total_score) ? score_list_[i] : 1.0;
+    const double ratio = (0.0 < total_score)
+        ? cumulative_score / total_score
+        : cumulative_score / static_cast<double>(n);
+    uint32b end = (i + 1 == n)
+        ? total
+        : static_cast<uint32b>(std::llround(ratio * static_cast<double>(total)));
+    end = std::clamp(end, begin, total);
+
+    auto& range = range_list[i];
+    range.offset_.fill(0);
+    range.works_ = works;
+    range.offset_[axis] = begin;
+    range.works_[axis] = end - begin;
+    range.linear_offset_ = row_size * begin;
+    range.linear_size_ = row_size * (end - begin);
+    begin = end;
+  }
+  return range_list;
+}
+
+/*!
+  */
+inline
+void VulkanDeviceGroup::waitForCompletion() const noexcept
+{
+  for (const auto& d : device_list_)
+    d->waitForCompletion();
+}
+
+/*!
+  */
+inline
+void VulkanDeviceGroup::initialize(
+    DeviceOptions& options,
+    const std::vector<uint32b>& device_number_list)
+{
+  instance_ = VulkanDevice::createInstance(options);
+
+  std::vector<uint32b> number_list = device_number_list;
+  if (number_list.empty()) {
+    number_list.resize(numOfPhysicalDevices());
+    std::iota(number_list.begin(), number_list.end(), 0u);
+  }
+
+  device_list_.reserve(number_list.size());
+  for (const uint32b number : number_list) {
+    DeviceOptions device_options = options;
+    device_options.vulkan_device_number_ = number;
+    device_options.device_selection_ = DeviceSelection::kNumber;
+    device_list_.emplace_back(
+        std::make_unique<VulkanDevice>(instance_, device_options));
+  }
+  score_list_.resize(device_list_.size(), 1.0);
+}
+
+/*!
+  \details
+  The measured throughput redistributes the total score of the measured
+  devices, the scores of the other devices are unchanged.
+  */
+template <std::size_t kDimension> inline
+void VulkanDeviceGroup::updateScores(
+    const std::vector<WorkRange<kDimension>>& range_list,
+    const std::vector<double>& time_list) noexcept
+{
+  const std::size_t n = numOfDevices();
+  std::vector<double> throughput_list(n, 0.0);
+  double total_throughput = 0.0;
+  double measured_score = 0.0;
+  for (std::size_t i = 0; i < n; ++i) {
+    if ((0 < range_list[i].linear_size_) && (0.0 < time_list[i])) {
+      throughput_list[i] = static_cast<double>(range_list[i].linear_size_) /
+                           time_list[i];
+      total_throughput += throughput_list[i];
+      measured_score += score_list_[i];
+    }
+  }
+  if (total_throughput <= 0.0)
+    return;
+
+  for (std::size_t i = 0; i < n; ++i) {
+    if (0.0 < throughput_list[i]) {
+      const double measurement = measured_score * throughput_list[i] /
+                                 total_throughput;
+      score_list_[i] = (1.0 - score_smoothing_) * score_list_[i] +
+                       score_smoothing_ * measurement;
+    }
+  }
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_DEVICE_GROUP_INL_HPP
@@ -0,0 +1,149 @@
+/*!
+  \file vulkan_device_group.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_DEVICE_GROUP_HPP
+#define CLSPV_TEST_VULKAN_DEVICE_GROUP_HPP
+
+// Standard C++ library
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "device_options.hpp"
+#include "vulkan_device.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+template <typename> class VulkanBuffer;
+
+/*!
+  \brief The part of a dispatch which is assigned to a device
+
+  A 1D dispatch is split along x and a 2D dispatch along y, so the items of
+  a part are contiguous in the row-major order.
+  */
+template <std::size_t kDimension>
+struct WorkRange
+{
+  static_assert((kDimension == 1) || (kDimension == 2),
+                "The dimension of a split dispatch must be 1 or 2.");
+
+  std::array<uint32b, kDimension> offset_;
+  std::array<uint32b, kDimension> works_;
+  std::size_t linear_offset_ = 0; //!< The index of the first item in the row-major order
+  std::size_t linear_size_ = 0; //!< The number of items, 0 if the part is empty
+};
+
+/*!
+  \brief Distribute a dispatch across multiple devices
+
+  The devices share a vulkan instance. A dispatch is split into parts in
+  proportion to the throughput scores of the devices. The scores start
+  equal and are updated with the throughput measured in run(), so the split
+  follows the actual speed of the devices.
+
+  A physical device number can be repeated, which makes multiple devices on
+  the same physical device. It's useful to test the distribution on a host
+  which has only one GPU or a software implementation.
+  */
+class VulkanDeviceGroup
+{
+ public:
+  //! Create a group of the all physical devices
+  VulkanDeviceGroup(DeviceOptions& options);
+
+  //! Create a group of the physical devices of the given numbers
+  VulkanDeviceGroup(DeviceOptions& options,
+                    const std::vector<uint32b>& device_number_list);
+
+  //! Destroy a group
+  ~VulkanDeviceGroup() noexcept;
+
+
+  //! Destroy a group
+  void destroy() noexcept;
+
+  //! Return the device by the index
+  VulkanDevice* device(const std::size_t index) noexcept;
+
+  //! Return the device by the index
+  const VulkanDevice* device(const std::size_t index) const noexcept;
+
+  //! Read the part of each device from the buffer of the device into the data
+  template <std::size_t kDimension, typename Type>
+  void gather(const std::vector<WorkRange<kDimension>>& range_list,
+              const std::vector<const VulkanBuffer<Type>*>& buffer_list,
+              Type* data) const noexcept;
+
+  //! Return the shared vulkan instance
+  const vk::Instance& instance() const noexcept;
+
+  //! Return the number of devices
+  std::size_t numOfDevices() const noexcept;
+
+  //! Return the number of the physical devices of the instance
+  std::size_t numOfPhysicalDevices() const noexcept;
+
+  //! Execute the parts of a dispatch on the devices and update the scores
+  template <std::size_t kDimension, typename Function>
+  std::vector<WorkRange<kDimension>> run(
+      const std::array<uint32b, kDimension>& works,
+      Function&& function);
+
+  //! Return the throughput score of the device
+  double score(const std::size_t index) const noexcept;
+
+  //! Set the throughput score of the device
+  void setScore(const std::size_t index, const double score) noexcept;
+
+  //! Set the weight of the new measurement in the score update
+  void setScoreSmoothing(const double smoothing) noexcept;
+
+  //! Set a shader module to the all devices
+  void setShaderModule(const std::vector<uint32b>& spirv_code,
+                       const std::size_t index);
+
+  //! Split a dispatch in proportion to the scores
+  template <std::size_t kDimension>
+  std::vector<WorkRange<kDimension>> split(
+      const std::array<uint32b, kDimension>& works) const noexcept;
+
+  //! Wait this thread until all commands in the devices are completed
+  void waitForCompletion() const noexcept;
+
+ private:
+  //! Initialize a group
+  void initialize(DeviceOptions& options,
+                  const std::vector<uint32b>& device_number_list);
+
+  //! Update the scores with the measured time of each part
+  template <std::size_t kDimension>
+  void updateScores(const std::vector<WorkRange<kDimension>>& range_list,
+                    const std::vector<double>& time_list) noexcept;
+
+
+  vk::Instance instance_;
+  std::vector<UniqueDevice> device_list_;
+  std::vector<double> score_list_;
+  double score_smoothing_ = 0.5;
+};
+
+// Type aliases
+using UniqueDeviceGroup = std::unique_ptr<VulkanDeviceGroup>;
+
+} // namespace clspvtest
+
+#include "vulkan_device_group-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_DEVICE_GROUP_HPP
@@ -0,0 +1,408 @@
+/*!
+  \file vulkan_device_selector-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_DEVICE_SELECTOR_INL_HPP
+#define CLSPV_TEST_VULKAN_DEVICE_SELECTOR_INL_HPP
+
+#include "vulkan_device_selector.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "device_options.hpp"
+#include "vulkan_physical_device_info.hpp"
+
+namespace clspvtest {
+
+/*!
+  \details
+  The device type dominates the score as the capability score does, so the
+  bandwidth only ranks the devices of the same type. The bandwidth up to
+  4 TB/s is distinguished.
+  */
+inline
+double VulkanDeviceSelector::calcBenchmarkScore(
+    const VulkanPhysicalDeviceInfo& info,
+    const double bandwidth) noexcept
+{
+  const double type_score = getTypeRank(info);
+  const double bandwidth_score = normalizeTerm(bandwidth, 12.0);
+  const double score = 1000.0 * type_score + 100.0 * bandwidth_score;
+  return score;
+}
+
+/*!
+  \details
+  Each term after the device type is normalized into [0, 1) and weighted by
+  a power of 10, so a term only breaks the ties of the previous terms.
+  */
+inline
+double VulkanDeviceSelector::calcCapabilityScore(
+    const VulkanPhysicalDeviceInfo& info) noexcept
+{
+  const auto& properties = info.properties().properties1_;
+  const double type_score = getTypeRank(info);
+
+  // The largest device local heap
+  vk::DeviceSize heap_size = 0;
+  const auto& memory_properties = info.memoryProperties().properties1_;
+  for (uint32b i = 0; i < memory_properties.memoryHeapCount; ++i) {
+    const auto& heap = memory_properties.memoryHeaps[i];
+    if (heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+      heap_size = (std::max)(heap_size, heap.size);
+  }
+  constexpr double gib = 1024.0 * 1024.0 * 1024.0;
+  const double heap_gib = static_cast<double>(heap_size) / gib;
+
+  const double heap_score = normalizeTerm(heap_gib, 8.0);
+  const double invocation_score = normalizeTerm(
+      static_cast<double>(properties.limits.maxComputeWorkGroupInvocations),
+      16.0);
+  const double subgroup_score = normalizeTerm(
+      static_cast<double>(info.properties().subgroup_.subgroupSize),
+      8.0);
+
+  const double score = 1000.0 * type_score +
+                       100.0 * heap_score +
+                       10.0 * invocation_score +
+                       subgroup_score;
+  return score;
+}
+
+/*!
+  \details
+  A device local buffer is copied repeatedly on a temporary logical device.
+  The bandwidth counts both the read and the write of a copy.
+  */
+inline
+double VulkanDeviceSelector::measureBandwidth(
+    const vk::PhysicalDevice& device,
+    const VulkanPhysicalDeviceInfo& info)
+{
+  constexpr uint32b num_of_copies = 8;
+  constexpr vk::DeviceSize max_buffer_size = 64ull * 1024ull * 1024ull;
+  constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+  const auto& memory_properties = info.memoryProperties().properties1_;
+
+  // Any queue family which supports compute or graphics supports transfers
+  uint32b family_index = 0;
+  {
+    const auto& family_list = info.queueFamilyPropertiesList();
+    const auto transfer_flags = vk::QueueFlagBits::eCompute |
+                                vk::QueueFlagBits::eGraphics |
+                                vk::QueueFlagBits::eTransfer;
+    for (uint32b i = 0; i < family_list.size(); ++i) {
+      if (family_list[i].properties1_.queueFlags & transfer_flags) {
+        family_index = i;
+        break;
+      }
+    }
+  }
+  vk::DeviceSize buffer_size = max_buffer_size;
+  for (uint32b i = 0; i < memory_properties.memoryHeapCount; ++i) {
+    const auto& heap = memory_properties.memoryHeaps[i];
+    if (heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal)
+      buffer_size = (std::min)(buffer_size, heap.size / 8);
+  }
+
+  const float priority = 1.0f;
+  const vk::DeviceQueueCreateInfo queue_info{vk::DeviceQueueCreateFlags{},
+                                             family_index,
+                                             1,
+                                             &priority};
+  const vk::DeviceCreateInfo device_info{vk::DeviceCreateFlags{},
+                                         1,
+                                         &queue_info};
+  const vk::Device d = device.createDevice(device_info);
+
+  std::array<vk::Buffer, 2> buffer_list;
+  std::array<vk::DeviceMemory, 2> memory_list;
+  vk::CommandPool command_pool;
+  vk::Fence fence;
+  // The objects are destroyed even if a command fails on the way
+  const auto destroy = [&]() noexcept
+  {
+    // The result is ignored since nothing can be done on a failure here
+    static_cast<void>(vkDeviceWaitIdle(static_cast<VkDevice>(d)));
+    d.destroyFence(fence);
+    // The command buffer is freed with the pool
+    d.destroyCommandPool(command_pool);
+    for (std::size_t i = 0; i < buffer_list.size(); ++i) {
+      d.destroyBuffer(buffer_list[i]);
+      d.freeMemory(memory_list[i]);
+    }
+    d.destroy();
+  };
+
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point end;
+  try {
+    const vk::Queue queue = d.getQueue(family_index, 0);
+
+    // Buffers
+    for (std::size_t i = 0; i < buffer_list.size(); ++i) {
+      const vk::BufferCreateInfo buffer_info{
+          vk::BufferCreateFlags{},
+          buffer_size,
+          vk::BufferUsageFlagBits::eTransferSrc |
+              vk::BufferUsageFlagBits::eTransferDst,
+          vk::SharingMode::eExclusive};
+      buffer_list[i] = d.createBuffer(buffer_info);
+      const auto requirements = d.getBufferMemoryRequirements(buffer_list[i]);
+      // Prefer a device local memory type
+      uint32b type_index = std::numeric_limits<uint32b>::max();
+      for (uint32b t = 0; t < memory_properties.memoryTypeCount; ++t) {
+        if ((requirements.memoryTypeBits & (1u << t)) == 0)
+          continue;
+        const auto flags = memory_properties.memoryTypes[t].propertyFlags;
+        if ((type_index == std::numeric_limits<uint32b>::max()) ||
+            (flags & vk::MemoryPropertyFlagBits::eDeviceLocal)) {
+          type_index = t;
+          if (flags & vk::MemoryPropertyFlagBits::eDeviceLocal)
+            break;
+        }
+      }
+      const vk::MemoryAllocateInfo alloc_info{requirements.size, type_index};
+      memory_list[i] = d.allocateMemory(alloc_info);
+      d.bindBufferMemory(buffer_list[i], memory_list[i], 0);
+    }
+
+    // Commands
+    const vk::CommandPoolCreateInfo pool_info{vk::CommandPoolCreateFlags{},
+                                              family_index};
+    command_pool = d.createCommandPool(pool_info);
+    vk::CommandBuffer command;
+    {
+      const vk::CommandBufferAllocateInfo alloc_info{command_pool,
+                                                     vk::CommandBufferLevel::ePrimary,
+                                                     1};
+      d.allocateCommandBuffers(&alloc_info, &command);
+    }
+    command.begin(vk::CommandBufferBeginInfo{});
+    command.fillBuffer(buffer_list[0], 0, VK_WHOLE_SIZE, 0);
+    const vk::MemoryBarrier barrier{vk::AccessFlagBits::eTransferWrite,
+                                    vk::AccessFlagBits::eTransferRead |
+                                        vk::AccessFlagBits::eTransferWrite};
+    const vk::BufferCopy copy_info{0, 0, buffer_size};
+    for (uint32b i = 0; i < num_of_copies; ++i) {
+      command.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                              vk::PipelineStageFlagBits::eTransfer,
+                              vk::DependencyFlags{},
+                              1, &barrier,
+                              0, nullptr,
+                              0, nullptr);
+      command.copyBuffer(buffer_list[0], buffer_list[1], 1, &copy_info);
+    }
+    command.end();
+
+    // The first submission is a warm up
+    fence = d.createFence(vk::FenceCreateInfo{});
+    const vk::SubmitInfo submit_info{0, nullptr, nullptr, 1, &command};
+    queue.submit(1, &submit_info, fence);
+    d.waitForFences(1, &fence, VK_TRUE, timeout);
+    d.resetFences(1, &fence);
+    start = std::chrono::steady_clock::now();
+    queue.submit(1, &submit_info, fence);
+    d.waitForFences(1, &fence, VK_TRUE, timeout);
+    end = std::chrono::steady_clock::now();
+  }
+  catch (const std::exception&) {
+    destroy();
+    throw;
+  }
+  destroy();
+
+  const std::chrono::duration<double> elapsed_time = end - start;
+  const double bytes = 2.0 * static_cast<double>(buffer_size * num_of_copies);
+  const double bandwidth = (0.0 < elapsed_time.count())
+      ? bytes / elapsed_time.count() * 1.0e-9
+      : 0.0;
+  return bandwidth;
+}
+
+/*!
+  \details
+  The devices are ranked by the capability score, or by the benchmark score
+  if the selection is 'kBenchmark'. The capability score breaks the ties.
+  The info of each device is loaded from the device info cache if available,
+  and saved into it on a miss, so later processes skip the queries.
+  */
+inline
+uint32b VulkanDeviceSelector::select(const vk::Instance& instance,
+                                     const DeviceOptions& options)
+{
+  if (options.device_selection_ == DeviceSelection::kNumber)
+    return options.vulkan_device_number_;
+
+  const bool is_benchmark =
+      options.device_selection_ == DeviceSelection::kBenchmark;
+  const bool is_cached = is_benchmark && (options.device_cache_path_ != nullptr);
+  ScoreCache cache;
+  if (is_cached)
+    cache = loadCache(options.device_cache_path_);
+  bool is_cache_updated = false;
+
+  const auto physical_device_list = instance.enumeratePhysicalDevices();
+  uint32b selected_number = 0;
+  double best_score = -1.0;
+  double best_capability = -1.0;
+  for (uint32b number = 0; number < physical_device_list.size(); ++number) {
+    const auto& physical_device = physical_device_list[number];
+    VulkanPhysicalDeviceInfo info;
+    info.fetch(physical_device);
+    // The cache is keyed by the device, so each device hits its own record
+    const bool is_info_cached = (options.device_info_cache_path_ != nullptr) &&
+                                info.loadCache(options.device_info_cache_path_);
+    const double capability = calcCapabilityScore(info);
+    double score = capability;
+    if (is_benchmark) {
+      const std::string key = getCacheKey(info);
+      const auto result = cache.find(key);
+      double bandwidth = 0.0;
+      if (result != cache.end()) {
+        bandwidth = result->second;
+      }
+      else {
+        bandwidth = measureBandwidth(physical_device, info);
+        cache[key] = bandwidth;
+        is_cache_updated = true;
+      }
+      score = calcBenchmarkScore(info, bandwidth);
+    }
+    if ((best_score < score) ||
+        ((best_score == score) && (best_capability < capability))) {
+      selected_number = number;
+      best_score = score;
+      best_capability = capability;
+    }
+    if ((options.device_info_cache_path_ != nullptr) && !is_info_cached)
+      info.saveCache(options.device_info_cache_path_);
+  }
+
+  if (is_cached && is_cache_updated)
+    saveCache(options.device_cache_path_, cache);
+  return selected_number;
+}
+
+/*!
+  \details
+  The key consists of the device UUID and the driver UUID, so the results
+  are measured again when the driver is updated.
+  */
+inline
+std::string VulkanDeviceSelector::getCacheKey(
+    const VulkanPhysicalDeviceInfo& info)
+{
+  constexpr char digits[] = "0123456789abcdef";
+  const auto& id_properties = info.properties().id_properties_;
+  std::string key;
+  key.reserve(2 * (VK_UUID_SIZE + VK_UUID_SIZE) + 1);
+  const auto append = [&key, &digits](const uint8b byte)
+  {
+    key.push_back(digits[(byte >> 4) & 0xfu]);
+    key.push_back(digits[byte & 0xfu]);
+  };
+  for (std::size_t i = 0; i < VK_UUID_SIZE; ++i)
+    append(id_properties.deviceUUID[i]);
+  key.push_back('-');
+  for (std::size_t i = 0; i < VK_UUID_SIZE; ++i)
+    append(id_properties.driverUUID[i]);
+  return key;
+}
+
+/*!
+  \details
+  A discrete GPU has the highest rank and an unknown type has 0.
+  */
+inline
+double VulkanDeviceSelector::getTypeRank(
+    const VulkanPhysicalDeviceInfo& info) noexcept
+{
+  double rank = 0.0;
+  switch (info.properties().properties1_.deviceType) {
+   case vk::PhysicalDeviceType::eDiscreteGpu:
+    rank = 4.0;
+    break;
+   case vk::PhysicalDeviceType::eIntegratedGpu:
+    rank = 3.0;
+    break;
+   case vk::PhysicalDeviceType::eVirtualGpu:
+    rank = 2.0;
+    break;
+   case vk::PhysicalDeviceType::eCpu:
+    rank = 1.0;
+    break;
+   default:
+    break;
+  }
+  return rank;
+}
+
+/*!
+  \details
+  A cache file has a line of "key bandwidth" per device. A missing file is
+  treated as an empty cache.
+  */
+inline
+auto VulkanDeviceSelector::loadCache(const std::string_view cache_path)
+    -> ScoreCache
+{
+  ScoreCache cache;
+  std::ifstream cache_file{std::string{cache_path}};
+  std::string key;
+  double score = 0.0;
+  while (cache_file >> key >> score)
+    cache[key] = score;
+  return cache;
+}
+
+/*!
+  \details
+  The value is mapped into [0, 1) in log scale. 'max_log' is the log2 of the
+  value which reaches the upper bound.
+  */
+inline
+double VulkanDeviceSelector::normalizeTerm(const double value,
+                                           const double max_log) noexcept
+{
+  constexpr double max_term = 0.999;
+  return (std::min)(std::log2(1.0 + value) / max_log, max_term);
+}
+
+/*!
+  */
+inline
+void VulkanDeviceSelector::saveCache(const std::string_view cache_path,
+                                     const ScoreCache& cache)
+{
+  std::ofstream cache_file{std::string{cache_path}};
+  if (!cache_file) {
+    //! \todo Handle error
+    return;
+  }
+  cache_file.precision(std::numeric_limits<double>::max_digits10);
+  for (const auto& entry : cache)
+    cache_file << entry.first << " " << entry.second << "\n";
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_DEVICE_SELECTOR_INL_HPP
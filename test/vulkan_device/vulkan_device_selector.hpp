@@ -0,0 +1,82 @@
+/*!
+  \file vulkan_device_selector.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_DEVICE_SELECTOR_HPP
+#define CLSPV_TEST_VULKAN_DEVICE_SELECTOR_HPP
+
+// Standard C++ library
+#include <string>
+#include <string_view>
+#include <unordered_map>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "device_options.hpp"
+#include "vulkan_physical_device_info.hpp"
+
+namespace clspvtest {
+
+/*!
+  \brief Rank the physical devices and select the best one
+
+  The capability score is computed from the device type, the device local
+  heap size, the max workgroup invocations and the subgroup size, in order
+  of priority. So a discrete GPU is always preferred to an integrated GPU or
+  a CPU device.
+
+  The benchmark measures the copy bandwidth of the device local memory on a
+  temporary logical device. The benchmark score ranks the devices by the
+  device type first and then by the bandwidth. The results are cached in a file keyed by the
+  device and driver, since the measurement takes a while.
+  */
+class VulkanDeviceSelector
+{
+ public:
+  //! Return the benchmark score of a device from its copy bandwidth
+  static double calcBenchmarkScore(const VulkanPhysicalDeviceInfo& info,
+                                   const double bandwidth) noexcept;
+
+  //! Return the capability score of a device
+  static double calcCapabilityScore(const VulkanPhysicalDeviceInfo& info) noexcept;
+
+  //! Return the cache key of a device
+  static std::string getCacheKey(const VulkanPhysicalDeviceInfo& info);
+
+  //! Measure the copy bandwidth of the device local memory in GB/s
+  static double measureBandwidth(const vk::PhysicalDevice& device,
+                                 const VulkanPhysicalDeviceInfo& info);
+
+  //! Return the number of the physical device which is selected by the options
+  static uint32b select(const vk::Instance& instance,
+                        const DeviceOptions& options);
+
+ private:
+  using ScoreCache = std::unordered_map<std::string, double>;
+
+
+  //! Return the rank of the device type
+  static double getTypeRank(const VulkanPhysicalDeviceInfo& info) noexcept;
+
+  //! Load the benchmark results from the cache file
+  static ScoreCache loadCache(const std::string_view cache_path);
+
+  //! Normalize a term of a score into [0, 1)
+  static double normalizeTerm(const double value, const double max_log) noexcept;
+
+  //! Save the benchmark results into the cache file
+  static void saveCache(const std::string_view cache_path,
+                        const ScoreCache& cache);
+};
+
+} // namespace clspvtest
+
+#include "vulkan_device_selector-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_DEVICE_SELECTOR_HPP
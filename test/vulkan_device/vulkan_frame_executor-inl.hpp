@@ -0,0 +1,296 @@
+/*!
+  \file vulkan_frame_executor-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_FRAME_EXECUTOR_INL_HPP
+#define CLSPV_TEST_VULKAN_FRAME_EXECUTOR_INL_HPP
+
+#include "vulkan_frame_executor.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_device.hpp"
+
+namespace clspvtest {
+
+/*!
+  \details
+  If the queue index is 'kAnyQueue', the least loaded queue is selected and
+  all frames are executed on it.
+  */
+inline
+VulkanFrameExecutor::VulkanFrameExecutor(VulkanDevice* device,
+                                         const std::size_t num_of_frames,
+                                         const QueueType queue_type,
+                                         const uint32b queue_index) :
+    VulkanFrameExecutor(device, num_of_frames, queue_type, queue_index, true)
+{
+}
+
+/*!
+  \details
+  If 'use_timeline' is false or timeline semaphores aren't supported, a fence
+  per frame tracks the progress.
+  */
+inline
+VulkanFrameExecutor::VulkanFrameExecutor(VulkanDevice* device,
+                                         const std::size_t num_of_frames,
+                                         const QueueType queue_type,
+                                         const uint32b queue_index,
+                                         const bool use_timeline) :
+    device_{device},
+    frame_list_((std::max)(num_of_frames, std::size_t{1})),
+    queue_type_{queue_type},
+    queue_index_{device->selectQueueIndex(queue_type, queue_index)},
+    is_timeline_used_{use_timeline && device->isTimelineSemaphoreSupported()}
+{
+  initialize();
+}
+
+/*!
+  */
+inline
+VulkanFrameExecutor::~VulkanFrameExecutor() noexcept
+{
+  destroy();
+}
+
+/*!
+  \details
+  The commands of the frame are recorded into command() until endFrame().
+  The previous submission of the frame is completed, so the staging buffer
+  of the frame holds its downloads and can be overwritten.
+  */
+inline
+std::size_t VulkanFrameExecutor::beginFrame() noexcept
+{
+  auto& frame = frame_list_[frame_index_];
+  waitForFrame(frame.value_);
+
+  vk::CommandBufferBeginInfo begin_info{};
+  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  frame.command_.begin(begin_info);
+  return frame_index_;
+}
+
+/*!
+  */
+inline
+const vk::CommandBuffer& VulkanFrameExecutor::command() const noexcept
+{
+  return frame_list_[frame_index_].command_;
+}
+
+/*!
+  */
+inline
+void VulkanFrameExecutor::destroy() noexcept
+{
+  waitForCompletion();
+  const auto& device = device_->device();
+  for (auto& frame : frame_list_) {
+    if (frame.command_pool_) {
+      device.destroyCommandPool(frame.command_pool_);
+      frame.command_pool_ = nullptr;
+      frame.command_ = nullptr;
+    }
+    if (frame.fence_) {
+      device.destroyFence(frame.fence_);
+      frame.fence_ = nullptr;
+    }
+    if (frame.staging_)
+      frame.staging_->destroy();
+    frame.value_ = 0;
+  }
+}
+
+/*!
+  */
+inline
+VulkanDevice* VulkanFrameExecutor::device() noexcept
+{
+  return device_;
+}
+
+/*!
+  */
+inline
+const VulkanDevice* VulkanFrameExecutor::device() const noexcept
+{
+  return device_;
+}
+
+/*!
+  \details
+  The progress values increase monotonically, a frame is completed when
+  the progress of the queue reaches its value.
+  */
+inline
+uint64b VulkanFrameExecutor::endFrame() noexcept
+{
+  auto& frame = frame_list_[frame_index_];
+  frame.command_.end();
+  if (isTimelineUsed()) {
+    frame.value_ = device_->submitTimeline(queue_type_, queue_index_, frame.command_);
+  }
+  else {
+    const auto& device = device_->device();
+    device.resetFences(1, &frame.fence_);
+    device_->submit(queue_type_, queue_index_, frame.command_, frame.fence_);
+    frame.value_ = last_value_ + 1;
+  }
+  last_value_ = frame.value_;
+  frame_index_ = (frame_index_ + 1) % numOfFrames();
+  return frame.value_;
+}
+
+/*!
+  */
+inline
+std::size_t VulkanFrameExecutor::frameIndex() const noexcept
+{
+  return frame_index_;
+}
+
+/*!
+  */
+inline
+bool VulkanFrameExecutor::isTimelineUsed() const noexcept
+{
+  return is_timeline_used_;
+}
+
+/*!
+  */
+inline
+std::size_t VulkanFrameExecutor::numOfFrames() const noexcept
+{
+  return frame_list_.size();
+}
+
+/*!
+  */
+inline
+uint32b VulkanFrameExecutor::queueIndex() const noexcept
+{
+  return queue_index_;
+}
+
+/*!
+  */
+inline
+QueueType VulkanFrameExecutor::queueType() const noexcept
+{
+  return queue_type_;
+}
+
+/*!
+  \details
+  All submitted frames are waited for before the buffers are resized.
+  */
+inline
+void VulkanFrameExecutor::setStagingSize(const std::size_t size) noexcept
+{
+  waitForCompletion();
+  for (auto& frame : frame_list_)
+    frame.staging_->setSize(size);
+  staging_size_ = size;
+}
+
+/*!
+  \details
+  The host can access the buffer while the frame is recorded, or after the
+  frame is completed.
+  */
+inline
+VulkanBuffer<uint8b>& VulkanFrameExecutor::stagingBuffer(
+    const std::size_t frame_index) noexcept
+{
+  return *frame_list_[frame_index].staging_;
+}
+
+/*!
+  */
+inline
+const VulkanBuffer<uint8b>& VulkanFrameExecutor::stagingBuffer(
+    const std::size_t frame_index) const noexcept
+{
+  return *frame_list_[frame_index].staging_;
+}
+
+/*!
+  */
+inline
+std::size_t VulkanFrameExecutor::stagingSize() const noexcept
+{
+  return staging_size_;
+}
+
+/*!
+  */
+inline
+void VulkanFrameExecutor::waitForCompletion() noexcept
+{
+  waitForFrame(last_value_);
+}
+
+/*!
+  */
+inline
+void VulkanFrameExecutor::waitForFrame(const uint64b value) noexcept
+{
+  if (value == 0)
+    return;
+  if (isTimelineUsed()) {
+    if (device_->timelineValue(queue_type_, queue_index_) < value)
+      device_->waitForTimeline(queue_type_, queue_index_, value);
+  }
+  else {
+    // The fence of the frame which has the value
+    const auto& device = device_->device();
+    constexpr uint64b timeout = (std::numeric_limits<uint64b>::max)();
+    for (const auto& frame : frame_list_) {
+      if ((0 < frame.value_) && (frame.value_ <= value))
+        device.waitForFences(1, &frame.fence_, VK_TRUE, timeout);
+    }
+  }
+}
+
+/*!
+  */
+inline
+void VulkanFrameExecutor::initialize()
+{
+  const auto& device = device_->device();
+  for (auto& frame : frame_list_) {
+    // Owned by the frame, so frames can be recorded from any thread
+    frame.command_pool_ = device_->createCommandPool(queue_type_);
+    const vk::CommandBufferAllocateInfo alloc_info{frame.command_pool_,
+                                                   vk::CommandBufferLevel::ePrimary,
+                                                   1};
+    device.allocateCommandBuffers(&alloc_info, &frame.command_);
+    frame.staging_ = std::make_unique<VulkanBuffer<uint8b>>(device_,
+                                                            BufferUsage::kHostOnly);
+    if (!isTimelineUsed()) {
+      const vk::FenceCreateInfo fence_info{vk::FenceCreateFlagBits::eSignaled};
+      device.createFence(&fence_info, nullptr, &frame.fence_);
+    }
+  }
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_FRAME_EXECUTOR_INL_HPP
@@ -0,0 +1,145 @@
+/*!
+  \file vulkan_frame_executor.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_FRAME_EXECUTOR_HPP
+#define CLSPV_TEST_VULKAN_FRAME_EXECUTOR_HPP
+
+// Standard C++ library
+#include <cstddef>
+#include <memory>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+class VulkanDevice;
+
+/*!
+  \brief Keep a fixed number of frames in flight on a queue
+
+  A frame has its own command buffer and staging buffer. The other resources
+  which a frame uses, e.g. device buffers and descriptor sets of kernels, must
+  be duplicated for each frame and selected by the frame index. A kernel which
+  has numOfFrames() descriptor sets can be recorded with the frame index.
+
+  The progress of the frames is tracked with the timeline semaphore of the
+  queue, so the host blocks only when it laps the device, i.e. when it begins
+  a frame whose previous submission isn't completed. If timeline semaphores
+  aren't supported, a fence per frame is used instead.
+  */
+class VulkanFrameExecutor
+{
+ public:
+  //! Create an executor
+  VulkanFrameExecutor(VulkanDevice* device,
+                      const std::size_t num_of_frames,
+                      const QueueType queue_type,
+                      const uint32b queue_index);
+
+  //! Create an executor which can track the frames with fences only
+  VulkanFrameExecutor(VulkanDevice* device,
+                      const std::size_t num_of_frames,
+                      const QueueType queue_type,
+                      const uint32b queue_index,
+                      const bool use_timeline);
+
+  //! Destroy an executor
+  ~VulkanFrameExecutor() noexcept;
+
+
+  //! Begin recording the next frame and return the frame index
+  std::size_t beginFrame() noexcept;
+
+  //! Return the command buffer of the current frame
+  const vk::CommandBuffer& command() const noexcept;
+
+  //! Destroy an executor
+  void destroy() noexcept;
+
+  //! Return an assigned device
+  VulkanDevice* device() noexcept;
+
+  //! Return an assigned device
+  const VulkanDevice* device() const noexcept;
+
+  //! Submit the current frame and return the progress value of the frame
+  uint64b endFrame() noexcept;
+
+  //! Return the index of the current frame
+  std::size_t frameIndex() const noexcept;
+
+  //! Check if the frames are tracked with the timeline semaphore
+  bool isTimelineUsed() const noexcept;
+
+  //! Return the number of frames
+  std::size_t numOfFrames() const noexcept;
+
+  //! Return the index of the queue which executes the frames
+  uint32b queueIndex() const noexcept;
+
+  //! Return the type of the queue which executes the frames
+  QueueType queueType() const noexcept;
+
+  //! Set the size of the staging buffer of each frame in bytes
+  void setStagingSize(const std::size_t size) noexcept;
+
+  //! Return the staging buffer of the frame
+  VulkanBuffer<uint8b>& stagingBuffer(const std::size_t frame_index) noexcept;
+
+  //! Return the staging buffer of the frame
+  const VulkanBuffer<uint8b>& stagingBuffer(const std::size_t frame_index) const noexcept;
+
+  //! Return the size of the staging buffer of each frame in bytes
+  std::size_t stagingSize() const noexcept;
+
+  //! Wait this thread until all submitted frames are completed
+  void waitForCompletion() noexcept;
+
+  //! Wait this thread until the frame which has the progress value is completed
+  void waitForFrame(const uint64b value) noexcept;
+
+ private:
+  //! The resources of a frame
+  struct Frame
+  {
+    vk::CommandPool command_pool_;
+    vk::CommandBuffer command_;
+    UniqueBuffer<uint8b> staging_;
+    vk::Fence fence_; //!< Used if the timeline semaphore isn't used
+    uint64b value_ = 0;
+  };
+
+
+  //! Initialize an executor
+  void initialize();
+
+
+  VulkanDevice* device_;
+  std::vector<Frame> frame_list_;
+  QueueType queue_type_;
+  uint32b queue_index_;
+  std::size_t frame_index_ = 0;
+  std::size_t staging_size_ = 0;
+  uint64b last_value_ = 0;
+  bool is_timeline_used_;
+};
+
+// Type aliases
+using UniqueFrameExecutor = std::unique_ptr<VulkanFrameExecutor>;
+
+} // namespace clspvtest
+
+#include "vulkan_frame_executor-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_FRAME_EXECUTOR_HPP
@@ -12,18 +12,27 @@
 
 #include "vulkan_kernel.hpp"
 // Standard C++ library
+#include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstddef>
+#include <iterator>
 #include <memory>
+#include <string>
 #include <string_view>
 #include <type_traits>
 #include <utility>
+#include <vector>
 // Vulkan
 #include <vulkan/vulkan.hpp>
 // ClspvTest
 #include "config.hpp"
 #include "vulkan_buffer.hpp"
 #include "vulkan_device.hpp"
+#include "vulkan_metrics.hpp"
+#include "vulkan_profiler.hpp"
+#include "vulkan_recorder.hpp"
+#include "vulkan_tracer.hpp"
 
 namespace clspvtest {
 
@@ -33,9 +42,60 @@ template <std::size_t kDimension, typename ...ArgumentTypes> inline
 VulkanKernel<kDimension, ArgumentTypes...>::VulkanKernel(
     VulkanDevice* device,
     const uint32b module_index,
-    const std::string_view kernel_name) : device_{device}
+    const std::string_view kernel_name) :
+        VulkanKernel(device, module_index, kernel_name, 1)
 {
-  initialize(module_index, kernel_name);
+}
+
+/*!
+  \details
+  A kernel whose commands are pending can't update its descriptor set.
+  Multiple descriptor sets let the kernel be recorded with different
+  buffers while the previous commands are executed, e.g. one set per frame.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+VulkanKernel<kDimension, ArgumentTypes...>::VulkanKernel(
+    VulkanDevice* device,
+    const uint32b module_index,
+    const std::string_view kernel_name,
+    const std::size_t num_of_sets) :
+        VulkanKernel(device,
+                     module_index,
+                     kernel_name,
+                     num_of_sets,
+                     std::vector<SpecializationConstant>{})
+{
+}
+
+/*!
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+VulkanKernel<kDimension, ArgumentTypes...>::VulkanKernel(
+    VulkanDevice* device,
+    const uint32b module_index,
+    const std::string_view kernel_name,
+    const std::vector<SpecializationConstant>& constant_list) :
+        VulkanKernel(device, module_index, kernel_name, 1, constant_list)
+{
+}
+
+/*!
+  \details
+  The constant IDs 0-2 are reserved for the local-work size, so the
+  constants of the IDs are ignored.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+VulkanKernel<kDimension, ArgumentTypes...>::VulkanKernel(
+    VulkanDevice* device,
+    const uint32b module_index,
+    const std::string_view kernel_name,
+    const std::size_t num_of_sets,
+    const std::vector<SpecializationConstant>& constant_list) : device_{device}
+{
+  initialize(module_index,
+             kernel_name,
+             (std::max)(num_of_sets, std::size_t{1}),
+             constant_list);
 }
 
 /*!
@@ -52,10 +112,12 @@ template <std::size_t kDimension, typename ...ArgumentTypes> inline
 void VulkanKernel<kDimension, ArgumentTypes...>::destroy() noexcept
 {
   const auto& device = device_->device();
-  if (compute_pipeline_) {
-    device.destroyPipeline(compute_pipeline_, nullptr);
-    compute_pipeline_ = nullptr;
+  for (auto& variant : pipeline_variant_list_) {
+    if (variant.pipeline_)
+      device.destroyPipeline(variant.pipeline_, nullptr);
   }
+  pipeline_variant_list_.clear();
+  variant_index_ = 0;
   if (pipeline_layout_) {
     device.destroyPipelineLayout(pipeline_layout_, nullptr);
     pipeline_layout_ = nullptr;
@@ -68,6 +130,11 @@ void VulkanKernel<kDimension, ArgumentTypes...>::destroy() noexcept
     device.destroyDescriptorSetLayout(descriptor_set_layout_, nullptr);
     descriptor_set_layout_ = nullptr;
   }
+  if (command_pool_) {
+    device.destroyCommandPool(command_pool_, nullptr);
+    command_pool_ = nullptr;
+    command_buffer_ = nullptr;
+  }
 }
 
 /*!
@@ -88,6 +155,40 @@ auto VulkanKernel<kDimension, ArgumentTypes...>::device() const noexcept
   return device_;
 }
 
+/*!
+  \details
+  The list is empty if the device doesn't support
+  VK_KHR_pipeline_executable_properties. The statistics are driver specific,
+  e.g. the number of registers and the size of the scratch memory, which
+  limit the occupancy of the kernel.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+auto VulkanKernel<kDimension, ArgumentTypes...>::executableProperties() const noexcept
+    -> const std::vector<ExecutableProperties>&
+{
+  return pipeline_variant_list_[variant_index_].executable_properties_list_;
+}
+
+/*!
+  \details
+  Each pipeline variant has its own size, since the tuned size of the kernel
+  can change between the compilations.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+auto VulkanKernel<kDimension, ArgumentTypes...>::localWorkSize() const noexcept
+    -> const std::array<uint32b, 3>&
+{
+  return pipeline_variant_list_[variant_index_].local_work_size_;
+}
+
+/*!
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+std::string_view VulkanKernel<kDimension, ArgumentTypes...>::name() const noexcept
+{
+  return name_;
+}
+
 /*!
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
@@ -98,6 +199,51 @@ constexpr std::size_t VulkanKernel<kDimension, ArgumentTypes...>::
   return num_of_arguments;
 }
 
+/*!
+  \details
+  The dispatch commands are recorded into the given command buffer which is
+  submitted by the caller to a compute queue. The ownership of the buffers
+  isn't transferred. If the buffers are different from the previous ones,
+  the descriptor set is updated, so the previously recorded commands of the
+  kernel must not be pending.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+void VulkanKernel<kDimension, ArgumentTypes...>::record(
+    const vk::CommandBuffer& command,
+    BufferRef<ArgumentTypes>... args,
+    const std::array<uint32b, kDimension> works)
+{
+  record(command, 0, args..., works);
+}
+
+/*!
+  \details
+  Only the given descriptor set is updated, so the commands which use the
+  other sets can be pending.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+void VulkanKernel<kDimension, ArgumentTypes...>::record(
+    const vk::CommandBuffer& command,
+    const std::size_t set_index,
+    BufferRef<ArgumentTypes>... args,
+    const std::array<uint32b, kDimension> works)
+{
+  device()->allocateDeferredBuffers();
+  if (!isSameArgs(set_index, args...))
+    bindBuffers(set_index, args...);
+  else if (auto metrics = device_->metrics())
+    metrics->add(MetricCounter::kDescriptorUpdatesAvoided);
+  dispatch(command, set_index, works);
+}
+
+/*!
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+void VulkanKernel<kDimension, ArgumentTypes...>::resetRunStatistics() noexcept
+{
+  run_statistics_ = RunStatistics{};
+}
+
 /*!
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
@@ -106,10 +252,203 @@ void VulkanKernel<kDimension, ArgumentTypes...>::run(
     const std::array<uint32b, kDimension> works,
     const uint32b queue_index)
 {
-  if (!isSameArgs(args...))
-    bindBuffers(args...);
-  dispatch(works);
-  device()->submit(QueueType::kCompute, queue_index, command_buffer_);
+  run(args..., works, queue_index, vk::Fence{});
+}
+
+/*!
+  \details
+  The fence is signaled when the kernel is completed, so the completion can
+  be observed without waiting for the all submissions of the queue.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+void VulkanKernel<kDimension, ArgumentTypes...>::run(
+    BufferRef<ArgumentTypes>... args,
+    const std::array<uint32b, kDimension> works,
+    const uint32b queue_index,
+    const vk::Fence& fence)
+{
+  const TraceSpan span{device()->tracer(), TraceCategory::kKernel, "run", name()};
+  if (auto recorder = device_->recorder())
+    recorder->runKernel(module_index_, name(), works, queue_index, args...);
+  device()->allocateDeferredBuffers();
+
+  // Accumulate the time since the last lap into the phase
+  using Clock = std::chrono::steady_clock;
+  const bool is_timed = is_run_statistics_enabled_;
+  Clock::time_point lap_time = is_timed ? Clock::now() : Clock::time_point{};
+  auto lap = [is_timed, &lap_time](uint64b& phase_time) noexcept
+  {
+    if (is_timed) {
+      const auto now = Clock::now();
+      const auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(now - lap_time);
+      phase_time += static_cast<uint64b>(t.count());
+      lap_time = now;
+    }
+  };
+
+  const bool is_same_args = isSameArgs(0, args...);
+  lap(run_statistics_.same_args_time_);
+  if (!is_same_args) {
+    bindBuffers(0, args...);
+    lap(run_statistics_.bind_buffers_time_);
+  }
+  else if (auto metrics = device_->metrics()) {
+    metrics->add(MetricCounter::kDescriptorUpdatesAvoided);
+  }
+  const uint32b index = selectQueueIndex(args..., queue_index);
+  // The waits for the owner queues and the ownership transfers
+  constexpr std::size_t max_waits = 2 * sizeof...(ArgumentTypes);
+  std::array<vk::Semaphore, max_waits> wait_list;
+  std::array<uint64b, max_waits> wait_value_list;
+  uint32b num_of_waits = waitForOwnerQueues(args...,
+                                            index,
+                                            wait_list.data(),
+                                            wait_value_list.data());
+
+  vk::CommandBufferBeginInfo begin_info{};
+  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  command_buffer_.begin(begin_info);
+
+  // Acquire the buffers which are owned by the transfer queue family
+  const std::array<vk::Semaphore, sizeof...(ArgumentTypes)> semaphore_list{{
+      args.transferOwnership(QueueType::kCompute, index, command_buffer_)...}};
+  dispatch(command_buffer_, 0, works);
+
+  command_buffer_.end();
+  lap(run_statistics_.dispatch_time_);
+  for (const auto& semaphore : semaphore_list) {
+    if (semaphore) {
+      wait_list[num_of_waits] = semaphore;
+      wait_value_list[num_of_waits++] = 0; // Ignored for the binary semaphores
+    }
+  }
+  device()->submit(QueueType::kCompute,
+                   index,
+                   command_buffer_,
+                   vk::ArrayProxy<const vk::Semaphore>{num_of_waits, wait_list.data()},
+                   vk::ArrayProxy<const uint64b>{num_of_waits, wait_value_list.data()},
+                   nullptr,
+                   fence);
+  lap(run_statistics_.submit_time_);
+  if (is_timed)
+    ++run_statistics_.num_of_runs_;
+}
+
+/*!
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+std::size_t VulkanKernel<kDimension, ArgumentTypes...>::numOfDescriptorSets()
+    const noexcept
+{
+  return descriptor_set_list_.size();
+}
+
+/*!
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+std::size_t VulkanKernel<kDimension, ArgumentTypes...>::numOfVariants()
+    const noexcept
+{
+  return pipeline_variant_list_.size();
+}
+
+/*!
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+auto VulkanKernel<kDimension, ArgumentTypes...>::runStatistics() const noexcept
+    -> const RunStatistics&
+{
+  return run_statistics_;
+}
+
+/*!
+  \details
+  The measurement costs a few clock reads per run, so it's disabled by
+  default.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+void VulkanKernel<kDimension, ArgumentTypes...>::setRunStatisticsEnabled(
+    const bool is_enabled) noexcept
+{
+  is_run_statistics_enabled_ = is_enabled;
+}
+
+/*!
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+auto VulkanKernel<kDimension, ArgumentTypes...>::specializationConstants()
+    const noexcept -> const std::vector<SpecializationConstant>&
+{
+  return pipeline_variant_list_[variant_index_].constant_list_;
+}
+
+/*!
+  \details
+  The IDs below kNumOfReservedConstants are reserved for the local-work size,
+  so the constants of those IDs are ignored. The constants are sorted by the
+  ID and the last one is used if an ID is given twice, so the order of the
+  constants doesn't make another variant.
+  The pipeline is created on the first use of the constants and cached, and
+  later calls with the same constants only select it. The commands which
+  are already recorded keep the previous pipeline.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+void VulkanKernel<kDimension, ArgumentTypes...>::specialize(
+    const std::vector<SpecializationConstant>& constant_list)
+{
+  std::vector<SpecializationConstant> list;
+  list.reserve(constant_list.size());
+  for (const auto& constant : constant_list) {
+    if (kNumOfReservedConstants <= constant.id_)
+      list.emplace_back(constant);
+  }
+  std::stable_sort(list.begin(), list.end(),
+  [](const SpecializationConstant& lhs, const SpecializationConstant& rhs)
+  {
+    return lhs.id_ < rhs.id_;
+  });
+  auto last = list.begin();
+  for (auto constant = list.begin(); constant != list.end(); ++constant) {
+    if ((last != list.begin()) && ((last - 1)->id_ == constant->id_))
+      *(last - 1) = *constant;
+    else
+      *last++ = *constant;
+  }
+  list.erase(last, list.end());
+
+  const auto is_same_constant = [](const SpecializationConstant& lhs,
+                                   const SpecializationConstant& rhs)
+  {
+    return (lhs.id_ == rhs.id_) && (lhs.value_ == rhs.value_);
+  };
+  const auto variant = std::find_if(
+      pipeline_variant_list_.begin(),
+      pipeline_variant_list_.end(),
+      [&list, &is_same_constant](const PipelineVariant& v)
+  {
+    return std::equal(list.begin(), list.end(),
+                      v.constant_list_.begin(), v.constant_list_.end(),
+                      is_same_constant);
+  });
+  if (variant != pipeline_variant_list_.end()) {
+    variant_index_ = static_cast<std::size_t>(
+        std::distance(pipeline_variant_list_.begin(), variant));
+    return;
+  }
+  initComputePipeline(list);
+  initExecutableProperties();
+}
+
+/*!
+  \details
+  The size is the required size of the kernel if it's set by
+  VulkanDevice::setSubgroupSizeControl(), otherwise the default size of the
+  device, which the selected pipeline variant is compiled with.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+uint32b VulkanKernel<kDimension, ArgumentTypes...>::subgroupSize() const noexcept
+{
+  return pipeline_variant_list_[variant_index_].subgroup_size_;
 }
 
 /*!
@@ -125,11 +464,12 @@ constexpr std::size_t VulkanKernel<kDimension, ArgumentTypes...>::
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
 void VulkanKernel<kDimension, ArgumentTypes...>::bindBuffers(
+    const std::size_t set_index,
     BufferRef<ArgumentTypes>... args)
 {
 //  constexpr std::size_t num_of_buffers = numOfArguments();
   constexpr std::size_t num_of_buffers = sizeof...(ArgumentTypes);
-  if ((num_of_buffers == 0) || isSameArgs(args...))
+  if ((num_of_buffers == 0) || isSameArgs(set_index, args...))
     return;
 
   std::array<vk::Buffer, num_of_buffers> buffer_list{getVkBuffer(args)...};
@@ -143,7 +483,7 @@ void VulkanKernel<kDimension, ArgumentTypes...>::bindBuffers(
     descriptor_info.range = VK_WHOLE_SIZE;
 
     auto& descriptor_set = descriptor_set_list[index];
-    descriptor_set.dstSet = descriptor_set_;
+    descriptor_set.dstSet = descriptor_set_list_[set_index];
     descriptor_set.dstBinding = static_cast<uint32b>(index);
     descriptor_set.dstArrayElement = 0;
     descriptor_set.descriptorCount = 1;
@@ -158,31 +498,45 @@ void VulkanKernel<kDimension, ArgumentTypes...>::bindBuffers(
                               descriptor_set_list.data(),
                               0,
                               nullptr);
-  buffer_list_ = std::move(buffer_list);
+  buffer_list_[set_index] = std::move(buffer_list);
+  if (auto metrics = device_->metrics())
+    metrics->add(MetricCounter::kDescriptorUpdates);
 }
 
 /*!
+  \details
+  If a profiler is attached to the device, the dispatch is measured by the
+  kernel name, including the compute shader invocations if the device
+  supports the pipeline statistics queries.
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
 void VulkanKernel<kDimension, ArgumentTypes...>::dispatch(
+    const vk::CommandBuffer& command,
+    const std::size_t set_index,
     std::array<uint32b, kDimension> works)
 {
-  const auto group_size = device_->calcWorkGroupSize(works);
-  vk::CommandBufferBeginInfo begin_info{};
-  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-  command_buffer_.begin(begin_info);
-
-  command_buffer_.bindPipeline(vk::PipelineBindPoint::eCompute, compute_pipeline_);
-  command_buffer_.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
-                                     pipeline_layout_,
-                                     0,
-                                     1,
-                                     &descriptor_set_,
-                                     0,
-                                     nullptr);
-  command_buffer_.dispatch(group_size[0], group_size[1], group_size[2]);
-
-  command_buffer_.end();
+  auto profiler = device_->profiler();
+  const uint32b range_id = (profiler != nullptr)
+      ? profiler->begin(command, QueueType::kCompute, name())
+      : VulkanProfiler::kInvalidRange;
+
+  const auto& variant = pipeline_variant_list_[variant_index_];
+  const auto group_size = device_->calcWorkGroupSize(works, variant.local_work_size_);
+  const auto& pipeline = variant.pipeline_;
+  command.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+  command.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                             pipeline_layout_,
+                             0,
+                             1,
+                             &descriptor_set_list_[set_index],
+                             0,
+                             nullptr);
+  command.dispatch(group_size[0], group_size[1], group_size[2]);
+  if (auto metrics = device_->metrics())
+    metrics->add(MetricCounter::kDispatches);
+
+  if (profiler != nullptr)
+    profiler->end(command, range_id);
 }
 
 /*!
@@ -196,12 +550,16 @@ auto VulkanKernel<kDimension, ArgumentTypes...>::getVkBuffer(
 }
 
 /*!
+  \details
+  The kernel owns the pool of the command buffer, so run() can be called from
+  any thread as long as a kernel isn't run by multiple threads at once.
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
 void VulkanKernel<kDimension, ArgumentTypes...>::initCommandBuffer()
 {
+  command_pool_ = device_->createCommandPool(QueueType::kCompute);
   const vk::CommandBufferAllocateInfo alloc_info{
-      device_->commandPool(QueueType::kCompute),
+      command_pool_,
       vk::CommandBufferLevel::ePrimary,
       1};
   const auto& device = device_->device();
@@ -210,23 +568,36 @@ void VulkanKernel<kDimension, ArgumentTypes...>::initCommandBuffer()
 }
 
 /*!
+  \details
+  The subgroup requirements of the kernel are dropped if the local-work size
+  doesn't satisfy them, i.e. full subgroups need the x size to be a multiple
+  of the subgroup size and a required size limits the number of the
+  subgroups in a workgroup.
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
 void VulkanKernel<kDimension, ArgumentTypes...>::initComputePipeline(
-    const uint32b module_index,
-    const std::string_view kernel_name)
+    const std::vector<SpecializationConstant>& constant_list)
 {
-  // Set constant IDs
-  constexpr std::size_t num_of_entries = 3u;
-  std::array<uint32b, num_of_entries> constant_data;
-  {
-    const auto& local_work_size = device_->localWorkSize<kDimension>();
-    for (std::size_t i = 0; i < local_work_size.size(); ++i)
-      constant_data[i] = local_work_size[i];
-  }
-  std::array<vk::SpecializationMapEntry, num_of_entries> entries;
+  const std::string_view kernel_name = name();
+  // Set constant IDs. A tuned local-work size of the kernel is preferred
+  PipelineVariant variant;
+  static_assert(kNumOfReservedConstants == std::tuple_size_v<decltype(variant.local_work_size_)>,
+                "The reserved constants don't match the local-work size.");
+  const std::size_t num_of_entries = kNumOfReservedConstants + constant_list.size();
+  variant.local_work_size_ = device_->localWorkSize<kDimension>(module_index_, kernel_name);
+  const auto& local_work_size = variant.local_work_size_;
+  std::vector<uint32b> constant_data;
+  constant_data.reserve(num_of_entries);
+  constant_data.insert(constant_data.end(),
+                       local_work_size.begin(),
+                       local_work_size.end());
+  for (const auto& constant : constant_list)
+    constant_data.emplace_back(constant.value_);
+  std::vector<vk::SpecializationMapEntry> entries(num_of_entries);
   for (std::size_t i = 0; i < entries.size(); ++i) {
-    entries[i].constantID = static_cast<uint32b>(i);
+    entries[i].constantID = (i < kNumOfReservedConstants)
+        ? static_cast<uint32b>(i)
+        : constant_list[i - kNumOfReservedConstants].id_;
     entries[i].offset = static_cast<uint32b>(i * sizeof(uint32b));
     entries[i].size = sizeof(uint32b);
   }
@@ -234,36 +605,72 @@ void VulkanKernel<kDimension, ArgumentTypes...>::initComputePipeline(
                                     entries.data(),
                                     num_of_entries * sizeof(uint32b),
                                     constant_data.data()};
+  // Subgroup requirements
+  auto control = device_->subgroupSizeControl(kernel_name);
+  const auto& capabilities = device_->subgroupCapabilities();
+  if (control.required_size_ != 0) {
+    const uint32b num_of_invocations =
+        local_work_size[0] * local_work_size[1] * local_work_size[2];
+    const uint32b max_invocations =
+        capabilities.max_compute_workgroup_subgroups_ * control.required_size_;
+    if (max_invocations < num_of_invocations)
+      control.required_size_ = 0;
+  }
+  if (control.require_full_subgroups_) {
+    const uint32b size = (control.required_size_ != 0) ? control.required_size_ :
+                         control.allow_varying_size_ ? capabilities.max_size_
+                                                     : capabilities.size_;
+    control.require_full_subgroups_ = (local_work_size[0] % size) == 0;
+  }
+  vk::PipelineShaderStageCreateFlags stage_flags;
+  if (control.allow_varying_size_)
+    stage_flags |= vk::PipelineShaderStageCreateFlagBits::eAllowVaryingSubgroupSizeEXT;
+  if (control.require_full_subgroups_)
+    stage_flags |= vk::PipelineShaderStageCreateFlagBits::eRequireFullSubgroupsEXT;
+  const vk::PipelineShaderStageRequiredSubgroupSizeCreateInfoEXT required_size_info{
+      control.required_size_};
+  variant.subgroup_size_ = (control.required_size_ != 0) ? control.required_size_ :
+                           control.allow_varying_size_ ? 0
+                                                       : capabilities.size_;
   // Shader stage create info
-  const auto& shader_module = device_->getShaderModule(module_index);
-  const vk::PipelineShaderStageCreateInfo shader_stage_create_info{
-      vk::PipelineShaderStageCreateFlags{},
+  const auto& shader_module = device_->getShaderModule(module_index_);
+  vk::PipelineShaderStageCreateInfo shader_stage_create_info{
+      stage_flags,
       vk::ShaderStageFlagBits::eCompute,
       shader_module,
       kernel_name.data(),
       &info};
+  if (control.required_size_ != 0)
+    shader_stage_create_info.pNext = &required_size_info;
   // Pipeline create info
+  const vk::PipelineCreateFlags flags = device_->isPipelineExecutableInfoSupported()
+      ? vk::PipelineCreateFlags{vk::PipelineCreateFlagBits::eCaptureStatisticsKHR}
+      : vk::PipelineCreateFlags{};
   const vk::ComputePipelineCreateInfo create_info{
-      vk::PipelineCreateFlags{},
+      flags,
       shader_stage_create_info,
       pipeline_layout_};
 
   const auto& device = device_->device();
   auto pipelines = device.createComputePipelines(vk::PipelineCache{},
                                                  create_info);
-  compute_pipeline_ = pipelines[0];
+  variant.constant_list_ = constant_list;
+  variant.pipeline_ = pipelines[0];
+  pipeline_variant_list_.emplace_back(std::move(variant));
+  variant_index_ = pipeline_variant_list_.size() - 1;
 }
 
 /*!
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
-void VulkanKernel<kDimension, ArgumentTypes...>::initDescriptorPool()
+void VulkanKernel<kDimension, ArgumentTypes...>::initDescriptorPool(
+    const std::size_t num_of_sets)
 {
   vk::DescriptorPoolSize pool_size;
   pool_size.type = vk::DescriptorType::eStorageBuffer;
-  pool_size.descriptorCount = static_cast<uint32b>(numOfArguments());
+  pool_size.descriptorCount = static_cast<uint32b>(numOfArguments() * num_of_sets);
   const vk::DescriptorPoolCreateInfo create_info{vk::DescriptorPoolCreateFlags{},
-                                                 1,
+                                                 static_cast<uint32b>(num_of_sets),
                                                  1,
                                                  &pool_size};
   const auto& device = device_->device();
@@ -273,14 +680,17 @@ void VulkanKernel<kDimension, ArgumentTypes...>::initDescriptorPool()
 /*!
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
-void VulkanKernel<kDimension, ArgumentTypes...>::initDescriptorSet()
+void VulkanKernel<kDimension, ArgumentTypes...>::initDescriptorSet(
+    const std::size_t num_of_sets)
 {
+  const std::vector<vk::DescriptorSetLayout> layout_list(num_of_sets,
+                                                         descriptor_set_layout_);
   const vk::DescriptorSetAllocateInfo alloc_info{descriptor_pool_,
-                                                 1,
-                                                 &descriptor_set_layout_};
+                                                 static_cast<uint32b>(num_of_sets),
+                                                 layout_list.data()};
   const auto& device = device_->device();
-  auto descriptor_sets = device.allocateDescriptorSets(alloc_info);
-  descriptor_set_ = descriptor_sets[0];
+  descriptor_set_list_ = device.allocateDescriptorSets(alloc_info);
+  buffer_list_.resize(num_of_sets);
 }
 
 /*!
@@ -306,18 +716,70 @@ void VulkanKernel<kDimension, ArgumentTypes...>::initDescriptorSetLayout()
   descriptor_set_layout_ = device.createDescriptorSetLayout(create_info);
 }
 
+/*!
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+void VulkanKernel<kDimension, ArgumentTypes...>::initExecutableProperties()
+{
+  auto& variant = pipeline_variant_list_[variant_index_];
+  variant.executable_properties_list_.clear();
+  const auto properties_list =
+      device_->getPipelineExecutableProperties(variant.pipeline_);
+  for (std::size_t i = 0; i < properties_list.size(); ++i) {
+    const auto& properties = properties_list[i];
+    ExecutableProperties executable;
+    executable.name_ = std::string_view{properties.name};
+    executable.description_ = std::string_view{properties.description};
+    executable.subgroup_size_ = properties.subgroupSize;
+    const auto statistic_list = device_->getPipelineExecutableStatistics(
+        variant.pipeline_,
+        static_cast<uint32b>(i));
+    for (const auto& statistic : statistic_list) {
+      ExecutableStatistic s;
+      s.name_ = std::string_view{statistic.name};
+      s.description_ = std::string_view{statistic.description};
+      switch (statistic.format) {
+       case vk::PipelineExecutableStatisticFormatKHR::eBool32: {
+        s.value_ = statistic.value.b32 ? "true" : "false";
+        break;
+       }
+       case vk::PipelineExecutableStatisticFormatKHR::eInt64: {
+        s.value_ = std::to_string(statistic.value.i64);
+        break;
+       }
+       case vk::PipelineExecutableStatisticFormatKHR::eUint64: {
+        s.value_ = std::to_string(statistic.value.u64);
+        break;
+       }
+       case vk::PipelineExecutableStatisticFormatKHR::eFloat64:
+       default: {
+        s.value_ = std::to_string(statistic.value.f64);
+        break;
+       }
+      }
+      executable.statistic_list_.emplace_back(std::move(s));
+    }
+    variant.executable_properties_list_.emplace_back(std::move(executable));
+  }
+}
+
 /*!
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
 void VulkanKernel<kDimension, ArgumentTypes...>::initialize(
     const uint32b module_index,
-    const std::string_view kernel_name)
+    const std::string_view kernel_name,
+    const std::size_t num_of_sets,
+    const std::vector<SpecializationConstant>& constant_list)
 {
+  const TraceSpan span{device()->tracer(), TraceCategory::kKernel, "createKernel", kernel_name};
+  name_ = kernel_name;
+  module_index_ = module_index;
   initDescriptorSetLayout();
-  initDescriptorPool();
-  initDescriptorSet();
+  initDescriptorPool(num_of_sets);
+  initDescriptorSet(num_of_sets);
   initPipelineLayout();
-  initComputePipeline(module_index, kernel_name);
+  specialize(constant_list);
   initCommandBuffer();
 }
 
@@ -338,6 +800,7 @@ void VulkanKernel<kDimension, ArgumentTypes...>::initPipelineLayout()
   */
 template <std::size_t kDimension, typename ...ArgumentTypes> inline
 bool VulkanKernel<kDimension, ArgumentTypes...>::isSameArgs(
+    const std::size_t set_index,
     BufferRef<ArgumentTypes>... args) const noexcept
 {
 //  constexpr std::size_t num_of_buffers = numOfArguments();
@@ -345,10 +808,82 @@ bool VulkanKernel<kDimension, ArgumentTypes...>::isSameArgs(
   std::array<vk::Buffer, num_of_buffers> buffer_list{{getVkBuffer(args)...}};
   bool result = true;
   for (std::size_t i = 0; (i < buffer_list.size()) && result; ++i)
-    result = buffer_list_[i] == buffer_list[i];
+    result = buffer_list_[set_index][i] == buffer_list[i];
   return result;
 }
 
+/*!
+  \details
+  For 'kAnyQueue', the compute queue which used an argument last is
+  preferred, so the kernel is ordered after the work which it depends on.
+  Otherwise the least loaded compute queue is selected. The arguments which
+  are used by other compute queues are waited for in waitForOwnerQueues().
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+uint32b VulkanKernel<kDimension, ArgumentTypes...>::selectQueueIndex(
+    BufferRef<ArgumentTypes>... args,
+    const uint32b queue_index) const noexcept
+{
+  uint32b index = queue_index;
+  if (index == kAnyQueue) {
+    const std::array<uint32b, sizeof...(ArgumentTypes)> owner_list{{
+        (args.hasOwner() && (args.owner() == QueueType::kCompute))
+            ? args.ownerQueueIndex()
+            : kAnyQueue...}};
+    for (const uint32b owner : owner_list) {
+      if (owner != kAnyQueue) {
+        index = owner;
+        break;
+      }
+    }
+  }
+  index = device_->selectQueueIndex(QueueType::kCompute, index);
+  return index;
+}
+
+/*!
+  \details
+  Submissions on different queues aren't ordered, so if an argument was used
+  by another compute queue last, the kernel waits for the work submitted to
+  that queue so far. The timeline semaphore of the queue and its last value
+  are written to the wait lists, so the wait happens on the device, and the
+  number of the waits is returned. If timeline semaphores aren't supported,
+  this thread waits for the queue instead, and 0 is returned. Each queue is
+  waited for once.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+uint32b VulkanKernel<kDimension, ArgumentTypes...>::waitForOwnerQueues(
+    BufferRef<ArgumentTypes>... args,
+    const uint32b queue_index,
+    vk::Semaphore* wait_semaphores,
+    uint64b* wait_values) const noexcept
+{
+  std::array<uint32b, sizeof...(ArgumentTypes)> owner_list{{
+      (args.hasOwner() && (args.owner() == QueueType::kCompute))
+          ? args.ownerQueueIndex()
+          : kAnyQueue...}};
+  const bool is_timeline = device_->isTimelineSemaphoreSupported();
+  uint32b num_of_waits = 0;
+  for (std::size_t i = 0; i < owner_list.size(); ++i) {
+    const uint32b owner = owner_list[i];
+    if ((owner == kAnyQueue) || (owner == queue_index))
+      continue;
+    if (is_timeline) {
+      const uint64b value = device_->lastTimelineValue(QueueType::kCompute, owner);
+      if (0 < value) {
+        wait_semaphores[num_of_waits] = device_->timelineSemaphore(QueueType::kCompute,
+                                                                   owner);
+        wait_values[num_of_waits++] = value;
+      }
+    }
+    else {
+      device_->waitForCompletion(QueueType::kCompute, owner);
+    }
+    std::replace(owner_list.begin() + i, owner_list.end(), owner, kAnyQueue);
+  }
+  return num_of_waits;
+}
+
 } // namespace clspvtest
 
 #endif // CLSPV_TEST_VULKAN_KERNEL_INL_HPP
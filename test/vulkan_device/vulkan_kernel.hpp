@@ -14,8 +14,10 @@
 #include <array>
 #include <cstddef>
 #include <memory>
+#include <string>
 #include <string_view>
 #include <type_traits>
+#include <vector>
 // Vulkan
 #include <vulkan/vulkan.hpp>
 // ClspvTest
@@ -26,6 +28,10 @@ namespace clspvtest {
 // Forward declaration
 template <typename> class VulkanBuffer;
 class VulkanDevice;
+#if defined(CLSPV_TEST_COROUTINE_SUPPORTED)
+class FenceAwaitable;
+class VulkanReactor;
+#endif // CLSPV_TEST_COROUTINE_SUPPORTED
 
 /*!
   */
@@ -36,12 +42,65 @@ class VulkanKernel
   template <typename Type>
   using BufferRef = std::add_lvalue_reference_t<VulkanBuffer<Type>>;
 
+  //! The host time spent in the phases of run() in nanoseconds
+  struct RunStatistics
+  {
+    uint64b num_of_runs_ = 0;
+    uint64b same_args_time_ = 0; //!< Comparing the buffers with the bound ones
+    uint64b bind_buffers_time_ = 0; //!< Updating the descriptor set
+    uint64b dispatch_time_ = 0; //!< Recording the ownership transfers and the dispatch
+    uint64b submit_time_ = 0; //!< Submitting the command buffer to the queue
+  };
+
+  //! A driver statistic of a pipeline executable
+  struct ExecutableStatistic
+  {
+    std::string name_;
+    std::string description_;
+    std::string value_;
+  };
+
+  //! The driver properties of a pipeline executable
+  struct ExecutableProperties
+  {
+    std::string name_;
+    std::string description_;
+    uint32b subgroup_size_ = 0;
+    std::vector<ExecutableStatistic> statistic_list_; //!< e.g. registers and scratch memory
+  };
+
+  //! A specialization constant. Other than 32-bit integers are given by the bits
+  struct SpecializationConstant
+  {
+    uint32b id_;
+    uint32b value_;
+  };
+
 
   //! Construct a kernel
   VulkanKernel(VulkanDevice* device,
                const uint32b module_index,
                const std::string_view kernel_name);
 
+  //! Construct a kernel which has the given number of descriptor sets
+  VulkanKernel(VulkanDevice* device,
+               const uint32b module_index,
+               const std::string_view kernel_name,
+               const std::size_t num_of_sets);
+
+  //! Construct a kernel which is specialized with the constants
+  VulkanKernel(VulkanDevice* device,
+               const uint32b module_index,
+               const std::string_view kernel_name,
+               const std::vector<SpecializationConstant>& constant_list);
+
+  //! Construct a kernel which is specialized with the constants and has the sets
+  VulkanKernel(VulkanDevice* device,
+               const uint32b module_index,
+               const std::string_view kernel_name,
+               const std::size_t num_of_sets,
+               const std::vector<SpecializationConstant>& constant_list);
+
   //! Destroy a kernel
   ~VulkanKernel() noexcept;
 
@@ -55,23 +114,94 @@ class VulkanKernel
   //! Return an assigned device
   const VulkanDevice* device() const noexcept;
 
+  //! Return the driver properties of the executables of the pipeline
+  const std::vector<ExecutableProperties>& executableProperties() const noexcept;
+
+  //! Return the local-work size which the pipeline is specialized with
+  const std::array<uint32b, 3>& localWorkSize() const noexcept;
+
+  //! Return the kernel name
+  std::string_view name() const noexcept;
+
   //! Return the number of a kernel arguments
   static constexpr std::size_t numOfArguments() noexcept;
 
+  //! Return the number of descriptor sets
+  std::size_t numOfDescriptorSets() const noexcept;
+
+  //! Return the number of the specialized pipelines which are cached
+  std::size_t numOfVariants() const noexcept;
+
+  //! Record the commands of a kernel into the command buffer
+  void record(const vk::CommandBuffer& command,
+              BufferRef<ArgumentTypes>... args,
+              const std::array<uint32b, kDimension> works);
+
+  //! Record the commands of a kernel with the descriptor set
+  void record(const vk::CommandBuffer& command,
+              const std::size_t set_index,
+              BufferRef<ArgumentTypes>... args,
+              const std::array<uint32b, kDimension> works);
+
+  //! Clear the run statistics
+  void resetRunStatistics() noexcept;
+
   //! Execute a kernel
   void run(BufferRef<ArgumentTypes>... args,
            const std::array<uint32b, kDimension> works,
            const uint32b queue_index);
 
+  //! Execute a kernel and signal the fence on completion
+  void run(BufferRef<ArgumentTypes>... args,
+           const std::array<uint32b, kDimension> works,
+           const uint32b queue_index,
+           const vk::Fence& fence);
+
+#if defined(CLSPV_TEST_COROUTINE_SUPPORTED)
+  //! Execute a kernel asynchronously. Defined in vulkan_coroutine.hpp
+  FenceAwaitable runAsync(VulkanReactor* reactor,
+                          BufferRef<ArgumentTypes>... args,
+                          const std::array<uint32b, kDimension> works,
+                          const uint32b queue_index);
+#endif // CLSPV_TEST_COROUTINE_SUPPORTED
+
+  //! Return the host time spent in the phases of run()
+  const RunStatistics& runStatistics() const noexcept;
+
+  //! Enable the measurement of the run statistics
+  void setRunStatisticsEnabled(const bool is_enabled) noexcept;
+
+  //! Return the constants which the current pipeline is specialized with
+  const std::vector<SpecializationConstant>& specializationConstants() const noexcept;
+
+  //! Select the pipeline which is specialized with the constants. The reserved IDs are ignored
+  void specialize(const std::vector<SpecializationConstant>& constant_list);
+
+  //! Return the subgroup size which the pipeline is compiled for. Returns 0 if it varies
+  uint32b subgroupSize() const noexcept;
+
   //! Return the workgroup dimension
   static constexpr std::size_t workgroupDimension() noexcept;
 
  private:
-  //! Bind buffers
-  void bindBuffers(BufferRef<ArgumentTypes>... args);
+  //! A pipeline which is specialized with the constants
+  struct PipelineVariant
+  {
+    std::vector<SpecializationConstant> constant_list_; //!< Sorted by the ID
+    vk::Pipeline pipeline_;
+    std::vector<ExecutableProperties> executable_properties_list_;
+    std::array<uint32b, 3> local_work_size_{{1, 1, 1}};
+    uint32b subgroup_size_ = 0;
+  };
+
 
-  //! Dispatch
-  void dispatch(const std::array<uint32b, kDimension> works);
+  //! Bind buffers to the descriptor set
+  void bindBuffers(const std::size_t set_index, BufferRef<ArgumentTypes>... args);
+
+  //! Record the dispatch commands
+  void dispatch(const vk::CommandBuffer& command,
+                const std::size_t set_index,
+                const std::array<uint32b, kDimension> works);
 
   //! Get the VkBuffer of the given buffer
   template <typename Type>
@@ -80,38 +210,63 @@ class VulkanKernel
   //! Initialize a command buffer
   void initCommandBuffer();
 
-  //! Initialize a compute pipeline
-  void initComputePipeline(const uint32b module_index,
-                           const std::string_view kernel_name);
+  //! Initialize a compute pipeline which is specialized with the constants
+  void initComputePipeline(const std::vector<SpecializationConstant>& constant_list);
 
   //! Initialize a descriptor pool
-  void initDescriptorPool();
+  void initDescriptorPool(const std::size_t num_of_sets);
 
-  //! Initialize a descriptor set
-  void initDescriptorSet();
+  //! Initialize descriptor sets
+  void initDescriptorSet(const std::size_t num_of_sets);
 
   //! Initialize a descriptor set layout
   void initDescriptorSetLayout();
 
+  //! Capture the driver properties of the executables of the current pipeline
+  void initExecutableProperties();
+
   //! Initialize a kernel
   void initialize(const uint32b module_index,
-                  const std::string_view kernel_name);
+                  const std::string_view kernel_name,
+                  const std::size_t num_of_sets,
+                  const std::vector<SpecializationConstant>& constant_list);
 
   //! Initialize a pipeline layout
   void initPipelineLayout();
 
   //! Check if the current buffers are same as previous buffers
-  bool isSameArgs(BufferRef<ArgumentTypes>... args) const noexcept;
+  bool isSameArgs(const std::size_t set_index,
+                  BufferRef<ArgumentTypes>... args) const noexcept;
+
+  //! Return the compute queue index which executes the kernel
+  uint32b selectQueueIndex(BufferRef<ArgumentTypes>... args,
+                           const uint32b queue_index) const noexcept;
+
+  //! Add the waits for the other compute queues which used the arguments last
+  uint32b waitForOwnerQueues(BufferRef<ArgumentTypes>... args,
+                             const uint32b queue_index,
+                             vk::Semaphore* wait_semaphores,
+                             uint64b* wait_values) const noexcept;
+
+
+  //! The constant IDs which are reserved for the local-work size
+  static constexpr uint32b kNumOfReservedConstants = 3;
 
 
   VulkanDevice* device_;
+  std::string name_;
   vk::DescriptorSetLayout descriptor_set_layout_;
   vk::DescriptorPool descriptor_pool_;
-  vk::DescriptorSet descriptor_set_;
+  std::vector<vk::DescriptorSet> descriptor_set_list_;
   vk::PipelineLayout pipeline_layout_;
-  vk::Pipeline compute_pipeline_;
+  vk::CommandPool command_pool_;
   vk::CommandBuffer command_buffer_;
-  std::array<vk::Buffer, sizeof...(ArgumentTypes)> buffer_list_;
+  std::vector<std::array<vk::Buffer, sizeof...(ArgumentTypes)>> buffer_list_;
+  std::vector<PipelineVariant> pipeline_variant_list_;
+  std::size_t variant_index_ = 0;
+  RunStatistics run_statistics_;
+  uint32b module_index_ = 0;
+  bool is_run_statistics_enabled_ = false;
 };
 
 // Type aliases
@@ -0,0 +1,183 @@
+/*!
+  \file vulkan_local_work_size_tuner-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_LOCAL_WORK_SIZE_TUNER_INL_HPP
+#define CLSPV_TEST_VULKAN_LOCAL_WORK_SIZE_TUNER_INL_HPP
+
+#include "vulkan_local_work_size_tuner.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <string_view>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_device.hpp"
+#include "vulkan_kernel.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+inline
+VulkanLocalWorkSizeTuner::VulkanLocalWorkSizeTuner(VulkanDevice* device) noexcept :
+    device_{device}
+{
+}
+
+/*!
+  \details
+  A multi-dimensional size is split into the powers of two along the y and
+  z axes, and the x axis is kept the longest, so the subgroups are laid
+  along x. The sizes which exceed maxComputeWorkGroupSize are excluded.
+  */
+template <std::size_t kDimension> inline
+std::vector<std::array<uint32b, 3>> VulkanLocalWorkSizeTuner::candidates() const
+{
+  static_assert((0 < kDimension) && (kDimension <= 3),
+                "The dimension is out of range.");
+  const auto& limits = device_->physicalDeviceInfo().properties().properties1_.limits;
+  const uint32b max_invocations = limits.maxComputeWorkGroupInvocations;
+  const uint32b subgroup_size = device_->subgroupSize();
+
+  std::vector<uint32b> total_list;
+  for (uint32b total = 1; total <= max_invocations; total *= 2)
+    total_list.emplace_back(total);
+  for (uint32b k = 1; k <= kMaxSubgroupMultiple; ++k) {
+    if (max_invocations < k * subgroup_size)
+      break;
+    total_list.emplace_back(k * subgroup_size);
+  }
+  std::sort(total_list.begin(), total_list.end());
+  total_list.erase(std::unique(total_list.begin(), total_list.end()),
+                   total_list.end());
+
+  std::vector<std::array<uint32b, 3>> candidate_list;
+  const auto add = [&limits, &candidate_list](const std::array<uint32b, 3>& size)
+  {
+    for (std::size_t i = 0; i < size.size(); ++i) {
+      if (limits.maxComputeWorkGroupSize[i] < size[i])
+        return;
+    }
+    candidate_list.emplace_back(size);
+  };
+  for (const uint32b total : total_list) {
+    if constexpr (kDimension == 1) {
+      add({{total, 1, 1}});
+    }
+    else {
+      const uint32b max_z = (kDimension == 3) ? total : 1;
+      for (uint32b z = 1; (z <= max_z) && (z * z * z <= total); z *= 2) {
+        if ((total % z) != 0)
+          continue;
+        const uint32b area = total / z;
+        for (uint32b y = z; y * y <= area; y *= 2) {
+          if ((area % y) == 0)
+            add({{area / y, y, z}});
+        }
+      }
+    }
+  }
+  return candidate_list;
+}
+
+/*!
+  */
+inline
+std::size_t VulkanLocalWorkSizeTuner::numOfRuns() const noexcept
+{
+  return num_of_runs_;
+}
+
+/*!
+  */
+inline
+auto VulkanLocalWorkSizeTuner::results() const noexcept
+    -> const std::vector<Result>&
+{
+  return result_list_;
+}
+
+/*!
+  */
+inline
+void VulkanLocalWorkSizeTuner::setNumOfRuns(const std::size_t num_of_runs) noexcept
+{
+  num_of_runs_ = (std::max)(num_of_runs, std::size_t{1});
+}
+
+/*!
+  \details
+  The first run of a candidate isn't measured since it includes the lazy
+  setup of the queue and the buffers. The round trip from run() to the
+  fence is measured, and the median of the runs is compared.
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+std::array<uint32b, 3> VulkanLocalWorkSizeTuner::tune(
+    const uint32b module_index,
+    const std::string_view kernel_name,
+    const std::array<uint32b, kDimension>& works,
+    const uint32b queue_index,
+    VulkanBuffer<ArgumentTypes>&... args)
+{
+  using Clock = std::chrono::steady_clock;
+  constexpr uint64b timeout = (std::numeric_limits<uint64b>::max)();
+
+  const auto& d = device_->device();
+  vk::Fence fence;
+  {
+    const vk::FenceCreateInfo fence_info{};
+    d.createFence(&fence_info, nullptr, &fence);
+  }
+
+  result_list_.clear();
+  std::vector<double> time_list;
+  for (const auto& local_work_size : candidates<kDimension>()) {
+    device_->setLocalWorkSize(module_index, kernel_name, local_work_size);
+    VulkanKernel<kDimension, ArgumentTypes...> kernel{device_,
+                                                      module_index,
+                                                      kernel_name};
+    time_list.clear();
+    for (std::size_t i = 0; i <= num_of_runs_; ++i) {
+      const auto start = Clock::now();
+      kernel.run(args..., works, queue_index, fence);
+      d.waitForFences(1, &fence, VK_TRUE, timeout);
+      const std::chrono::duration<double, std::milli> t = Clock::now() - start;
+      d.resetFences(1, &fence);
+      if (0 < i)
+        time_list.emplace_back(t.count());
+    }
+    const auto median = time_list.begin() + time_list.size() / 2;
+    std::nth_element(time_list.begin(), median, time_list.end());
+    result_list_.push_back(Result{local_work_size, *median});
+  }
+  d.destroyFence(fence);
+
+  std::array<uint32b, 3> local_work_size = device_->localWorkSize<kDimension>();
+  const auto best = std::min_element(result_list_.begin(),
+                                     result_list_.end(),
+                                     [](const Result& lhs, const Result& rhs)
+  {
+    return lhs.time_ < rhs.time_;
+  });
+  if (best != result_list_.end())
+    local_work_size = best->local_work_size_;
+  device_->setLocalWorkSize(module_index, kernel_name, local_work_size);
+  return local_work_size;
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_LOCAL_WORK_SIZE_TUNER_INL_HPP
@@ -0,0 +1,92 @@
+/*!
+  \file vulkan_local_work_size_tuner.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_LOCAL_WORK_SIZE_TUNER_HPP
+#define CLSPV_TEST_VULKAN_LOCAL_WORK_SIZE_TUNER_HPP
+
+// Standard C++ library
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+template <typename> class VulkanBuffer;
+class VulkanDevice;
+
+/*!
+  \brief Select the fastest local-work size of a kernel
+
+  The candidates are the power of two sizes and the multiples of the
+  subgroup size up to maxComputeWorkGroupInvocations, so non-powers-of-two
+  are also measured. Each candidate is compiled into a pipeline and the
+  round trip of the kernel is measured. The fastest size is set to the
+  device with VulkanDevice::setLocalWorkSize(), so the kernels which are
+  created after the tuning use it. The result is persisted with
+  VulkanDevice::saveLocalWorkSizeCache(), and later runs load it with
+  DeviceOptions::local_work_size_cache_path_.
+
+  The kernel is run on the given buffers many times, so it must not depend
+  on the contents which it writes.
+  */
+class VulkanLocalWorkSizeTuner
+{
+ public:
+  //! The measured time of a candidate
+  struct Result
+  {
+    std::array<uint32b, 3> local_work_size_;
+    double time_ = 0.0; //!< The median round trip in milliseconds
+  };
+
+
+  //! Create a tuner
+  VulkanLocalWorkSizeTuner(VulkanDevice* device) noexcept;
+
+
+  //! Return the candidate local-work sizes for the work dimension
+  template <std::size_t kDimension>
+  std::vector<std::array<uint32b, 3>> candidates() const;
+
+  //! Return the number of the measured runs of a candidate
+  std::size_t numOfRuns() const noexcept;
+
+  //! Return the measured candidates of the last tuning
+  const std::vector<Result>& results() const noexcept;
+
+  //! Set the number of the measured runs of a candidate
+  void setNumOfRuns(const std::size_t num_of_runs) noexcept;
+
+  //! Measure the candidates and set the fastest one to the device
+  template <std::size_t kDimension, typename ...ArgumentTypes>
+  std::array<uint32b, 3> tune(const uint32b module_index,
+                              const std::string_view kernel_name,
+                              const std::array<uint32b, kDimension>& works,
+                              const uint32b queue_index,
+                              VulkanBuffer<ArgumentTypes>&... args);
+
+ private:
+  //! The maximum multiple of the subgroup size which is measured
+  static constexpr uint32b kMaxSubgroupMultiple = 16;
+
+
+  VulkanDevice* device_;
+  std::vector<Result> result_list_;
+  std::size_t num_of_runs_ = 10;
+};
+
+} // namespace clspvtest
+
+#include "vulkan_local_work_size_tuner-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_LOCAL_WORK_SIZE_TUNER_HPP
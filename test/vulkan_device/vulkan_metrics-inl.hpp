@@ -0,0 +1,225 @@
+/*!
+  \file vulkan_metrics-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_METRICS_INL_HPP
+#define CLSPV_TEST_VULKAN_METRICS_INL_HPP
+
+#include "vulkan_metrics.hpp"
+// Standard C++ library
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+inline
+void VulkanMetrics::add(const MetricCounter counter, const uint64b value) noexcept
+{
+  auto& c = counter_list_[static_cast<std::size_t>(counter)];
+  c.fetch_add(value, std::memory_order_relaxed);
+}
+
+/*!
+  */
+inline
+uint64b VulkanMetrics::count(const MetricCounter counter) const noexcept
+{
+  const auto& c = counter_list_[static_cast<std::size_t>(counter)];
+  return c.load(std::memory_order_relaxed);
+}
+
+/*!
+  \details
+  The callback is called once with the whole text as a std::string_view.
+  */
+template <typename Function> inline
+void VulkanMetrics::dumpPrometheusText(Function&& callback) const
+{
+  const std::string text = toPrometheusText();
+  callback(std::string_view{text});
+}
+
+/*!
+  */
+inline
+void VulkanMetrics::observe(const MetricHistogram histogram,
+                            const uint64b value) noexcept
+{
+  const std::size_t index = static_cast<std::size_t>(histogram);
+  const auto& info = getHistogramInfo(index);
+  std::size_t bucket = 0;
+  while ((bucket < info.bound_list_.size()) && (info.bound_list_[bucket] < value))
+    ++bucket;
+  auto& data = histogram_list_[index];
+  data.bucket_list_[bucket].fetch_add(1, std::memory_order_relaxed);
+  data.count_.fetch_add(1, std::memory_order_relaxed);
+  data.sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+/*!
+  */
+inline
+void VulkanMetrics::reset() noexcept
+{
+  for (auto& counter : counter_list_)
+    counter.store(0, std::memory_order_relaxed);
+  for (auto& data : histogram_list_) {
+    for (auto& bucket : data.bucket_list_)
+      bucket.store(0, std::memory_order_relaxed);
+    data.count_.store(0, std::memory_order_relaxed);
+    data.sum_.store(0, std::memory_order_relaxed);
+  }
+}
+
+/*!
+  \details
+  The values are read one by one without a lock, so a histogram which is
+  updated during the export can be slightly inconsistent. The buckets are
+  cumulative as the format requires.
+  */
+inline
+std::string VulkanMetrics::toPrometheusText() const
+{
+  const auto number = [](const double value)
+  {
+    std::array<char, 32> s;
+    std::snprintf(s.data(), s.size(), "%.9g", value);
+    return std::string{s.data()};
+  };
+
+  std::ostringstream text;
+  for (std::size_t i = 0; i < kNumOfCounters; ++i) {
+    const auto& info = getCounterInfo(i);
+    const uint64b value = counter_list_[i].load(std::memory_order_relaxed);
+    text << "# HELP " << info.name_ << " " << info.help_ << "\n"
+         << "# TYPE " << info.name_ << " counter\n"
+         << info.name_ << " " << number(info.scale_ * static_cast<double>(value))
+         << "\n";
+  }
+  for (std::size_t i = 0; i < kNumOfHistograms; ++i) {
+    const auto& info = getHistogramInfo(i);
+    const auto& data = histogram_list_[i];
+    text << "# HELP " << info.name_ << " " << info.help_ << "\n"
+         << "# TYPE " << info.name_ << " histogram\n";
+    uint64b cumulative = 0;
+    for (std::size_t b = 0; b < kNumOfBuckets; ++b) {
+      cumulative += data.bucket_list_[b].load(std::memory_order_relaxed);
+      const std::string bound = (b < info.bound_list_.size())
+          ? number(info.scale_ * static_cast<double>(info.bound_list_[b]))
+          : std::string{"+Inf"};
+      text << info.name_ << "_bucket{le=\"" << bound << "\"} " << cumulative << "\n";
+    }
+    const uint64b sum = data.sum_.load(std::memory_order_relaxed);
+    text << info.name_ << "_sum " << number(info.scale_ * static_cast<double>(sum)) << "\n"
+         << info.name_ << "_count " << data.count_.load(std::memory_order_relaxed)
+         << "\n";
+  }
+  return text.str();
+}
+
+/*!
+  */
+inline
+bool VulkanMetrics::writePrometheusText(const std::string_view file_path) const
+{
+  std::ofstream file{std::string{file_path}};
+  if (!file)
+    return false;
+  file << toPrometheusText();
+  return static_cast<bool>(file);
+}
+
+/*!
+  */
+inline
+auto VulkanMetrics::getCounterInfo(const std::size_t index) noexcept
+    -> const CounterInfo&
+{
+  static const std::array<CounterInfo, kNumOfCounters> info_list{{
+      {"clspvtest_dispatches_total",
+       "Recorded kernel dispatches.", 1.0},
+      {"clspvtest_descriptor_updates_total",
+       "Descriptor set updates.", 1.0},
+      {"clspvtest_descriptor_updates_avoided_total",
+       "Kernel runs which reused the bound buffers.", 1.0},
+      {"clspvtest_uploaded_bytes_total",
+       "Bytes written into buffers from the host.", 1.0},
+      {"clspvtest_downloaded_bytes_total",
+       "Bytes read from buffers into the host.", 1.0},
+      {"clspvtest_staging_allocations_total",
+       "Staging buffers allocated for reads and writes.", 1.0},
+      {"clspvtest_buffer_creations_total",
+       "Buffers created by the memory allocator.", 1.0},
+      {"clspvtest_waits_total",
+       "Host waits for the device.", 1.0},
+      {"clspvtest_wait_seconds_total",
+       "Host time blocked waiting for the device.", 1.0e-9}}};
+  return info_list[index];
+}
+
+/*!
+  */
+inline
+auto VulkanMetrics::getHistogramInfo(const std::size_t index) noexcept
+    -> const HistogramInfo&
+{
+  constexpr uint64b kKiB = 1024;
+  static const std::array<HistogramInfo, kNumOfHistograms> info_list{{
+      {"clspvtest_wait_duration_seconds",
+       "Host time blocked in a wait for the device.",
+       1.0e-9,
+       {{10'000, 100'000, 1'000'000, 10'000'000, 100'000'000,
+         1'000'000'000, 10'000'000'000}}},
+      {"clspvtest_transfer_size_bytes",
+       "Bytes of a buffer read or write.",
+       1.0,
+       {{4 * kKiB, 64 * kKiB, kKiB * kKiB, 16 * kKiB * kKiB, 256 * kKiB * kKiB,
+         kKiB * kKiB * kKiB, 4 * kKiB * kKiB * kKiB}}}}};
+  return info_list[index];
+}
+
+/*!
+  */
+inline
+WaitMeasurement::WaitMeasurement(VulkanMetrics* metrics) noexcept :
+    metrics_{metrics}
+{
+  if (metrics_ != nullptr)
+    begin_ = Clock::now();
+}
+
+/*!
+  */
+inline
+WaitMeasurement::~WaitMeasurement() noexcept
+{
+  if (metrics_ != nullptr) {
+    const auto t = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - begin_);
+    const uint64b time = static_cast<uint64b>(t.count());
+    metrics_->add(MetricCounter::kWaits);
+    metrics_->add(MetricCounter::kWaitTime, time);
+    metrics_->observe(MetricHistogram::kWaitTime, time);
+  }
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_METRICS_INL_HPP
@@ -0,0 +1,151 @@
+/*!
+  \file vulkan_metrics.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_METRICS_HPP
+#define CLSPV_TEST_VULKAN_METRICS_HPP
+
+// Standard C++ library
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+enum class MetricCounter : uint32b
+{
+  kDispatches = 0, //!< Recorded dispatches
+  kDescriptorUpdates, //!< Descriptor set updates
+  kDescriptorUpdatesAvoided, //!< Runs which reused the bound buffers
+  kUploadedBytes, //!< Bytes written into buffers from the host
+  kDownloadedBytes, //!< Bytes read from buffers into the host
+  kStagingAllocations, //!< Staging buffers for reads and writes
+  kBufferCreations, //!< vmaCreateBuffer calls
+  kWaits, //!< waitForCompletion calls
+  kWaitTime //!< Nanoseconds blocked in waitForCompletion
+};
+
+/*!
+  */
+enum class MetricHistogram : uint32b
+{
+  kWaitTime = 0, //!< Nanoseconds blocked in a waitForCompletion call
+  kTransferSize //!< Bytes of a buffer read or write
+};
+
+/*!
+  \brief Count the events of the hot paths
+
+  The counters and the histograms are lock-free atomics which are updated
+  with the relaxed order, so they can be incremented from any thread. A
+  registry is attached to a device with VulkanDevice::setMetrics(), and then
+  the device, the kernels and the buffers update it. The values are exported
+  in the Prometheus text format.
+  */
+class VulkanMetrics
+{
+ public:
+  //! Add the value to the counter
+  void add(const MetricCounter counter, const uint64b value = 1) noexcept;
+
+  //! Return the value of the counter
+  uint64b count(const MetricCounter counter) const noexcept;
+
+  //! Pass the metrics in the Prometheus text format to the callback
+  template <typename Function>
+  void dumpPrometheusText(Function&& callback) const;
+
+  //! Add the value to the histogram
+  void observe(const MetricHistogram histogram, const uint64b value) noexcept;
+
+  //! Reset the counters and the histograms to zero
+  void reset() noexcept;
+
+  //! Return the metrics in the Prometheus text format
+  std::string toPrometheusText() const;
+
+  //! Write the metrics in the Prometheus text format into a file
+  bool writePrometheusText(const std::string_view file_path) const;
+
+ private:
+  static constexpr std::size_t kNumOfCounters = 9;
+  static constexpr std::size_t kNumOfHistograms = 2;
+  static constexpr std::size_t kNumOfBuckets = 8;
+
+
+  //! The description of a counter
+  struct CounterInfo
+  {
+    const char* name_;
+    const char* help_;
+    double scale_; //!< From the recorded unit to the exported unit
+  };
+
+  //! The description of a histogram
+  struct HistogramInfo
+  {
+    const char* name_;
+    const char* help_;
+    double scale_; //!< From the recorded unit to the exported unit
+    std::array<uint64b, kNumOfBuckets - 1> bound_list_; //!< The last bucket is +Inf
+  };
+
+  //! The buckets of a histogram
+  struct HistogramData
+  {
+    std::array<std::atomic<uint64b>, kNumOfBuckets> bucket_list_{};
+    std::atomic<uint64b> count_{0};
+    std::atomic<uint64b> sum_{0};
+  };
+
+
+  //! Return the description of the counter
+  static const CounterInfo& getCounterInfo(const std::size_t index) noexcept;
+
+  //! Return the description of the histogram
+  static const HistogramInfo& getHistogramInfo(const std::size_t index) noexcept;
+
+
+  std::array<std::atomic<uint64b>, kNumOfCounters> counter_list_{};
+  std::array<HistogramData, kNumOfHistograms> histogram_list_;
+};
+
+/*!
+  \brief Count the enclosing scope as a wait and measure its time
+
+  Nothing is measured if the registry is null.
+  */
+class WaitMeasurement
+{
+ public:
+  //! Start a wait
+  WaitMeasurement(VulkanMetrics* metrics) noexcept;
+
+  //! Finish a wait
+  ~WaitMeasurement() noexcept;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+
+  VulkanMetrics* metrics_;
+  Clock::time_point begin_;
+};
+
+} // namespace clspvtest
+
+#include "vulkan_metrics-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_METRICS_HPP
@@ -0,0 +1,585 @@
+/*!
+  \file vulkan_paged_buffer-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_PAGED_BUFFER_INL_HPP
+#define CLSPV_TEST_VULKAN_PAGED_BUFFER_INL_HPP
+
+#include "vulkan_paged_buffer.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <list>
+#include <utility>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_device.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+template <typename T> inline
+VulkanPagedBuffer<T>::VulkanPagedBuffer(VulkanDevice* device,
+                                        const std::size_t page_size,
+                                        const std::size_t num_of_slots) :
+    device_{device},
+    device_pages_{device, BufferUsage::kDeviceOnly},
+    staging_{device, BufferUsage::kHostOnly},
+    page_table_{device, BufferUsage::kHostToDevice},
+    slot_page_list_(num_of_slots, std::numeric_limits<std::size_t>::max()),
+    slot_batch_list_(num_of_slots, kNumOfBatches),
+    page_size_{page_size}
+{
+  // The slots are accessed by the transfer queue and the compute queue
+  // alternately, so the ownership isn't transferred on each residency change
+  device_pages_.setConcurrent(true);
+  initialize();
+}
+
+/*!
+  */
+template <typename T> inline
+VulkanPagedBuffer<T>::~VulkanPagedBuffer() noexcept
+{
+  destroy();
+}
+
+/*!
+  */
+template <typename T> inline
+auto VulkanPagedBuffer<T>::deviceBuffer() noexcept -> VulkanBuffer<Type>&
+{
+  return device_pages_;
+}
+
+/*!
+  */
+template <typename T> inline
+auto VulkanPagedBuffer<T>::deviceBuffer() const noexcept
+    -> const VulkanBuffer<Type>&
+{
+  return device_pages_;
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::destroy() noexcept
+{
+  waitForResidency();
+  for (auto& batch : batch_list_) {
+    if (batch.fence_) {
+      device_->device().destroyFence(batch.fence_);
+      batch.fence_ = nullptr;
+    }
+    batch.command_ = nullptr;
+  }
+  if (command_pool_) {
+    device_->device().destroyCommandPool(command_pool_);
+    command_pool_ = nullptr;
+  }
+  page_table_.destroy();
+  staging_.destroy();
+  device_pages_.destroy();
+}
+
+/*!
+  */
+template <typename T> inline
+auto VulkanPagedBuffer<T>::hostData() noexcept -> Pointer
+{
+  return host_data_.data();
+}
+
+/*!
+  */
+template <typename T> inline
+auto VulkanPagedBuffer<T>::hostData() const noexcept -> ConstPointer
+{
+  return host_data_.data();
+}
+
+/*!
+  */
+template <typename T> inline
+bool VulkanPagedBuffer<T>::isResident(const std::size_t page) const noexcept
+{
+  const bool result = slot(page) != kInvalidSlot;
+  return result;
+}
+
+/*!
+  */
+template <typename T> inline
+std::size_t VulkanPagedBuffer<T>::numOfPages() const noexcept
+{
+  return page_list_.size();
+}
+
+/*!
+  */
+template <typename T> inline
+std::size_t VulkanPagedBuffer<T>::numOfSlots() const noexcept
+{
+  return slot_page_list_.size();
+}
+
+/*!
+  */
+template <typename T> inline
+std::size_t VulkanPagedBuffer<T>::pageIndex(const std::size_t index) const noexcept
+{
+  return index / page_size_;
+}
+
+/*!
+  */
+template <typename T> inline
+std::size_t VulkanPagedBuffer<T>::pageSize() const noexcept
+{
+  return page_size_;
+}
+
+/*!
+  */
+template <typename T> inline
+VulkanBuffer<uint32b>& VulkanPagedBuffer<T>::pageTable() noexcept
+{
+  return page_table_;
+}
+
+/*!
+  */
+template <typename T> inline
+const VulkanBuffer<uint32b>& VulkanPagedBuffer<T>::pageTable() const noexcept
+{
+  return page_table_;
+}
+
+/*!
+  \details
+  The copies are submitted to the transfer queue and this function returns
+  without waiting them. Call 'waitForPages' (or 'request') before
+  dispatching a kernel which uses the pages.
+  Only the earlier batches which used the same slots are waited for.
+  Returns false if the range is out of the array or there aren't enough
+  unpinned slots for the range. On the failure the pages which this call
+  pinned are unpinned again, though the loaded pages stay resident.
+  */
+template <typename T> inline
+bool VulkanPagedBuffer<T>::prefetch(const std::size_t offset,
+                                    const std::size_t count,
+                                    const bool will_write,
+                                    const uint32b queue_index)
+{
+  if (count == 0)
+    return true;
+  if (!isValidRange(offset, count))
+    return false;
+
+  beginTransfer();
+  auto& batch = batch_list_[batch_index_];
+
+  const std::size_t first = pageIndex(offset);
+  const std::size_t last = pageIndex(offset + count - 1);
+  // Pin the resident pages first so that they are not evicted by the range
+  std::vector<std::size_t> pin_list;
+  for (std::size_t page = first; page <= last; ++page) {
+    auto& state = page_list_[page];
+    if (state.slot_ != kInvalidSlot) {
+      lru_list_.splice(lru_list_.begin(), lru_list_, state.lru_);
+      if (!state.is_pinned_)
+        pin_list.emplace_back(page);
+      state.is_pinned_ = true;
+      state.is_dirty_ = state.is_dirty_ || will_write;
+    }
+  }
+
+  // Load the non-resident pages
+  bool result = true;
+  std::vector<std::size_t> table_update_list;
+  {
+    auto staging = staging_.mapMemory();
+    for (std::size_t page = first; result && (page <= last); ++page) {
+      auto& state = page_list_[page];
+      if (state.slot_ != kInvalidSlot)
+        continue;
+      const uint32b s = findSlot();
+      result = s != kInvalidSlot;
+      if (!result)
+        break;
+      // The staging regions of the slot are reused
+      waitForBatch(slot_batch_list_[s]);
+      slot_batch_list_[s] = batch_index_;
+      const std::size_t slot_offset = sizeof(Type) * page_size_ * s;
+      // Evict the page in the slot
+      const std::size_t victim = slot_page_list_[s];
+      if (victim != std::numeric_limits<std::size_t>::max()) {
+        auto& victim_state = page_list_[victim];
+        if (victim_state.is_dirty_) {
+          const std::size_t download_offset = sizeof(Type) * page_size_ *
+                                              (numOfSlots() + s);
+          evict_list_.emplace_back(slot_offset,
+                                   download_offset,
+                                   sizeof(Type) * countOf(victim));
+          batch.write_back_list_.emplace_back(victim, s);
+        }
+        lru_list_.erase(victim_state.lru_);
+        victim_state.slot_ = kInvalidSlot;
+        victim_state.is_dirty_ = false;
+        table_update_list.emplace_back(victim);
+      }
+      // Load the page into the slot
+      waitForWriteBack(page);
+      const std::size_t n = countOf(page);
+      std::copy_n(host_data_.data() + page_size_ * page,
+                  n,
+                  staging.data() + page_size_ * s);
+      load_list_.emplace_back(slot_offset, slot_offset, sizeof(Type) * n);
+      slot_page_list_[s] = page;
+      lru_list_.push_front(page);
+      state.lru_ = lru_list_.begin();
+      state.slot_ = s;
+      state.is_pinned_ = true;
+      state.is_dirty_ = will_write;
+      pin_list.emplace_back(page);
+      table_update_list.emplace_back(page);
+    }
+  }
+  updatePageTable(table_update_list);
+  submitTransfer(queue_index);
+  // The pages which were pinned before this call keep their pins
+  if (!result) {
+    for (const std::size_t page : pin_list)
+      page_list_[page].is_pinned_ = false;
+  }
+  return result;
+}
+
+/*!
+  */
+template <typename T> inline
+bool VulkanPagedBuffer<T>::request(const std::size_t offset,
+                                   const std::size_t count,
+                                   const bool will_write,
+                                   const uint32b queue_index)
+{
+  const bool result = prefetch(offset, count, will_write, queue_index);
+  waitForPages(offset, count);
+  return result;
+}
+
+/*!
+  \details
+  All pages become non-resident.
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::setSize(const std::size_t size)
+{
+  waitForResidency();
+  size_ = size;
+  host_data_.resize(size);
+  page_list_.clear();
+  page_list_.resize((size + page_size_ - 1) / page_size_);
+  lru_list_.clear();
+  std::fill(slot_page_list_.begin(),
+            slot_page_list_.end(),
+            std::numeric_limits<std::size_t>::max());
+  std::fill(slot_batch_list_.begin(), slot_batch_list_.end(), kNumOfBatches);
+
+  device_pages_.setSize(page_size_ * numOfSlots());
+  staging_.setSize(2 * page_size_ * numOfSlots());
+  page_table_.setSize((std::max)(numOfPages(), std::size_t{1}));
+  {
+    auto table = page_table_.mapMemory();
+    if (table)
+      std::fill(table.begin(), table.end(), kInvalidSlot);
+  }
+}
+
+/*!
+  */
+template <typename T> inline
+std::size_t VulkanPagedBuffer<T>::size() const noexcept
+{
+  return size_;
+}
+
+/*!
+  */
+template <typename T> inline
+uint32b VulkanPagedBuffer<T>::slot(const std::size_t page) const noexcept
+{
+  return page_list_[page].slot_;
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::synchronize(const uint32b queue_index)
+{
+  waitForResidency();
+  beginTransfer();
+  auto& batch = batch_list_[batch_index_];
+  for (std::size_t page = 0; page < numOfPages(); ++page) {
+    auto& state = page_list_[page];
+    if ((state.slot_ != kInvalidSlot) && state.is_dirty_) {
+      const uint32b s = state.slot_;
+      const std::size_t slot_offset = sizeof(Type) * page_size_ * s;
+      const std::size_t download_offset = sizeof(Type) * page_size_ *
+                                          (numOfSlots() + s);
+      evict_list_.emplace_back(slot_offset,
+                               download_offset,
+                               sizeof(Type) * countOf(page));
+      batch.write_back_list_.emplace_back(page, s);
+      slot_batch_list_[s] = batch_index_;
+      state.is_dirty_ = false;
+    }
+  }
+  submitTransfer(queue_index);
+  waitForResidency();
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::unpin(const std::size_t offset,
+                                 const std::size_t count) noexcept
+{
+  if ((count == 0) || !isValidRange(offset, count))
+    return;
+  const std::size_t first = pageIndex(offset);
+  const std::size_t last = pageIndex(offset + count - 1);
+  for (std::size_t page = first; page <= last; ++page)
+    page_list_[page].is_pinned_ = false;
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::unpinAll() noexcept
+{
+  for (auto& state : page_list_)
+    state.is_pinned_ = false;
+}
+
+/*!
+  \details
+  Waits only for the batches which loaded the resident pages of the range.
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::waitForPages(const std::size_t offset,
+                                        const std::size_t count) noexcept
+{
+  if ((count == 0) || !isValidRange(offset, count))
+    return;
+  const std::size_t first = pageIndex(offset);
+  const std::size_t last = pageIndex(offset + count - 1);
+  for (std::size_t page = first; page <= last; ++page) {
+    const uint32b s = slot(page);
+    if (s != kInvalidSlot)
+      waitForBatch(slot_batch_list_[s]);
+  }
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::waitForResidency() noexcept
+{
+  for (std::size_t index = 0; index < kNumOfBatches; ++index)
+    waitForBatch(index);
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::beginTransfer() noexcept
+{
+  // The command buffer of the oldest batch is reused
+  batch_index_ = (batch_index_ + 1) % kNumOfBatches;
+  waitForBatch(batch_index_);
+  load_list_.clear();
+  evict_list_.clear();
+}
+
+/*!
+  */
+template <typename T> inline
+std::size_t VulkanPagedBuffer<T>::countOf(const std::size_t page) const noexcept
+{
+  const std::size_t n = (std::min)(page_size_, size_ - page_size_ * page);
+  return n;
+}
+
+/*!
+  */
+template <typename T> inline
+uint32b VulkanPagedBuffer<T>::findSlot() noexcept
+{
+  // Find a free slot
+  for (std::size_t s = 0; s < slot_page_list_.size(); ++s) {
+    if (slot_page_list_[s] == std::numeric_limits<std::size_t>::max())
+      return static_cast<uint32b>(s);
+  }
+  // Find the least recently used page which isn't pinned
+  for (auto ite = lru_list_.rbegin(); ite != lru_list_.rend(); ++ite) {
+    const auto& state = page_list_[*ite];
+    if (!state.is_pinned_)
+      return state.slot_;
+  }
+  return kInvalidSlot;
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::initialize()
+{
+  const auto& device = device_->device();
+  command_pool_ = device_->createCommandPool(QueueType::kTransfer);
+  const vk::CommandBufferAllocateInfo alloc_info{
+      command_pool_,
+      vk::CommandBufferLevel::ePrimary,
+      static_cast<uint32b>(kNumOfBatches)};
+  auto commands = device.allocateCommandBuffers(alloc_info);
+  for (std::size_t index = 0; index < kNumOfBatches; ++index) {
+    auto& batch = batch_list_[index];
+    batch.command_ = commands[index];
+    batch.fence_ = device.createFence(vk::FenceCreateInfo{});
+  }
+}
+
+/*!
+  */
+template <typename T> inline
+bool VulkanPagedBuffer<T>::isValidRange(const std::size_t offset,
+                                        const std::size_t count) const noexcept
+{
+  const bool result = (offset < size_) && (count <= (size_ - offset));
+  return result;
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::submitTransfer(const uint32b queue_index)
+{
+  if (load_list_.empty() && evict_list_.empty())
+    return;
+
+  device_->allocateDeferredBuffers();
+
+  auto& batch = batch_list_[batch_index_];
+  const auto& command = batch.command_;
+  vk::CommandBufferBeginInfo begin_info{};
+  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  command.begin(begin_info);
+
+  if (!evict_list_.empty()) {
+    command.copyBuffer(device_pages_.buffer(),
+                       staging_.buffer(),
+                       static_cast<uint32b>(evict_list_.size()),
+                       evict_list_.data());
+    // The slots must be read before they are overwritten by the loads
+    command.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                            vk::PipelineStageFlagBits::eTransfer,
+                            vk::DependencyFlags{},
+                            0, nullptr,
+                            0, nullptr,
+                            0, nullptr);
+  }
+  if (!load_list_.empty()) {
+    command.copyBuffer(staging_.buffer(),
+                       device_pages_.buffer(),
+                       static_cast<uint32b>(load_list_.size()),
+                       load_list_.data());
+  }
+
+  command.end();
+  device_->submit(QueueType::kTransfer,
+                  queue_index,
+                  command,
+                  batch.fence_);
+  batch.is_pending_ = true;
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::updatePageTable(
+    const std::vector<std::size_t>& page_list) noexcept
+{
+  if (page_list.empty())
+    return;
+  auto table = page_table_.mapMemory();
+  if (table) {
+    for (const std::size_t page : page_list)
+      table[page] = page_list_[page].slot_;
+  }
+}
+
+/*!
+  \details
+  The evicted pages of the batch are written back to the host storage.
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::waitForBatch(const std::size_t batch_index) noexcept
+{
+  if (kNumOfBatches <= batch_index)
+    return;
+  auto& batch = batch_list_[batch_index];
+  if (!batch.is_pending_)
+    return;
+
+  const auto& device = device_->device();
+  constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+  const auto result = device.waitForFences(1, &batch.fence_, VK_TRUE, timeout);
+  //! \todo Handle error
+  if (result != vk::Result::eSuccess) {
+  }
+  device.resetFences(1, &batch.fence_);
+  batch.is_pending_ = false;
+
+  // Write the evicted pages back to the host storage
+  if (!batch.write_back_list_.empty()) {
+    auto staging = staging_.mapMemory();
+    for (const auto& [page, s] : batch.write_back_list_) {
+      std::copy_n(staging.data() + page_size_ * (numOfSlots() + s),
+                  countOf(page),
+                  host_data_.data() + page_size_ * page);
+    }
+    batch.write_back_list_.clear();
+  }
+}
+
+/*!
+  */
+template <typename T> inline
+void VulkanPagedBuffer<T>::waitForWriteBack(const std::size_t page) noexcept
+{
+  for (std::size_t index = 0; index < kNumOfBatches; ++index) {
+    const auto& list = batch_list_[index].write_back_list_;
+    const bool has_page = std::any_of(list.begin(),
+                                      list.end(),
+                                      [page](const auto& w){return w.first == page;});
+    if (has_page)
+      waitForBatch(index);
+  }
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_PAGED_BUFFER_INL_HPP
@@ -0,0 +1,223 @@
+/*!
+  \file vulkan_paged_buffer.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_PAGED_BUFFER_HPP
+#define CLSPV_TEST_VULKAN_PAGED_BUFFER_HPP
+
+// Standard C++ library
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <list>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+class VulkanDevice;
+
+/*!
+  \brief A large logical array which is paged into a device buffer on demand
+
+  The whole array is stored in a host memory, and fixed-size pages of it are
+  made resident in the slots of a device buffer. The least recently used
+  page is evicted when a slot is required. The page table buffer maps a page
+  to the slot, a kernel accesses the element 'i' as
+  'pages[table[i / page_size] * page_size + i % page_size]'.
+
+  The pages requested for a dispatch are pinned, and never evicted until
+  they are unpinned. Residency changes are executed on a transfer queue,
+  so they overlap with the compute which uses other pinned pages.
+  Each prefetch is submitted as a batch which has its own fence, and a new
+  batch waits only for the batches which used the same slots.
+  */
+template <typename T>
+class VulkanPagedBuffer
+{
+ public:
+  //! The type of the buffer. "const", "volatile" and "reference" are removed
+  using Type = std::remove_cv_t<std::remove_reference_t<T>>;
+  using ConstType = std::add_const_t<Type>;
+  using Pointer = std::add_pointer_t<Type>;
+  using ConstPointer = std::add_pointer_t<ConstType>;
+
+
+  //! Create a paged buffer
+  VulkanPagedBuffer(VulkanDevice* device,
+                    const std::size_t page_size,
+                    const std::size_t num_of_slots);
+
+  //! Destroy a paged buffer
+  ~VulkanPagedBuffer() noexcept;
+
+
+  //! Return the device buffer which holds the resident pages
+  VulkanBuffer<Type>& deviceBuffer() noexcept;
+
+  //! Return the device buffer which holds the resident pages
+  const VulkanBuffer<Type>& deviceBuffer() const noexcept;
+
+  //! Destroy a paged buffer
+  void destroy() noexcept;
+
+  //! Return the host storage of the array
+  Pointer hostData() noexcept;
+
+  //! Return the host storage of the array
+  ConstPointer hostData() const noexcept;
+
+  //! Check if the page is resident on the device
+  bool isResident(const std::size_t page) const noexcept;
+
+  //! Return the number of pages
+  std::size_t numOfPages() const noexcept;
+
+  //! Return the number of slots in the device buffer
+  std::size_t numOfSlots() const noexcept;
+
+  //! Return the page index of the element
+  std::size_t pageIndex(const std::size_t index) const noexcept;
+
+  //! Return the number of elements in a page
+  std::size_t pageSize() const noexcept;
+
+  //! Return the page table buffer
+  VulkanBuffer<uint32b>& pageTable() noexcept;
+
+  //! Return the page table buffer
+  const VulkanBuffer<uint32b>& pageTable() const noexcept;
+
+  //! Load the pages of the range asynchronously and pin them
+  bool prefetch(const std::size_t offset,
+                const std::size_t count,
+                const bool will_write,
+                const uint32b queue_index);
+
+  //! Make the pages of the range resident and pin them
+  bool request(const std::size_t offset,
+               const std::size_t count,
+               const bool will_write,
+               const uint32b queue_index);
+
+  //! Set a size of the array
+  void setSize(const std::size_t size);
+
+  //! Return a size of the array
+  std::size_t size() const noexcept;
+
+  //! Return the slot index of the page
+  uint32b slot(const std::size_t page) const noexcept;
+
+  //! Write all modified pages back to the host storage
+  void synchronize(const uint32b queue_index);
+
+  //! Unpin the pages of the range
+  void unpin(const std::size_t offset, const std::size_t count) noexcept;
+
+  //! Unpin all pages
+  void unpinAll() noexcept;
+
+  //! Wait this thread until the pages of the range are resident
+  void waitForPages(const std::size_t offset, const std::size_t count) noexcept;
+
+  //! Wait this thread until all residency changes are completed
+  void waitForResidency() noexcept;
+
+
+  //! The slot index of a non-resident page
+  static constexpr uint32b kInvalidSlot = std::numeric_limits<uint32b>::max();
+
+ private:
+  //! The state of a page
+  struct PageState
+  {
+    std::list<std::size_t>::iterator lru_;
+    uint32b slot_ = kInvalidSlot;
+    bool is_dirty_ = false;
+    bool is_pinned_ = false;
+  };
+
+  //! The residency changes which are submitted at once
+  struct TransferBatch
+  {
+    std::vector<std::pair<std::size_t, uint32b>> write_back_list_;
+    vk::CommandBuffer command_;
+    vk::Fence fence_;
+    bool is_pending_ = false;
+  };
+
+
+  //! Begin recording residency changes into the next batch
+  void beginTransfer() noexcept;
+
+  //! Return the number of elements in the page
+  std::size_t countOf(const std::size_t page) const noexcept;
+
+  //! Find a slot for a page. Return kInvalidSlot if all slots are pinned
+  uint32b findSlot() noexcept;
+
+  //! Initialize a paged buffer
+  void initialize();
+
+  //! Check if the range is in the array
+  bool isValidRange(const std::size_t offset,
+                    const std::size_t count) const noexcept;
+
+  //! Submit the recorded residency changes
+  void submitTransfer(const uint32b queue_index);
+
+  //! Update the page table entries of the pages
+  void updatePageTable(const std::vector<std::size_t>& page_list) noexcept;
+
+  //! Wait this thread until the batch is completed
+  void waitForBatch(const std::size_t batch_index) noexcept;
+
+  //! Wait this thread until the page is written back to the host storage
+  void waitForWriteBack(const std::size_t page) noexcept;
+
+
+  //! The number of the batches which can be in flight
+  static constexpr std::size_t kNumOfBatches = 3;
+
+
+  VulkanDevice* device_;
+  VulkanBuffer<Type> device_pages_;
+  VulkanBuffer<Type> staging_;
+  VulkanBuffer<uint32b> page_table_;
+  std::vector<Type> host_data_;
+  std::vector<PageState> page_list_;
+  std::vector<std::size_t> slot_page_list_;
+  std::vector<std::size_t> slot_batch_list_; //!< The last batch which used the slot
+  std::list<std::size_t> lru_list_;
+  std::vector<vk::BufferCopy> load_list_;
+  std::vector<vk::BufferCopy> evict_list_;
+  std::array<TransferBatch, kNumOfBatches> batch_list_;
+  vk::CommandPool command_pool_;
+  std::size_t page_size_;
+  std::size_t size_ = 0;
+  std::size_t batch_index_ = 0;
+};
+
+// Type aliases
+template <typename Type>
+using UniquePagedBuffer = std::unique_ptr<VulkanPagedBuffer<Type>>;
+
+} // namespace clspvtest
+
+#include "vulkan_paged_buffer-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_PAGED_BUFFER_HPP
@@ -12,7 +12,18 @@
 
 #include "vulkan_physical_device_info.hpp"
 // Standard C++ library
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstddef>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 // Vulkan
@@ -33,22 +44,37 @@ VulkanPhysicalDeviceInfo::VulkanPhysicalDeviceInfo() noexcept
   */
 inline
 VulkanPhysicalDeviceInfo::VulkanPhysicalDeviceInfo(
-    VulkanPhysicalDeviceInfo&& other) noexcept :
-        extension_properties_list_{std::move(other.extension_properties_list_)},
-        layer_properties_list_{std::move(other.layer_properties_list_)},
-        queue_family_properties_list_{std::move(other.queue_family_properties_list_)}
+    VulkanPhysicalDeviceInfo&& other) noexcept
 {
+  *this = std::move(other);
 }
 
 /*!
+  \details
+  The structs which are chained by pNext are linked again, since they point
+  each other.
   */
 inline
 VulkanPhysicalDeviceInfo& VulkanPhysicalDeviceInfo::operator=(
     VulkanPhysicalDeviceInfo&& other) noexcept
 {
+  device_ = other.device_;
   extension_properties_list_ = std::move(other.extension_properties_list_);
   layer_properties_list_ = std::move(other.layer_properties_list_);
   queue_family_properties_list_ = std::move(other.queue_family_properties_list_);
+  properties_ = other.properties_;
+  features_ = other.features_;
+  memory_properties_ = other.memory_properties_;
+  {
+    vk::PhysicalDeviceProperties2 p;
+    linkProperties(p);
+    vk::PhysicalDeviceFeatures2 f;
+    linkFeatures(f);
+    vk::PhysicalDeviceMemoryProperties2 m;
+    link(m, memory_properties_.budget_);
+  }
+  fetched_categories_.store(other.fetched_categories_.load());
+  other.fetched_categories_.store(0);
   return *this;
 }
 
@@ -58,6 +84,7 @@ inline
 auto VulkanPhysicalDeviceInfo::extensionPropertiesList() noexcept
     -> std::vector<ExtensionProperties>&
 {
+  ensure(kExtensionCategory);
   return extension_properties_list_;
 }
 
@@ -67,6 +94,7 @@ inline
 auto VulkanPhysicalDeviceInfo::extensionPropertiesList() const noexcept
     -> const std::vector<ExtensionProperties>&
 {
+  ensure(kExtensionCategory);
   return extension_properties_list_;
 }
 
@@ -75,6 +103,7 @@ auto VulkanPhysicalDeviceInfo::extensionPropertiesList() const noexcept
 inline
 auto VulkanPhysicalDeviceInfo::features() noexcept -> Features&
 {
+  ensure(kFeaturesCategory);
   return features_;
 }
 
@@ -83,20 +112,50 @@ auto VulkanPhysicalDeviceInfo::features() noexcept -> Features&
 inline
 auto VulkanPhysicalDeviceInfo::features() const noexcept -> const Features&
 {
+  ensure(kFeaturesCategory);
   return features_;
 }
 
 /*!
+  \details
+  No query is issued here, the info of the device is fetched per category on
+  the first access.
   */
 inline
 void VulkanPhysicalDeviceInfo::fetch(const vk::PhysicalDevice& device)
 {
-  fetchExtensionProperties(device);
-  fetchLayerProperties(device);
-  fetchQueueFamilyProperties(device);
-  fetchProperties(device);
-  fetchFeatures(device);
-  fetchMemoryProperties(device);
+  std::lock_guard<std::mutex> lock{fetch_mutex_};
+  device_ = device;
+  fetched_categories_.store(0);
+}
+
+/*!
+  */
+inline
+void VulkanPhysicalDeviceInfo::fetchAll() const
+{
+  ensure(kExtensionCategory);
+  ensure(kLayerCategory);
+  ensure(kQueueFamilyCategory);
+  ensure(kPropertiesCategory);
+  ensure(kFeaturesCategory);
+  ensure(kMemoryCategory);
+}
+
+/*!
+  */
+inline
+bool VulkanPhysicalDeviceInfo::isExtensionSupported(
+    const std::string_view extension_name) const noexcept
+{
+  const auto& extension_list = extensionPropertiesList();
+  auto ite = std::find_if(extension_list.begin(), extension_list.end(),
+  [extension_name](const ExtensionProperties& extension)
+  {
+    const std::string_view name{extension.properties1_.extensionName};
+    return name == extension_name;
+  });
+  return ite != extension_list.end();
 }
 
 /*!
@@ -105,6 +164,7 @@ inline
 auto VulkanPhysicalDeviceInfo::layerPropertiesList() noexcept
     -> std::vector<LayerProperties>&
 {
+  ensure(kLayerCategory);
   return layer_properties_list_;
 }
 
@@ -114,6 +174,7 @@ inline
 auto VulkanPhysicalDeviceInfo::layerPropertiesList() const noexcept
     -> const std::vector<LayerProperties>&
 {
+  ensure(kLayerCategory);
   return layer_properties_list_;
 }
 
@@ -134,12 +195,78 @@ void VulkanPhysicalDeviceInfo::link(Type1&& value1,
   }
 }
 
+/*!
+  \details
+  The cached categories are marked as fetched if the cache file has the
+  record of the device. The record is rejected if the layout of the info
+  doesn't match, e.g. the file is made with another version of the headers.
+  */
+inline
+bool VulkanPhysicalDeviceInfo::loadCache(const std::string_view cache_path)
+{
+  const std::vector<uint8b> key = getCacheKey();
+  const auto record_list = loadCacheRecordList(cache_path);
+  const auto record = std::find_if(record_list.begin(), record_list.end(),
+  [&key](const CacheRecord& r)
+  {
+    return r.key_ == key;
+  });
+  if (record == record_list.end())
+    return false;
+
+  std::istringstream payload{record->payload_};
+  const std::size_t payload_size = record->payload_.size();
+  const auto read_size = [&payload]()
+  {
+    uint64b size = 0;
+    payload.read(reinterpret_cast<char*>(&size), sizeof(size));
+    return static_cast<std::size_t>(size);
+  };
+  const auto read_data = [&payload, &read_size, payload_size](void* data,
+                                                              const std::size_t size)
+  {
+    if ((read_size() != size) || (payload_size < size))
+      return false;
+    payload.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+    return static_cast<bool>(payload);
+  };
+  const auto read_list = [&payload, &read_size, payload_size](auto& list)
+  {
+    using ElementType = typename std::remove_reference_t<decltype(list)>::value_type;
+    const std::size_t n = read_size();
+    if (payload_size < n * sizeof(ElementType))
+      return false;
+    list.resize(n);
+    payload.read(reinterpret_cast<char*>(list.data()),
+                 static_cast<std::streamsize>(n * sizeof(ElementType)));
+    return static_cast<bool>(payload);
+  };
+
+  std::lock_guard<std::mutex> lock{fetch_mutex_};
+  const bool result = read_data(&properties_, sizeof(Properties)) &&
+                      read_data(&features_, sizeof(Features)) &&
+                      read_list(extension_properties_list_) &&
+                      read_list(layer_properties_list_) &&
+                      read_list(queue_family_properties_list_);
+  // The pointers in the cache are invalid
+  vk::PhysicalDeviceProperties2 p;
+  linkProperties(p);
+  vk::PhysicalDeviceFeatures2 f;
+  linkFeatures(f);
+  if (result)
+    fetched_categories_.fetch_or(kCachedCategories);
+  else
+    fetched_categories_.fetch_and(~static_cast<uint32b>(kCachedCategories));
+  return result;
+}
+
 /*!
   */
 inline
 auto VulkanPhysicalDeviceInfo::memoryProperties() noexcept
     -> MemoryProperties&
 {
+  ensure(kMemoryCategory);
   return memory_properties_;
 }
 
@@ -149,6 +276,7 @@ inline
 auto VulkanPhysicalDeviceInfo::memoryProperties() const noexcept
     -> const MemoryProperties&
 {
+  ensure(kMemoryCategory);
   return memory_properties_;
 }
 
@@ -157,6 +285,7 @@ auto VulkanPhysicalDeviceInfo::memoryProperties() const noexcept
 inline
 auto VulkanPhysicalDeviceInfo::properties() noexcept -> Properties&
 {
+  ensure(kPropertiesCategory);
   return properties_;
 }
 
@@ -165,6 +294,7 @@ auto VulkanPhysicalDeviceInfo::properties() noexcept -> Properties&
 inline
 auto VulkanPhysicalDeviceInfo::properties() const noexcept -> const Properties&
 {
+  ensure(kPropertiesCategory);
   return properties_;
 }
 
@@ -174,6 +304,7 @@ inline
 auto VulkanPhysicalDeviceInfo::queueFamilyPropertiesList() noexcept
     -> std::vector<QueueFamilyProperties>&
 {
+  ensure(kQueueFamilyCategory);
   return queue_family_properties_list_;
 }
 
@@ -183,16 +314,102 @@ inline
 auto VulkanPhysicalDeviceInfo::queueFamilyPropertiesList() const noexcept
     -> const std::vector<QueueFamilyProperties>&
 {
+  ensure(kQueueFamilyCategory);
   return queue_family_properties_list_;
 }
 
 /*!
+  \details
+  The record of the device is added or replaced, the records of the other
+  devices are kept.
+  */
+inline
+void VulkanPhysicalDeviceInfo::saveCache(const std::string_view cache_path) const
+{
+  CacheRecord new_record;
+  new_record.key_ = getCacheKey();
+  {
+    std::ostringstream payload;
+    const auto write_data = [&payload](const void* data, const std::size_t size)
+    {
+      const uint64b s = size;
+      payload.write(reinterpret_cast<const char*>(&s), sizeof(s));
+      payload.write(static_cast<const char*>(data),
+                    static_cast<std::streamsize>(size));
+    };
+    const auto write_list = [&payload](const auto& list)
+    {
+      using ElementType = typename std::remove_reference_t<decltype(list)>::value_type;
+      const uint64b n = list.size();
+      payload.write(reinterpret_cast<const char*>(&n), sizeof(n));
+      payload.write(reinterpret_cast<const char*>(list.data()),
+                    static_cast<std::streamsize>(n * sizeof(ElementType)));
+    };
+    write_data(&properties(), sizeof(Properties));
+    write_data(&features(), sizeof(Features));
+    write_list(extensionPropertiesList());
+    write_list(layerPropertiesList());
+    write_list(queueFamilyPropertiesList());
+    new_record.payload_ = payload.str();
+  }
+
+  auto record_list = loadCacheRecordList(cache_path);
+  auto record = std::find_if(record_list.begin(), record_list.end(),
+  [&new_record](const CacheRecord& r)
+  {
+    return r.key_ == new_record.key_;
+  });
+  if (record != record_list.end())
+    *record = std::move(new_record);
+  else
+    record_list.emplace_back(std::move(new_record));
+  saveCacheRecordList(cache_path, record_list);
+}
+
+/*!
+  \details
+  The category is fetched only once even if it's accessed from multiple
+  threads.
   */
 inline
-void VulkanPhysicalDeviceInfo::fetchExtensionProperties(
-    const vk::PhysicalDevice& device)
+void VulkanPhysicalDeviceInfo::ensure(const Category category) const
 {
-  const auto properties = device.enumerateDeviceExtensionProperties();
+  if ((fetched_categories_.load(std::memory_order_acquire) & category) != 0)
+    return;
+  std::lock_guard<std::mutex> lock{fetch_mutex_};
+  if ((fetched_categories_.load(std::memory_order_relaxed) & category) != 0)
+    return;
+  switch (category) {
+   case kExtensionCategory:
+    fetchExtensionProperties();
+    break;
+   case kLayerCategory:
+    fetchLayerProperties();
+    break;
+   case kQueueFamilyCategory:
+    fetchQueueFamilyProperties();
+    break;
+   case kPropertiesCategory:
+    fetchProperties();
+    break;
+   case kFeaturesCategory:
+    fetchFeatures();
+    break;
+   case kMemoryCategory:
+    fetchMemoryProperties();
+    break;
+   default:
+    break;
+  }
+  fetched_categories_.fetch_or(category, std::memory_order_release);
+}
+
+/*!
+  */
+inline
+void VulkanPhysicalDeviceInfo::fetchExtensionProperties() const
+{
+  const auto properties = device_.enumerateDeviceExtensionProperties();
   extension_properties_list_.resize(properties.size());
   for (std::size_t i = 0; i < properties.size(); ++i)
     extension_properties_list_[i].properties1_ = properties[i];
@@ -201,12 +418,112 @@ void VulkanPhysicalDeviceInfo::fetchExtensionProperties(
 /*!
   */
 inline
-void VulkanPhysicalDeviceInfo::fetchFeatures(
-    const vk::PhysicalDevice& device) noexcept
+void VulkanPhysicalDeviceInfo::fetchFeatures() const noexcept
 {
   vk::PhysicalDeviceFeatures2 p;
-  auto& props = features_;
+  linkFeatures(p);
+  device_.getFeatures2(&p);
+  features_.features1_ = p.features;
+}
+
+/*!
+  */
+inline
+void VulkanPhysicalDeviceInfo::fetchLayerProperties() const
+{
+  const auto properties = device_.enumerateDeviceLayerProperties();
+  layer_properties_list_.resize(properties.size());
+  for (std::size_t i = 0; i < properties.size(); ++i)
+    layer_properties_list_[i].properties1_ = properties[i];
+}
+
+/*!
+  */
+inline
+void VulkanPhysicalDeviceInfo::fetchMemoryProperties() const noexcept
+{
+  vk::PhysicalDeviceMemoryProperties2 p;
+  auto& props = memory_properties_;
   link(p,
+       props.budget_
+       );
+  device_.getMemoryProperties2(&p);
+  props.properties1_ = p.memoryProperties;
+}
+
+/*!
+  */
+inline
+void VulkanPhysicalDeviceInfo::fetchProperties() const noexcept
+{
+  vk::PhysicalDeviceProperties2 p;
+  linkProperties(p);
+  device_.getProperties2(&p);
+  properties_.properties1_ = p.properties;
+}
+
+/*!
+  */
+inline
+void VulkanPhysicalDeviceInfo::fetchQueueFamilyProperties() const
+{
+  // Query queue family properties
+  {
+    uint32b n = 0;
+    std::vector<vk::QueueFamilyProperties2> properties_list;
+    device_.getQueueFamilyProperties2(&n, properties_list.data());
+
+    queue_family_properties_list_.resize(static_cast<std::size_t>(n));
+    properties_list.resize(static_cast<std::size_t>(n));
+    device_.getQueueFamilyProperties2(&n, properties_list.data());
+
+    for (std::size_t i = 0; i < properties_list.size(); ++i) {
+      const auto& src = properties_list[i];
+      auto& dst = queue_family_properties_list_[i];
+      dst.properties1_ = src.queueFamilyProperties;
+    }
+  }
+}
+
+/*!
+  \details
+  The key consists of the device UUID, the driver UUID, the driver version
+  and the vendor and device IDs. Only the ID properties are queried.
+  */
+inline
+std::vector<uint8b> VulkanPhysicalDeviceInfo::getCacheKey() const
+{
+  vk::PhysicalDeviceProperties2 p;
+  vk::PhysicalDeviceIDProperties id_properties;
+  link(p, id_properties);
+  device_.getProperties2(&p);
+
+  std::vector<uint8b> key;
+  key.reserve(2 * VK_UUID_SIZE + 3 * sizeof(uint32b));
+  key.insert(key.end(),
+             std::begin(id_properties.deviceUUID),
+             std::end(id_properties.deviceUUID));
+  key.insert(key.end(),
+             std::begin(id_properties.driverUUID),
+             std::end(id_properties.driverUUID));
+  const std::array<uint32b, 3> id_list{{p.properties.driverVersion,
+                                        p.properties.vendorID,
+                                        p.properties.deviceID}};
+  for (const uint32b id : id_list) {
+    for (std::size_t i = 0; i < sizeof(uint32b); ++i)
+      key.push_back(static_cast<uint8b>(id >> (8 * i)));
+  }
+  return key;
+}
+
+/*!
+  */
+inline
+void VulkanPhysicalDeviceInfo::linkFeatures(
+    vk::PhysicalDeviceFeatures2& head) const noexcept
+{
+  auto& props = features_;
+  link(head,
        props.b16bit_storage_,
        props.b8bit_storage_,
        props.astc_decode_,
@@ -222,11 +539,14 @@ void VulkanPhysicalDeviceInfo::fetchFeatures(
        props.inline_uniform_block_,
        props.memory_priority_features_,
        props.multiview_,
+       props.pipeline_executable_properties_,
        props.protected_memory_,
        props.sampler_ycbcr_conversion_,
        props.scalar_block_layout_,
        props.shader_atomic_int64_,
        props.shader_draw_parameters_,
+       props.subgroup_size_control_,
+       props.timeline_semaphore_,
        props.transform_feedback_,
        props.uniform_buffer_standard_layout_,
        props.variable_pointers_,
@@ -234,46 +554,16 @@ void VulkanPhysicalDeviceInfo::fetchFeatures(
        props.vulkan_memory_mode_,
        props.ycbcr_image_arrays_
        );
-  device.getFeatures2(&p);
-  props.features1_ = p.features;
 }
 
 /*!
   */
 inline
-void VulkanPhysicalDeviceInfo::fetchLayerProperties(
-    const vk::PhysicalDevice& device)
+void VulkanPhysicalDeviceInfo::linkProperties(
+    vk::PhysicalDeviceProperties2& head) const noexcept
 {
-  const auto properties = device.enumerateDeviceLayerProperties();
-  layer_properties_list_.resize(properties.size());
-  for (std::size_t i = 0; i < properties.size(); ++i)
-    layer_properties_list_[i].properties1_ = properties[i];
-}
-
-/*!
-  */
-inline
-void VulkanPhysicalDeviceInfo::fetchMemoryProperties(
-    const vk::PhysicalDevice& device) noexcept
-{
-  vk::PhysicalDeviceMemoryProperties2 p;
-  auto& props = memory_properties_;
-  link(p,
-       props.budget_
-       );
-  device.getMemoryProperties2(&p);
-  props.properties1_ = p.memoryProperties;
-}
-
-/*!
-  */
-inline
-void VulkanPhysicalDeviceInfo::fetchProperties(
-    const vk::PhysicalDevice& device) noexcept
-{
-  vk::PhysicalDeviceProperties2 p;
   auto& props = properties_;
-  link(p,
+  link(head,
        props.blend_operation_advanced_,
        props.conservative_rasterization_,
        props.depth_stencil_resolve_,
@@ -294,34 +584,80 @@ void VulkanPhysicalDeviceInfo::fetchProperties(
        props.sample_locations_,
        props.sampler_filter_minmax_,
        props.subgroup_,
+       props.subgroup_size_control_,
        props.transform_feedback_,
        props.vertex_attribute_divisor_
        );
-  device.getProperties2(&p);
-  props.properties1_ = p.properties;
 }
 
 /*!
+  \details
+  A cache file consists of a magic number and records. A record has the
+  key of a device and the payload of the info of the device. An empty list
+  is returned if the file doesn't exist or is broken.
   */
 inline
-void VulkanPhysicalDeviceInfo::fetchQueueFamilyProperties(
-    const vk::PhysicalDevice& device)
+auto VulkanPhysicalDeviceInfo::loadCacheRecordList(
+    const std::string_view cache_path) -> std::vector<CacheRecord>
 {
-  // Query queue family properties
-  {
-    uint32b n = 0;
-    std::vector<vk::QueueFamilyProperties2> properties_list;
-    device.getQueueFamilyProperties2(&n, properties_list.data());
+  std::vector<CacheRecord> record_list;
+  std::ifstream cache_file{std::string{cache_path}, std::ios_base::binary};
+  if (!cache_file)
+    return record_list;
 
-    queue_family_properties_list_.resize(static_cast<std::size_t>(n));
-    properties_list.resize(static_cast<std::size_t>(n));
-    device.getQueueFamilyProperties2(&n, properties_list.data());
+  const auto read_string = [&cache_file](auto& data) -> bool
+  {
+    uint64b size = 0;
+    cache_file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!cache_file || (kMaxCacheRecordSize < size))
+      return false;
+    data.resize(static_cast<std::size_t>(size));
+    cache_file.read(reinterpret_cast<char*>(data.data()),
+                    static_cast<std::streamsize>(size));
+    return static_cast<bool>(cache_file);
+  };
 
-    for (std::size_t i = 0; i < properties_list.size(); ++i) {
-      const auto& src = properties_list[i];
-      auto& dst = queue_family_properties_list_[i];
-      dst.properties1_ = src.queueFamilyProperties;
+  uint64b magic = 0;
+  cache_file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+  if (!cache_file || (magic != kCacheMagic))
+    return record_list;
+  while (cache_file.peek() != std::ifstream::traits_type::eof()) {
+    CacheRecord record;
+    if (!read_string(record.key_) || !read_string(record.payload_)) {
+      record_list.clear();
+      break;
     }
+    record_list.emplace_back(std::move(record));
+  }
+  return record_list;
+}
+
+/*!
+  */
+inline
+void VulkanPhysicalDeviceInfo::saveCacheRecordList(
+    const std::string_view cache_path,
+    const std::vector<CacheRecord>& record_list)
+{
+  std::ofstream cache_file{std::string{cache_path}, std::ios_base::binary};
+  if (!cache_file) {
+    //! \todo Handle error
+    return;
+  }
+
+  const auto write_string = [&cache_file](const auto& data)
+  {
+    const uint64b size = data.size();
+    cache_file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    cache_file.write(reinterpret_cast<const char*>(data.data()),
+                     static_cast<std::streamsize>(size));
+  };
+
+  const uint64b magic = kCacheMagic;
+  cache_file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+  for (const auto& record : record_list) {
+    write_string(record.key_);
+    write_string(record.payload_);
   }
 }
 
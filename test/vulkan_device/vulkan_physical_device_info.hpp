@@ -11,6 +11,10 @@
 #define CLSPV_TEST_VULKAN_PHYSICAL_DEVICE_INFO_HPP
 
 // Standard C++ library
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <vector>
 // Vulkan
 #include <vulkan/vulkan.hpp>
@@ -21,6 +25,12 @@ namespace clspvtest {
 
 /*!
   \brief Properties and features of a vulkan device
+
+  The info is fetched lazily per category, i.e. extensions, layers, queue
+  families, properties, features and memory properties, on the first access
+  of the category. The categories except the memory properties, which
+  contain the memory budget, can be saved in a cache file and loaded in
+  later processes to skip the queries.
   */
 class VulkanPhysicalDeviceInfo
 {
@@ -61,6 +71,7 @@ class VulkanPhysicalDeviceInfo
     vk::PhysicalDeviceSampleLocationsPropertiesEXT sample_locations_;
     vk::PhysicalDeviceSamplerFilterMinmaxPropertiesEXT sampler_filter_minmax_;
     vk::PhysicalDeviceSubgroupProperties subgroup_;
+    vk::PhysicalDeviceSubgroupSizeControlPropertiesEXT subgroup_size_control_;
     vk::PhysicalDeviceTransformFeedbackPropertiesEXT transform_feedback_;
     vk::PhysicalDeviceVertexAttributeDivisorPropertiesEXT vertex_attribute_divisor_;
   };
@@ -84,11 +95,14 @@ class VulkanPhysicalDeviceInfo
     vk::PhysicalDeviceInlineUniformBlockFeaturesEXT inline_uniform_block_;
     vk::PhysicalDeviceMemoryPriorityFeaturesEXT memory_priority_features_;
     vk::PhysicalDeviceMultiviewFeatures multiview_;
+    vk::PhysicalDevicePipelineExecutablePropertiesFeaturesKHR pipeline_executable_properties_;
     vk::PhysicalDeviceProtectedMemoryFeatures protected_memory_;
     vk::PhysicalDeviceSamplerYcbcrConversionFeatures sampler_ycbcr_conversion_;
     vk::PhysicalDeviceScalarBlockLayoutFeaturesEXT scalar_block_layout_;
     vk::PhysicalDeviceShaderAtomicInt64FeaturesKHR shader_atomic_int64_;
     vk::PhysicalDeviceShaderDrawParametersFeatures shader_draw_parameters_;
+    vk::PhysicalDeviceSubgroupSizeControlFeaturesEXT subgroup_size_control_;
+    vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_;
     vk::PhysicalDeviceTransformFeedbackFeaturesEXT transform_feedback_;
     vk::PhysicalDeviceUniformBufferStandardLayoutFeaturesKHR uniform_buffer_standard_layout_;
     vk::PhysicalDeviceVariablePointersFeatures variable_pointers_;
@@ -134,9 +148,15 @@ class VulkanPhysicalDeviceInfo
   //! Return features
   const Features& features() const noexcept;
 
-  //! Fetch device info from a physical device
+  //! Set a physical device. The info is fetched on the first access
   void fetch(const vk::PhysicalDevice& device);
 
+  //! Fetch the all categories from the physical device
+  void fetchAll() const;
+
+  //! Check if the device supports the extension
+  bool isExtensionSupported(const std::string_view extension_name) const noexcept;
+
   //! Return layer properties list
   std::vector<LayerProperties>& layerPropertiesList() noexcept;
 
@@ -146,6 +166,9 @@ class VulkanPhysicalDeviceInfo
   template <typename Type1, typename Type2, typename ...Types>
   static void link(Type1&& value1, Type2&& value2, Types&&... values) noexcept;
 
+  //! Load the cached info of the device from the file
+  bool loadCache(const std::string_view cache_path);
+
   //! Return memory properties
   MemoryProperties& memoryProperties() noexcept;
 
@@ -164,32 +187,83 @@ class VulkanPhysicalDeviceInfo
   //! Return queue family properties list
   const std::vector<QueueFamilyProperties>& queueFamilyPropertiesList() const noexcept;
 
+  //! Save the info of the device into the cache file
+  void saveCache(const std::string_view cache_path) const;
+
  private:
+  //! The categories of the info
+  enum Category : uint32b
+  {
+    kExtensionCategory = 0b1u << 0,
+    kLayerCategory = 0b1u << 1,
+    kQueueFamilyCategory = 0b1u << 2,
+    kPropertiesCategory = 0b1u << 3,
+    kFeaturesCategory = 0b1u << 4,
+    kMemoryCategory = 0b1u << 5,
+    kCachedCategories = kExtensionCategory | kLayerCategory |
+                        kQueueFamilyCategory | kPropertiesCategory |
+                        kFeaturesCategory
+  };
+
+  static constexpr uint64b kCacheMagic = 0x314f464e49564544; //!< "DEVINFO1"
+  static constexpr uint64b kMaxCacheRecordSize = 64ull * 1024ull * 1024ull;
+
+  //! The cached info of a device
+  struct CacheRecord
+  {
+    std::vector<uint8b> key_;
+    std::string payload_;
+  };
+
+
+  //! Fetch the category if it isn't fetched yet
+  void ensure(const Category category) const;
+
   //! Fetch extension properties from a physical device
-  void fetchExtensionProperties(const vk::PhysicalDevice& device);
+  void fetchExtensionProperties() const;
 
   //! Fetch features from a physical device
-  void fetchFeatures(const vk::PhysicalDevice& device) noexcept;
+  void fetchFeatures() const noexcept;
 
   //! Fetch layer properties from a physical device
-  void fetchLayerProperties(const vk::PhysicalDevice& device);
+  void fetchLayerProperties() const;
 
   //! Fetch memory properties from a physical device
-  void fetchMemoryProperties(const vk::PhysicalDevice& device) noexcept;
+  void fetchMemoryProperties() const noexcept;
 
   //! Fetch properties from a physical device
-  void fetchProperties(const vk::PhysicalDevice& device) noexcept;
+  void fetchProperties() const noexcept;
 
   //! Fetch queue family properties from a physical device
-  void fetchQueueFamilyProperties(const vk::PhysicalDevice& device);
+  void fetchQueueFamilyProperties() const;
+
+  //! Return the cache key of the device
+  std::vector<uint8b> getCacheKey() const;
+
+  //! Link the structs of the features to the head
+  void linkFeatures(vk::PhysicalDeviceFeatures2& head) const noexcept;
+
+  //! Link the structs of the properties to the head
+  void linkProperties(vk::PhysicalDeviceProperties2& head) const noexcept;
+
+  //! Load the all records of the cache file
+  static std::vector<CacheRecord> loadCacheRecordList(
+      const std::string_view cache_path);
+
+  //! Save the records into the cache file
+  static void saveCacheRecordList(const std::string_view cache_path,
+                                  const std::vector<CacheRecord>& record_list);
 
 
-  std::vector<ExtensionProperties> extension_properties_list_;
-  std::vector<LayerProperties> layer_properties_list_;
-  std::vector<QueueFamilyProperties> queue_family_properties_list_;
-  Properties properties_;
-  Features features_;
-  MemoryProperties memory_properties_;
+  vk::PhysicalDevice device_;
+  mutable std::vector<ExtensionProperties> extension_properties_list_;
+  mutable std::vector<LayerProperties> layer_properties_list_;
+  mutable std::vector<QueueFamilyProperties> queue_family_properties_list_;
+  mutable Properties properties_;
+  mutable Features features_;
+  mutable MemoryProperties memory_properties_;
+  mutable std::mutex fetch_mutex_;
+  mutable std::atomic<uint32b> fetched_categories_{0};
 };
 
 } // namespace clspvtest
@@ -0,0 +1,539 @@
+/*!
+  \file vulkan_profiler-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_PROFILER_INL_HPP
+#define CLSPV_TEST_VULKAN_PROFILER_INL_HPP
+
+#include "vulkan_profiler.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_device.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+inline
+VulkanProfiler::VulkanProfiler(VulkanDevice* device) noexcept :
+    device_{device}
+{
+}
+
+/*!
+  */
+inline
+VulkanProfiler::~VulkanProfiler() noexcept
+{
+  destroy();
+}
+
+/*!
+  \details
+  The timestamp is written when the previous commands reach the top of the
+  pipe. On a compute queue, a pipeline statistics query is also begun if
+  the device supports it. Returns kInvalidRange if the queue type can't write timestamps, and
+  then end() ignores the range. The range is measured when the command
+  buffer is submitted and completed.
+  */
+inline
+uint32b VulkanProfiler::begin(const vk::CommandBuffer& command,
+                              const QueueType queue_type,
+                              const std::string_view name) noexcept
+{
+  const uint64b valid_mask = validMask(queue_type);
+  if (valid_mask == 0)
+    return kInvalidRange;
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  // Recycle the completed ranges before allocating a new pool
+  if (free_range_list_.empty())
+    resolveRanges();
+  if (free_range_list_.empty() && !addQueryPool())
+    return kInvalidRange;
+  const uint32b range_id = free_range_list_.back();
+  free_range_list_.pop_back();
+  const bool has_invocations = isPipelineStatisticsSupported(queue_type) &&
+                               statisticsPool(range_id);
+  pending_range_list_.emplace_back(PendingRange{std::string{name},
+                                                queue_type,
+                                                range_id,
+                                                valid_mask,
+                                                has_invocations});
+  command.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe,
+                         queryPool(range_id),
+                         queryIndex(range_id));
+  if (has_invocations) {
+    command.beginQuery(statisticsPool(range_id),
+                       statisticsIndex(range_id),
+                       vk::QueryControlFlags{});
+  }
+  return range_id;
+}
+
+/*!
+  */
+inline
+void VulkanProfiler::clear() noexcept
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  time_list_.clear();
+  invocation_list_.clear();
+  range_list_.clear();
+}
+
+/*!
+  \details
+  The commands which write the timestamps must be completed.
+  */
+inline
+void VulkanProfiler::destroy() noexcept
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  const auto& device = device_->device();
+  for (auto& query_pool : query_pool_list_)
+    device.destroyQueryPool(query_pool, nullptr);
+  query_pool_list_.clear();
+  for (auto& statistics_pool : statistics_pool_list_) {
+    if (statistics_pool)
+      device.destroyQueryPool(statistics_pool, nullptr);
+  }
+  statistics_pool_list_.clear();
+  free_range_list_.clear();
+  pending_range_list_.clear();
+}
+
+/*!
+  */
+inline
+void VulkanProfiler::end(const vk::CommandBuffer& command,
+                         const uint32b range_id) noexcept
+{
+  if (range_id == kInvalidRange)
+    return;
+  std::lock_guard<std::mutex> lock{mutex_};
+  // The range is usually the last one begun
+  const auto range = std::find_if(pending_range_list_.rbegin(),
+                                  pending_range_list_.rend(),
+  [range_id](const PendingRange& r)
+  {
+    return r.range_id_ == range_id;
+  });
+  if ((range != pending_range_list_.rend()) && range->has_invocations_)
+    command.endQuery(statisticsPool(range_id), statisticsIndex(range_id));
+  command.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                         queryPool(range_id),
+                         queryIndex(range_id) + 1);
+}
+
+/*!
+  \details
+  A timestamp is written on a compute queue between two reads of the steady
+  clock, and the device time is assumed to be at the middle of them. The
+  offset is used to place the device ranges on the host timeline. Returns 0
+  if the compute queues can't write timestamps.
+  */
+inline
+double VulkanProfiler::hostTimeOffset() noexcept
+{
+  if (!isTimestampSupported(QueueType::kCompute))
+    return 0.0;
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (free_range_list_.empty() && !addQueryPool())
+    return 0.0;
+  const uint32b range_id = free_range_list_.back();
+  free_range_list_.pop_back();
+  const auto& query_pool = queryPool(range_id);
+  const uint32b query_index = queryIndex(range_id);
+
+  using Clock = std::chrono::steady_clock;
+  const auto host_time = [](const Clock::time_point t)
+  {
+    const std::chrono::duration<double, std::nano> d = t.time_since_epoch();
+    return d.count();
+  };
+  double begin = 0.0;
+  double end = 0.0;
+  submitCommand([&](const vk::CommandBuffer& command)
+  {
+    command.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                           query_pool,
+                           query_index);
+    begin = host_time(Clock::now());
+  });
+  end = host_time(Clock::now());
+
+  uint64b timestamp = 0;
+  const auto& device = device_->device();
+  const auto result = device.getQueryPoolResults(
+      query_pool,
+      query_index,
+      1,
+      sizeof(timestamp),
+      &timestamp,
+      sizeof(uint64b),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+  resetRanges(std::vector<uint32b>{range_id});
+  free_range_list_.emplace_back(range_id);
+  //! \todo Handle error
+  if (result != vk::Result::eSuccess) {
+    return 0.0;
+  }
+  const double device_time = static_cast<double>(timestamp) * timestampPeriod();
+  return 0.5 * (begin + end) - device_time;
+}
+
+/*!
+  \details
+  The pipeline statistics queries are used only on the compute queues.
+  */
+inline
+bool VulkanProfiler::isPipelineStatisticsSupported(
+    const QueueType queue_type) const noexcept
+{
+  const bool result = (queue_type == QueueType::kCompute) &&
+                      device_->isPipelineStatisticsQuerySupported();
+  return result;
+}
+
+/*!
+  */
+inline
+bool VulkanProfiler::isTimestampSupported(const QueueType queue_type) const noexcept
+{
+  const bool result = validMask(queue_type) != 0;
+  return result;
+}
+
+/*!
+  */
+inline
+std::size_t VulkanProfiler::numOfPendingRanges() const noexcept
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  return pending_range_list_.size();
+}
+
+/*!
+  \details
+  The completed ranges are resolved before they are returned.
+  */
+inline
+auto VulkanProfiler::ranges() noexcept -> std::vector<Range>
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  resolveRanges();
+  return range_list_;
+}
+
+/*!
+  \details
+  The ranges which aren't completed stay pending, so this can be called
+  anytime without waiting for the device.
+  */
+inline
+void VulkanProfiler::resolve() noexcept
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  resolveRanges();
+}
+
+/*!
+  \details
+  The completed ranges are resolved before the statistics are computed.
+  The names are sorted in the lexicographical order.
+  */
+inline
+auto VulkanProfiler::statistics() noexcept -> std::vector<Statistics>
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  resolveRanges();
+
+  std::vector<Statistics> statistics_list;
+  statistics_list.reserve(time_list_.size());
+  for (const auto& [name, time_list] : time_list_) {
+    if (time_list.empty())
+      continue;
+    std::vector<double> sorted_list = time_list;
+    std::sort(sorted_list.begin(), sorted_list.end());
+    const std::size_t n = sorted_list.size();
+    Statistics statistics;
+    statistics.name_ = name;
+    statistics.count_ = n;
+    statistics.min_ = sorted_list.front();
+    statistics.total_ = std::accumulate(sorted_list.begin(), sorted_list.end(), 0.0);
+    statistics.mean_ = statistics.total_ / static_cast<double>(n);
+    statistics.p99_ = sorted_list[static_cast<std::size_t>(0.99 * static_cast<double>(n - 1))];
+    statistics.max_ = sorted_list.back();
+    const auto invocations = invocation_list_.find(name);
+    if (invocations != invocation_list_.end())
+      statistics.invocations_ = invocations->second;
+    statistics_list.emplace_back(std::move(statistics));
+  }
+  return statistics_list;
+}
+
+/*!
+  */
+inline
+double VulkanProfiler::timestampPeriod() const noexcept
+{
+  const auto& limits = device_->physicalDeviceInfo().properties().properties1_.limits;
+  return static_cast<double>(limits.timestampPeriod);
+}
+
+/*!
+  \details
+  The queries of a new pool are reset before they are used.
+  */
+inline
+bool VulkanProfiler::addQueryPool() noexcept
+{
+  const auto& device = device_->device();
+  vk::QueryPoolCreateInfo create_info;
+  create_info.queryType = vk::QueryType::eTimestamp;
+  create_info.queryCount = 2 * kRangesPerPool;
+  vk::QueryPool query_pool;
+  const auto result = device.createQueryPool(&create_info, nullptr, &query_pool);
+  //! \todo Handle error
+  if (result != vk::Result::eSuccess) {
+    return false;
+  }
+
+  // The compute shader invocations are counted by a query per range
+  vk::QueryPool statistics_pool;
+  if (device_->isPipelineStatisticsQuerySupported()) {
+    vk::QueryPoolCreateInfo statistics_create_info;
+    statistics_create_info.queryType = vk::QueryType::ePipelineStatistics;
+    statistics_create_info.queryCount = kRangesPerPool;
+    statistics_create_info.pipelineStatistics =
+        vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations;
+    const auto r = device.createQueryPool(&statistics_create_info,
+                                          nullptr,
+                                          &statistics_pool);
+    //! \todo Handle error
+    if (r != vk::Result::eSuccess) {
+      statistics_pool = nullptr;
+    }
+  }
+
+  const auto first = static_cast<uint32b>(query_pool_list_.size()) * kRangesPerPool;
+  query_pool_list_.emplace_back(query_pool);
+  statistics_pool_list_.emplace_back(statistics_pool);
+  // The ranges are used from the lowest ID
+  std::vector<uint32b> range_list(kRangesPerPool);
+  for (uint32b i = 0; i < kRangesPerPool; ++i)
+    range_list[i] = first + (kRangesPerPool - 1 - i);
+  resetRanges(range_list);
+  free_range_list_.insert(free_range_list_.end(),
+                          range_list.begin(),
+                          range_list.end());
+  return true;
+}
+
+/*!
+  */
+inline
+const vk::QueryPool& VulkanProfiler::queryPool(const uint32b range_id) const noexcept
+{
+  return query_pool_list_[range_id / kRangesPerPool];
+}
+
+/*!
+  */
+inline
+uint32b VulkanProfiler::queryIndex(const uint32b range_id) noexcept
+{
+  const uint32b index = 2 * (range_id % kRangesPerPool);
+  return index;
+}
+
+/*!
+  \details
+  The queries are reset on the host if the device supports it. Otherwise a
+  command which resets the queries is submitted to a compute queue and
+  waited, so a query is never read with the result of its previous use.
+  */
+inline
+void VulkanProfiler::resetRanges(const std::vector<uint32b>& range_list) noexcept
+{
+  if (range_list.empty())
+    return;
+  if (device_->isHostQueryResetSupported()) {
+    for (const uint32b range_id : range_list) {
+      device_->resetQueries(queryPool(range_id), queryIndex(range_id), 2);
+      if (statisticsPool(range_id))
+        device_->resetQueries(statisticsPool(range_id), statisticsIndex(range_id), 1);
+    }
+    return;
+  }
+
+  submitCommand([this, &range_list](const vk::CommandBuffer& command)
+  {
+    for (const uint32b range_id : range_list) {
+      command.resetQueryPool(queryPool(range_id), queryIndex(range_id), 2);
+      if (statisticsPool(range_id))
+        command.resetQueryPool(statisticsPool(range_id), statisticsIndex(range_id), 1);
+    }
+  });
+}
+
+/*!
+  \details
+  A range is completed when the both timestamps and the invocations are
+  available. The time is recorded in milliseconds and the queries of the
+  range are recycled.
+  */
+inline
+void VulkanProfiler::resolveRanges() noexcept
+{
+  const auto& device = device_->device();
+  const double period = timestampPeriod();
+  std::vector<uint32b> completed_list;
+  auto range = pending_range_list_.begin();
+  while (range != pending_range_list_.end()) {
+    // The timestamps are followed by the availabilities
+    std::array<uint64b, 4> results{{0, 0, 0, 0}};
+    const auto result = device.getQueryPoolResults(
+        queryPool(range->range_id_),
+        queryIndex(range->range_id_),
+        2,
+        sizeof(results),
+        results.data(),
+        2 * sizeof(uint64b),
+        vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+    bool is_completed = ((result == vk::Result::eSuccess) ||
+                         (result == vk::Result::eNotReady)) &&
+                        (results[1] != 0) && (results[3] != 0);
+    // The invocations are followed by the availability
+    std::array<uint64b, 2> invocations{{0, 0}};
+    if (is_completed && range->has_invocations_) {
+      const auto r = device.getQueryPoolResults(
+          statisticsPool(range->range_id_),
+          statisticsIndex(range->range_id_),
+          1,
+          sizeof(invocations),
+          invocations.data(),
+          sizeof(invocations),
+          vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+      is_completed = ((r == vk::Result::eSuccess) ||
+                      (r == vk::Result::eNotReady)) &&
+                     (invocations[1] != 0);
+    }
+    if (!is_completed) {
+      ++range;
+      continue;
+    }
+    const uint64b ticks = (results[2] - results[0]) & range->valid_mask_;
+    const double time = static_cast<double>(ticks) * period * 1.0e-6;
+    time_list_[range->name_].emplace_back(time);
+    if (range->has_invocations_)
+      invocation_list_[range->name_] += invocations[0];
+    const double begin = static_cast<double>(results[0]) * period;
+    range_list_.emplace_back(Range{std::move(range->name_),
+                                   range->queue_type_,
+                                   begin,
+                                   begin + static_cast<double>(ticks) * period,
+                                   invocations[0]});
+    completed_list.emplace_back(range->range_id_);
+    range = pending_range_list_.erase(range);
+  }
+  resetRanges(completed_list);
+  free_range_list_.insert(free_range_list_.end(),
+                          completed_list.begin(),
+                          completed_list.end());
+}
+
+/*!
+  */
+inline
+uint32b VulkanProfiler::statisticsIndex(const uint32b range_id) noexcept
+{
+  const uint32b index = range_id % kRangesPerPool;
+  return index;
+}
+
+/*!
+  */
+inline
+const vk::QueryPool& VulkanProfiler::statisticsPool(const uint32b range_id) const noexcept
+{
+  return statistics_pool_list_[range_id / kRangesPerPool];
+}
+
+/*!
+  \details
+  The command buffer is allocated from the command pool of the calling
+  thread, and submitted to a compute queue.
+  */
+template <typename Function> inline
+void VulkanProfiler::submitCommand(Function&& record) noexcept
+{
+  const auto& device = device_->device();
+  const auto& command_pool = device_->commandPool(QueueType::kCompute);
+  vk::CommandBuffer command;
+  {
+    const vk::CommandBufferAllocateInfo alloc_info{
+        command_pool,
+        vk::CommandBufferLevel::ePrimary,
+        1};
+    device.allocateCommandBuffers(&alloc_info, &command);
+  }
+  vk::CommandBufferBeginInfo begin_info{};
+  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  command.begin(begin_info);
+  record(command);
+  command.end();
+
+  vk::Fence fence;
+  {
+    const vk::FenceCreateInfo fence_info{};
+    device.createFence(&fence_info, nullptr, &fence);
+  }
+  device_->submit(QueueType::kCompute, kAnyQueue, command, fence);
+  constexpr uint64b timeout = (std::numeric_limits<uint64b>::max)();
+  device.waitForFences(1, &fence, VK_TRUE, timeout);
+  device.destroyFence(fence);
+  device.freeCommandBuffers(command_pool, 1, &command);
+}
+
+/*!
+  \details
+  Returns 0 if the queue family doesn't support timestamps.
+  */
+inline
+uint64b VulkanProfiler::validMask(const QueueType queue_type) const noexcept
+{
+  const auto& info = device_->physicalDeviceInfo();
+  const uint32b family_index = device_->queueFamilyIndex(queue_type);
+  const auto& family_list = info.queueFamilyPropertiesList();
+  const uint32b valid_bits = family_list[family_index].properties1_.timestampValidBits;
+  const uint64b mask = (valid_bits == 0) ? 0 :
+                       (valid_bits < 64) ? (uint64b{1} << valid_bits) - 1
+                                         : (std::numeric_limits<uint64b>::max)();
+  return mask;
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_PROFILER_INL_HPP
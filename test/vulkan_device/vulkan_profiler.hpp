@@ -0,0 +1,176 @@
+/*!
+  \file vulkan_profiler.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_PROFILER_HPP
+#define CLSPV_TEST_VULKAN_PROFILER_HPP
+
+// Standard C++ library
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+class VulkanDevice;
+
+/*!
+  \brief Measure the device time of commands with timestamp queries
+
+  A measured range is enclosed by begin() and end() in a command buffer. The
+  ranges are written into query pools which are allocated on demand and
+  recycled after the results are resolved. A profiler is attached to a device
+  with VulkanDevice::setProfiler(), and then every dispatch of VulkanKernel
+  and every copy of VulkanBuffer are measured by the name of the kernel or
+  "copyTo". If the device supports the pipeline statistics queries, the
+  compute shader invocations of the compute ranges are counted as well.
+  */
+class VulkanProfiler
+{
+ public:
+  //! The device time of the ranges of a name in milliseconds
+  struct Statistics
+  {
+    std::string name_;
+    std::size_t count_ = 0;
+    double min_ = 0.0;
+    double mean_ = 0.0;
+    double p99_ = 0.0;
+    double max_ = 0.0;
+    double total_ = 0.0;
+    uint64b invocations_ = 0; //!< The compute shader invocations of all ranges
+  };
+
+  //! A measured range on the device timeline in nanoseconds
+  struct Range
+  {
+    std::string name_;
+    QueueType queue_type_;
+    double begin_;
+    double end_;
+    uint64b invocations_;
+  };
+
+  //! The ID of a range which isn't measured
+  static constexpr uint32b kInvalidRange = (std::numeric_limits<uint32b>::max)();
+
+
+  //! Create a profiler
+  VulkanProfiler(VulkanDevice* device) noexcept;
+
+  //! Destroy a profiler
+  ~VulkanProfiler() noexcept;
+
+
+  //! Write the beginning timestamp of a range and return the ID of the range
+  uint32b begin(const vk::CommandBuffer& command,
+                const QueueType queue_type,
+                const std::string_view name) noexcept;
+
+  //! Clear the measured time and ranges
+  void clear() noexcept;
+
+  //! Destroy the query pools
+  void destroy() noexcept;
+
+  //! Write the ending timestamp of a range
+  void end(const vk::CommandBuffer& command, const uint32b range_id) noexcept;
+
+  //! Return the offset from the device time to the steady clock time in nanoseconds
+  double hostTimeOffset() noexcept;
+
+  //! Check if the queue type can count the compute shader invocations
+  bool isPipelineStatisticsSupported(const QueueType queue_type) const noexcept;
+
+  //! Check if the queue type can write timestamps
+  bool isTimestampSupported(const QueueType queue_type) const noexcept;
+
+  //! Return the number of the ranges which aren't resolved yet
+  std::size_t numOfPendingRanges() const noexcept;
+
+  //! Return the measured ranges on the device timeline
+  std::vector<Range> ranges() noexcept;
+
+  //! Read the results of the completed ranges
+  void resolve() noexcept;
+
+  //! Return the statistics of each name
+  std::vector<Statistics> statistics() noexcept;
+
+  //! Return the number of nanoseconds per timestamp tick
+  double timestampPeriod() const noexcept;
+
+ private:
+  //! A range whose result isn't read yet
+  struct PendingRange
+  {
+    std::string name_;
+    QueueType queue_type_;
+    uint32b range_id_;
+    uint64b valid_mask_;
+    bool has_invocations_;
+  };
+
+
+  //! Allocate a query pool and add its ranges to the free list. The mutex must be locked
+  bool addQueryPool() noexcept;
+
+  //! Return the query pool of the range
+  const vk::QueryPool& queryPool(const uint32b range_id) const noexcept;
+
+  //! Return the index of the beginning query of the range in the pool
+  static uint32b queryIndex(const uint32b range_id) noexcept;
+
+  //! Reset the queries of the ranges. The mutex must be locked
+  void resetRanges(const std::vector<uint32b>& range_list) noexcept;
+
+  //! Read the results of the completed ranges. The mutex must be locked
+  void resolveRanges() noexcept;
+
+  //! Return the index of the statistics query of the range in the pool
+  static uint32b statisticsIndex(const uint32b range_id) noexcept;
+
+  //! Return the pipeline statistics query pool of the range. Null if not supported
+  const vk::QueryPool& statisticsPool(const uint32b range_id) const noexcept;
+
+  //! Record commands by the function, submit them and wait for the completion
+  template <typename Function>
+  void submitCommand(Function&& record) noexcept;
+
+  //! Return the mask of the valid timestamp bits of the queue type
+  uint64b validMask(const QueueType queue_type) const noexcept;
+
+
+  static constexpr uint32b kRangesPerPool = 128;
+
+
+  VulkanDevice* device_;
+  std::vector<vk::QueryPool> query_pool_list_;
+  std::vector<vk::QueryPool> statistics_pool_list_;
+  std::vector<uint32b> free_range_list_;
+  std::vector<PendingRange> pending_range_list_;
+  std::map<std::string, std::vector<double>> time_list_;
+  std::map<std::string, uint64b> invocation_list_;
+  std::vector<Range> range_list_;
+  mutable std::mutex mutex_;
+};
+
+} // namespace clspvtest
+
+#include "vulkan_profiler-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_PROFILER_HPP
@@ -0,0 +1,363 @@
+/*!
+  \file vulkan_recorder-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_RECORDER_INL_HPP
+#define CLSPV_TEST_VULKAN_RECORDER_INL_HPP
+
+#include "vulkan_recorder.hpp"
+// Standard C++ library
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <ios>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+
+namespace clspvtest {
+
+/*!
+  \details
+  The file starts with a magic number and a version, followed by the
+  records. The values are written in the byte order of the host.
+  */
+inline
+VulkanRecorder::VulkanRecorder(const std::string_view file_path,
+                               const bool record_contents) :
+    file_{std::string{file_path}, std::ios_base::binary | std::ios_base::trunc},
+    record_contents_{record_contents}
+{
+  if (file_) {
+    file_.write(kMagic.data(), static_cast<std::streamsize>(kMagic.size()));
+    file_.write(reinterpret_cast<const char*>(&kVersion), sizeof(kVersion));
+  }
+}
+
+/*!
+  */
+inline
+VulkanRecorder::~VulkanRecorder() noexcept
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (file_.is_open())
+    file_.close();
+}
+
+/*!
+  */
+template <typename Type> inline
+void VulkanRecorder::copyBuffer(const VulkanBuffer<Type>& src,
+                                const VulkanBuffer<Type>& dst,
+                                const std::size_t count,
+                                const std::size_t src_offset,
+                                const std::size_t dst_offset,
+                                const uint32b queue_index)
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  CaptureRecord record;
+  record.type_ = CaptureRecordType::kCopyBuffer;
+  record.id_ = bufferId(src);
+  record.dst_id_ = bufferId(dst);
+  record.queue_index_ = queue_index;
+  record.offset_ = sizeof(Type) * src_offset;
+  record.dst_offset_ = sizeof(Type) * dst_offset;
+  record.size_ = sizeof(Type) * count;
+  writeRecord(record);
+}
+
+/*!
+  \details
+  Nothing is captured if the buffer has never been referenced.
+  */
+template <typename Type> inline
+void VulkanRecorder::destroyBuffer(const VulkanBuffer<Type>& buffer)
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  const auto id = buffer_id_list_.find(&buffer);
+  if (id == buffer_id_list_.end())
+    return;
+  CaptureRecord record;
+  record.type_ = CaptureRecordType::kDestroyBuffer;
+  record.id_ = id->second.id_;
+  buffer_id_list_.erase(id);
+  writeRecord(record);
+}
+
+/*!
+  */
+inline
+bool VulkanRecorder::isOpen() const noexcept
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  return file_.is_open() && static_cast<bool>(file_);
+}
+
+/*!
+  \details
+  Returns false if the file isn't a capture or it's truncated. The records
+  which are read before an error are kept in the list.
+  */
+inline
+bool VulkanRecorder::loadCapture(const std::string_view file_path,
+                                 std::vector<CaptureRecord>* record_list)
+{
+  std::ifstream file{std::string{file_path}, std::ios_base::binary};
+  if (!file)
+    return false;
+  file.seekg(0, std::ios_base::end);
+  const auto file_size = static_cast<uint64b>(file.tellg());
+  file.seekg(0, std::ios_base::beg);
+
+  std::array<char, kMagic.size()> magic;
+  uint32b version = 0;
+  file.read(magic.data(), static_cast<std::streamsize>(magic.size()));
+  file.read(reinterpret_cast<char*>(&version), sizeof(version));
+  if (!file || (magic != kMagic) || (version != kVersion))
+    return false;
+
+  const auto read = [&file](auto* value)
+  {
+    file.read(reinterpret_cast<char*>(value), sizeof(*value));
+    return static_cast<bool>(file);
+  };
+  // The sizes are checked against the file size to reject broken files
+  const auto read_list = [&file, file_size](auto* list)
+  {
+    using ElementType = typename std::remove_pointer_t<decltype(list)>::value_type;
+    const auto n = static_cast<uint64b>(list->size());
+    if (file_size < n * sizeof(ElementType))
+      return false;
+    file.read(reinterpret_cast<char*>(list->data()),
+              static_cast<std::streamsize>(n * sizeof(ElementType)));
+    return static_cast<bool>(file);
+  };
+
+  while (file.peek() != std::ifstream::traits_type::eof()) {
+    CaptureRecord record;
+    uint32b type = 0;
+    uint32b name_size = 0;
+    uint32b num_of_ids = 0;
+    uint64b data_size = 0;
+    bool result = read(&type) &&
+                  read(&record.id_) &&
+                  read(&record.dst_id_) &&
+                  read(&record.usage_) &&
+                  read(&record.queue_index_) &&
+                  read(&record.dimension_) &&
+                  read(&record.works_[0]) &&
+                  read(&record.works_[1]) &&
+                  read(&record.works_[2]) &&
+                  read(&record.offset_) &&
+                  read(&record.dst_offset_) &&
+                  read(&record.size_) &&
+                  read(&name_size) &&
+                  (name_size <= file_size);
+    if (result) {
+      record.name_.resize(name_size);
+      result = read_list(&record.name_) &&
+               read(&num_of_ids) &&
+               (num_of_ids <= file_size);
+    }
+    if (result) {
+      record.id_list_.resize(num_of_ids);
+      result = read_list(&record.id_list_) &&
+               read(&data_size) &&
+               (data_size <= file_size);
+    }
+    if (result) {
+      record.data_.resize(static_cast<std::size_t>(data_size));
+      result = read_list(&record.data_) &&
+               (type <= static_cast<uint32b>(CaptureRecordType::kWait));
+    }
+    if (!result)
+      return false;
+    record.type_ = static_cast<CaptureRecordType>(type);
+    record_list->emplace_back(std::move(record));
+  }
+  return true;
+}
+
+/*!
+  */
+inline
+std::size_t VulkanRecorder::numOfRecords() const noexcept
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  return num_of_records_;
+}
+
+/*!
+  */
+template <typename Type> inline
+void VulkanRecorder::readBuffer(const VulkanBuffer<Type>& buffer,
+                                const void* data,
+                                const std::size_t count,
+                                const std::size_t offset)
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  CaptureRecord record;
+  record.type_ = CaptureRecordType::kReadBuffer;
+  record.id_ = bufferId(buffer);
+  record.offset_ = sizeof(Type) * offset;
+  record.size_ = sizeof(Type) * count;
+  if (record_contents_) {
+    const auto p = static_cast<const uint8b*>(data);
+    record.data_.assign(p, p + record.size_);
+  }
+  writeRecord(record);
+}
+
+/*!
+  */
+template <std::size_t kDimension, typename ...ArgumentTypes> inline
+void VulkanRecorder::runKernel(const uint32b module_index,
+                               const std::string_view kernel_name,
+                               const std::array<uint32b, kDimension>& works,
+                               const uint32b queue_index,
+                               const VulkanBuffer<ArgumentTypes>&... args)
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  CaptureRecord record;
+  record.type_ = CaptureRecordType::kRunKernel;
+  record.id_ = module_index;
+  record.queue_index_ = queue_index;
+  record.dimension_ = static_cast<uint32b>(kDimension);
+  for (std::size_t i = 0; i < kDimension; ++i)
+    record.works_[i] = works[i];
+  record.name_ = kernel_name;
+  record.id_list_ = {bufferId(args)...};
+  writeRecord(record);
+}
+
+/*!
+  */
+inline
+void VulkanRecorder::setShaderModule(const std::vector<uint32b>& spirv_code,
+                                     const std::size_t index)
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  CaptureRecord record;
+  record.type_ = CaptureRecordType::kShaderModule;
+  record.id_ = static_cast<uint32b>(index);
+  record.data_.resize(sizeof(uint32b) * spirv_code.size());
+  std::memcpy(record.data_.data(), spirv_code.data(), record.data_.size());
+  writeRecord(record);
+}
+
+/*!
+  */
+inline
+void VulkanRecorder::wait()
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  CaptureRecord record;
+  record.type_ = CaptureRecordType::kWait;
+  writeRecord(record);
+}
+
+/*!
+  */
+template <typename Type> inline
+void VulkanRecorder::writeBuffer(const VulkanBuffer<Type>& buffer,
+                                 const void* data,
+                                 const std::size_t count,
+                                 const std::size_t offset)
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  CaptureRecord record;
+  record.type_ = CaptureRecordType::kWriteBuffer;
+  record.id_ = bufferId(buffer);
+  record.offset_ = sizeof(Type) * offset;
+  record.size_ = sizeof(Type) * count;
+  if (record_contents_) {
+    const auto p = static_cast<const uint8b*>(data);
+    record.data_.assign(p, p + record.size_);
+  }
+  writeRecord(record);
+}
+
+/*!
+  \details
+  The buffers are identified by their addresses. An address which is reused
+  after the destruction gets a new ID.
+  */
+template <typename Type> inline
+uint32b VulkanRecorder::bufferId(const VulkanBuffer<Type>& buffer)
+{
+  const uint64b size = sizeof(Type) * buffer.size();
+  auto id = buffer_id_list_.find(&buffer);
+  if ((id != buffer_id_list_.end()) && (id->second.size_ == size))
+    return id->second.id_;
+
+  // A resized buffer is created again with the same ID, so the replay
+  // replaces the buffer
+  CaptureRecord record;
+  record.type_ = CaptureRecordType::kCreateBuffer;
+  record.usage_ = static_cast<uint32b>(buffer.usage());
+  record.size_ = size;
+  if (id != buffer_id_list_.end()) {
+    record.id_ = id->second.id_;
+    id->second.size_ = size;
+  }
+  else {
+    record.id_ = buffer_id_count_++;
+    buffer_id_list_.emplace(&buffer, CapturedBuffer{record.id_, size});
+  }
+  writeRecord(record);
+  return record.id_;
+}
+
+/*!
+  */
+inline
+void VulkanRecorder::writeRecord(const CaptureRecord& record)
+{
+  if (!file_)
+    return;
+  const auto write = [this](const auto& value)
+  {
+    file_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  const auto write_list = [this](const auto& list)
+  {
+    using ElementType = typename std::remove_reference_t<decltype(list)>::value_type;
+    file_.write(reinterpret_cast<const char*>(list.data()),
+                static_cast<std::streamsize>(list.size() * sizeof(ElementType)));
+  };
+
+  write(static_cast<uint32b>(record.type_));
+  write(record.id_);
+  write(record.dst_id_);
+  write(record.usage_);
+  write(record.queue_index_);
+  write(record.dimension_);
+  for (const uint32b w : record.works_)
+    write(w);
+  write(record.offset_);
+  write(record.dst_offset_);
+  write(record.size_);
+  write(static_cast<uint32b>(record.name_.size()));
+  write_list(record.name_);
+  write(static_cast<uint32b>(record.id_list_.size()));
+  write_list(record.id_list_);
+  write(static_cast<uint64b>(record.data_.size()));
+  write_list(record.data_);
+  ++num_of_records_;
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_RECORDER_INL_HPP
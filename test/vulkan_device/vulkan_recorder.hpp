@@ -0,0 +1,176 @@
+/*!
+  \file vulkan_recorder.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_RECORDER_HPP
+#define CLSPV_TEST_VULKAN_RECORDER_HPP
+
+// Standard C++ library
+#include <array>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+template <typename> class VulkanBuffer;
+
+/*!
+  */
+enum class CaptureRecordType : uint32b
+{
+  kShaderModule = 0, //!< A shader module is set to the device
+  kCreateBuffer, //!< A buffer is referenced for the first time
+  kDestroyBuffer, //!< A buffer is destroyed or resized
+  kWriteBuffer, //!< Data is written into a buffer from the host
+  kReadBuffer, //!< Data is read from a buffer into the host
+  kCopyBuffer, //!< A buffer is copied into another buffer
+  kRunKernel, //!< A kernel is run
+  kWait //!< The host waits for the device
+};
+
+/*!
+  \brief An operation in a capture file
+
+  The fields which aren't used by the type are zero or empty. The offsets
+  and the sizes are in bytes.
+  */
+struct CaptureRecord
+{
+  CaptureRecordType type_ = CaptureRecordType::kWait;
+  uint32b id_ = 0; //!< The buffer ID, the source buffer ID or the module index
+  uint32b dst_id_ = 0; //!< The destination buffer ID of a copy
+  uint32b usage_ = 0; //!< The BufferUsage of a created buffer
+  uint32b queue_index_ = 0;
+  uint32b dimension_ = 0; //!< The work dimension of a kernel
+  std::array<uint32b, 3> works_{{1, 1, 1}};
+  uint64b offset_ = 0; //!< The offset or the source offset of a copy
+  uint64b dst_offset_ = 0; //!< The destination offset of a copy
+  uint64b size_ = 0;
+  std::string name_; //!< The entry point of a kernel
+  std::vector<uint32b> id_list_; //!< The argument buffer IDs of a kernel
+  std::vector<uint8b> data_; //!< The buffer contents or the SPIR-V code
+};
+
+/*!
+  \brief Capture the buffer and kernel operations into a file
+
+  A recorder is attached to a device with VulkanDevice::setRecorder(). Then
+  the shader modules, the buffer writes, reads and copies, the kernel runs
+  and the waits for the device or for a queue type are appended to the
+  capture file. A buffer is captured when it's first referenced, with its
+  current usage and size. The buffer contents are captured only if
+  requested. The staging buffers of reads and writes, the waits on a single
+  queue and the dispatches recorded into the user command buffers aren't
+  captured. Attach the recorder before the shader modules are set, because
+  the device doesn't keep the SPIR-V code.
+  */
+class VulkanRecorder
+{
+ public:
+  //! Open a capture file
+  VulkanRecorder(const std::string_view file_path,
+                 const bool record_contents = false);
+
+  //! Close the capture file
+  ~VulkanRecorder() noexcept;
+
+
+  //! Capture a copy of buffers
+  template <typename Type>
+  void copyBuffer(const VulkanBuffer<Type>& src,
+                  const VulkanBuffer<Type>& dst,
+                  const std::size_t count,
+                  const std::size_t src_offset,
+                  const std::size_t dst_offset,
+                  const uint32b queue_index);
+
+  //! Capture the destruction of a buffer
+  template <typename Type>
+  void destroyBuffer(const VulkanBuffer<Type>& buffer);
+
+  //! Check if the capture file is open
+  bool isOpen() const noexcept;
+
+  //! Load the records of a capture file
+  static bool loadCapture(const std::string_view file_path,
+                          std::vector<CaptureRecord>* record_list);
+
+  //! Return the number of the captured records
+  std::size_t numOfRecords() const noexcept;
+
+  //! Capture a read of a buffer. The data is the read result
+  template <typename Type>
+  void readBuffer(const VulkanBuffer<Type>& buffer,
+                  const void* data,
+                  const std::size_t count,
+                  const std::size_t offset);
+
+  //! Capture a run of a kernel
+  template <std::size_t kDimension, typename ...ArgumentTypes>
+  void runKernel(const uint32b module_index,
+                 const std::string_view kernel_name,
+                 const std::array<uint32b, kDimension>& works,
+                 const uint32b queue_index,
+                 const VulkanBuffer<ArgumentTypes>&... args);
+
+  //! Capture a shader module
+  void setShaderModule(const std::vector<uint32b>& spirv_code,
+                       const std::size_t index);
+
+  //! Capture a wait for the device
+  void wait();
+
+  //! Capture a write of a buffer
+  template <typename Type>
+  void writeBuffer(const VulkanBuffer<Type>& buffer,
+                   const void* data,
+                   const std::size_t count,
+                   const std::size_t offset);
+
+ private:
+  //! A buffer which has been captured
+  struct CapturedBuffer
+  {
+    uint32b id_;
+    uint64b size_; //!< The size in bytes when the buffer was captured
+  };
+
+
+  //! Return the ID of the buffer. A new or resized buffer is captured. The mutex must be locked
+  template <typename Type>
+  uint32b bufferId(const VulkanBuffer<Type>& buffer);
+
+  //! Append a record to the file. The mutex must be locked
+  void writeRecord(const CaptureRecord& record);
+
+
+  static constexpr std::array<char, 8> kMagic{{'C', 'L', 'S', 'P', 'V', 'C', 'A', 'P'}};
+  static constexpr uint32b kVersion = 1;
+
+
+  std::ofstream file_;
+  std::unordered_map<const void*, CapturedBuffer> buffer_id_list_;
+  mutable std::mutex mutex_;
+  std::size_t num_of_records_ = 0;
+  uint32b buffer_id_count_ = 0;
+  bool record_contents_;
+};
+
+} // namespace clspvtest
+
+#include "vulkan_recorder-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_RECORDER_HPP
@@ -0,0 +1,665 @@
+/*!
+  \file vulkan_service-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_SERVICE_INL_HPP
+#define CLSPV_TEST_VULKAN_SERVICE_INL_HPP
+
+#include "vulkan_service.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+// POSIX
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_device.hpp"
+
+namespace clspvtest {
+
+// Linux specific socket flags
+#if defined(MSG_NOSIGNAL)
+constexpr int kServiceSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kServiceSendFlags = 0;
+#endif
+#if defined(MSG_CMSG_CLOEXEC)
+constexpr int kServiceReceiveFlags = MSG_CMSG_CLOEXEC;
+#else
+constexpr int kServiceReceiveFlags = 0;
+#endif
+
+/*!
+  */
+inline
+SharedMemory::SharedMemory() noexcept
+{
+}
+
+/*!
+  \details
+  The memory is an anonymous file, so it disappears when the all processes
+  close it. On linux, the file is sealed against shrinking, so the receiver
+  can map it without being killed by SIGBUS.
+  */
+inline
+SharedMemory::SharedMemory(const std::size_t size)
+{
+#if defined(Z_LINUX)
+  fd_ = ::memfd_create("clspvtest_shared_memory", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else // Z_LINUX
+  {
+    static std::atomic<uint32b> counter{0};
+    const std::string name = "/clspvtest_" + std::to_string(::getpid()) + "_" +
+                             std::to_string(counter++);
+    fd_ = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd_ != -1)
+      ::shm_unlink(name.c_str());
+  }
+#endif // Z_LINUX
+  if (fd_ == -1)
+    throw std::runtime_error{"Creating a shared memory failed."};
+  if (::ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+    destroy();
+    throw std::runtime_error{"Resizing a shared memory failed."};
+  }
+#if defined(Z_LINUX)
+  if (::fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) != 0) {
+    destroy();
+    throw std::runtime_error{"Sealing a shared memory failed."};
+  }
+#endif // Z_LINUX
+  map(size);
+}
+
+/*!
+  \details
+  The shared memory takes the ownership of the file descriptor. On linux,
+  the file must be sealed against shrinking, otherwise the sender could
+  truncate it after the size is checked and the access would raise SIGBUS.
+  */
+inline
+SharedMemory::SharedMemory(const int fd, const std::size_t size) :
+    fd_{fd}
+{
+#if defined(Z_LINUX)
+  const int seals = ::fcntl(fd_, F_GET_SEALS);
+  if ((seals == -1) || ((seals & F_SEAL_SHRINK) == 0)) {
+    destroy();
+    throw std::runtime_error{"The shared memory isn't sealed against shrinking."};
+  }
+#endif // Z_LINUX
+  struct stat file_status;
+  if ((::fstat(fd_, &file_status) != 0) ||
+      (static_cast<std::size_t>(file_status.st_size) < size)) {
+    destroy();
+    throw std::runtime_error{"The shared memory is smaller than the request."};
+  }
+  map(size);
+}
+
+/*!
+  */
+inline
+SharedMemory::SharedMemory(SharedMemory&& other) noexcept
+{
+  *this = std::move(other);
+}
+
+/*!
+  */
+inline
+SharedMemory::~SharedMemory() noexcept
+{
+  destroy();
+}
+
+/*!
+  */
+inline
+SharedMemory& SharedMemory::operator=(SharedMemory&& other) noexcept
+{
+  if (this != &other) {
+    destroy();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    fd_ = std::exchange(other.fd_, -1);
+  }
+  return *this;
+}
+
+/*!
+  */
+inline
+void* SharedMemory::data() noexcept
+{
+  return data_;
+}
+
+/*!
+  */
+inline
+const void* SharedMemory::data() const noexcept
+{
+  return data_;
+}
+
+/*!
+  */
+inline
+void SharedMemory::destroy() noexcept
+{
+  if (data_ != nullptr) {
+    ::munmap(data_, size_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+  if (fd_ != -1) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+/*!
+  */
+inline
+int SharedMemory::fd() const noexcept
+{
+  return fd_;
+}
+
+/*!
+  */
+inline
+bool SharedMemory::isValid() const noexcept
+{
+  return data_ != nullptr;
+}
+
+/*!
+  */
+inline
+std::size_t SharedMemory::size() const noexcept
+{
+  return size_;
+}
+
+/*!
+  */
+inline
+void SharedMemory::map(const std::size_t size)
+{
+  if (size == 0)
+    return;
+  void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    destroy();
+    throw std::runtime_error{"Mapping a shared memory failed."};
+  }
+  data_ = data;
+  size_ = size;
+}
+
+/*!
+  \details
+  The socket file is replaced if it exists. The device must outlive the
+  service.
+  */
+inline
+VulkanService::VulkanService(VulkanDevice* device,
+                             const std::string_view socket_path) :
+    device_{device},
+    socket_path_{socket_path}
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  if (sizeof(address.sun_path) <= socket_path_.size())
+    throw std::runtime_error{"The socket path is too long."};
+  address.sun_family = AF_UNIX;
+  std::copy(socket_path_.begin(), socket_path_.end(), address.sun_path);
+
+  listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener_ == -1)
+    throw std::runtime_error{"Creating a service socket failed."};
+  ::unlink(socket_path_.c_str());
+  if ((::bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) ||
+      (::listen(listener_, SOMAXCONN) != 0)) {
+    ::close(listener_);
+    listener_ = -1;
+    throw std::runtime_error{"Binding the service socket failed."};
+  }
+}
+
+/*!
+  */
+inline
+VulkanService::~VulkanService() noexcept
+{
+  stop();
+  for (auto& t : thread_list_) {
+    if (t.joinable())
+      t.join();
+  }
+  if (listener_ != -1) {
+    ::close(listener_);
+    ::unlink(socket_path_.c_str());
+  }
+}
+
+/*!
+  */
+inline
+VulkanDevice* VulkanService::device() noexcept
+{
+  return device_;
+}
+
+/*!
+  */
+inline
+uint64b VulkanService::numOfExecutedJobs() const noexcept
+{
+  return num_of_executed_jobs_.load(std::memory_order_relaxed);
+}
+
+/*!
+  \details
+  The function is called with the mapped memories of a request and returns
+  false if the job fails. Jobs must be registered before run() is called.
+  */
+inline
+void VulkanService::registerJob(const uint32b job_id, JobFunction function)
+{
+  Job job{std::move(function), std::make_unique<std::mutex>()};
+  job_list_[job_id] = std::move(job);
+}
+
+/*!
+  \details
+  The listener is polled with a short timeout, so stop() can be called from
+  another thread. The flag is only cleared, so a stop() which is called
+  before run() isn't lost and run() returns immediately.
+  */
+inline
+void VulkanService::run()
+{
+  while (is_running_) {
+    joinFinishedThreads();
+    pollfd listener{listener_, POLLIN, 0};
+    constexpr int timeout = 100; // in milliseconds
+    if (::poll(&listener, 1, timeout) <= 0)
+      continue;
+    const int connection = ::accept(listener_, nullptr, nullptr);
+    if (connection == -1)
+      continue;
+    std::unique_lock<std::mutex> lock{connection_mutex_};
+    if (!is_running_) {
+      ::close(connection);
+      break;
+    }
+    connection_list_.emplace_back(connection);
+    thread_list_.emplace_back([this, connection]()
+    {
+      serve(connection);
+    });
+  }
+  for (auto& t : thread_list_) {
+    if (t.joinable())
+      t.join();
+  }
+  thread_list_.clear();
+  finished_thread_list_.clear();
+}
+
+/*!
+  */
+inline
+const std::string& VulkanService::socketPath() const noexcept
+{
+  return socket_path_;
+}
+
+/*!
+  \details
+  The connections are shut down, so the clients which are waiting for a
+  response get ServiceStatus::kDisconnected. A running job completes.
+  */
+inline
+void VulkanService::stop() noexcept
+{
+  std::unique_lock<std::mutex> lock{connection_mutex_};
+  is_running_ = false;
+  for (const int connection : connection_list_)
+    ::shutdown(connection, SHUT_RDWR);
+}
+
+/*!
+  */
+inline
+ServiceResponse VulkanService::execute(const ServiceRequest& request,
+                                       const int input_fd,
+                                       const int output_fd) noexcept
+{
+  ServiceResponse response;
+  const auto job = job_list_.find(request.job_id_);
+  if (job == job_list_.end()) {
+    response.status_ = ServiceStatus::kUnknownJob;
+    ::close(input_fd);
+    ::close(output_fd);
+    return response;
+  }
+
+  SharedMemory input;
+  SharedMemory output;
+  bool has_output = false;
+  try {
+    input = SharedMemory{input_fd, static_cast<std::size_t>(request.input_size_)};
+    has_output = true;
+    output = SharedMemory{output_fd, static_cast<std::size_t>(request.output_size_)};
+  }
+  catch (const std::exception&) {
+    // The output descriptor is closed by the shared memory once it's taken
+    if (!has_output)
+      ::close(output_fd);
+    response.status_ = ServiceStatus::kInvalidMemory;
+    return response;
+  }
+
+  const ServiceJob arguments{device_,
+                             request.works_,
+                             input.data(),
+                             input.size(),
+                             output.data(),
+                             output.size()};
+  const auto start = std::chrono::steady_clock::now();
+  bool result = false;
+  {
+    std::unique_lock<std::mutex> lock{*job->second.mutex_};
+    try {
+      result = job->second.function_(arguments);
+    }
+    catch (const std::exception&) {
+      result = false;
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+  const std::chrono::duration<float, std::milli> elapsed_time = end - start;
+  response.status_ = result ? ServiceStatus::kSuccess : ServiceStatus::kJobFailed;
+  response.job_time_ = elapsed_time.count();
+  ++num_of_executed_jobs_;
+  return response;
+}
+
+/*!
+  \details
+  A daemon serves many short-lived clients, so the threads of the closed
+  connections are joined while it runs.
+  */
+inline
+void VulkanService::joinFinishedThreads() noexcept
+{
+  std::unique_lock<std::mutex> lock{connection_mutex_};
+  for (const auto id : finished_thread_list_) {
+    auto t = std::find_if(thread_list_.begin(), thread_list_.end(),
+    [id](const std::thread& thread)
+    {
+      return thread.get_id() == id;
+    });
+    if (t != thread_list_.end()) {
+      t->join();
+      thread_list_.erase(t);
+    }
+  }
+  finished_thread_list_.clear();
+}
+
+/*!
+  */
+inline
+void VulkanService::serve(const int connection) noexcept
+{
+  while (is_running_) {
+    ServiceRequest request;
+    std::array<int, 2> fd_list{{-1, -1}};
+    if (!receiveServiceMessage(connection, &request, sizeof(request),
+                               fd_list.data(), fd_list.size()))
+      break;
+    const ServiceResponse response = execute(request, fd_list[0], fd_list[1]);
+    if (!sendServiceMessage(connection, &response, sizeof(response), nullptr, 0))
+      break;
+  }
+
+  std::unique_lock<std::mutex> lock{connection_mutex_};
+  auto c = std::find(connection_list_.begin(), connection_list_.end(), connection);
+  if (c != connection_list_.end())
+    connection_list_.erase(c);
+  finished_thread_list_.emplace_back(std::this_thread::get_id());
+  ::close(connection);
+}
+
+/*!
+  */
+inline
+VulkanServiceClient::VulkanServiceClient(const std::string_view socket_path)
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  if (sizeof(address.sun_path) <= socket_path.size())
+    throw std::runtime_error{"The socket path is too long."};
+  address.sun_family = AF_UNIX;
+  std::copy(socket_path.begin(), socket_path.end(), address.sun_path);
+
+  socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (socket_ == -1)
+    throw std::runtime_error{"Creating a client socket failed."};
+  if (::connect(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    destroy();
+    throw std::runtime_error{"Connecting to the service failed."};
+  }
+}
+
+/*!
+  */
+inline
+VulkanServiceClient::~VulkanServiceClient() noexcept
+{
+  destroy();
+}
+
+/*!
+  */
+inline
+void VulkanServiceClient::destroy() noexcept
+{
+  if (socket_ != -1) {
+    ::close(socket_);
+    socket_ = -1;
+  }
+}
+
+/*!
+  */
+inline
+bool VulkanServiceClient::isConnected() const noexcept
+{
+  return socket_ != -1;
+}
+
+/*!
+  \details
+  The input and the output can be the same memory. The results are in the
+  output memory when the function returns kSuccess.
+  */
+inline
+ServiceResponse VulkanServiceClient::submit(
+    const uint32b job_id,
+    const std::array<uint32b, 3>& works,
+    const SharedMemory& input,
+    const SharedMemory& output) noexcept
+{
+  ServiceResponse response;
+  if (!isConnected()) {
+    response.status_ = ServiceStatus::kDisconnected;
+    return response;
+  }
+  if (!input.isValid() || !output.isValid()) {
+    response.status_ = ServiceStatus::kInvalidMemory;
+    return response;
+  }
+
+  ServiceRequest request;
+  request.job_id_ = job_id;
+  request.works_ = works;
+  request.input_size_ = input.size();
+  request.output_size_ = output.size();
+  const std::array<int, 2> fd_list{{input.fd(), output.fd()}};
+  if (!sendServiceMessage(socket_, &request, sizeof(request),
+                          fd_list.data(), fd_list.size()) ||
+      !receiveServiceMessage(socket_, &response, sizeof(response), nullptr, 0)) {
+    destroy();
+    response = ServiceResponse{};
+    response.status_ = ServiceStatus::kDisconnected;
+  }
+  return response;
+}
+
+/*!
+  \details
+  The descriptors are attached to the first byte of the message.
+  */
+inline
+bool sendServiceMessage(const int socket,
+                        const void* message,
+                        const std::size_t size,
+                        const int* fd_list,
+                        const std::size_t num_of_fds) noexcept
+{
+  constexpr std::size_t max_num_of_fds = 4;
+  if (max_num_of_fds < num_of_fds)
+    return false;
+  const auto* data = static_cast<const char*>(message);
+  std::size_t sent_size = 0;
+  {
+    iovec io{const_cast<char*>(data), size};
+    msghdr header;
+    std::memset(&header, 0, sizeof(header));
+    header.msg_iov = &io;
+    header.msg_iovlen = 1;
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * max_num_of_fds)> control;
+    if (0 < num_of_fds) {
+      header.msg_control = control.data();
+      header.msg_controllen = CMSG_SPACE(sizeof(int) * num_of_fds);
+      cmsghdr* c = CMSG_FIRSTHDR(&header);
+      c->cmsg_level = SOL_SOCKET;
+      c->cmsg_type = SCM_RIGHTS;
+      c->cmsg_len = CMSG_LEN(sizeof(int) * num_of_fds);
+      std::memcpy(CMSG_DATA(c), fd_list, sizeof(int) * num_of_fds);
+    }
+    const ssize_t result = ::sendmsg(socket, &header, kServiceSendFlags);
+    if (result <= 0)
+      return false;
+    sent_size = static_cast<std::size_t>(result);
+  }
+  while (sent_size < size) {
+    const ssize_t result = ::send(socket, data + sent_size, size - sent_size,
+                                  kServiceSendFlags);
+    if (result <= 0)
+      return false;
+    sent_size += static_cast<std::size_t>(result);
+  }
+  return true;
+}
+
+/*!
+  \details
+  The received descriptors are owned by the caller. The function fails if
+  the number of the descriptors doesn't match.
+  */
+inline
+bool receiveServiceMessage(const int socket,
+                           void* message,
+                           const std::size_t size,
+                           int* fd_list,
+                           const std::size_t num_of_fds) noexcept
+{
+  constexpr std::size_t max_num_of_fds = 4;
+  if (max_num_of_fds < num_of_fds)
+    return false;
+  auto* data = static_cast<char*>(message);
+  std::size_t received_size = 0;
+  std::size_t num_of_received_fds = 0;
+  {
+    iovec io{data, size};
+    msghdr header;
+    std::memset(&header, 0, sizeof(header));
+    header.msg_iov = &io;
+    header.msg_iovlen = 1;
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * max_num_of_fds)> control;
+    header.msg_control = control.data();
+    header.msg_controllen = control.size();
+    const ssize_t result = ::recvmsg(socket, &header, kServiceReceiveFlags);
+    if (result <= 0)
+      return false;
+    received_size = static_cast<std::size_t>(result);
+    for (cmsghdr* c = CMSG_FIRSTHDR(&header); c != nullptr; c = CMSG_NXTHDR(&header, c)) {
+      if ((c->cmsg_level != SOL_SOCKET) || (c->cmsg_type != SCM_RIGHTS))
+        continue;
+      const std::size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      std::array<int, max_num_of_fds> received_fd_list;
+      std::memcpy(received_fd_list.data(), CMSG_DATA(c), sizeof(int) * n);
+      for (std::size_t i = 0; i < n; ++i) {
+        if (num_of_received_fds < num_of_fds)
+          fd_list[num_of_received_fds++] = received_fd_list[i];
+        else
+          ::close(received_fd_list[i]);
+      }
+    }
+  }
+  const auto close_fds = [fd_list, &num_of_received_fds]()
+  {
+    for (std::size_t i = 0; i < num_of_received_fds; ++i)
+      ::close(fd_list[i]);
+  };
+  if (num_of_received_fds != num_of_fds) {
+    close_fds();
+    return false;
+  }
+  while (received_size < size) {
+    const ssize_t result = ::recv(socket, data + received_size,
+                                  size - received_size, 0);
+    if (result <= 0) {
+      close_fds();
+      return false;
+    }
+    received_size += static_cast<std::size_t>(result);
+  }
+  return true;
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_SERVICE_INL_HPP
@@ -0,0 +1,271 @@
+/*!
+  \file vulkan_service.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_SERVICE_HPP
+#define CLSPV_TEST_VULKAN_SERVICE_HPP
+
+#if defined(Z_LINUX) || defined(Z_MAC)
+#define CLSPV_TEST_SERVICE_SUPPORTED 1
+#endif
+
+#if defined(CLSPV_TEST_SERVICE_SUPPORTED)
+
+// Standard C++ library
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+class VulkanDevice;
+
+/*!
+  \brief A memory region which can be shared with another process by a file descriptor
+  */
+class SharedMemory
+{
+ public:
+  //! Create an empty shared memory
+  SharedMemory() noexcept;
+
+  //! Create a shared memory of the given size
+  SharedMemory(const std::size_t size);
+
+  //! Map a shared memory which is received from another process
+  SharedMemory(const int fd, const std::size_t size);
+
+  //! Move a shared memory
+  SharedMemory(SharedMemory&& other) noexcept;
+
+  //! Destroy a shared memory
+  ~SharedMemory() noexcept;
+
+
+  //! Move a shared memory
+  SharedMemory& operator=(SharedMemory&& other) noexcept;
+
+
+  //! Return the mapped memory
+  void* data() noexcept;
+
+  //! Return the mapped memory
+  const void* data() const noexcept;
+
+  //! Unmap the memory and close the file descriptor
+  void destroy() noexcept;
+
+  //! Return the file descriptor
+  int fd() const noexcept;
+
+  //! Check if the memory is mapped
+  bool isValid() const noexcept;
+
+  //! Return the size of the memory in bytes
+  std::size_t size() const noexcept;
+
+ private:
+  //! Map the memory of the file descriptor
+  void map(const std::size_t size);
+
+
+  void* data_ = nullptr;
+  std::size_t size_ = 0;
+  int fd_ = -1;
+};
+
+/*!
+  \brief A job request which is sent from a client to a service
+
+  The input and the output memories are passed as file descriptors along
+  with the request. They can be the same memory.
+  */
+struct ServiceRequest
+{
+  uint32b job_id_ = 0;
+  std::array<uint32b, 3> works_{{1, 1, 1}};
+  uint64b input_size_ = 0; //!< The size of the input memory in bytes
+  uint64b output_size_ = 0; //!< The size of the output memory in bytes
+};
+
+/*!
+  \brief The status of a job which is sent back to a client
+  */
+enum class ServiceStatus : uint32b
+{
+  kSuccess = 0,
+  kUnknownJob,
+  kInvalidMemory,
+  kJobFailed,
+  kDisconnected
+};
+
+/*!
+  \brief A job response which is sent from a service to a client
+  */
+struct ServiceResponse
+{
+  ServiceStatus status_ = ServiceStatus::kSuccess;
+  float job_time_ = 0.0f; //!< The time the job took in the service in milliseconds
+};
+
+/*!
+  \brief The arguments which a job function receives
+  */
+struct ServiceJob
+{
+  VulkanDevice* device_;
+  std::array<uint32b, 3> works_;
+  const void* input_;
+  std::size_t input_size_;
+  void* output_;
+  std::size_t output_size_;
+};
+
+/*!
+  \brief Serve kernels of a warm device to short-lived client processes
+
+  The service owns a device whose shader modules and kernels are built once,
+  and listens on a unix domain socket. A client sends a request with the
+  file descriptors of its shared memories (SCM_RIGHTS), the service maps them
+  and runs the registered job function on them, so no data goes through the
+  socket. Each connection is served by its own thread, so concurrent clients
+  share the device like the threads of a process.
+  */
+class VulkanService
+{
+ public:
+  //! The function which executes a job
+  using JobFunction = std::function<bool (const ServiceJob&)>;
+
+
+  //! Create a service of the device
+  VulkanService(VulkanDevice* device, const std::string_view socket_path);
+
+  //! Stop a service
+  ~VulkanService() noexcept;
+
+
+  //! Return the device of the service
+  VulkanDevice* device() noexcept;
+
+  //! Return the number of the jobs which have been executed
+  uint64b numOfExecutedJobs() const noexcept;
+
+  //! Register a job function by the id
+  void registerJob(const uint32b job_id, JobFunction function);
+
+  //! Serve clients until stop() is called
+  void run();
+
+  //! Return the socket path
+  const std::string& socketPath() const noexcept;
+
+  //! Stop serving clients
+  void stop() noexcept;
+
+ private:
+  //! Execute a request
+  ServiceResponse execute(const ServiceRequest& request,
+                          const int input_fd,
+                          const int output_fd) noexcept;
+
+  //! Join the threads of the closed connections
+  void joinFinishedThreads() noexcept;
+
+  //! Serve a connection until the client disconnects
+  void serve(const int connection) noexcept;
+
+
+  /*!
+    \brief A registered job. The executions of a job are serialized since
+    its kernels record commands into their own command buffers
+    */
+  struct Job
+  {
+    JobFunction function_;
+    std::unique_ptr<std::mutex> mutex_;
+  };
+
+
+  VulkanDevice* device_;
+  std::string socket_path_;
+  std::unordered_map<uint32b, Job> job_list_;
+  std::mutex connection_mutex_;
+  std::vector<int> connection_list_;
+  std::vector<std::thread> thread_list_;
+  std::vector<std::thread::id> finished_thread_list_;
+  std::atomic<uint64b> num_of_executed_jobs_{0};
+  std::atomic<bool> is_running_{true}; //!< Only cleared by stop()
+  int listener_ = -1;
+};
+
+/*!
+  \brief Submit jobs to a service
+  */
+class VulkanServiceClient
+{
+ public:
+  //! Connect to a service
+  VulkanServiceClient(const std::string_view socket_path);
+
+  //! Disconnect from a service
+  ~VulkanServiceClient() noexcept;
+
+
+  //! Disconnect from a service
+  void destroy() noexcept;
+
+  //! Check if the client is connected
+  bool isConnected() const noexcept;
+
+  //! Submit a job and wait for the response
+  ServiceResponse submit(const uint32b job_id,
+                         const std::array<uint32b, 3>& works,
+                         const SharedMemory& input,
+                         const SharedMemory& output) noexcept;
+
+ private:
+  int socket_ = -1;
+};
+
+// Type aliases
+using UniqueService = std::unique_ptr<VulkanService>;
+
+//! Send a message with file descriptors
+bool sendServiceMessage(const int socket,
+                        const void* message,
+                        const std::size_t size,
+                        const int* fd_list,
+                        const std::size_t num_of_fds) noexcept;
+
+//! Receive a message with file descriptors
+bool receiveServiceMessage(const int socket,
+                           void* message,
+                           const std::size_t size,
+                           int* fd_list,
+                           const std::size_t num_of_fds) noexcept;
+
+} // namespace clspvtest
+
+#include "vulkan_service-inl.hpp"
+
+#endif // CLSPV_TEST_SERVICE_SUPPORTED
+
+#endif // CLSPV_TEST_VULKAN_SERVICE_HPP
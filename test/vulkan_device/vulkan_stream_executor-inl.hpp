@@ -0,0 +1,356 @@
+/*!
+  \file vulkan_stream_executor-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_STREAM_EXECUTOR_INL_HPP
+#define CLSPV_TEST_VULKAN_STREAM_EXECUTOR_INL_HPP
+
+#include "vulkan_stream_executor.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_buffer.hpp"
+#include "vulkan_device.hpp"
+
+namespace clspvtest {
+
+/*!
+  \details
+  The number of slots is at least 3, so the upload of a job never waits for
+  the download which is submitted in the same iteration. The download queue
+  is different from the upload queue if the transfer family has several
+  queues.
+  */
+inline
+VulkanStreamExecutor::VulkanStreamExecutor(VulkanDevice* device,
+                                           const std::size_t num_of_slots) :
+    device_{device},
+    slot_list_((std::max)(num_of_slots, static_cast<std::size_t>(3)))
+{
+  initialize();
+}
+
+/*!
+  */
+inline
+VulkanStreamExecutor::~VulkanStreamExecutor() noexcept
+{
+  destroy();
+}
+
+/*!
+  */
+template <typename Type> inline
+void VulkanStreamExecutor::addInput(const std::size_t slot,
+                                    VulkanBuffer<Type>* buffer) noexcept
+{
+  auto& input_list = slot_list_[slot].input_list_;
+  input_list.emplace_back();
+  auto& input = input_list.back();
+  input.buffer_ = buffer->buffer();
+  input.set_owner_ = [buffer](const QueueType queue_type, const uint32b queue_index)
+  {
+    buffer->setOwner(queue_type, queue_index);
+  };
+  input.is_concurrent_ = buffer->isConcurrent();
+}
+
+/*!
+  */
+template <typename Type> inline
+void VulkanStreamExecutor::addOutput(const std::size_t slot,
+                                     VulkanBuffer<Type>* buffer) noexcept
+{
+  auto& output_list = slot_list_[slot].output_list_;
+  output_list.emplace_back();
+  auto& output = output_list.back();
+  output.buffer_ = buffer->buffer();
+  output.set_owner_ = [buffer](const QueueType queue_type, const uint32b queue_index)
+  {
+    buffer->setOwner(queue_type, queue_index);
+  };
+  output.is_concurrent_ = buffer->isConcurrent();
+}
+
+/*!
+  */
+inline
+void VulkanStreamExecutor::destroy() noexcept
+{
+  const auto& device = device_->device();
+  for (auto& slot : slot_list_) {
+    if (slot.fence_) {
+      constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+      device.waitForFences(1, &slot.fence_, VK_TRUE, timeout);
+      device.destroyFence(slot.fence_);
+      slot.fence_ = nullptr;
+    }
+    if (slot.upload_semaphore_) {
+      device.destroySemaphore(slot.upload_semaphore_);
+      slot.upload_semaphore_ = nullptr;
+    }
+    if (slot.compute_semaphore_) {
+      device.destroySemaphore(slot.compute_semaphore_);
+      slot.compute_semaphore_ = nullptr;
+    }
+    for (std::size_t i = 0; i < slot.command_list_.size(); ++i) {
+      auto& command_pool = slot.command_pool_list_[i];
+      if (command_pool) {
+        device.destroyCommandPool(command_pool);
+        command_pool = nullptr;
+        slot.command_list_[i] = nullptr;
+      }
+    }
+    slot.is_busy_ = false;
+  }
+}
+
+/*!
+  */
+inline
+VulkanDevice* VulkanStreamExecutor::device() noexcept
+{
+  return device_;
+}
+
+/*!
+  */
+inline
+const VulkanDevice* VulkanStreamExecutor::device() const noexcept
+{
+  return device_;
+}
+
+/*!
+  */
+inline
+std::size_t VulkanStreamExecutor::numOfSlots() const noexcept
+{
+  return slot_list_.size();
+}
+
+/*!
+  \details
+  The upload and the download of a slot can write and read the host visible
+  buffers of the slot, because the previous job of the slot is completed
+  before the upload is recorded. The complete function is called in the
+  order of the jobs.
+  */
+inline
+void VulkanStreamExecutor::run(const std::size_t num_of_jobs,
+                               const RecordFunction& upload,
+                               const RecordFunction& compute,
+                               const RecordFunction& download,
+                               const CompleteFunction& complete)
+{
+  device_->allocateDeferredBuffers();
+
+  // Each iteration submits the download of the job t-2, the compute of the
+  // job t-1 and the upload of the job t, so a queue never waits for a stage
+  // which is submitted later
+  for (std::size_t t = 0; t < num_of_jobs + 2; ++t) {
+    if ((2 <= t) && (t - 2 < num_of_jobs))
+      submitDownload(t - 2, download);
+    if ((1 <= t) && (t - 1 < num_of_jobs))
+      submitCompute(t - 1, compute);
+    if (t < num_of_jobs) {
+      auto& slot = slot_list_[t % numOfSlots()];
+      if (slot.is_busy_)
+        finishJob(slot, complete);
+      submitUpload(t, upload);
+    }
+  }
+  // Complete the remaining jobs
+  const std::size_t num_of_remainings = (std::min)(num_of_jobs, numOfSlots());
+  for (std::size_t job = num_of_jobs - num_of_remainings; job < num_of_jobs; ++job) {
+    auto& slot = slot_list_[job % numOfSlots()];
+    if (slot.is_busy_)
+      finishJob(slot, complete);
+  }
+}
+
+/*!
+  */
+inline
+void VulkanStreamExecutor::setQueueIndices(const uint32b upload_queue_index,
+                                           const uint32b compute_queue_index,
+                                           const uint32b download_queue_index) noexcept
+{
+  upload_queue_index_ = upload_queue_index;
+  compute_queue_index_ = compute_queue_index;
+  download_queue_index_ = download_queue_index;
+}
+
+/*!
+  */
+inline
+void VulkanStreamExecutor::finishJob(Slot& slot,
+                                     const CompleteFunction& complete) noexcept
+{
+  const auto& device = device_->device();
+  constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+  device.waitForFences(1, &slot.fence_, VK_TRUE, timeout);
+  device.resetFences(1, &slot.fence_);
+  slot.is_busy_ = false;
+
+  for (const auto& input : slot.input_list_)
+    input.set_owner_(QueueType::kCompute, compute_queue_index_);
+  for (const auto& output : slot.output_list_)
+    output.set_owner_(QueueType::kTransfer, download_queue_index_);
+  if (complete)
+    complete(slot.job_, static_cast<std::size_t>(&slot - slot_list_.data()));
+}
+
+/*!
+  */
+inline
+void VulkanStreamExecutor::initialize()
+{
+  if (1 < device_->numOfQueues(QueueType::kTransfer))
+    download_queue_index_ = 1;
+
+  constexpr std::array<QueueType, 3> queue_type_list{{QueueType::kTransfer,
+                                                      QueueType::kCompute,
+                                                      QueueType::kTransfer}};
+  const auto& device = device_->device();
+  for (auto& slot : slot_list_) {
+    for (std::size_t i = 0; i < slot.command_list_.size(); ++i) {
+      // Owned by the slot, so the stream can be driven from any thread
+      slot.command_pool_list_[i] = device_->createCommandPool(queue_type_list[i]);
+      const vk::CommandBufferAllocateInfo alloc_info{
+          slot.command_pool_list_[i],
+          vk::CommandBufferLevel::ePrimary,
+          1};
+      device.allocateCommandBuffers(&alloc_info, &slot.command_list_[i]);
+    }
+    const vk::SemaphoreCreateInfo semaphore_info{};
+    device.createSemaphore(&semaphore_info, nullptr, &slot.upload_semaphore_);
+    device.createSemaphore(&semaphore_info, nullptr, &slot.compute_semaphore_);
+    const vk::FenceCreateInfo fence_info{};
+    device.createFence(&fence_info, nullptr, &slot.fence_);
+  }
+}
+
+/*!
+  \details
+  The barriers are recorded only if the queue families are different and
+  the buffer is exclusive.
+  */
+inline
+void VulkanStreamExecutor::recordHandoff(
+    const std::vector<HandoffBuffer>& buffer_list,
+    const QueueType src_queue_type,
+    const QueueType dst_queue_type,
+    const vk::CommandBuffer& command,
+    const bool is_release) const noexcept
+{
+  if (device_->isQueueFamilyShared())
+    return;
+  for (const auto& handoff : buffer_list) {
+    if (handoff.is_concurrent_)
+      continue;
+    if (is_release)
+      device_->releaseOwnership(handoff.buffer_, src_queue_type, dst_queue_type, command);
+    else
+      device_->acquireOwnership(handoff.buffer_, src_queue_type, dst_queue_type, command);
+  }
+}
+
+/*!
+  */
+inline
+void VulkanStreamExecutor::submitCompute(const std::size_t job,
+                                         const RecordFunction& compute)
+{
+  const std::size_t slot_index = job % numOfSlots();
+  auto& slot = slot_list_[slot_index];
+  const auto& command = slot.command_list_[1];
+
+  vk::CommandBufferBeginInfo begin_info{};
+  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  command.begin(begin_info);
+  recordHandoff(slot.input_list_, QueueType::kTransfer, QueueType::kCompute,
+                command, false);
+  compute(job, slot_index, command);
+  recordHandoff(slot.output_list_, QueueType::kCompute, QueueType::kTransfer,
+                command, true);
+  command.end();
+
+  device_->submit(QueueType::kCompute,
+                  compute_queue_index_,
+                  command,
+                  slot.upload_semaphore_,
+                  slot.compute_semaphore_,
+                  vk::Fence{});
+}
+
+/*!
+  */
+inline
+void VulkanStreamExecutor::submitDownload(const std::size_t job,
+                                          const RecordFunction& download)
+{
+  const std::size_t slot_index = job % numOfSlots();
+  auto& slot = slot_list_[slot_index];
+  const auto& command = slot.command_list_[2];
+
+  vk::CommandBufferBeginInfo begin_info{};
+  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  command.begin(begin_info);
+  recordHandoff(slot.output_list_, QueueType::kCompute, QueueType::kTransfer,
+                command, false);
+  download(job, slot_index, command);
+  command.end();
+
+  device_->submit(QueueType::kTransfer,
+                  download_queue_index_,
+                  command,
+                  slot.compute_semaphore_,
+                  nullptr,
+                  slot.fence_);
+}
+
+/*!
+  */
+inline
+void VulkanStreamExecutor::submitUpload(const std::size_t job,
+                                        const RecordFunction& upload)
+{
+  const std::size_t slot_index = job % numOfSlots();
+  auto& slot = slot_list_[slot_index];
+  const auto& command = slot.command_list_[0];
+
+  vk::CommandBufferBeginInfo begin_info{};
+  begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  command.begin(begin_info);
+  upload(job, slot_index, command);
+  recordHandoff(slot.input_list_, QueueType::kTransfer, QueueType::kCompute,
+                command, true);
+  command.end();
+
+  device_->submit(QueueType::kTransfer,
+                  upload_queue_index_,
+                  command,
+                  nullptr,
+                  slot.upload_semaphore_,
+                  vk::Fence{});
+  slot.job_ = job;
+  slot.is_busy_ = true;
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_STREAM_EXECUTOR_INL_HPP
@@ -0,0 +1,156 @@
+/*!
+  \file vulkan_stream_executor.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_STREAM_EXECUTOR_HPP
+#define CLSPV_TEST_VULKAN_STREAM_EXECUTOR_HPP
+
+// Standard C++ library
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+template <typename> class VulkanBuffer;
+class VulkanDevice;
+
+/*!
+  \brief Execute a batch of jobs as an upload/compute/download pipeline
+
+  A job consists of three stages, an upload on a transfer queue, a compute on
+  a compute queue and a download on a transfer queue. The stages are linked
+  with semaphores, and the jobs are submitted in a software pipelined order,
+  so the upload of the job N+1, the compute of the job N and the download of
+  the job N-1 are executed simultaneously.
+
+  A job uses the resources of a slot (job % numOfSlots()). The ownership of
+  the input buffers of a slot is transferred from the upload to the compute,
+  and the output buffers from the compute to the download. At least 3 slots
+  are required to overlap all stages, so fewer slots are rounded up to 3.
+  */
+class VulkanStreamExecutor
+{
+ public:
+  //! Record the commands of a stage of a job
+  using RecordFunction = std::function<void (const std::size_t job,
+                                             const std::size_t slot,
+                                             const vk::CommandBuffer& command)>;
+  //! Process the result of a completed job
+  using CompleteFunction = std::function<void (const std::size_t job,
+                                               const std::size_t slot)>;
+
+
+  //! Create an executor
+  VulkanStreamExecutor(VulkanDevice* device, const std::size_t num_of_slots);
+
+  //! Destroy an executor
+  ~VulkanStreamExecutor() noexcept;
+
+
+  //! Add a buffer which is written by the upload and read by the compute
+  template <typename Type>
+  void addInput(const std::size_t slot, VulkanBuffer<Type>* buffer) noexcept;
+
+  //! Add a buffer which is written by the compute and read by the download
+  template <typename Type>
+  void addOutput(const std::size_t slot, VulkanBuffer<Type>* buffer) noexcept;
+
+  //! Destroy an executor
+  void destroy() noexcept;
+
+  //! Return an assigned device
+  VulkanDevice* device() noexcept;
+
+  //! Return an assigned device
+  const VulkanDevice* device() const noexcept;
+
+  //! Return the number of slots
+  std::size_t numOfSlots() const noexcept;
+
+  //! Execute jobs
+  void run(const std::size_t num_of_jobs,
+           const RecordFunction& upload,
+           const RecordFunction& compute,
+           const RecordFunction& download,
+           const CompleteFunction& complete);
+
+  //! Set the indices of the queues which execute the stages
+  void setQueueIndices(const uint32b upload_queue_index,
+                       const uint32b compute_queue_index,
+                       const uint32b download_queue_index) noexcept;
+
+ private:
+  //! A buffer which is handed over between the stages
+  struct HandoffBuffer
+  {
+    vk::Buffer buffer_;
+    std::function<void (const QueueType, const uint32b)> set_owner_;
+    bool is_concurrent_;
+  };
+
+  //! The resources of a slot
+  struct Slot
+  {
+    std::vector<HandoffBuffer> input_list_;
+    std::vector<HandoffBuffer> output_list_;
+    std::array<vk::CommandPool, 3> command_pool_list_;
+    std::array<vk::CommandBuffer, 3> command_list_;
+    vk::Semaphore upload_semaphore_;
+    vk::Semaphore compute_semaphore_;
+    vk::Fence fence_;
+    std::size_t job_ = 0;
+    bool is_busy_ = false;
+  };
+
+
+  //! Wait for the job of the slot and complete it
+  void finishJob(Slot& slot, const CompleteFunction& complete) noexcept;
+
+  //! Initialize an executor
+  void initialize();
+
+  //! Record the ownership transfer barriers of the buffers
+  void recordHandoff(const std::vector<HandoffBuffer>& buffer_list,
+                     const QueueType src_queue_type,
+                     const QueueType dst_queue_type,
+                     const vk::CommandBuffer& command,
+                     const bool is_release) const noexcept;
+
+  //! Record and submit the compute of the job
+  void submitCompute(const std::size_t job, const RecordFunction& compute);
+
+  //! Record and submit the download of the job
+  void submitDownload(const std::size_t job, const RecordFunction& download);
+
+  //! Record and submit the upload of the job
+  void submitUpload(const std::size_t job, const RecordFunction& upload);
+
+
+  VulkanDevice* device_;
+  std::vector<Slot> slot_list_;
+  uint32b upload_queue_index_ = 0;
+  uint32b compute_queue_index_ = 0;
+  uint32b download_queue_index_ = 0;
+};
+
+// Type aliases
+using UniqueStreamExecutor = std::unique_ptr<VulkanStreamExecutor>;
+
+} // namespace clspvtest
+
+#include "vulkan_stream_executor-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_STREAM_EXECUTOR_HPP
@@ -0,0 +1,333 @@
+/*!
+  \file vulkan_tracer-inl.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_TRACER_INL_HPP
+#define CLSPV_TEST_VULKAN_TRACER_INL_HPP
+
+#include "vulkan_tracer.hpp"
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+// ClspvTest
+#include "config.hpp"
+#include "vulkan_profiler.hpp"
+
+namespace clspvtest {
+
+/*!
+  */
+inline
+VulkanTracer::VulkanTracer(const std::size_t capacity) noexcept :
+    capacity_{(std::max)(capacity, std::size_t{1})}
+{
+  // The ID distinguishes the tracers in the thread local cache
+  static std::atomic<std::size_t> id_count{0};
+  id_ = ++id_count;
+}
+
+/*!
+  \details
+  The begin and the end are the steady clock time in nanoseconds. The name
+  and the detail are truncated to 47 characters.
+  */
+inline
+void VulkanTracer::addSpan(const TraceCategory category,
+                           const std::string_view name,
+                           const std::string_view detail,
+                           const double begin,
+                           const double end) noexcept
+{
+  if (!isEnabled())
+    return;
+  ThreadBuffer* buffer = threadBuffer();
+  if (buffer == nullptr)
+    return;
+
+  const auto copy = [](const std::string_view text, std::array<char, 48>& dst)
+  {
+    const std::size_t n = (std::min)(text.size(), dst.size() - 1);
+    std::copy_n(text.data(), n, dst.data());
+    dst[n] = '\0';
+  };
+  // Only the owner thread writes the buffer
+  const std::size_t head = buffer->head_.load(std::memory_order_relaxed);
+  auto& span = buffer->span_list_[head % capacity_];
+  copy(name, span.name_);
+  copy(detail, span.detail_);
+  span.category_ = category;
+  span.begin_ = begin;
+  span.end_ = end;
+  buffer->head_.store(head + 1, std::memory_order_release);
+}
+
+/*!
+  */
+inline
+std::size_t VulkanTracer::capacity() const noexcept
+{
+  return capacity_;
+}
+
+/*!
+  \details
+  No thread may record spans during the clear.
+  */
+inline
+void VulkanTracer::clear() noexcept
+{
+  std::lock_guard<std::mutex> lock{thread_buffer_mutex_};
+  for (auto& buffer : thread_buffer_list_)
+    buffer.second->head_.store(0, std::memory_order_release);
+}
+
+/*!
+  */
+inline
+double VulkanTracer::currentTime() noexcept
+{
+  using Clock = std::chrono::steady_clock;
+  const std::chrono::duration<double, std::nano> t =
+      Clock::now().time_since_epoch();
+  return t.count();
+}
+
+/*!
+  */
+inline
+bool VulkanTracer::isEnabled() const noexcept
+{
+  return is_enabled_.load(std::memory_order_relaxed);
+}
+
+/*!
+  */
+inline
+void VulkanTracer::setEnabled(const bool is_enabled) noexcept
+{
+  is_enabled_.store(is_enabled, std::memory_order_relaxed);
+}
+
+/*!
+  \details
+  The host spans are placed in the process 0 with a track per thread, and
+  the device ranges are placed in the process 1 with a track per queue type.
+  The device ranges are moved onto the host timeline by the offset which the
+  profiler measures. The profiler can be null. No thread may record spans
+  during the export, so the tracer should be disabled before.
+  */
+inline
+std::string VulkanTracer::toChromeTrace(VulkanProfiler* profiler) const
+{
+  std::ostringstream json;
+  bool is_first = true;
+  const auto separator = [&is_first]()
+  {
+    const char* s = is_first ? "\n" : ",\n";
+    is_first = false;
+    return s;
+  };
+  // Microseconds
+  const auto timestamp = [](const double t)
+  {
+    std::array<char, 32> s;
+    std::snprintf(s.data(), s.size(), "%.3f", t * 1.0e-3);
+    return std::string{s.data()};
+  };
+
+  json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  json << separator()
+       << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, "
+          "\"args\": {\"name\": \"Host\"}}";
+  {
+    std::lock_guard<std::mutex> lock{thread_buffer_mutex_};
+    for (const auto& thread_buffer : thread_buffer_list_) {
+      const auto& buffer = *thread_buffer.second;
+      const std::size_t tid = buffer.thread_index_;
+      json << separator()
+           << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": "
+           << tid << ", \"args\": {\"name\": \"Thread " << tid << "\"}}";
+      const std::size_t head = buffer.head_.load(std::memory_order_acquire);
+      const std::size_t n = (std::min)(head, capacity_);
+      for (std::size_t i = head - n; i < head; ++i) {
+        const auto& span = buffer.span_list_[i % capacity_];
+        json << separator()
+             << "  {\"name\": \"" << escape(span.name_.data())
+             << "\", \"cat\": \"" << getCategoryName(span.category_)
+             << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << tid
+             << ", \"ts\": " << timestamp(span.begin_)
+             << ", \"dur\": " << timestamp(span.end_ - span.begin_);
+        if (span.detail_[0] != '\0')
+          json << ", \"args\": {\"detail\": \"" << escape(span.detail_.data()) << "\"}";
+        json << "}";
+      }
+    }
+  }
+
+  if (profiler != nullptr) {
+    const auto range_list = profiler->ranges();
+    const double offset = profiler->hostTimeOffset();
+    const std::array<const char*, 2> queue_name_list{{"Compute", "Transfer"}};
+    for (std::size_t i = 0; i < queue_name_list.size(); ++i) {
+      json << separator()
+           << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+           << i << ", \"args\": {\"name\": \"" << queue_name_list[i] << "\"}}";
+    }
+    json << separator()
+         << "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+            "\"args\": {\"name\": \"Device\"}}";
+    for (const auto& range : range_list) {
+      json << separator()
+           << "  {\"name\": \"" << escape(range.name_)
+           << "\", \"cat\": \"device\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+           << static_cast<uint32b>(range.queue_type_)
+           << ", \"ts\": " << timestamp(range.begin_ + offset)
+           << ", \"dur\": " << timestamp(range.end_ - range.begin_);
+      if (range.invocations_ != 0)
+        json << ", \"args\": {\"invocations\": " << range.invocations_ << "}";
+      json << "}";
+    }
+  }
+  json << "\n]}\n";
+  return json.str();
+}
+
+/*!
+  */
+inline
+bool VulkanTracer::writeChromeTrace(const std::string_view file_path,
+                                    VulkanProfiler* profiler) const
+{
+  std::ofstream file{std::string{file_path}};
+  if (!file)
+    return false;
+  file << toChromeTrace(profiler);
+  return static_cast<bool>(file);
+}
+
+/*!
+  */
+inline
+std::string VulkanTracer::escape(const std::string_view text) noexcept
+{
+  std::string result;
+  result.reserve(text.size());
+  for (const char c : text) {
+    if ((c == '"') || (c == '\\'))
+      result += '\\';
+    if (static_cast<unsigned char>(c) < 0x20)
+      continue;
+    result += c;
+  }
+  return result;
+}
+
+/*!
+  */
+inline
+std::string_view VulkanTracer::getCategoryName(const TraceCategory category) noexcept
+{
+  std::string_view name;
+  switch (category) {
+   case TraceCategory::kKernel: {
+    name = "kernel";
+    break;
+   }
+   case TraceCategory::kSubmit: {
+    name = "submit";
+    break;
+   }
+   case TraceCategory::kWait: {
+    name = "wait";
+    break;
+   }
+   case TraceCategory::kTransfer: {
+    name = "transfer";
+    break;
+   }
+   case TraceCategory::kMemory:
+   default: {
+    name = "memory";
+    break;
+   }
+  }
+  return name;
+}
+
+/*!
+  \details
+  The buffer of the last tracer which the thread used is cached, so only the
+  first span of a thread takes the lock.
+  */
+inline
+auto VulkanTracer::threadBuffer() noexcept -> ThreadBuffer*
+{
+  struct Cache
+  {
+    std::size_t tracer_id_ = 0;
+    ThreadBuffer* buffer_ = nullptr;
+  };
+  thread_local Cache cache;
+  if (cache.tracer_id_ == id_)
+    return cache.buffer_;
+
+  std::lock_guard<std::mutex> lock{thread_buffer_mutex_};
+  const auto id = std::this_thread::get_id();
+  auto& buffer = thread_buffer_list_[id];
+  if (!buffer) {
+    buffer = std::make_unique<ThreadBuffer>();
+    buffer->span_list_.resize(capacity_);
+    buffer->thread_index_ = thread_buffer_list_.size() - 1;
+  }
+  cache.tracer_id_ = id_;
+  cache.buffer_ = buffer.get();
+  return cache.buffer_;
+}
+
+/*!
+  */
+inline
+TraceSpan::TraceSpan(VulkanTracer* tracer,
+                     const TraceCategory category,
+                     const std::string_view name,
+                     const std::string_view detail) noexcept :
+    tracer_{((tracer != nullptr) && tracer->isEnabled()) ? tracer : nullptr},
+    name_{name},
+    detail_{detail},
+    category_{category}
+{
+  if (tracer_ != nullptr)
+    begin_ = VulkanTracer::currentTime();
+}
+
+/*!
+  */
+inline
+TraceSpan::~TraceSpan() noexcept
+{
+  if (tracer_ != nullptr) {
+    const double end = VulkanTracer::currentTime();
+    tracer_->addSpan(category_, name_, detail_, begin_, end);
+  }
+}
+
+} // namespace clspvtest
+
+#endif // CLSPV_TEST_VULKAN_TRACER_INL_HPP
@@ -0,0 +1,156 @@
+/*!
+  \file vulkan_tracer.hpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#ifndef CLSPV_TEST_VULKAN_TRACER_HPP
+#define CLSPV_TEST_VULKAN_TRACER_HPP
+
+// Standard C++ library
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+// ClspvTest
+#include "config.hpp"
+
+namespace clspvtest {
+
+// Forward declaration
+class VulkanProfiler;
+
+/*!
+  */
+enum class TraceCategory : uint32b
+{
+  kKernel = 0, //!< Kernel creation and run
+  kSubmit, //!< Queue submission
+  kWait, //!< Waiting for the device
+  kTransfer, //!< Buffer reads, writes and copies
+  kMemory //!< Buffer allocation
+};
+
+/*!
+  \brief Record the host activity as spans on a timeline
+
+  Each thread writes its spans into its own ring buffer, so recording
+  doesn't take a lock except for the first span of a thread. When a ring
+  buffer is full, the oldest spans are overwritten. A tracer is attached to
+  a device with VulkanDevice::setTracer(), and then the kernel creation and
+  runs, submissions, waits, staging copies and buffer allocations are
+  recorded. The spans can be exported as a chrome://tracing json with the
+  device ranges of a profiler.
+  */
+class VulkanTracer
+{
+ public:
+  //! Create a tracer which keeps the given number of spans per thread
+  VulkanTracer(const std::size_t capacity = 1 << 16) noexcept;
+
+
+  //! Add a span
+  void addSpan(const TraceCategory category,
+               const std::string_view name,
+               const std::string_view detail,
+               const double begin,
+               const double end) noexcept;
+
+  //! Return the number of spans per thread
+  std::size_t capacity() const noexcept;
+
+  //! Clear the recorded spans
+  void clear() noexcept;
+
+  //! Return the current time of the steady clock in nanoseconds
+  static double currentTime() noexcept;
+
+  //! Check if the tracer records spans
+  bool isEnabled() const noexcept;
+
+  //! Enable the recording of spans
+  void setEnabled(const bool is_enabled) noexcept;
+
+  //! Return the spans and the device ranges as a chrome://tracing json
+  std::string toChromeTrace(VulkanProfiler* profiler) const;
+
+  //! Write the spans and the device ranges into a chrome://tracing json file
+  bool writeChromeTrace(const std::string_view file_path,
+                        VulkanProfiler* profiler) const;
+
+ private:
+  //! A span of the host activity
+  struct Span
+  {
+    std::array<char, 48> name_;
+    std::array<char, 48> detail_;
+    TraceCategory category_;
+    double begin_;
+    double end_;
+  };
+
+  //! The ring buffer of a thread
+  struct ThreadBuffer
+  {
+    std::vector<Span> span_list_;
+    std::atomic<std::size_t> head_{0};
+    std::size_t thread_index_;
+  };
+
+
+  //! Escape the string for json
+  static std::string escape(const std::string_view text) noexcept;
+
+  //! Return the name of the category
+  static std::string_view getCategoryName(const TraceCategory category) noexcept;
+
+  //! Return the ring buffer of the calling thread
+  ThreadBuffer* threadBuffer() noexcept;
+
+
+  std::unordered_map<std::thread::id, std::unique_ptr<ThreadBuffer>> thread_buffer_list_;
+  mutable std::mutex thread_buffer_mutex_;
+  std::size_t capacity_;
+  std::size_t id_;
+  std::atomic<bool> is_enabled_{true};
+};
+
+/*!
+  \brief Record a span of the enclosing scope
+
+  Nothing is recorded if the tracer is null or disabled.
+  */
+class TraceSpan
+{
+ public:
+  //! Start a span
+  TraceSpan(VulkanTracer* tracer,
+            const TraceCategory category,
+            const std::string_view name,
+            const std::string_view detail = std::string_view{}) noexcept;
+
+  //! Finish a span
+  ~TraceSpan() noexcept;
+
+ private:
+  VulkanTracer* tracer_;
+  std::string_view name_;
+  std::string_view detail_;
+  TraceCategory category_;
+  double begin_ = 0.0;
+};
+
+} // namespace clspvtest
+
+#include "vulkan_tracer-inl.hpp"
+
+#endif // CLSPV_TEST_VULKAN_TRACER_HPP
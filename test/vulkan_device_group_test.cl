@@ -0,0 +1,53 @@
+/*!
+  \file vulkan_device_group_test.cl
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-compat"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-c++11-compat-pedantic"
+
+// Type aliases
+typedef unsigned int uint32b;
+
+
+/*!
+  \brief Compute the pattern value of a pixel. Must match the host implementation
+  */
+uint32b computePattern(const uint32b x, const uint32b y)
+{
+  uint32b value = (x * 73856093u) ^ (y * 19349663u);
+  for (uint32b i = 0; i < 256u; ++i) {
+    value = value ^ (value << 13u);
+    value = value ^ (value >> 17u);
+    value = value ^ (value << 5u);
+  }
+  return value;
+}
+
+/*!
+  \brief Fill the rows of an image which are assigned to the device
+
+  params[0]: the width of the image
+  params[1]: the first row of the part
+  params[2]: the number of rows of the part
+  */
+__kernel void fillPattern(__global uint32b* outputs,
+                          __global const uint32b* params)
+{
+  const uint32b width = params[0];
+  const uint32b x = (uint32b)get_global_id(0);
+  const uint32b row = (uint32b)get_global_id(1);
+  if ((x < width) && (row < params[2])) {
+    const uint32b y = row + params[1];
+    outputs[y * width + x] = computePattern(x, y);
+  }
+}
+
+#pragma clang diagnostic pop
+#pragma clang diagnostic pop
@@ -0,0 +1,156 @@
+/*!
+  \file vulkan_device_group_test.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+#include "vulkan_device/vulkan_device_group.hpp"
+
+// Forward declaration
+clspvtest::uint32b computePattern(const clspvtest::uint32b x,
+                                  const clspvtest::uint32b y) noexcept;
+
+
+/*!
+  \details
+  The arguments are the numbers of the physical devices which are used,
+  e.g. "0 0" makes two devices on the 0th GPU. All GPUs are used by default.
+  */
+int main(int argc, char** argv)
+{
+  using clspvtest::uint32b;
+  using clspvtest::BufferUsage;
+  constexpr uint32b width = 1920;
+  constexpr uint32b height = 1080;
+  constexpr std::size_t num_of_iterations = 8;
+
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanDeviceGroupTest";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  std::vector<uint32b> device_number_list;
+  for (int i = 1; i < argc; ++i)
+    device_number_list.emplace_back(static_cast<uint32b>(std::atoi(argv[i])));
+
+  using Kernel = clspvtest::VulkanKernel<2, uint32b, uint32b>;
+  std::vector<std::unique_ptr<Kernel>> kernel_list;
+  std::vector<clspvtest::UniqueBuffer<uint32b>> output_list;
+  std::vector<clspvtest::UniqueBuffer<uint32b>> param_list;
+  clspvtest::UniqueDeviceGroup group;
+  try {
+    group = std::make_unique<clspvtest::VulkanDeviceGroup>(device_options,
+                                                           device_number_list);
+    for (std::size_t i = 0; i < group->numOfDevices(); ++i) {
+      const std::string info = clspvtest::getDeviceInfo(*group->device(i));
+      std::cout << info << std::endl;
+    }
+    {
+      const std::vector<uint32b> spirv_code =
+          clspvtest::loadModuleSpirvCode("vulkan_device_group_test.spv");
+      group->setShaderModule(spirv_code, 0);
+    }
+    // Each device has an output buffer of the whole image
+    for (std::size_t i = 0; i < group->numOfDevices(); ++i) {
+      auto device = group->device(i);
+      kernel_list.emplace_back(std::make_unique<Kernel>(device, 0, "fillPattern"));
+      output_list.emplace_back(std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+          device, BufferUsage::kDeviceOnly, width * height));
+      param_list.emplace_back(std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+          device, BufferUsage::kHostOnly, 3));
+    }
+
+    std::vector<const clspvtest::VulkanBuffer<uint32b>*> buffer_list;
+    for (const auto& output : output_list)
+      buffer_list.emplace_back(output.get());
+    std::vector<uint32b> image(width * height);
+    for (std::size_t iteration = 0; iteration < num_of_iterations; ++iteration) {
+      const auto range_list = group->run(
+          std::array<uint32b, 2>{{width, height}},
+          [&kernel_list, &output_list, &param_list]
+          (clspvtest::VulkanDevice* /* device */,
+           const std::size_t index,
+           const clspvtest::WorkRange<2>& range)
+          {
+            const std::array<uint32b, 3> params{{width,
+                                                 range.offset_[1],
+                                                 range.works_[1]}};
+            param_list[index]->write(params.data(), params.size(), 0, 0);
+            kernel_list[index]->run(*output_list[index],
+                                    *param_list[index],
+                                    range.works_,
+                                    clspvtest::kAnyQueue);
+          });
+      group->gather(range_list, buffer_list, image.data());
+
+      std::size_t num_of_errors = 0;
+      for (uint32b y = 0; y < height; ++y) {
+        for (uint32b x = 0; x < width; ++x) {
+          if (image[y * width + x] != computePattern(x, y))
+            ++num_of_errors;
+        }
+      }
+      std::cout << "  iteration " << iteration << ": errors = " << num_of_errors;
+      for (std::size_t i = 0; i < group->numOfDevices(); ++i) {
+        std::cout << ", device" << i << " rows = " << range_list[i].works_[1]
+                  << " (score " << group->score(i) << ")";
+      }
+      std::cout << std::endl;
+    }
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+  }
+
+  // The resources of the devices must be destroyed before the group
+  kernel_list.clear();
+  output_list.clear();
+  param_list.clear();
+  group.reset();
+
+  return 0;
+}
+
+/*!
+  \brief Compute the pattern value of a pixel. Must match the kernel
+  */
+clspvtest::uint32b computePattern(const clspvtest::uint32b x,
+                                  const clspvtest::uint32b y) noexcept
+{
+  using clspvtest::uint32b;
+  uint32b value = (x * 73856093u) ^ (y * 19349663u);
+  for (uint32b i = 0; i < 256u; ++i) {
+    value = value ^ (value << 13u);
+    value = value ^ (value >> 17u);
+    value = value ^ (value << 5u);
+  }
+  return value;
+}
@@ -0,0 +1,46 @@
+/*!
+  \file vulkan_external_memory_test.cl
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-compat"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-c++11-compat-pedantic"
+
+// Type aliases
+typedef unsigned int uint32b;
+
+
+/*!
+  \brief Fill the values with a sequence. Executed by the producer process
+
+  params[0]: the number of the values
+  */
+__kernel void fillSequence(__global uint32b* values,
+                           __global const uint32b* params)
+{
+  const uint32b index = (uint32b)get_global_id(0);
+  if (index < params[0])
+    values[index] = 3u * index + 1u;
+}
+
+/*!
+  \brief Double the values in place. Executed by the consumer process
+
+  params[0]: the number of the values
+  */
+__kernel void doubleValues(__global uint32b* values,
+                           __global const uint32b* params)
+{
+  const uint32b index = (uint32b)get_global_id(0);
+  if (index < params[0])
+    values[index] = 2u * values[index];
+}
+
+#pragma clang diagnostic pop
+#pragma clang diagnostic pop
@@ -0,0 +1,271 @@
+/*!
+  \file vulkan_external_memory_test.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+// POSIX
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+#include "vulkan_device/vulkan_service.hpp"
+
+// Forward declaration
+clspvtest::DeviceOptions makeDeviceOptions(const char* app_name,
+                                           const clspvtest::uint32b number);
+
+int runConsumer(const int socket, const clspvtest::uint32b device_number);
+
+int runProducer(const int socket, const clspvtest::uint32b device_number);
+
+namespace {
+
+//! The message which the processes exchange
+struct HandoffMessage
+{
+  clspvtest::uint64b n_ = 0; //!< The number of the values in the buffer
+  clspvtest::uint64b num_of_errors_ = 0; //!< The errors which the consumer found
+};
+
+constexpr clspvtest::uint64b kHandoffFailed = ~clspvtest::uint64b{0};
+
+} // namespace
+
+
+/*!
+  \details
+  Usage:
+    VulkanExternalMemoryTest [device number]
+
+  The process forks into a producer and a consumer before vulkan is
+  initialized. The producer fills an exportable buffer and passes its memory
+  to the consumer, which imports it, checks the values and doubles them in
+  place. Then the producer checks the doubled values in its own buffer, so
+  the handoff doesn't copy the data on the device. Returns non-zero if either
+  process fails or finds a wrong value.
+
+  A software driver can be used by setting VK_ICD_FILENAMES, e.g. to the
+  lavapipe icd file.
+  */
+int main(int argc, char** argv)
+{
+  const clspvtest::uint32b device_number = (1 < argc)
+      ? static_cast<clspvtest::uint32b>(std::atoi(argv[1]))
+      : 0;
+
+  std::array<int, 2> socket_pair{{-1, -1}};
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, socket_pair.data()) != 0) {
+    std::cerr << "Error: creating a socket pair failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+  const pid_t pid = ::fork();
+  if (pid == -1) {
+    std::cerr << "Error: forking the process failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (pid == 0) {
+    ::close(socket_pair[0]);
+    const int result = runConsumer(socket_pair[1], device_number);
+    ::close(socket_pair[1]);
+    std::exit(result);
+  }
+
+  ::close(socket_pair[1]);
+  const int result = runProducer(socket_pair[0], device_number);
+  ::close(socket_pair[0]);
+  int status = 0;
+  if (::waitpid(pid, &status, 0) == -1) {
+    std::cerr << "Error: waiting for the consumer failed." << std::endl;
+    return EXIT_FAILURE;
+  }
+  // The consumer can be killed by a signal
+  const int consumer_result = WIFEXITED(status) ? WEXITSTATUS(status)
+                                                : EXIT_FAILURE;
+  return (result != EXIT_SUCCESS) ? result : consumer_result;
+}
+
+clspvtest::DeviceOptions makeDeviceOptions(const char* app_name,
+                                           const clspvtest::uint32b number)
+{
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = app_name;
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+  // Both processes must use the same physical device
+  device_options.vulkan_device_number_ = number;
+  device_options.device_selection_ = clspvtest::DeviceSelection::kNumber;
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+  return device_options;
+}
+
+int runProducer(const int socket, const clspvtest::uint32b device_number)
+{
+  using clspvtest::uint32b;
+  using clspvtest::BufferUsage;
+  using Kernel = clspvtest::VulkanKernel<1, uint32b, uint32b>;
+  constexpr uint32b n = 1024 * 1024;
+
+  clspvtest::UniqueDevice device;
+  std::unique_ptr<Kernel> kernel;
+  clspvtest::UniqueBuffer<uint32b> values;
+  clspvtest::UniqueBuffer<uint32b> params;
+  bool success = true;
+  try {
+    auto device_options = makeDeviceOptions("VulkanExternalMemoryProducer",
+                                            device_number);
+    device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+    std::cout << "Producer:\n" << clspvtest::getDeviceInfo(*device) << std::endl;
+    if (!device->isExternalMemorySupported())
+      throw std::runtime_error{"The device doesn't support external memory fds."};
+    {
+      const std::vector<uint32b> spirv_code =
+          clspvtest::loadModuleSpirvCode("vulkan_external_memory_test.spv");
+      device->setShaderModule(spirv_code, 0);
+    }
+    kernel = std::make_unique<Kernel>(device.get(), 0, "fillSequence");
+    values = std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+        device.get(), BufferUsage::kDeviceOnly);
+    values->setExportable(true);
+    values->setSize(n);
+    params = std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+        device.get(), BufferUsage::kHostOnly, 1);
+    params->write(&n, 1, 0, 0);
+
+    kernel->run(*values, *params, {n}, 0);
+    device->waitForCompletion();
+
+    // Hand off the memory
+    HandoffMessage message;
+    message.n_ = n;
+    const int fd = values->exportMemory();
+    if (fd == -1)
+      throw std::runtime_error{"Exporting the memory failed."};
+    const bool is_sent = clspvtest::sendServiceMessage(socket, &message,
+                                                       sizeof(message), &fd, 1);
+    ::close(fd);
+    if (!is_sent ||
+        !clspvtest::receiveServiceMessage(socket, &message, sizeof(message),
+                                          nullptr, 0) ||
+        (message.num_of_errors_ == kHandoffFailed))
+      throw std::runtime_error{"The consumer failed."};
+    std::cout << "  consumer errors: " << message.num_of_errors_ << std::endl;
+
+    // The consumer doubled the values in the same memory
+    std::vector<uint32b> results(n);
+    values->read(results.data(), n, 0, 0);
+    std::size_t num_of_errors = 0;
+    for (uint32b i = 0; i < n; ++i) {
+      if (results[i] != 2u * (3u * i + 1u))
+        ++num_of_errors;
+    }
+    std::cout << "  producer errors: " << num_of_errors << std::endl;
+    success = (message.num_of_errors_ == 0) && (num_of_errors == 0);
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+    success = false;
+  }
+
+  // The resources of the device must be destroyed before the device
+  kernel.reset();
+  values.reset();
+  params.reset();
+  device.reset();
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int runConsumer(const int socket, const clspvtest::uint32b device_number)
+{
+  using clspvtest::uint32b;
+  using clspvtest::uint64b;
+  using clspvtest::BufferUsage;
+  using Kernel = clspvtest::VulkanKernel<1, uint32b, uint32b>;
+
+  HandoffMessage message;
+  int fd = -1;
+  if (!clspvtest::receiveServiceMessage(socket, &message, sizeof(message), &fd, 1))
+    return EXIT_FAILURE;
+
+  clspvtest::UniqueDevice device;
+  std::unique_ptr<Kernel> kernel;
+  clspvtest::UniqueBuffer<uint32b> values;
+  clspvtest::UniqueBuffer<uint32b> params;
+  try {
+    message.num_of_errors_ = kHandoffFailed;
+    const uint32b n = static_cast<uint32b>(message.n_);
+    auto device_options = makeDeviceOptions("VulkanExternalMemoryConsumer",
+                                            device_number);
+    device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+    {
+      const std::vector<uint32b> spirv_code =
+          clspvtest::loadModuleSpirvCode("vulkan_external_memory_test.spv");
+      device->setShaderModule(spirv_code, 0);
+    }
+    kernel = std::make_unique<Kernel>(device.get(), 0, "doubleValues");
+    // The buffer must have the same usage and size as the exported one
+    values = std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+        device.get(), BufferUsage::kDeviceOnly, n, fd);
+    if (!values->isExternal())
+      throw std::runtime_error{"Importing the memory failed."};
+    fd = -1;
+    params = std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+        device.get(), BufferUsage::kHostOnly, 1);
+    params->write(&n, 1, 0, 0);
+
+    std::vector<uint32b> inputs(n);
+    values->read(inputs.data(), n, 0, 0);
+    uint64b num_of_errors = 0;
+    for (uint32b i = 0; i < n; ++i) {
+      if (inputs[i] != 3u * i + 1u)
+        ++num_of_errors;
+    }
+    kernel->run(*values, *params, {n}, 0);
+    device->waitForCompletion();
+    message.num_of_errors_ = num_of_errors;
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+  }
+  if (fd != -1)
+    ::close(fd);
+  const bool is_sent = clspvtest::sendServiceMessage(socket, &message,
+                                                     sizeof(message), nullptr, 0);
+  const bool success = is_sent && (message.num_of_errors_ == 0);
+
+  // The resources of the device must be destroyed before the device
+  kernel.reset();
+  values.reset();
+  params.reset();
+  device.reset();
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
@@ -0,0 +1,237 @@
+/*!
+  \file vulkan_frame_executor_test.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_frame_executor.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+
+namespace {
+
+using Kernel = clspvtest::VulkanKernel<1, clspvtest::uint32b, clspvtest::uint32b>;
+
+} // namespace
+
+// Forward declaration
+std::size_t countErrors(const std::size_t iteration,
+                        const clspvtest::VulkanBuffer<clspvtest::uint8b>& staging,
+                        const std::size_t n) noexcept;
+clspvtest::uint32b getInput(const std::size_t iteration, const std::size_t i) noexcept;
+std::size_t runFrames(clspvtest::VulkanDevice* device,
+                      Kernel* kernel,
+                      const bool use_timeline);
+
+//! The number of the frames in flight
+constexpr std::size_t kNumOfFrames = 3;
+
+//! The number of the values which a frame processes
+constexpr std::size_t kNumOfValues = 1 << 16;
+
+/*!
+  \details
+  Usage: VulkanFrameExecutorTest
+
+  Runs more frames than the executor keeps in flight, once with the timeline
+  semaphore and once with the fences. A frame uploads values through its
+  staging buffer, scales them with a kernel and downloads the results into
+  the staging buffer, which is checked when the frame is begun again or all
+  frames are completed. Returns non-zero if any result is wrong.
+  */
+int main(int /* argc */, char** /* argv */)
+{
+  using clspvtest::uint32b;
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanFrameExecutorTest";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  bool success = true;
+  {
+    std::unique_ptr<Kernel> kernel;
+    try {
+      device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+      {
+        const std::string info = clspvtest::getDeviceInfo(*device);
+        std::cout << info << std::endl;
+      }
+      {
+        const std::vector<uint32b> spirv_code =
+            clspvtest::loadModuleSpirvCode("vulkan_frame_executor_test.spv");
+        device->setShaderModule(spirv_code, 0);
+      }
+      // A frame records the kernel with its own descriptor set
+      kernel = std::make_unique<Kernel>(device.get(), 0, "scaleValues", kNumOfFrames);
+
+      if (!device->isTimelineSemaphoreSupported())
+        std::cout << "  Timeline semaphores aren't supported." << std::endl;
+      for (const bool use_timeline : {true, false}) {
+        const std::size_t num_of_errors = runFrames(device.get(),
+                                                    kernel.get(),
+                                                    use_timeline);
+        std::cout << "  " << (use_timeline ? "timeline" : "fence")
+                  << ": errors = " << num_of_errors << std::endl;
+        success = success && (num_of_errors == 0);
+      }
+    }
+    catch (const std::exception& error) {
+      std::cerr << "Error: " << error.what() << std::endl;
+      success = false;
+    }
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!
+  \brief Count the downloaded results which are different from the expected values
+  */
+std::size_t countErrors(const std::size_t iteration,
+                        const clspvtest::VulkanBuffer<clspvtest::uint8b>& staging,
+                        const std::size_t n) noexcept
+{
+  using clspvtest::uint32b;
+  const auto memory = staging.mapMemory();
+  const auto* outputs = reinterpret_cast<const uint32b*>(memory.data()) + n;
+  std::size_t num_of_errors = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    const uint32b expected = 2u * getInput(iteration, i) + 1u;
+    if (outputs[i] != expected)
+      ++num_of_errors;
+  }
+  return num_of_errors;
+}
+
+/*!
+  \brief Return the input value of an iteration
+  */
+clspvtest::uint32b getInput(const std::size_t iteration, const std::size_t i) noexcept
+{
+  const std::size_t value = iteration * 7919 + i;
+  return static_cast<clspvtest::uint32b>(value);
+}
+
+/*!
+  \brief Run frames and return the number of the wrong results
+  */
+std::size_t runFrames(clspvtest::VulkanDevice* device,
+                      Kernel* kernel,
+                      const bool use_timeline)
+{
+  using clspvtest::uint32b;
+  using clspvtest::BufferUsage;
+  using Buffer = clspvtest::VulkanBuffer<uint32b>;
+  constexpr std::size_t num_of_iterations = 4 * kNumOfFrames + 1;
+  constexpr std::size_t size = sizeof(uint32b) * kNumOfValues;
+  constexpr std::size_t kNoIteration = std::numeric_limits<std::size_t>::max();
+
+  clspvtest::VulkanFrameExecutor executor{device,
+                                          kNumOfFrames,
+                                          clspvtest::QueueType::kCompute,
+                                          0,
+                                          use_timeline};
+  // The inputs and the outputs of a frame are placed in its staging buffer
+  executor.setStagingSize(2 * size);
+  std::vector<std::unique_ptr<Buffer>> input_list;
+  std::vector<std::unique_ptr<Buffer>> output_list;
+  for (std::size_t f = 0; f < executor.numOfFrames(); ++f) {
+    input_list.emplace_back(std::make_unique<Buffer>(device, BufferUsage::kDeviceOnly, kNumOfValues));
+    output_list.emplace_back(std::make_unique<Buffer>(device, BufferUsage::kDeviceOnly, kNumOfValues));
+  }
+  std::vector<std::size_t> iteration_list(executor.numOfFrames(), kNoIteration);
+
+  std::size_t num_of_errors = 0;
+  const vk::BufferCopy upload_region{0, 0, size};
+  const vk::BufferCopy download_region{0, size, size};
+  for (std::size_t iteration = 0; iteration < num_of_iterations; ++iteration) {
+    const std::size_t f = executor.beginFrame();
+    auto& staging = executor.stagingBuffer(f);
+    // The previous submission of the frame is completed
+    if (iteration_list[f] != kNoIteration)
+      num_of_errors += countErrors(iteration_list[f], staging, kNumOfValues);
+    {
+      auto memory = staging.mapMemory();
+      auto* inputs = reinterpret_cast<uint32b*>(memory.data());
+      for (std::size_t i = 0; i < kNumOfValues; ++i)
+        inputs[i] = getInput(iteration, i);
+    }
+
+    const auto& command = executor.command();
+    command.copyBuffer(staging.buffer(), input_list[f]->buffer(), 1, &upload_region);
+    {
+      const vk::MemoryBarrier barrier{vk::AccessFlagBits::eTransferWrite,
+                                      vk::AccessFlagBits::eShaderRead};
+      command.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                              vk::PipelineStageFlagBits::eComputeShader,
+                              vk::DependencyFlags{},
+                              1, &barrier,
+                              0, nullptr,
+                              0, nullptr);
+    }
+    kernel->record(command, f, *input_list[f], *output_list[f],
+                   {static_cast<uint32b>(kNumOfValues)});
+    {
+      const vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite,
+                                      vk::AccessFlagBits::eTransferRead};
+      command.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                              vk::PipelineStageFlagBits::eTransfer,
+                              vk::DependencyFlags{},
+                              1, &barrier,
+                              0, nullptr,
+                              0, nullptr);
+    }
+    command.copyBuffer(output_list[f]->buffer(), staging.buffer(), 1, &download_region);
+    {
+      const vk::MemoryBarrier barrier{vk::AccessFlagBits::eTransferWrite,
+                                      vk::AccessFlagBits::eHostRead};
+      command.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                              vk::PipelineStageFlagBits::eHost,
+                              vk::DependencyFlags{},
+                              1, &barrier,
+                              0, nullptr,
+                              0, nullptr);
+    }
+    executor.endFrame();
+    iteration_list[f] = iteration;
+  }
+
+  // Check the frames which are still in flight
+  executor.waitForCompletion();
+  for (std::size_t f = 0; f < executor.numOfFrames(); ++f) {
+    if (iteration_list[f] != kNoIteration) {
+      num_of_errors += countErrors(iteration_list[f],
+                                   executor.stagingBuffer(f),
+                                   kNumOfValues);
+    }
+  }
+  return num_of_errors;
+}
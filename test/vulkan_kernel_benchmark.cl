@@ -0,0 +1,30 @@
+/*!
+  \file vulkan_kernel_benchmark.cl
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-compat"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-c++11-compat-pedantic"
+
+// Type aliases
+typedef unsigned int uint32b;
+
+
+/*!
+  \brief Do nothing. The store is never executed but keeps the binding
+  */
+__kernel void empty(__global uint32b* values)
+{
+  const uint32b index = (uint32b)get_global_id(0);
+  if (index == 0xffffffffu)
+    values[0] = 0u;
+}
+
+#pragma clang diagnostic pop
+#pragma clang diagnostic pop
@@ -0,0 +1,320 @@
+/*!
+  \file vulkan_kernel_benchmark.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/benchmark_utility.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+
+namespace {
+
+using Kernel = clspvtest::VulkanKernel<1, clspvtest::uint32b>;
+
+//! The dispatch throughput of a configuration
+struct ThroughputResult
+{
+  std::size_t num_of_threads_ = 0;
+  std::size_t num_of_queues_ = 0;
+  double dispatches_per_second_ = 0.0;
+};
+
+} // namespace
+
+// Forward declaration
+double measureThroughput(clspvtest::VulkanDevice* device,
+                         const std::size_t num_of_threads,
+                         const std::size_t num_of_queues,
+                         const std::size_t num_of_dispatches);
+
+void submitKernels(clspvtest::VulkanDevice* device,
+                   const clspvtest::uint32b queue_index,
+                   const std::size_t num_of_dispatches,
+                   std::atomic<std::size_t>* num_of_ready_threads,
+                   const std::atomic<bool>* is_started);
+
+std::string toJson(const clspvtest::VulkanDevice& device,
+                   const std::size_t num_of_iterations,
+                   const clspvtest::RunPhaseTime& same_args_phases,
+                   const clspvtest::RunPhaseTime& rebind_phases,
+                   const clspvtest::KernelLatency& latency,
+                   const std::vector<ThroughputResult>& throughput_list);
+
+
+/*!
+  \details
+  Usage:
+    VulkanKernelBenchmark [iterations] [output json]
+
+  Measure the host overhead of a kernel run, the round-trip latency of an
+  empty kernel and the dispatch throughput against the number of threads and
+  queues. The results are written as json, so runs can be compared to find
+  regressions in the submission path.
+  */
+int main(int argc, char** argv)
+{
+  std::cout << "Measure the launch latency and the submission overhead of kernels." << std::endl;
+
+  std::size_t num_of_iterations = 1000;
+  if (1 < argc)
+    num_of_iterations = static_cast<std::size_t>(std::atoll(argv[1]));
+  const std::string output_path = (2 < argc) ? argv[2]
+                                             : "vulkan_kernel_benchmark.json";
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanKernelBenchmark";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+  device_options.vulkan_device_number_ = 0; //!< Use 0th GPU
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  try {
+    device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+    std::cout << clspvtest::getDeviceInfo(*device) << std::endl;
+    const std::vector<clspvtest::uint32b> spirv_code =
+        clspvtest::loadModuleSpirvCode("vulkan_kernel_benchmark.spv");
+    device->setShaderModule(spirv_code, 0);
+
+    std::cout << "- run() phases." << std::endl;
+    const clspvtest::RunPhaseTime same_args_phases =
+        clspvtest::measureRunPhases(device.get(), 0, "empty", num_of_iterations, false);
+    const clspvtest::RunPhaseTime rebind_phases =
+        clspvtest::measureRunPhases(device.get(), 0, "empty", num_of_iterations, true);
+    for (const auto* phases : {&same_args_phases, &rebind_phases}) {
+      std::cout << ((phases == &same_args_phases) ? "  same args" : "  rebind")
+                << ": isSameArgs " << phases->same_args_ << " ns"
+                << ", bindBuffers " << phases->bind_buffers_ << " ns"
+                << ", dispatch " << phases->dispatch_ << " ns"
+                << ", submit " << phases->submit_ << " ns"
+                << ", total " << phases->total_ << " ns" << std::endl;
+    }
+
+    std::cout << "- Empty kernel latency." << std::endl;
+    const clspvtest::KernelLatency latency =
+        clspvtest::measureKernelLatency(device.get(), 0, "empty", num_of_iterations);
+    std::cout << "  min " << latency.min_ << " us, mean " << latency.mean_
+              << " us, p50 " << latency.p50_ << " us, p99 " << latency.p99_
+              << " us, max " << latency.max_ << " us" << std::endl;
+
+    std::cout << "- Dispatch throughput." << std::endl;
+    std::vector<ThroughputResult> throughput_list;
+    const std::size_t max_threads =
+        (std::max)(std::thread::hardware_concurrency(), 1u);
+    const std::size_t max_queues =
+        device->numOfQueues(clspvtest::QueueType::kCompute);
+    for (std::size_t q = 1; q <= max_queues; q *= 2) {
+      for (std::size_t t = 1; t <= max_threads; t *= 2) {
+        ThroughputResult result;
+        result.num_of_threads_ = t;
+        result.num_of_queues_ = q;
+        result.dispatches_per_second_ =
+            measureThroughput(device.get(), t, q, num_of_iterations);
+        std::cout << "  queues: " << q << ", threads: " << t
+                  << ", dispatches/s: " << result.dispatches_per_second_
+                  << std::endl;
+        throughput_list.emplace_back(result);
+      }
+    }
+
+    std::ofstream output{output_path};
+    output << toJson(*device,
+                     num_of_iterations,
+                     same_args_phases,
+                     rebind_phases,
+                     latency,
+                     throughput_list);
+    std::cout << "- Write '" << output_path << "'." << std::endl;
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+  }
+
+  return 0;
+}
+
+/*!
+  \brief Return the number of dispatches per second of the all threads
+
+  The threads are assigned to the queues in round robin.
+  */
+double measureThroughput(clspvtest::VulkanDevice* device,
+                         const std::size_t num_of_threads,
+                         const std::size_t num_of_queues,
+                         const std::size_t num_of_dispatches)
+{
+  std::atomic<std::size_t> num_of_ready_threads{0};
+  std::atomic<bool> is_started{false};
+  std::vector<std::thread> thread_list;
+  thread_list.reserve(num_of_threads);
+  for (std::size_t i = 0; i < num_of_threads; ++i) {
+    const auto queue_index = static_cast<clspvtest::uint32b>(i % num_of_queues);
+    thread_list.emplace_back(submitKernels,
+                             device,
+                             queue_index,
+                             num_of_dispatches,
+                             &num_of_ready_threads,
+                             &is_started);
+  }
+  // Start the dispatches after the all threads finish the setup
+  while (num_of_ready_threads.load() < num_of_threads)
+    std::this_thread::yield();
+
+  const auto start = std::chrono::steady_clock::now();
+  is_started.store(true);
+  for (auto& t : thread_list)
+    t.join();
+  const auto end = std::chrono::steady_clock::now();
+
+  const std::chrono::duration<double> elapsed_time = end - start;
+  const double total = static_cast<double>(num_of_threads * num_of_dispatches);
+  return total / elapsed_time.count();
+}
+
+/*!
+  \brief Record and submit the empty kernel repeatedly
+
+  A thread has its own kernel, buffer and command buffers, which are made in
+  the thread so that they use the command pool of the thread.
+  */
+void submitKernels(clspvtest::VulkanDevice* device,
+                   const clspvtest::uint32b queue_index,
+                   const std::size_t num_of_dispatches,
+                   std::atomic<std::size_t>* num_of_ready_threads,
+                   const std::atomic<bool>* is_started)
+{
+  using clspvtest::uint32b;
+  using clspvtest::uint64b;
+  using clspvtest::QueueType;
+  constexpr std::size_t num_of_commands = 8;
+  constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+
+  Kernel kernel{device, 0, "empty"};
+  clspvtest::VulkanBuffer<uint32b> buffer{device,
+                                          clspvtest::BufferUsage::kDeviceOnly,
+                                          1};
+
+  const auto& d = device->device();
+  std::array<vk::CommandBuffer, num_of_commands> command_list;
+  std::array<vk::Fence, num_of_commands> fence_list;
+  {
+    const vk::CommandBufferAllocateInfo alloc_info{
+        device->commandPool(QueueType::kCompute),
+        vk::CommandBufferLevel::ePrimary,
+        static_cast<uint32b>(num_of_commands)};
+    d.allocateCommandBuffers(&alloc_info, command_list.data());
+    const vk::FenceCreateInfo fence_info{vk::FenceCreateFlagBits::eSignaled};
+    for (auto& fence : fence_list)
+      d.createFence(&fence_info, nullptr, &fence);
+  }
+
+  ++(*num_of_ready_threads);
+  while (!is_started->load())
+    std::this_thread::yield();
+
+  for (std::size_t i = 0; i < num_of_dispatches; ++i) {
+    const std::size_t index = i % num_of_commands;
+    const auto& command = command_list[index];
+    auto& fence = fence_list[index];
+    d.waitForFences(1, &fence, VK_TRUE, timeout);
+    d.resetFences(1, &fence);
+
+    vk::CommandBufferBeginInfo begin_info{};
+    begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+    command.begin(begin_info);
+    kernel.record(command, buffer, {1});
+    command.end();
+    device->submit(QueueType::kCompute, queue_index, command, fence);
+  }
+
+  d.waitForFences(static_cast<uint32b>(num_of_commands),
+                  fence_list.data(),
+                  VK_TRUE,
+                  timeout);
+  for (auto& fence : fence_list)
+    d.destroyFence(fence);
+  d.freeCommandBuffers(device->commandPool(QueueType::kCompute),
+                       static_cast<uint32b>(num_of_commands),
+                       command_list.data());
+}
+
+/*!
+  \brief Format the results as json
+  */
+std::string toJson(const clspvtest::VulkanDevice& device,
+                   const std::size_t num_of_iterations,
+                   const clspvtest::RunPhaseTime& same_args_phases,
+                   const clspvtest::RunPhaseTime& rebind_phases,
+                   const clspvtest::KernelLatency& latency,
+                   const std::vector<ThroughputResult>& throughput_list)
+{
+  const auto phases_json = [](const clspvtest::RunPhaseTime& phases)
+  {
+    std::ostringstream json;
+    json << "{\"is_same_args_ns\": " << phases.same_args_
+         << ", \"bind_buffers_ns\": " << phases.bind_buffers_
+         << ", \"dispatch_ns\": " << phases.dispatch_
+         << ", \"submit_ns\": " << phases.submit_
+         << ", \"total_ns\": " << phases.total_ << "}";
+    return json.str();
+  };
+
+  std::ostringstream json;
+  json << "{\n";
+  json << "  \"device\": {\"vendor\": \"" << device.vendorName()
+       << "\", \"name\": \"" << device.name()
+       << "\", \"compute_queues\": "
+       << device.numOfQueues(clspvtest::QueueType::kCompute) << "},\n";
+  json << "  \"iterations\": " << num_of_iterations << ",\n";
+  json << "  \"run_phases\": {\n";
+  json << "    \"same_args\": " << phases_json(same_args_phases) << ",\n";
+  json << "    \"rebind\": " << phases_json(rebind_phases) << "\n";
+  json << "  },\n";
+  json << "  \"empty_kernel_latency_us\": {\"min\": " << latency.min_
+       << ", \"mean\": " << latency.mean_
+       << ", \"p50\": " << latency.p50_
+       << ", \"p99\": " << latency.p99_
+       << ", \"max\": " << latency.max_ << "},\n";
+  json << "  \"throughput\": [";
+  for (std::size_t i = 0; i < throughput_list.size(); ++i) {
+    const auto& result = throughput_list[i];
+    json << ((i == 0) ? "\n" : ",\n")
+         << "    {\"queues\": " << result.num_of_queues_
+         << ", \"threads\": " << result.num_of_threads_
+         << ", \"dispatches_per_second\": " << result.dispatches_per_second_ << "}";
+  }
+  json << "\n  ]\n";
+  json << "}\n";
+  return json.str();
+}
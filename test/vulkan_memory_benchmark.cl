@@ -0,0 +1,35 @@
+/*!
+  \file vulkan_memory_benchmark.cl
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-compat"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-c++11-compat-pedantic"
+
+// Type aliases
+typedef unsigned int uint32b;
+
+
+/*!
+  \brief Copy the values. A work-item copies the values in the grid stride
+
+  params[0]: the number of the values
+  */
+__kernel void copyValues(__global const uint32b* inputs,
+                         __global uint32b* outputs,
+                         __global const uint32b* params)
+{
+  const uint32b n = params[0];
+  const uint32b stride = (uint32b)get_global_size(0);
+  for (uint32b index = (uint32b)get_global_id(0); index < n; index += stride)
+    outputs[index] = inputs[index];
+}
+
+#pragma clang diagnostic pop
+#pragma clang diagnostic pop
@@ -0,0 +1,444 @@
+/*!
+  \file vulkan_memory_benchmark.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/benchmark_utility.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+
+namespace {
+
+using Kernel = clspvtest::VulkanKernel<1, clspvtest::uint32b,
+                                          clspvtest::uint32b,
+                                          clspvtest::uint32b>;
+
+//! The maximum number of the work-items of the streaming copy
+constexpr clspvtest::uint32b kMaxKernelWorks = 1u << 20;
+
+//! The bandwidths at a transfer size in GB/s. 0 means not measured
+struct BandwidthResult
+{
+  std::size_t size_ = 0; //!< The transfer size in bytes
+  double write_ = 0.0; //!< VulkanBuffer::write from host memory
+  double read_ = 0.0; //!< VulkanBuffer::read to host memory
+  double copy_ = 0.0; //!< VulkanBuffer::copyTo between two buffers
+  double memcpy_write_ = 0.0; //!< memcpy from host memory to the mapped memory
+  double memcpy_read_ = 0.0; //!< memcpy from the mapped memory to host memory
+  double kernel_copy_ = 0.0; //!< Streaming copy by a kernel
+};
+
+//! The results of a buffer usage or a memory type
+struct MemoryResult
+{
+  std::string name_;
+  clspvtest::uint32b memory_type_ = 0;
+  clspvtest::uint32b heap_ = 0;
+  std::string flags_;
+  std::vector<BandwidthResult> bandwidth_list_;
+};
+
+//! The memory type which is optimal for a buffer usage
+struct Recommendation
+{
+  std::string usage_;
+  std::string metric_;
+  clspvtest::uint32b current_type_ = 0;
+  double current_bandwidth_ = 0.0;
+  clspvtest::uint32b best_type_ = 0;
+  double best_bandwidth_ = 0.0;
+};
+
+} // namespace
+
+// Forward declaration
+std::vector<Recommendation> makeRecommendations(
+    const std::vector<MemoryResult>& usage_result_list,
+    const std::vector<MemoryResult>& type_result_list);
+
+bool measureMemory(clspvtest::VulkanDevice* device,
+                   const clspvtest::BufferUsage usage,
+                   const clspvtest::uint32b memory_type_bits,
+                   const std::vector<std::size_t>& size_list,
+                   const std::size_t num_of_repetitions,
+                   MemoryResult* result);
+
+std::string toJson(const clspvtest::VulkanDevice& device,
+                   const std::size_t num_of_repetitions,
+                   const std::vector<MemoryResult>& usage_result_list,
+                   const std::vector<MemoryResult>& type_result_list,
+                   const std::vector<Recommendation>& recommendation_list);
+
+
+/*!
+  \details
+  Usage:
+    VulkanMemoryBenchmark [max size in MiB] [repetitions] [output json]
+
+  Measure the bandwidths of the transfers for each buffer usage and for each
+  memory type of the device, from 4 KiB up to the max size. The buffer usages
+  are allocated as VulkanDevice::allocate maps them, and the memory types are
+  forced by VulkanBuffer::setMemoryTypeBits. Then the memory types which are
+  faster than the current mapping are reported for each usage.
+  */
+int main(int argc, char** argv)
+{
+  std::cout << "Measure the memory bandwidths of the buffer usages and the memory types." << std::endl;
+
+  std::size_t max_size = 64;
+  if (1 < argc)
+    max_size = static_cast<std::size_t>(std::atoll(argv[1]));
+  max_size = max_size * 1024 * 1024;
+  std::size_t num_of_repetitions = 10;
+  if (2 < argc)
+    num_of_repetitions = static_cast<std::size_t>(std::atoll(argv[2]));
+  num_of_repetitions = (std::max)(num_of_repetitions, std::size_t{1});
+  const std::string output_path = (3 < argc) ? argv[3]
+                                             : "vulkan_memory_benchmark.json";
+
+  std::vector<std::size_t> size_list;
+  for (std::size_t size = 4 * 1024; size <= max_size; size *= 4)
+    size_list.emplace_back(size);
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanMemoryBenchmark";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+  device_options.vulkan_device_number_ = 0; //!< Use 0th GPU
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  const auto print_result = [](const MemoryResult& result)
+  {
+    std::cout << "  " << result.name_ << " (type " << result.memory_type_
+              << ", heap " << result.heap_ << ", " << result.flags_ << ")"
+              << std::endl;
+    for (const auto& bandwidth : result.bandwidth_list_) {
+      std::cout << "    " << (bandwidth.size_ / 1024) << " KiB:"
+                << " write " << bandwidth.write_
+                << ", read " << bandwidth.read_
+                << ", copyTo " << bandwidth.copy_
+                << ", memcpy write " << bandwidth.memcpy_write_
+                << ", memcpy read " << bandwidth.memcpy_read_
+                << ", kernel copy " << bandwidth.kernel_copy_ << " GB/s"
+                << std::endl;
+    }
+  };
+
+  try {
+    device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+    std::cout << clspvtest::getDeviceInfo(*device) << std::endl;
+    const std::vector<clspvtest::uint32b> spirv_code =
+        clspvtest::loadModuleSpirvCode("vulkan_memory_benchmark.spv");
+    device->setShaderModule(spirv_code, 0);
+
+    using clspvtest::BufferUsage;
+    std::cout << "- Buffer usages." << std::endl;
+    std::vector<MemoryResult> usage_result_list;
+    const std::array<std::pair<BufferUsage, const char*>, 4> usage_list{{
+        {BufferUsage::kDeviceOnly, "kDeviceOnly"},
+        {BufferUsage::kHostOnly, "kHostOnly"},
+        {BufferUsage::kHostToDevice, "kHostToDevice"},
+        {BufferUsage::kDeviceToHost, "kDeviceToHost"}}};
+    for (const auto& usage : usage_list) {
+      MemoryResult result;
+      result.name_ = usage.second;
+      if (measureMemory(device.get(), usage.first, 0, size_list,
+                        num_of_repetitions, &result)) {
+        print_result(result);
+        usage_result_list.emplace_back(std::move(result));
+      }
+    }
+
+    std::cout << "- Memory types." << std::endl;
+    std::vector<MemoryResult> type_result_list;
+    const auto& memory_properties =
+        device->physicalDeviceInfo().memoryProperties().properties1_;
+    for (clspvtest::uint32b i = 0; i < memory_properties.memoryTypeCount; ++i) {
+      MemoryResult result;
+      result.name_ = "type " + std::to_string(i);
+      // The memory type is forced, so the usage only affects the buffer flags
+      const auto flags = memory_properties.memoryTypes[i].propertyFlags;
+      const auto usage = (flags & vk::MemoryPropertyFlagBits::eHostVisible)
+          ? BufferUsage::kHostOnly
+          : BufferUsage::kDeviceOnly;
+      if (measureMemory(device.get(), usage, 1u << i, size_list,
+                        num_of_repetitions, &result)) {
+        print_result(result);
+        type_result_list.emplace_back(std::move(result));
+      }
+      else {
+        std::cout << "  " << result.name_ << " can't be used for buffers."
+                  << std::endl;
+      }
+    }
+
+    std::cout << "- Recommendations." << std::endl;
+    const auto recommendation_list = makeRecommendations(usage_result_list,
+                                                         type_result_list);
+    for (const auto& recommendation : recommendation_list) {
+      std::cout << "  " << recommendation.usage_ << " ("
+                << recommendation.metric_ << "): current type "
+                << recommendation.current_type_ << " "
+                << recommendation.current_bandwidth_ << " GB/s, best type "
+                << recommendation.best_type_ << " "
+                << recommendation.best_bandwidth_ << " GB/s" << std::endl;
+    }
+
+    std::ofstream output{output_path};
+    output << toJson(*device,
+                     num_of_repetitions,
+                     usage_result_list,
+                     type_result_list,
+                     recommendation_list);
+    std::cout << "- Write '" << output_path << "'." << std::endl;
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+  }
+
+  return 0;
+}
+
+/*!
+  \brief Compare the memory type of each usage with the fastest memory type
+
+  The bandwidths are compared at the largest size which is measured by both.
+  A usage is evaluated by the transfer which the usage is made for.
+  */
+std::vector<Recommendation> makeRecommendations(
+    const std::vector<MemoryResult>& usage_result_list,
+    const std::vector<MemoryResult>& type_result_list)
+{
+  using Metric = double BandwidthResult::*;
+  const auto find_bandwidth = [](const MemoryResult& result,
+                                 const std::size_t size,
+                                 const Metric metric)
+  {
+    for (const auto& bandwidth : result.bandwidth_list_) {
+      if (bandwidth.size_ == size)
+        return bandwidth.*metric;
+    }
+    return 0.0;
+  };
+
+  const auto find_metric = [](const std::string_view usage)
+  {
+    if (usage == "kHostOnly")
+      return std::make_pair("memcpy write", &BandwidthResult::memcpy_write_);
+    else if (usage == "kHostToDevice")
+      return std::make_pair("write", &BandwidthResult::write_);
+    else if (usage == "kDeviceToHost")
+      return std::make_pair("read", &BandwidthResult::read_);
+    return std::make_pair("kernel copy", &BandwidthResult::kernel_copy_);
+  };
+
+  std::vector<Recommendation> recommendation_list;
+  for (const auto& usage_result : usage_result_list) {
+    if (usage_result.bandwidth_list_.empty())
+      continue;
+    const std::size_t size = usage_result.bandwidth_list_.back().size_;
+    const auto metric = find_metric(usage_result.name_);
+    Recommendation recommendation;
+    recommendation.usage_ = usage_result.name_;
+    recommendation.metric_ = metric.first;
+    recommendation.current_type_ = usage_result.memory_type_;
+    recommendation.current_bandwidth_ = find_bandwidth(usage_result, size,
+                                                       metric.second);
+    recommendation.best_type_ = recommendation.current_type_;
+    recommendation.best_bandwidth_ = recommendation.current_bandwidth_;
+    for (const auto& type_result : type_result_list) {
+      const double bandwidth = find_bandwidth(type_result, size, metric.second);
+      if (recommendation.best_bandwidth_ < bandwidth) {
+        recommendation.best_type_ = type_result.memory_type_;
+        recommendation.best_bandwidth_ = bandwidth;
+      }
+    }
+    recommendation_list.emplace_back(std::move(recommendation));
+  }
+  return recommendation_list;
+}
+
+/*!
+  \brief Measure the bandwidths of the buffers of the usage over the sizes
+
+  If the memory type bits isn't 0, the buffers are allocated in the memory
+  types. The sizes which exceed a quarter of the heap are skipped.
+  Returns false if the buffers can't be allocated.
+  */
+bool measureMemory(clspvtest::VulkanDevice* device,
+                   const clspvtest::BufferUsage usage,
+                   const clspvtest::uint32b memory_type_bits,
+                   const std::vector<std::size_t>& size_list,
+                   const std::size_t num_of_repetitions,
+                   MemoryResult* result)
+{
+  using clspvtest::uint32b;
+  using clspvtest::BufferUsage;
+  using clspvtest::VulkanBuffer;
+
+  const auto& memory_properties =
+      device->physicalDeviceInfo().memoryProperties().properties1_;
+  Kernel kernel{device, 0, "copyValues"};
+  VulkanBuffer<uint32b> params{device, BufferUsage::kHostOnly, 1};
+  bool is_allocated = false;
+  for (const std::size_t size : size_list) {
+    const std::size_t n = size / sizeof(uint32b);
+    VulkanBuffer<uint32b> src{device, usage};
+    VulkanBuffer<uint32b> dst{device, usage};
+    src.setMemoryTypeBits(memory_type_bits);
+    dst.setMemoryTypeBits(memory_type_bits);
+    src.setSize(n);
+    dst.setSize(n);
+    // The allocation fails if the memory type can't be used for the buffers
+    if (!src.buffer() || !dst.buffer())
+      break;
+
+    const uint32b type_index = src.allocationInfo().memoryType;
+    const auto& type = memory_properties.memoryTypes[type_index];
+    const auto& heap = memory_properties.memoryHeaps[type.heapIndex];
+    if ((heap.size / 4) < 2 * size)
+      break;
+    if (!is_allocated) {
+      result->memory_type_ = type_index;
+      result->heap_ = type.heapIndex;
+      result->flags_ = vk::to_string(type.propertyFlags);
+      is_allocated = true;
+    }
+
+    std::vector<uint32b> host_memory(n, 1u);
+    BandwidthResult bandwidth;
+    bandwidth.size_ = size;
+    bandwidth.write_ = clspvtest::measureBandwidth(size, num_of_repetitions, [&]()
+    {
+      src.write(host_memory.data(), n, 0, 0);
+      device->waitForCompletion();
+    });
+    bandwidth.read_ = clspvtest::measureBandwidth(size, num_of_repetitions, [&]()
+    {
+      src.read(host_memory.data(), n, 0, 0);
+      device->waitForCompletion();
+    });
+    bandwidth.copy_ = clspvtest::measureBandwidth(size, num_of_repetitions, [&]()
+    {
+      src.copyTo(&dst, n, 0, 0, 0);
+      device->waitForCompletion();
+    });
+    if (src.isHostVisible()) {
+      auto mapped_memory = src.mapMemory();
+      bandwidth.memcpy_write_ = clspvtest::measureBandwidth(size, num_of_repetitions, [&]()
+      {
+        std::memcpy(mapped_memory.data(), host_memory.data(), size);
+      });
+      bandwidth.memcpy_read_ = clspvtest::measureBandwidth(size, num_of_repetitions, [&]()
+      {
+        std::memcpy(host_memory.data(), mapped_memory.data(), size);
+      });
+    }
+    {
+      const uint32b count = static_cast<uint32b>(n);
+      params.write(&count, 1, 0, 0);
+      const uint32b works = (std::min)(count, kMaxKernelWorks);
+      // The kernel reads and writes the size
+      bandwidth.kernel_copy_ = 2.0 * clspvtest::measureBandwidth(size, num_of_repetitions, [&]()
+      {
+        kernel.run(src, dst, params, {works}, 0);
+        device->waitForCompletion();
+      });
+    }
+    result->bandwidth_list_.emplace_back(bandwidth);
+  }
+  return is_allocated;
+}
+
+/*!
+  \brief Format the results as json
+  */
+std::string toJson(const clspvtest::VulkanDevice& device,
+                   const std::size_t num_of_repetitions,
+                   const std::vector<MemoryResult>& usage_result_list,
+                   const std::vector<MemoryResult>& type_result_list,
+                   const std::vector<Recommendation>& recommendation_list)
+{
+  const auto result_list_json = [](const std::vector<MemoryResult>& result_list)
+  {
+    std::ostringstream json;
+    json << "[";
+    for (std::size_t i = 0; i < result_list.size(); ++i) {
+      const auto& result = result_list[i];
+      json << ((i == 0) ? "\n" : ",\n")
+           << "    {\"name\": \"" << result.name_
+           << "\", \"memory_type\": " << result.memory_type_
+           << ", \"heap\": " << result.heap_
+           << ", \"flags\": \"" << result.flags_ << "\", \"gb_per_second\": [";
+      for (std::size_t j = 0; j < result.bandwidth_list_.size(); ++j) {
+        const auto& bandwidth = result.bandwidth_list_[j];
+        json << ((j == 0) ? "\n" : ",\n")
+             << "      {\"size\": " << bandwidth.size_
+             << ", \"write\": " << bandwidth.write_
+             << ", \"read\": " << bandwidth.read_
+             << ", \"copy\": " << bandwidth.copy_
+             << ", \"memcpy_write\": " << bandwidth.memcpy_write_
+             << ", \"memcpy_read\": " << bandwidth.memcpy_read_
+             << ", \"kernel_copy\": " << bandwidth.kernel_copy_ << "}";
+      }
+      json << "\n    ]}";
+    }
+    json << "\n  ]";
+    return json.str();
+  };
+
+  std::ostringstream json;
+  json << "{\n";
+  json << "  \"device\": {\"vendor\": \"" << device.vendorName()
+       << "\", \"name\": \"" << device.name() << "\"},\n";
+  json << "  \"repetitions\": " << num_of_repetitions << ",\n";
+  json << "  \"buffer_usages\": " << result_list_json(usage_result_list) << ",\n";
+  json << "  \"memory_types\": " << result_list_json(type_result_list) << ",\n";
+  json << "  \"recommendations\": [";
+  for (std::size_t i = 0; i < recommendation_list.size(); ++i) {
+    const auto& recommendation = recommendation_list[i];
+    json << ((i == 0) ? "\n" : ",\n")
+         << "    {\"usage\": \"" << recommendation.usage_
+         << "\", \"metric\": \"" << recommendation.metric_
+         << "\", \"current_type\": " << recommendation.current_type_
+         << ", \"current_gb_per_second\": " << recommendation.current_bandwidth_
+         << ", \"best_type\": " << recommendation.best_type_
+         << ", \"best_gb_per_second\": " << recommendation.best_bandwidth_ << "}";
+  }
+  json << "\n  ]\n";
+  json << "}\n";
+  return json.str();
+}
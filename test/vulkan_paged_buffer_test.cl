@@ -0,0 +1,40 @@
+/*!
+  \file vulkan_paged_buffer_test.cl
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-compat"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-c++11-compat-pedantic"
+
+// Type aliases
+typedef unsigned int uint32b;
+
+
+/*!
+  \brief Update the elements of the range through the page table
+
+  params[0] is the first element of the range, params[1] is the number of
+  the elements and params[2] is the page size.
+  */
+__kernel void updatePagedValues(__global uint32b* pages,
+                                __global const uint32b* table,
+                                __global const uint32b* params)
+{
+  const uint32b id = (uint32b)get_global_id(0);
+  if (params[1] <= id)
+    return;
+  const uint32b index = params[0] + id;
+  const uint32b page_size = params[2];
+  const uint32b slot = table[index / page_size];
+  const uint32b i = slot * page_size + index % page_size;
+  pages[i] = 3u * pages[i] + 1u;
+}
+
+#pragma clang diagnostic pop
+#pragma clang diagnostic pop
@@ -0,0 +1,139 @@
+/*!
+  \file vulkan_paged_buffer_test.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+#include "vulkan_device/vulkan_paged_buffer.hpp"
+
+/*!
+  \details
+  Usage: VulkanPagedBufferTest
+
+  Pages an array which is four times larger than the slots of its device
+  buffer through a kernel. The next range is prefetched while the kernel
+  processes the current range, so the evictions and the loads overlap with
+  the compute. Returns non-zero if any element is wrong.
+  */
+int main(int /* argc */, char** /* argv */)
+{
+  using clspvtest::uint32b;
+  using clspvtest::BufferUsage;
+  constexpr std::size_t page_size = 1 << 12;
+  constexpr std::size_t num_of_slots = 4;
+  constexpr std::size_t num_of_pages = 4 * num_of_slots;
+  constexpr std::size_t num_of_values = page_size * num_of_pages - 7;
+  // Two ranges are pinned at once, so a range uses a half of the slots
+  constexpr std::size_t range_size = page_size * (num_of_slots / 2);
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanPagedBufferTest";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  bool success = true;
+  {
+    clspvtest::UniqueKernel<1, uint32b, uint32b, uint32b> kernel;
+    clspvtest::UniquePagedBuffer<uint32b> values;
+    clspvtest::UniqueBuffer<uint32b> params;
+    try {
+      device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+      {
+        const std::string info = clspvtest::getDeviceInfo(*device);
+        std::cout << info << std::endl;
+      }
+      {
+        const std::vector<uint32b> spirv_code =
+            clspvtest::loadModuleSpirvCode("vulkan_paged_buffer_test.spv");
+        device->setShaderModule(spirv_code, 0);
+      }
+      kernel = std::make_unique<clspvtest::VulkanKernel<1, uint32b, uint32b, uint32b>>(
+          device.get(), 0, "updatePagedValues");
+      values = std::make_unique<clspvtest::VulkanPagedBuffer<uint32b>>(
+          device.get(), page_size, num_of_slots);
+      values->setSize(num_of_values);
+      params = std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+          device.get(), BufferUsage::kHostOnly, 3);
+      for (std::size_t i = 0; i < num_of_values; ++i)
+        values->hostData()[i] = static_cast<uint32b>(i);
+
+      // The ranges out of the array are rejected
+      if (values->prefetch(num_of_values, 1, false, 0) ||
+          values->prefetch(num_of_values - 1, 2, false, 0)) {
+        std::cerr << "Error: An out of range prefetch succeeded." << std::endl;
+        success = false;
+      }
+
+      const auto count_of = [num_of_values, range_size](const std::size_t offset)
+      {
+        return (std::min)(range_size, num_of_values - offset);
+      };
+      success = success && values->request(0, count_of(0), true, 0);
+      for (std::size_t offset = 0; success && (offset < num_of_values); offset += range_size) {
+        const std::size_t count = count_of(offset);
+        values->waitForPages(offset, count);
+        const std::array<uint32b, 3> p{{static_cast<uint32b>(offset),
+                                        static_cast<uint32b>(count),
+                                        static_cast<uint32b>(page_size)}};
+        params->write(p.data(), p.size(), 0, 0);
+        kernel->run(values->deviceBuffer(),
+                    values->pageTable(),
+                    *params,
+                    {static_cast<uint32b>(count)},
+                    0);
+        // Load the next range while the kernel runs
+        const std::size_t next = offset + range_size;
+        if (next < num_of_values)
+          success = values->prefetch(next, count_of(next), true, 0);
+        device->waitForCompletion();
+        values->unpin(offset, count);
+      }
+      values->synchronize(0);
+
+      std::size_t num_of_errors = 0;
+      for (std::size_t i = 0; i < num_of_values; ++i) {
+        const uint32b expected = 3u * static_cast<uint32b>(i) + 1u;
+        if (values->hostData()[i] != expected)
+          ++num_of_errors;
+      }
+      std::cout << "  " << values->numOfPages() << " pages in "
+                << values->numOfSlots() << " slots: errors = " << num_of_errors
+                << std::endl;
+      success = success && (num_of_errors == 0);
+    }
+    catch (const std::exception& error) {
+      std::cerr << "Error: " << error.what() << std::endl;
+      success = false;
+    }
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,396 @@
+/*!
+  \file vulkan_replay.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+// Vulkan
+#include <vulkan/vulkan.hpp>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+#include "vulkan_device/vulkan_profiler.hpp"
+#include "vulkan_device/vulkan_recorder.hpp"
+
+namespace {
+
+using clspvtest::uint8b;
+using clspvtest::uint32b;
+using clspvtest::CaptureRecord;
+using clspvtest::CaptureRecordType;
+using ReplayBuffer = clspvtest::VulkanBuffer<uint8b>;
+
+//! The maximum number of the kernel arguments which can be replayed
+constexpr std::size_t kMaxReplayArguments = 8;
+
+/*!
+  \brief A kernel whose arguments are replayed as byte buffers
+
+  The descriptor set of a kernel doesn't depend on the element types of the
+  buffers, so a captured kernel is rebuilt from its work dimension and its
+  number of arguments.
+  */
+class ReplayKernel
+{
+ public:
+  virtual ~ReplayKernel() noexcept = default;
+
+  //! Execute the kernel
+  virtual void run(const std::vector<ReplayBuffer*>& arg_list,
+                   const std::array<uint32b, 3>& works,
+                   const uint32b queue_index) = 0;
+};
+
+template <std::size_t kDimension, typename IndexSequence>
+class ReplayKernelImpl;
+
+template <std::size_t kDimension, std::size_t ...kIndices>
+class ReplayKernelImpl<kDimension, std::index_sequence<kIndices...>> :
+    public ReplayKernel
+{
+ public:
+  ReplayKernelImpl(clspvtest::VulkanDevice* device,
+                   const uint32b module_index,
+                   const std::string_view kernel_name) :
+      kernel_{device, module_index, kernel_name}
+  {
+  }
+
+  void run(const std::vector<ReplayBuffer*>& arg_list,
+           const std::array<uint32b, 3>& works,
+           const uint32b queue_index) override
+  {
+    std::array<uint32b, kDimension> w;
+    std::copy_n(works.begin(), kDimension, w.begin());
+    kernel_.run(*arg_list[kIndices]..., w, queue_index);
+  }
+
+ private:
+  template <std::size_t>
+  using ArgumentType = uint8b;
+
+
+  clspvtest::VulkanKernel<kDimension, ArgumentType<kIndices>...> kernel_;
+};
+
+//! The timing of the replay
+struct ReplayResult
+{
+  std::vector<double> time_list_; //!< The wall time of each repetition in ms
+  std::size_t num_of_mismatches_ = 0; //!< Reads which differ from the capture
+  std::size_t num_of_skipped_ = 0; //!< Records which can't be replayed
+};
+
+} // namespace
+
+// Forward declaration
+template <std::size_t kDimension, std::size_t kNumOfArguments = 1>
+std::unique_ptr<ReplayKernel> makeReplayKernel(
+    clspvtest::VulkanDevice* device,
+    const uint32b module_index,
+    const std::string_view kernel_name,
+    const std::size_t num_of_arguments);
+
+std::unique_ptr<ReplayKernel> makeReplayKernel(
+    clspvtest::VulkanDevice* device,
+    const CaptureRecord& record);
+
+bool replay(clspvtest::VulkanDevice* device,
+            const std::vector<CaptureRecord>& record_list,
+            const std::size_t num_of_repetitions,
+            ReplayResult* result);
+
+
+/*!
+  \details
+  Usage:
+    VulkanReplay [capture file] [repetitions]
+
+  Replay a capture which is written by clspvtest::VulkanRecorder. The
+  buffers, the transfers and the kernel runs are reproduced in the captured
+  order, without the application which issued them. The wall time of each
+  repetition and the device time of the kernels and the copies are printed.
+  If the capture has the buffer contents, the reads are compared with the
+  captured results. The default capture is written by
+  'VulkanClspvTest2 --capture'.
+  */
+int main(int argc, char** argv)
+{
+  std::cout << "Replay a captured workload." << std::endl;
+
+  const std::string capture_path = (1 < argc) ? argv[1]
+                                              : "vulkan_clspv_test2.capture";
+  std::size_t num_of_repetitions = 1;
+  if (2 < argc)
+    num_of_repetitions = static_cast<std::size_t>(std::atoll(argv[2]));
+  num_of_repetitions = (std::max)(num_of_repetitions, std::size_t{1});
+
+  std::vector<CaptureRecord> record_list;
+  if (!clspvtest::VulkanRecorder::loadCapture(capture_path, &record_list)) {
+    std::cerr << "Error: '" << capture_path << "' isn't a valid capture."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "- Load " << record_list.size() << " records from '"
+            << capture_path << "'." << std::endl;
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanReplay";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+  device_options.vulkan_device_number_ = 0; //!< Use 0th GPU
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  bool success = true;
+  try {
+    device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+    std::cout << clspvtest::getDeviceInfo(*device) << std::endl;
+    clspvtest::VulkanProfiler profiler{device.get()};
+    device->setProfiler(&profiler);
+
+    ReplayResult result;
+    success = replay(device.get(), record_list, num_of_repetitions, &result);
+    device->setProfiler(nullptr);
+
+    std::cout << "- Wall time." << std::endl;
+    for (std::size_t i = 0; i < result.time_list_.size(); ++i) {
+      std::cout << "    repetition " << i << ": " << result.time_list_[i]
+                << " ms" << std::endl;
+    }
+    if (!result.time_list_.empty()) {
+      const auto& times = result.time_list_;
+      const double total = std::accumulate(times.begin(), times.end(), 0.0);
+      std::cout << "    min " << *std::min_element(times.begin(), times.end())
+                << " ms, mean " << (total / static_cast<double>(times.size()))
+                << " ms, max " << *std::max_element(times.begin(), times.end())
+                << " ms" << std::endl;
+    }
+    std::cout << "- Device time." << std::endl;
+    for (const auto& statistics : profiler.statistics()) {
+      std::cout << "    " << statistics.name_ << ": count " << statistics.count_
+                << ", min " << statistics.min_ << " ms"
+                << ", mean " << statistics.mean_ << " ms"
+                << ", p99 " << statistics.p99_ << " ms" << std::endl;
+    }
+    if (result.num_of_skipped_ != 0) {
+      std::cout << "- " << result.num_of_skipped_
+                << " records couldn't be replayed." << std::endl;
+    }
+    if (result.num_of_mismatches_ != 0) {
+      std::cout << "- " << result.num_of_mismatches_
+                << " reads differ from the capture." << std::endl;
+      success = false;
+    }
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+    success = false;
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!
+  \details
+  The kernels are instantiated for each number of arguments up to
+  kMaxReplayArguments. Null is returned if the number exceeds it.
+  */
+template <std::size_t kDimension, std::size_t kNumOfArguments>
+std::unique_ptr<ReplayKernel> makeReplayKernel(
+    clspvtest::VulkanDevice* device,
+    const uint32b module_index,
+    const std::string_view kernel_name,
+    const std::size_t num_of_arguments)
+{
+  if (num_of_arguments == kNumOfArguments) {
+    using Kernel = ReplayKernelImpl<kDimension,
+                                    std::make_index_sequence<kNumOfArguments>>;
+    return std::make_unique<Kernel>(device, module_index, kernel_name);
+  }
+  if constexpr (kNumOfArguments < kMaxReplayArguments) {
+    return makeReplayKernel<kDimension, kNumOfArguments + 1>(device,
+                                                             module_index,
+                                                             kernel_name,
+                                                             num_of_arguments);
+  }
+  else {
+    return nullptr;
+  }
+}
+
+std::unique_ptr<ReplayKernel> makeReplayKernel(
+    clspvtest::VulkanDevice* device,
+    const CaptureRecord& record)
+{
+  const std::size_t n = record.id_list_.size();
+  switch (record.dimension_) {
+   case 1:
+    return makeReplayKernel<1>(device, record.id_, record.name_, n);
+   case 2:
+    return makeReplayKernel<2>(device, record.id_, record.name_, n);
+   case 3:
+    return makeReplayKernel<3>(device, record.id_, record.name_, n);
+   default:
+    return nullptr;
+  }
+}
+
+/*!
+  \details
+  A shader module is set only if the device has another module at the index,
+  and the kernels are created once for each module, so the repetitions after
+  the first one don't measure the pipeline creation. The buffers are created
+  in every repetition.
+  */
+bool replay(clspvtest::VulkanDevice* device,
+            const std::vector<CaptureRecord>& record_list,
+            const std::size_t num_of_repetitions,
+            ReplayResult* result)
+{
+  using Clock = std::chrono::steady_clock;
+  using KernelKey = std::tuple<std::size_t, std::string, uint32b, std::size_t>;
+
+  // The record which set the current module at each index
+  std::unordered_map<uint32b, std::size_t> module_list;
+  std::map<KernelKey, std::unique_ptr<ReplayKernel>> kernel_list;
+  std::vector<uint8b> host_data;
+
+  for (std::size_t repetition = 0; repetition < num_of_repetitions; ++repetition) {
+    std::unordered_map<uint32b, std::unique_ptr<ReplayBuffer>> buffer_list;
+    const auto find_buffer = [&buffer_list, result](const uint32b id)
+    {
+      const auto buffer = buffer_list.find(id);
+      if (buffer == buffer_list.end()) {
+        ++result->num_of_skipped_;
+        return static_cast<ReplayBuffer*>(nullptr);
+      }
+      return buffer->second.get();
+    };
+
+    const auto begin = Clock::now();
+    for (std::size_t i = 0; i < record_list.size(); ++i) {
+      const auto& record = record_list[i];
+      switch (record.type_) {
+       case CaptureRecordType::kShaderModule: {
+        const auto module = module_list.find(record.id_);
+        if ((module == module_list.end()) || (module->second != i)) {
+          std::vector<uint32b> spirv_code(record.data_.size() / sizeof(uint32b));
+          std::memcpy(spirv_code.data(), record.data_.data(),
+                      sizeof(uint32b) * spirv_code.size());
+          device->setShaderModule(spirv_code, record.id_);
+          module_list[record.id_] = i;
+        }
+        break;
+       }
+       case CaptureRecordType::kCreateBuffer: {
+        const auto usage = static_cast<clspvtest::BufferUsage>(record.usage_);
+        const auto size = static_cast<std::size_t>(record.size_);
+        buffer_list[record.id_] = std::make_unique<ReplayBuffer>(device, usage, size);
+        break;
+       }
+       case CaptureRecordType::kDestroyBuffer: {
+        buffer_list.erase(record.id_);
+        break;
+       }
+       case CaptureRecordType::kWriteBuffer: {
+        if (auto buffer = find_buffer(record.id_)) {
+          const auto size = static_cast<std::size_t>(record.size_);
+          host_data.assign(size, 0);
+          if (record.data_.size() == size)
+            host_data = record.data_;
+          buffer->write(host_data.data(), size,
+                        static_cast<std::size_t>(record.offset_), 0);
+        }
+        break;
+       }
+       case CaptureRecordType::kReadBuffer: {
+        if (auto buffer = find_buffer(record.id_)) {
+          const auto size = static_cast<std::size_t>(record.size_);
+          host_data.resize(size);
+          buffer->read(host_data.data(), size,
+                       static_cast<std::size_t>(record.offset_), 0);
+          if ((record.data_.size() == size) && (host_data != record.data_))
+            ++result->num_of_mismatches_;
+        }
+        break;
+       }
+       case CaptureRecordType::kCopyBuffer: {
+        auto src = find_buffer(record.id_);
+        auto dst = find_buffer(record.dst_id_);
+        if ((src != nullptr) && (dst != nullptr)) {
+          src->copyTo(dst,
+                      static_cast<std::size_t>(record.size_),
+                      static_cast<std::size_t>(record.offset_),
+                      static_cast<std::size_t>(record.dst_offset_),
+                      record.queue_index_);
+        }
+        break;
+       }
+       case CaptureRecordType::kRunKernel: {
+        std::vector<ReplayBuffer*> arg_list;
+        for (const uint32b id : record.id_list_)
+          arg_list.emplace_back(find_buffer(id));
+        // A missing buffer is already counted as skipped
+        if (std::count(arg_list.begin(), arg_list.end(), nullptr))
+          break;
+        const auto module = module_list.find(record.id_);
+        if (module == module_list.end()) {
+          ++result->num_of_skipped_;
+          break;
+        }
+        const KernelKey key{module->second, record.name_, record.dimension_,
+                            arg_list.size()};
+        auto& kernel = kernel_list[key];
+        if (!kernel)
+          kernel = makeReplayKernel(device, record);
+        if (kernel)
+          kernel->run(arg_list, record.works_, record.queue_index_);
+        else
+          ++result->num_of_skipped_;
+        break;
+       }
+       case CaptureRecordType::kWait: {
+        device->waitForCompletion();
+        break;
+       }
+      }
+    }
+    device->waitForCompletion();
+    const auto end = Clock::now();
+    const std::chrono::duration<double, std::milli> time = end - begin;
+    result->time_list_.emplace_back(time.count());
+  }
+  return result->num_of_skipped_ == 0;
+}
@@ -0,0 +1,36 @@
+/*!
+  \file vulkan_service_test.cl
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-compat"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-c++11-compat-pedantic"
+
+// Type aliases
+typedef unsigned int uint32b;
+
+
+/*!
+  \brief Compute the square of the values
+
+  params[0]: the number of the values
+  */
+__kernel void squareValues(__global const uint32b* inputs,
+                           __global uint32b* outputs,
+                           __global const uint32b* params)
+{
+  const uint32b index = (uint32b)get_global_id(0);
+  if (index < params[0]) {
+    const uint32b value = inputs[index];
+    outputs[index] = value * value;
+  }
+}
+
+#pragma clang diagnostic pop
+#pragma clang diagnostic pop
@@ -0,0 +1,217 @@
+/*!
+  \file vulkan_service_test.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+#include "vulkan_device/vulkan_service.hpp"
+
+// Forward declaration
+int runClient(const std::string_view socket_path, const std::size_t n);
+
+int runServer(const std::string_view socket_path);
+
+namespace {
+
+//! The id of the job which computes the square of the values
+constexpr clspvtest::uint32b kSquareJob = 0;
+
+std::atomic<bool> is_interrupted{false};
+
+} // namespace
+
+
+/*!
+  \details
+  Usage:
+    VulkanServiceTest server [socket]
+    VulkanServiceTest client [socket] [number of values]
+
+  The server keeps a device and a kernel warm until it's interrupted, and a
+  client submits a job to it without initializing vulkan. Returns non-zero
+  if the server fails or the job of the client fails or gives wrong values.
+  */
+int main(int argc, char** argv)
+{
+  const std::string_view mode = (1 < argc) ? argv[1] : "client";
+  const std::string_view socket_path = (2 < argc)
+      ? argv[2]
+      : "/tmp/vulkan_service_test.socket";
+  if (mode == "server")
+    return runServer(socket_path);
+  const std::size_t n = (3 < argc)
+      ? static_cast<std::size_t>(std::atoll(argv[3]))
+      : 1024 * 1024;
+  return runClient(socket_path, n);
+}
+
+int runServer(const std::string_view socket_path)
+{
+  using clspvtest::uint32b;
+  using clspvtest::BufferUsage;
+  using Kernel = clspvtest::VulkanKernel<1, uint32b, uint32b, uint32b>;
+
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanServiceTest";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+  device_options.device_selection_ = clspvtest::DeviceSelection::kCapability; //!< Use the most capable GPU
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  clspvtest::UniqueDevice device;
+  std::unique_ptr<Kernel> kernel;
+  clspvtest::UniqueBuffer<uint32b> inputs;
+  clspvtest::UniqueBuffer<uint32b> outputs;
+  clspvtest::UniqueBuffer<uint32b> params;
+  clspvtest::UniqueService service;
+  bool success = true;
+  try {
+    device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+    std::cout << clspvtest::getDeviceInfo(*device) << std::endl;
+    {
+      const std::vector<uint32b> spirv_code =
+          clspvtest::loadModuleSpirvCode("vulkan_service_test.spv");
+      device->setShaderModule(spirv_code, 0);
+    }
+    kernel = std::make_unique<Kernel>(device.get(), 0, "squareValues");
+    params = std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+        device.get(), BufferUsage::kHostOnly, 1);
+
+    service = std::make_unique<clspvtest::VulkanService>(device.get(),
+                                                         socket_path);
+    service->registerJob(kSquareJob,
+    [&kernel, &inputs, &outputs, &params](const clspvtest::ServiceJob& job)
+    {
+      const std::size_t n = job.works_[0];
+      if ((job.input_size_ < n * sizeof(uint32b)) ||
+          (job.output_size_ < n * sizeof(uint32b)))
+        return false;
+      // The buffers are reused while they are large enough
+      if (!inputs || (inputs->size() < n)) {
+        inputs = std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+            job.device_, BufferUsage::kDeviceOnly, n);
+        outputs = std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+            job.device_, BufferUsage::kDeviceOnly, n);
+      }
+      const uint32b count = static_cast<uint32b>(n);
+      params->write(&count, 1, 0, clspvtest::kAnyQueue);
+      inputs->write(static_cast<const uint32b*>(job.input_), n, 0, clspvtest::kAnyQueue);
+      kernel->run(*inputs, *outputs, *params, {count}, clspvtest::kAnyQueue);
+      job.device_->waitForCompletion();
+      outputs->read(static_cast<uint32b*>(job.output_), n, 0, clspvtest::kAnyQueue);
+      return true;
+    });
+
+    std::signal(SIGINT, [](int)
+    {
+      is_interrupted = true;
+    });
+    std::signal(SIGTERM, [](int)
+    {
+      is_interrupted = true;
+    });
+    std::thread watcher{[&service]()
+    {
+      while (!is_interrupted)
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+      service->stop();
+    }};
+    std::cout << "Serving on '" << socket_path << "'." << std::endl;
+    service->run();
+    watcher.join();
+    std::cout << "Executed " << service->numOfExecutedJobs() << " jobs."
+              << std::endl;
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+    success = false;
+  }
+
+  // The resources of the device must be destroyed before the device
+  service.reset();
+  kernel.reset();
+  inputs.reset();
+  outputs.reset();
+  params.reset();
+  device.reset();
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int runClient(const std::string_view socket_path, const std::size_t n)
+{
+  using clspvtest::uint32b;
+
+  bool success = true;
+  try {
+    const auto start = std::chrono::steady_clock::now();
+    clspvtest::VulkanServiceClient client{socket_path};
+    clspvtest::SharedMemory input{n * sizeof(uint32b)};
+    clspvtest::SharedMemory output{n * sizeof(uint32b)};
+    auto* values = static_cast<uint32b*>(input.data());
+    for (std::size_t i = 0; i < n; ++i)
+      values[i] = static_cast<uint32b>(i);
+
+    const auto response = client.submit(kSquareJob,
+                                        {{static_cast<uint32b>(n), 1, 1}},
+                                        input,
+                                        output);
+    const auto end = std::chrono::steady_clock::now();
+    const std::chrono::duration<double, std::milli> elapsed_time = end - start;
+    if (response.status_ != clspvtest::ServiceStatus::kSuccess) {
+      std::cerr << "Error: the job failed with the status "
+                << static_cast<uint32b>(response.status_) << "." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    const auto* results = static_cast<const uint32b*>(output.data());
+    std::size_t num_of_errors = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      const uint32b expected = static_cast<uint32b>(i) * static_cast<uint32b>(i);
+      if (results[i] != expected)
+        ++num_of_errors;
+    }
+    success = num_of_errors == 0;
+    std::cout << "  values: " << n << ", errors: " << num_of_errors
+              << ", job: " << response.job_time_ << " ms"
+              << ", total: " << elapsed_time.count() << " ms" << std::endl;
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+    success = false;
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
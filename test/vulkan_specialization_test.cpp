@@ -0,0 +1,281 @@
+/*!
+  \file vulkan_specialization_test.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+
+namespace {
+
+using Kernel = clspvtest::VulkanKernel<1, clspvtest::uint32b>;
+using ConstantList = std::vector<Kernel::SpecializationConstant>;
+
+//! The constant IDs which the module declares after the local-work size
+constexpr clspvtest::uint32b kScaleId = 3;
+constexpr clspvtest::uint32b kOffsetId = 4;
+
+} // namespace
+
+// Forward declaration
+std::vector<clspvtest::uint32b> makeSpirvCode();
+std::size_t runKernel(clspvtest::VulkanDevice* device,
+                      Kernel* kernel,
+                      clspvtest::VulkanBuffer<clspvtest::uint32b>* values,
+                      const clspvtest::uint32b scale,
+                      const clspvtest::uint32b offset);
+
+/*!
+  \details
+  Usage: VulkanSpecializationTest
+
+  Specializes a kernel with sets of the constants and checks the results of
+  each set. Reusing a set, also in another order, must select the cached
+  pipeline instead of making a new variant. Returns non-zero if any result
+  or the number of the variants is wrong.
+
+  clspv only emits the SpecIds of the local-work size, so the kernel is
+  taken from a SPIR-V module which is assembled in this file.
+  */
+int main(int /* argc */, char** /* argv */)
+{
+  using clspvtest::uint32b;
+  using clspvtest::BufferUsage;
+  constexpr std::size_t num_of_values = 1 << 16;
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanSpecializationTest";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  bool success = true;
+  {
+    std::unique_ptr<Kernel> kernel;
+    clspvtest::UniqueBuffer<uint32b> values;
+    try {
+      device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+      {
+        const std::string info = clspvtest::getDeviceInfo(*device);
+        std::cout << info << std::endl;
+      }
+      device->setShaderModule(makeSpirvCode(), 0);
+      const ConstantList constants1{{kScaleId, 3}, {kOffsetId, 1}};
+      const ConstantList constants2{{kScaleId, 5}, {kOffsetId, 7}};
+      kernel = std::make_unique<Kernel>(device.get(), 0, "fillValues", constants1);
+      values = std::make_unique<clspvtest::VulkanBuffer<uint32b>>(
+          device.get(), BufferUsage::kDeviceOnly, num_of_values);
+
+      // The sets of the constants give the different results
+      std::size_t num_of_errors = runKernel(device.get(), kernel.get(), values.get(), 3, 1);
+      kernel->specialize(constants2);
+      num_of_errors += runKernel(device.get(), kernel.get(), values.get(), 5, 7);
+      const std::size_t num_of_variants = kernel->numOfVariants();
+
+      // The sets are reused, the order of the constants doesn't matter
+      kernel->specialize({{kOffsetId, 1}, {kScaleId, 3}});
+      num_of_errors += runKernel(device.get(), kernel.get(), values.get(), 3, 1);
+      kernel->specialize(constants2);
+      num_of_errors += runKernel(device.get(), kernel.get(), values.get(), 5, 7);
+      const std::size_t num_of_reused_variants = kernel->numOfVariants();
+
+      // No constant leaves the defaults of the module
+      kernel->specialize(ConstantList{});
+      num_of_errors += runKernel(device.get(), kernel.get(), values.get(), 1, 0);
+
+      std::cout << "  errors = " << num_of_errors << std::endl;
+      std::cout << "  variants = " << num_of_variants << ", after reuse = "
+                << num_of_reused_variants << ", with defaults = "
+                << kernel->numOfVariants() << std::endl;
+      success = (num_of_errors == 0) &&
+                (num_of_variants == 2) &&
+                (num_of_reused_variants == 2) &&
+                (kernel->numOfVariants() == 3);
+    }
+    catch (const std::exception& error) {
+      std::cerr << "Error: " << error.what() << std::endl;
+      success = false;
+    }
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!
+  \brief Return a module which has a kernel with the specialization constants
+
+  The kernel 'fillValues' is equivalent to the following GLSL.
+
+    layout(local_size_x_id = 0, local_size_y_id = 1, local_size_z_id = 2) in;
+    layout(constant_id = 3) const uint kScale = 1;
+    layout(constant_id = 4) const uint kOffset = 0;
+    layout(set = 0, binding = 0) buffer Values {uint values[];};
+
+    void fillValues()
+    {
+      const uint i = gl_GlobalInvocationID.x;
+      if (i < values.length())
+        values[i] = i * kScale + kOffset;
+    }
+  */
+std::vector<clspvtest::uint32b> makeSpirvCode()
+{
+  const std::vector<clspvtest::uint32b> spirv_code{
+      // Magic, version 1.0, generator, bound, schema
+      0x07230203, 0x00010000, 0x00000000, 0x00000020, 0x00000000,
+      // OpCapability Shader
+      0x00020011, 0x00000001,
+      // OpMemoryModel Logical GLSL450
+      0x0003000e, 0x00000000, 0x00000001,
+      // OpEntryPoint GLCompute %main "fillValues" %gid
+      0x0007000f, 0x00000005, 0x00000001, 0x6c6c6966, 0x756c6156, 0x00007365, 0x00000002,
+      // OpExecutionMode %main LocalSize 1 1 1
+      0x00060010, 0x00000001, 0x00000011, 0x00000001, 0x00000001, 0x00000001,
+      // OpDecorate %gid BuiltIn GlobalInvocationId
+      0x00040047, 0x00000002, 0x0000000b, 0x0000001c,
+      // OpDecorate %wgsize BuiltIn WorkgroupSize
+      0x00040047, 0x00000003, 0x0000000b, 0x00000019,
+      // OpDecorate %sx SpecId 0
+      0x00040047, 0x00000004, 0x00000001, 0x00000000,
+      // OpDecorate %sy SpecId 1
+      0x00040047, 0x00000005, 0x00000001, 0x00000001,
+      // OpDecorate %sz SpecId 2
+      0x00040047, 0x00000006, 0x00000001, 0x00000002,
+      // OpDecorate %scale SpecId 3
+      0x00040047, 0x00000007, 0x00000001, 0x00000003,
+      // OpDecorate %offset SpecId 4
+      0x00040047, 0x00000008, 0x00000001, 0x00000004,
+      // OpDecorate %rta ArrayStride 4
+      0x00040047, 0x00000009, 0x00000006, 0x00000004,
+      // OpMemberDecorate %struct 0 Offset 0
+      0x00050048, 0x0000000a, 0x00000000, 0x00000023, 0x00000000,
+      // OpDecorate %struct BufferBlock
+      0x00030047, 0x0000000a, 0x00000003,
+      // OpDecorate %values DescriptorSet 0
+      0x00040047, 0x0000000b, 0x00000022, 0x00000000,
+      // OpDecorate %values Binding 0
+      0x00040047, 0x0000000b, 0x00000021, 0x00000000,
+      // %void = OpTypeVoid
+      0x00020013, 0x0000000c,
+      // %fn = OpTypeFunction %void
+      0x00030021, 0x0000000d, 0x0000000c,
+      // %uint = OpTypeInt 32 0
+      0x00040015, 0x0000000e, 0x00000020, 0x00000000,
+      // %bool = OpTypeBool
+      0x00020014, 0x00000014,
+      // %v3uint = OpTypeVector %uint 3
+      0x00040017, 0x0000000f, 0x0000000e, 0x00000003,
+      // %ptr_in_v3 = OpTypePointer Input %v3uint
+      0x00040020, 0x00000010, 0x00000001, 0x0000000f,
+      // %ptr_in_uint = OpTypePointer Input %uint
+      0x00040020, 0x00000013, 0x00000001, 0x0000000e,
+      // %rta = OpTypeRuntimeArray %uint
+      0x0003001d, 0x00000009, 0x0000000e,
+      // %struct = OpTypeStruct %rta
+      0x0003001e, 0x0000000a, 0x00000009,
+      // %ptr_u_struct = OpTypePointer Uniform %struct
+      0x00040020, 0x00000011, 0x00000002, 0x0000000a,
+      // %ptr_u_uint = OpTypePointer Uniform %uint
+      0x00040020, 0x00000012, 0x00000002, 0x0000000e,
+      // %c0 = OpConstant %uint 0
+      0x0004002b, 0x0000000e, 0x00000015, 0x00000000,
+      // %sx = OpSpecConstant %uint 1
+      0x00040032, 0x0000000e, 0x00000004, 0x00000001,
+      // %sy = OpSpecConstant %uint 1
+      0x00040032, 0x0000000e, 0x00000005, 0x00000001,
+      // %sz = OpSpecConstant %uint 1
+      0x00040032, 0x0000000e, 0x00000006, 0x00000001,
+      // %wgsize = OpSpecConstantComposite %v3uint %sx %sy %sz
+      0x00060033, 0x0000000f, 0x00000003, 0x00000004, 0x00000005, 0x00000006,
+      // %scale = OpSpecConstant %uint 1
+      0x00040032, 0x0000000e, 0x00000007, 0x00000001,
+      // %offset = OpSpecConstant %uint 0
+      0x00040032, 0x0000000e, 0x00000008, 0x00000000,
+      // %gid = OpVariable %ptr_in_v3 Input
+      0x0004003b, 0x00000010, 0x00000002, 0x00000001,
+      // %values = OpVariable %ptr_u_struct Uniform
+      0x0004003b, 0x00000011, 0x0000000b, 0x00000002,
+      // %main = OpFunction %void None %fn
+      0x00050036, 0x0000000c, 0x00000001, 0x00000000, 0x0000000d,
+      // %entry = OpLabel
+      0x000200f8, 0x00000016,
+      // %px = OpAccessChain %ptr_in_uint %gid %c0
+      0x00050041, 0x00000013, 0x00000017, 0x00000002, 0x00000015,
+      // %i = OpLoad %uint %px
+      0x0004003d, 0x0000000e, 0x00000018, 0x00000017,
+      // %len = OpArrayLength %uint %values 0
+      0x00050044, 0x0000000e, 0x00000019, 0x0000000b, 0x00000000,
+      // %cond = OpULessThan %bool %i %len
+      0x000500b0, 0x00000014, 0x0000001a, 0x00000018, 0x00000019,
+      // OpSelectionMerge %merge None
+      0x000300f7, 0x0000001c, 0x00000000,
+      // OpBranchConditional %cond %body %merge
+      0x000400fa, 0x0000001a, 0x0000001b, 0x0000001c,
+      // %body = OpLabel
+      0x000200f8, 0x0000001b,
+      // %mul = OpIMul %uint %i %scale
+      0x00050084, 0x0000000e, 0x0000001d, 0x00000018, 0x00000007,
+      // %val = OpIAdd %uint %mul %offset
+      0x00050080, 0x0000000e, 0x0000001e, 0x0000001d, 0x00000008,
+      // %pv = OpAccessChain %ptr_u_uint %values %c0 %i
+      0x00060041, 0x00000012, 0x0000001f, 0x0000000b, 0x00000015, 0x00000018,
+      // OpStore %pv %val
+      0x0003003e, 0x0000001f, 0x0000001e,
+      // OpBranch %merge
+      0x000200f9, 0x0000001c,
+      // %merge = OpLabel
+      0x000200f8, 0x0000001c,
+      // OpReturn
+      0x000100fd,
+      // OpFunctionEnd
+      0x00010038,
+  };
+  return spirv_code;
+}
+
+/*!
+  \brief Run the kernel and return the number of the wrong values
+  */
+std::size_t runKernel(clspvtest::VulkanDevice* device,
+                      Kernel* kernel,
+                      clspvtest::VulkanBuffer<clspvtest::uint32b>* values,
+                      const clspvtest::uint32b scale,
+                      const clspvtest::uint32b offset)
+{
+  using clspvtest::uint32b;
+  const std::size_t n = values->size();
+  kernel->run(*values, {static_cast<uint32b>(n)}, 0);
+  device->waitForCompletion();
+  std::vector<uint32b> results(n);
+  values->read(results.data(), n, 0, 0);
+  std::size_t num_of_errors = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (results[i] != static_cast<uint32b>(i) * scale + offset)
+      ++num_of_errors;
+  }
+  return num_of_errors;
+}
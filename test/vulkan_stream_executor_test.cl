@@ -0,0 +1,29 @@
+/*!
+  \file vulkan_stream_executor_test.cl
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-compat"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-c++11-compat-pedantic"
+
+// Type aliases
+typedef unsigned int uint32b;
+
+
+/*!
+  \brief Scale the values of a job
+  */
+__kernel void scaleValues(__global const uint32b* inputs, __global uint32b* outputs)
+{
+  const size_t index = get_global_id(0);
+  outputs[index] = 2u * inputs[index] + 1u;
+}
+
+#pragma clang diagnostic pop
+#pragma clang diagnostic pop
@@ -0,0 +1,213 @@
+/*!
+  \file vulkan_stream_executor_test.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/benchmark_utility.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+#include "vulkan_device/vulkan_stream_executor.hpp"
+
+namespace {
+
+using Kernel = clspvtest::VulkanKernel<1, clspvtest::uint32b, clspvtest::uint32b>;
+
+//! The buffers of a slot of the stream
+struct SlotBuffers
+{
+  clspvtest::UniqueBuffer<clspvtest::uint32b> upload_;
+  clspvtest::UniqueBuffer<clspvtest::uint32b> input_;
+  clspvtest::UniqueBuffer<clspvtest::uint32b> output_;
+  clspvtest::UniqueBuffer<clspvtest::uint32b> download_;
+};
+
+} // namespace
+
+// Forward declaration
+clspvtest::uint32b getInput(const std::size_t job, const std::size_t i) noexcept;
+std::size_t countErrors(const std::size_t job,
+                        const clspvtest::uint32b* outputs,
+                        const std::size_t n) noexcept;
+
+/*!
+  \details
+  Usage: VulkanStreamExecutorTest
+
+  Streams jobs which upload values, scale them with a kernel and download
+  the results through the stream executor, and then executes the same jobs
+  one by one. Prints the median wall time of both and returns non-zero if
+  any result is wrong.
+  */
+int main(int /* argc */, char** /* argv */)
+{
+  using clspvtest::uint32b;
+  using clspvtest::BufferUsage;
+  constexpr std::size_t num_of_jobs = 32;
+  constexpr std::size_t num_of_slots = 3;
+  constexpr std::size_t num_of_values = 1 << 18;
+  constexpr std::size_t num_of_repetitions = 5;
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanStreamExecutorTest";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  bool success = true;
+  {
+    std::unique_ptr<Kernel> kernel;
+    std::vector<SlotBuffers> slot_list(num_of_slots);
+    clspvtest::UniqueStreamExecutor executor;
+    try {
+      device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+      {
+        const std::string info = clspvtest::getDeviceInfo(*device);
+        std::cout << info << std::endl;
+      }
+      {
+        const std::vector<uint32b> spirv_code =
+            clspvtest::loadModuleSpirvCode("vulkan_stream_executor_test.spv");
+        device->setShaderModule(spirv_code, 0);
+      }
+      // A slot records the kernel with its own descriptor set
+      kernel = std::make_unique<Kernel>(device.get(), 0, "scaleValues", num_of_slots);
+      executor = std::make_unique<clspvtest::VulkanStreamExecutor>(device.get(),
+                                                                   num_of_slots);
+      for (std::size_t slot = 0; slot < num_of_slots; ++slot) {
+        auto& buffers = slot_list[slot];
+        using Buffer = clspvtest::VulkanBuffer<uint32b>;
+        buffers.upload_ = std::make_unique<Buffer>(device.get(), BufferUsage::kHostOnly, num_of_values);
+        buffers.input_ = std::make_unique<Buffer>(device.get(), BufferUsage::kDeviceOnly, num_of_values);
+        buffers.output_ = std::make_unique<Buffer>(device.get(), BufferUsage::kDeviceOnly, num_of_values);
+        buffers.download_ = std::make_unique<Buffer>(device.get(), BufferUsage::kHostOnly, num_of_values);
+        executor->addInput(slot, buffers.input_.get());
+        executor->addOutput(slot, buffers.output_.get());
+      }
+
+      const vk::BufferCopy region{0, 0, sizeof(uint32b) * num_of_values};
+      std::size_t stream_errors = 0;
+      const auto upload = [&slot_list, &region](const std::size_t job,
+                                                const std::size_t slot,
+                                                const vk::CommandBuffer& command)
+      {
+        auto& buffers = slot_list[slot];
+        {
+          auto values = buffers.upload_->mapMemory();
+          for (std::size_t i = 0; i < num_of_values; ++i)
+            values[i] = getInput(job, i);
+        }
+        command.copyBuffer(buffers.upload_->buffer(), buffers.input_->buffer(), 1, &region);
+      };
+      const auto compute = [&slot_list, &kernel](const std::size_t /* job */,
+                                                 const std::size_t slot,
+                                                 const vk::CommandBuffer& command)
+      {
+        auto& buffers = slot_list[slot];
+        kernel->record(command, slot, *buffers.input_, *buffers.output_,
+                       {static_cast<uint32b>(num_of_values)});
+      };
+      const auto download = [&slot_list, &region](const std::size_t /* job */,
+                                                  const std::size_t slot,
+                                                  const vk::CommandBuffer& command)
+      {
+        auto& buffers = slot_list[slot];
+        command.copyBuffer(buffers.output_->buffer(), buffers.download_->buffer(), 1, &region);
+      };
+      const auto complete = [&slot_list, &stream_errors](const std::size_t job,
+                                                         const std::size_t slot)
+      {
+        const auto values = slot_list[slot].download_->mapMemory();
+        stream_errors += countErrors(job, values.data(), num_of_values);
+      };
+      const double stream_time = clspvtest::measureMedianTime(num_of_repetitions, [&]()
+      {
+        executor->run(num_of_jobs, upload, compute, download, complete);
+      });
+
+      // Execute the same jobs without overlapping the stages
+      std::size_t serial_errors = 0;
+      std::vector<uint32b> values(num_of_values);
+      auto& buffers = slot_list[0];
+      const double serial_time = clspvtest::measureMedianTime(num_of_repetitions, [&]()
+      {
+        for (std::size_t job = 0; job < num_of_jobs; ++job) {
+          for (std::size_t i = 0; i < num_of_values; ++i)
+            values[i] = getInput(job, i);
+          buffers.input_->write(values.data(), num_of_values, 0, 0);
+          kernel->run(*buffers.input_, *buffers.output_,
+                      {static_cast<uint32b>(num_of_values)}, 0);
+          device->waitForCompletion();
+          buffers.output_->read(values.data(), num_of_values, 0, 0);
+          serial_errors += countErrors(job, values.data(), num_of_values);
+        }
+      });
+
+      std::cout << "  " << num_of_jobs << " jobs of " << num_of_values
+                << " values." << std::endl;
+      std::cout << "    stream: " << (1.0e3 * stream_time) << " ms, errors = "
+                << stream_errors << std::endl;
+      std::cout << "    serial: " << (1.0e3 * serial_time) << " ms, errors = "
+                << serial_errors << std::endl;
+      if (0.0 < stream_time) {
+        std::cout << "    speedup: " << (serial_time / stream_time) << "x"
+                  << std::endl;
+      }
+      success = (stream_errors == 0) && (serial_errors == 0);
+    }
+    catch (const std::exception& error) {
+      std::cerr << "Error: " << error.what() << std::endl;
+      success = false;
+    }
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!
+  \brief Return the input value of a job
+  */
+clspvtest::uint32b getInput(const std::size_t job, const std::size_t i) noexcept
+{
+  const std::size_t value = job * 7919 + i;
+  return static_cast<clspvtest::uint32b>(value);
+}
+
+/*!
+  \brief Count the outputs which are different from the expected values
+  */
+std::size_t countErrors(const std::size_t job,
+                        const clspvtest::uint32b* outputs,
+                        const std::size_t n) noexcept
+{
+  std::size_t num_of_errors = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    const clspvtest::uint32b expected = 2u * getInput(job, i) + 1u;
+    if (outputs[i] != expected)
+      ++num_of_errors;
+  }
+  return num_of_errors;
+}
@@ -0,0 +1,29 @@
+/*!
+  \file vulkan_submission_benchmark.cl
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-compat"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc++98-c++11-compat-pedantic"
+
+// Type aliases
+typedef unsigned int uint32b;
+
+
+/*!
+  \brief Increment the values. The kernel is small so that the submission cost dominates
+  */
+__kernel void increment(__global uint32b* values)
+{
+  const size_t index = get_global_id(0);
+  values[index] = values[index] + 1u;
+}
+
+#pragma clang diagnostic pop
+#pragma clang diagnostic pop
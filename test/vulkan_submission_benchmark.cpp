@@ -0,0 +1,196 @@
+/*!
+  \file vulkan_submission_benchmark.cpp
+  \author Sho Ikeda
+
+  Copyright (c) 2015-2019 Sho Ikeda
+  This software is released under the MIT License.
+  http://opensource.org/licenses/mit-license.php
+  */
+
+// Standard C++ library
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+// ClspvTest
+#include "vulkan_device/vulkan_initialization.hpp" //!< Initialize vulkan memory allocator. This header must be included only once in a project before any vulkan instances are created.
+#include "vulkan_device/config.hpp"
+#include "vulkan_device/device_options.hpp"
+#include "vulkan_device/test_utility.hpp"
+#include "vulkan_device/vulkan_buffer.hpp"
+#include "vulkan_device/vulkan_kernel.hpp"
+#include "vulkan_device/vulkan_device.hpp"
+
+// Forward declaration
+double measureSubmissionThroughput(clspvtest::VulkanDevice* device,
+                                   const std::size_t num_of_threads,
+                                   const std::size_t num_of_submissions);
+
+void submitKernels(clspvtest::VulkanDevice* device,
+                   const clspvtest::uint32b queue_index,
+                   const std::size_t num_of_submissions,
+                   std::atomic<std::size_t>* num_of_ready_threads,
+                   const std::atomic<bool>* is_started);
+
+
+int main(int argc, char** argv)
+{
+  std::cout << "Measure the kernel submission throughput against the number of threads." << std::endl;
+
+  std::size_t num_of_submissions = 4096; //!< The number of submissions per thread
+  if (1 < argc)
+    num_of_submissions = static_cast<std::size_t>(std::atoll(argv[1]));
+
+  clspvtest::UniqueDevice device;
+  clspvtest::DeviceOptions device_options;
+  device_options.app_name_ = "VulkanSubmissionBenchmark";
+  device_options.app_version_major_ = 1;
+  device_options.app_version_minor_ = 0;
+  device_options.app_version_patch_ = 0;
+  device_options.vulkan_device_number_ = 0; //!< Use 0th GPU
+#if defined(Z_DEBUG_MODE)
+  device_options.enable_debug_ = true;
+#else
+  device_options.enable_debug_ = false;
+#endif
+
+  try {
+    // Create a vulkan device
+    device = std::make_unique<clspvtest::VulkanDevice>(device_options);
+    {
+      const std::string info = clspvtest::getDeviceInfo(*device);
+      std::cout << info << std::endl;
+    }
+    // The shader module is shared by the kernels of the all threads
+    const std::vector<clspvtest::uint32b> spirv_code =
+        clspvtest::loadModuleSpirvCode("vulkan_submission_benchmark.spv");
+    device->setShaderModule(spirv_code, 0);
+
+    const std::size_t max_threads =
+        (std::max)(std::thread::hardware_concurrency(), 1u);
+    for (std::size_t n = 1; n <= max_threads; n *= 2) {
+      const double throughput =
+          measureSubmissionThroughput(device.get(), n, num_of_submissions);
+      std::cout << "  threads: " << n
+                << ", submissions/s: " << throughput << std::endl;
+    }
+  }
+  catch (const std::exception& error) {
+    std::cerr << "Error: " << error.what() << std::endl;
+  }
+
+  return 0;
+}
+
+/*!
+  \brief Return the number of submissions per second of the all threads
+  */
+double measureSubmissionThroughput(clspvtest::VulkanDevice* device,
+                                   const std::size_t num_of_threads,
+                                   const std::size_t num_of_submissions)
+{
+  std::atomic<std::size_t> num_of_ready_threads{0};
+  std::atomic<bool> is_started{false};
+  std::vector<std::thread> thread_list;
+  thread_list.reserve(num_of_threads);
+  for (std::size_t i = 0; i < num_of_threads; ++i) {
+    const auto queue_index = static_cast<clspvtest::uint32b>(i);
+    thread_list.emplace_back(submitKernels,
+                             device,
+                             queue_index,
+                             num_of_submissions,
+                             &num_of_ready_threads,
+                             &is_started);
+  }
+  // Start the submissions after the all threads finish the setup
+  while (num_of_ready_threads.load() < num_of_threads)
+    std::this_thread::yield();
+
+  const auto start = std::chrono::steady_clock::now();
+  is_started.store(true);
+  for (auto& t : thread_list)
+    t.join();
+  const auto end = std::chrono::steady_clock::now();
+
+  const std::chrono::duration<double> elapsed_time = end - start;
+  const double total = static_cast<double>(num_of_threads * num_of_submissions);
+  return total / elapsed_time.count();
+}
+
+/*!
+  \brief Record and submit the kernel repeatedly
+
+  A thread has its own kernel, buffer and command buffers, which are made in
+  the thread so that they use the command pool of the thread.
+  */
+void submitKernels(clspvtest::VulkanDevice* device,
+                   const clspvtest::uint32b queue_index,
+                   const std::size_t num_of_submissions,
+                   std::atomic<std::size_t>* num_of_ready_threads,
+                   const std::atomic<bool>* is_started)
+{
+  using clspvtest::uint32b;
+  using clspvtest::uint64b;
+  using clspvtest::QueueType;
+  constexpr uint32b num_of_elements = 1024;
+  constexpr std::size_t num_of_commands = 8;
+  constexpr uint64b timeout = std::numeric_limits<uint64b>::max();
+
+  clspvtest::VulkanKernel<1, uint32b> kernel{device, 0, "increment"};
+  clspvtest::VulkanBuffer<uint32b> buffer{device,
+                                          clspvtest::BufferUsage::kDeviceOnly,
+                                          num_of_elements};
+
+  const auto& d = device->device();
+  std::array<vk::CommandBuffer, num_of_commands> command_list;
+  std::array<vk::Fence, num_of_commands> fence_list;
+  {
+    const vk::CommandBufferAllocateInfo alloc_info{
+        device->commandPool(QueueType::kCompute),
+        vk::CommandBufferLevel::ePrimary,
+        static_cast<uint32b>(num_of_commands)};
+    d.allocateCommandBuffers(&alloc_info, command_list.data());
+    const vk::FenceCreateInfo fence_info{vk::FenceCreateFlagBits::eSignaled};
+    for (auto& fence : fence_list)
+      d.createFence(&fence_info, nullptr, &fence);
+  }
+
+  ++(*num_of_ready_threads);
+  while (!is_started->load())
+    std::this_thread::yield();
+
+  for (std::size_t i = 0; i < num_of_submissions; ++i) {
+    const std::size_t index = i % num_of_commands;
+    const auto& command = command_list[index];
+    auto& fence = fence_list[index];
+    d.waitForFences(1, &fence, VK_TRUE, timeout);
+    d.resetFences(1, &fence);
+
+    vk::CommandBufferBeginInfo begin_info{};
+    begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+    command.begin(begin_info);
+    kernel.record(command, buffer, {num_of_elements});
+    command.end();
+    device->submit(QueueType::kCompute, queue_index, command, fence);
+  }
+
+  d.waitForFences(static_cast<uint32b>(num_of_commands),
+                  fence_list.data(),
+                  VK_TRUE,
+                  timeout);
+  for (auto& fence : fence_list)
+    d.destroyFence(fence);
+  d.freeCommandBuffers(device->commandPool(QueueType::kCompute),
+                       static_cast<uint32b>(num_of_commands),
+                       command_list.data());
+}